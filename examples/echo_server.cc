@@ -29,9 +29,9 @@ void EchoServer::handleClient(yuan::Socket::ptr client) {
     yuan::ByteArray::ptr ba(new yuan::ByteArray());
 
     while (true) {
-        ba->clear();
         std::vector<iovec> iovs;
-        ba->getWriteBuffers(iovs, 1024);
+        // 直接收到ba的空闲空间里，commit之后就可以从position读出来
+        ba->prepare(iovs, 1024);
 
         int ret = client->recv(&iovs[0], iovs.size());
         if (ret == 0) {
@@ -42,14 +42,14 @@ void EchoServer::handleClient(yuan::Socket::ptr client) {
                 << " errstr=" << strerror(errno);
                 break; 
         }
-        ba->setPosition(ba->getPosition() + ret);
-        // 后面的ba->toString()是读取剩余未读取数据，因此要把position设置到0
-        ba->setPosition(0);
+        ba->commit(ret);
         if (m_type == 1) {
             std::cout << ba->toString() << std::flush;
         } else {
             std::cout << ba->toHexString() << std::flush;
         }
+        // 输出过的数据丢掉，读完的节点会被释放
+        ba->consume(ba->getReadSize());
     }
 }
 
@@ -0,0 +1,25 @@
+#include "../yuan/binlog.h"
+
+/**
+ * 二进制日志的离线解码工具，把BinLogger写的文件还原成文本输出到标准输出
+ * 用法：binlog_decoder file.binlog [file2.binlog ...]
+ */
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " file.binlog [file2.binlog ...]" << std::endl;
+        return 1;
+    }
+    // 解码工具自己的日志只输出错误
+    YUAN_GET_ROOT_LOGGER()->setLevel(yuan::LogLevel::ERROR);
+    YUAN_GET_LOGGER("system")->setLevel(yuan::LogLevel::ERROR);
+    int rt = 0;
+    for (int i = 1; i < argc; ++i) {
+        int64_t count = yuan::BinLogDecoder::DecodeFile(argv[i], std::cout);
+        if (count < 0) {
+            std::cerr << argv[i] << ": decode error" << std::endl;
+            rt = 1;
+        }
+    }
+    return rt;
+}
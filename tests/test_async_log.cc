@@ -0,0 +1,186 @@
+#include "../yuan/yuan_all_headers.h"
+
+#include <atomic>
+#include <fstream>
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static size_t count_lines(const std::string &file) {
+    std::ifstream ifs(file);
+    std::string line;
+    size_t n = 0;
+    while (std::getline(ifs, line)) {
+        ++n;
+    }
+    return n;
+}
+
+// 多线程写日志，析构appender后所有日志都应在文件里
+static uint64_t write_logs(yuan::LogAppender::ptr appender, int threads, int lines) {
+    yuan::Logger::ptr logger(new yuan::Logger("async_test"));
+    logger->setFormatter("%d%T%t%T%m%n");
+    logger->addAppender(appender);
+    std::vector<yuan::Thread::ptr> thrs;
+    uint64_t start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < threads; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([logger, lines](){
+            for (int k = 0; k < lines; ++k) {
+                YUAN_LOG_INFO(logger) << "async log line " << k << " xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+            }
+        }, "log_" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    return yuan::GetCurrentTimeUS() - start;
+}
+
+void test_block() {
+    const std::string file = "/tmp/yuan_async_block.log";
+    unlink(file.c_str());
+    {
+        yuan::AsyncFileLogAppender::ptr appender(new yuan::AsyncFileLogAppender(file, 4096));
+        write_logs(appender, 4, 10000);
+    }
+    // BLOCK策略下一条都不会丢
+    YUAN_ASSERT(count_lines(file) == 40000);
+    YUAN_LOG_INFO(g_logger) << "test_block ok";
+}
+
+// 卡在log里的appender：模拟一个很慢的appender（如BLOCK策略下等后台线程腾空间）
+class GateAppender : public yuan::LogAppender {
+public:
+    void log(const std::shared_ptr<yuan::Logger> &logger, yuan::LogLevel::Level level
+            , const yuan::LogEvent::ptr &event) override {
+        if (level == yuan::LogLevel::WARN) {
+            m_entered = true;
+            while (!m_open) {
+                usleep(1000);
+            }
+        }
+    }
+    std::string toYAMLString() override { return ""; }
+
+    std::atomic<bool> m_entered = {false};
+    std::atomic<bool> m_open = {false};
+};
+
+// 多个生产者写同一个logger，BLOCK策略、缓冲区很小，经常写满；
+// 同时有一个线程卡在另一个appender里，其他生产者不能被它拖住
+void test_block_concurrent() {
+    const std::string file = "/tmp/yuan_async_block_concurrent.log";
+    unlink(file.c_str());
+    std::shared_ptr<GateAppender> gate(new GateAppender);
+    {
+        yuan::Logger::ptr logger(new yuan::Logger("async_concurrent"));
+        logger->setFormatter("%m%n");
+        logger->addAppender(yuan::LogAppender::ptr(new yuan::AsyncFileLogAppender(file, 256)));
+        logger->addAppender(gate);
+
+        yuan::Thread::ptr holder(new yuan::Thread([logger](){
+            YUAN_LOG_WARN(logger) << "holder";
+        }, "log_holder"));
+        while (!gate->m_entered) {
+            usleep(1000);
+        }
+
+        std::atomic<int> finished = {0};
+        std::vector<yuan::Thread::ptr> thrs;
+        for (int i = 0; i < 4; ++i) {
+            thrs.push_back(yuan::Thread::ptr(new yuan::Thread([logger, &finished](){
+                for (int k = 0; k < 5000; ++k) {
+                    YUAN_LOG_INFO(logger) << "concurrent line " << k << " xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+                }
+                ++finished;
+            }, "log_" + std::to_string(i))));
+        }
+        uint64_t start = yuan::GetCurrentTimeMS();
+        while (finished < 4 && yuan::GetCurrentTimeMS() - start < 10000) {
+            usleep(1000);
+        }
+        // holder还卡着，其他生产者就应该已经写完了
+        YUAN_ASSERT2(finished == 4, finished);
+        gate->m_open = true;
+        holder->join();
+        for (auto &t : thrs) {
+            t->join();
+        }
+        logger->clearAppenders();
+    }
+    YUAN_ASSERT2(count_lines(file) == 20001, count_lines(file));
+    YUAN_LOG_INFO(g_logger) << "test_block_concurrent ok";
+}
+
+void test_drop() {
+    const std::string file = "/tmp/yuan_async_drop.log";
+    unlink(file.c_str());
+    uint64_t dropped = 0;
+    {
+        yuan::AsyncFileLogAppender::ptr appender(new yuan::AsyncFileLogAppender(file, 4096
+            , yuan::AsyncFileLogAppender::DROP, 1000));
+        write_logs(appender, 4, 10000);
+        dropped = appender->getDropped();
+    }
+    // 丢弃的会在文件里记一条汇总
+    size_t lines = count_lines(file);
+    YUAN_LOG_INFO(g_logger) << "test_drop lines=" << lines << " dropped=" << dropped;
+    YUAN_ASSERT(lines >= 40000 - dropped);
+    YUAN_ASSERT(dropped > 0);
+}
+
+// 同一个线程反复创建、销毁appender，线程局部表里不能留下已经析构的appender的缓冲区
+void test_recreate() {
+    const std::string file = "/tmp/yuan_async_recreate.log";
+    unlink(file.c_str());
+    yuan::Logger::ptr logger(new yuan::Logger("async_recreate"));
+    logger->setFormatter("%m%n");
+    for (int i = 0; i < 200; ++i) {
+        yuan::LogAppender::ptr appender(new yuan::AsyncFileLogAppender(file, 1024 * 1024));
+        logger->addAppender(appender);
+        YUAN_LOG_INFO(logger) << "recreate " << i;
+        logger->clearAppenders();
+    }
+    YUAN_ASSERT2(count_lines(file) == 200, count_lines(file));
+    YUAN_LOG_INFO(g_logger) << "test_recreate ok";
+}
+
+void test_fatal_flush() {
+    const std::string file = "/tmp/yuan_async_fatal.log";
+    unlink(file.c_str());
+    yuan::Logger::ptr logger(new yuan::Logger("async_fatal"));
+    logger->addAppender(yuan::LogAppender::ptr(new yuan::AsyncFileLogAppender(file, 4096
+        , yuan::AsyncFileLogAppender::BLOCK, 10000)));
+    YUAN_LOG_INFO(logger) << "before fatal";
+    YUAN_LOG_FATAL(logger) << "fatal";
+    // 后台线程10秒才写一次，这里能读到说明FATAL同步刷盘了
+    YUAN_ASSERT(count_lines(file) == 2);
+    YUAN_LOG_INFO(g_logger) << "test_fatal_flush ok";
+}
+
+void bench() {
+    const int threads = 4;
+    const int lines = 50000;
+    const std::string sync_file = "/tmp/yuan_sync_bench.log";
+    const std::string async_file = "/tmp/yuan_async_bench.log";
+    unlink(sync_file.c_str());
+    unlink(async_file.c_str());
+    uint64_t sync_us = write_logs(yuan::LogAppender::ptr(new yuan::FileLogAppender(sync_file)), threads, lines);
+    uint64_t async_us = 0;
+    {
+        yuan::AsyncFileLogAppender::ptr appender(new yuan::AsyncFileLogAppender(async_file));
+        async_us = write_logs(appender, threads, lines);
+    }
+    YUAN_LOG_INFO(g_logger) << "threads=" << threads << " lines=" << threads * lines
+        << " FileLogAppender used_us=" << sync_us
+        << " AsyncFileLogAppender used_us=" << async_us;
+}
+
+int main(int argc, char **argv) {
+    test_block();
+    test_block_concurrent();
+    test_drop();
+    test_recreate();
+    test_fatal_flush();
+    bench();
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "../yuan/yuan_all_headers.h"
+#include "../yuan/binlog.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static const std::string s_file = "test_binlog.binlog";
+
+// 返回每行日志的内容部分（最后一个\t之后）
+static std::vector<std::string> decode_messages(int64_t &count) {
+    std::stringstream ss;
+    count = yuan::BinLogDecoder::DecodeFile(s_file, ss);
+    std::vector<std::string> msgs;
+    std::string line;
+    while (std::getline(ss, line)) {
+        msgs.push_back(line.substr(line.rfind('\t') + 1));
+    }
+    return msgs;
+}
+
+// 各种类型的参数都能按格式串还原
+void test_decode() {
+    unlink(s_file.c_str());
+    {
+        yuan::BinLogger::ptr binlog(new yuan::BinLogger("binlog", s_file));
+        std::string str = "std string";
+        int x = 0;
+        YUAN_BINLOG_DEBUG(binlog, "no args");
+        YUAN_BINLOG_INFO(binlog, "int=%d neg=%ld u=%u hex=%#x big=%llu", 42, -1234567890123L, 7u, 255, 18446744073709551615ULL);
+        YUAN_BINLOG_WARN(binlog, "str=%s literal=%s width=[%5d] char=%c 100%%", str, "lit", 3, 'z');
+        YUAN_BINLOG_ERROR(binlog, "double=%.3f float=%g bool=%d", 3.14159, 0.5f, true);
+        YUAN_BINLOG_DEBUG(binlog, "ptr=%p null=%s more=%d %d", &x, static_cast<const char*>(nullptr), 1);
+        binlog->setLevel(yuan::LogLevel::INFO);
+        YUAN_BINLOG_DEBUG(binlog, "filtered");
+    }
+    int64_t count = 0;
+    std::vector<std::string> msgs = decode_messages(count);
+    YUAN_ASSERT2(count == 5 && msgs.size() == 5, std::to_string(count));
+    YUAN_ASSERT2(msgs[0] == "no args", msgs[0]);
+    YUAN_ASSERT2(msgs[1] == "int=42 neg=-1234567890123 u=7 hex=0xff big=18446744073709551615", msgs[1]);
+    YUAN_ASSERT2(msgs[2] == "str=std string literal=lit width=[    3] char=z 100%", msgs[2]);
+    YUAN_ASSERT2(msgs[3] == "double=3.142 float=0.5 bool=1", msgs[3]);
+    YUAN_ASSERT2(msgs[4].compare(0, 6, "ptr=0x") == 0 && msgs[4].find(" null= more=1 %d") != std::string::npos, msgs[4]);
+
+    std::stringstream ss;
+    yuan::BinLogDecoder::DecodeFile(s_file, ss);
+    YUAN_LOG_INFO(g_logger) << "test_decode ok\n" << ss.str();
+}
+
+// 多线程写，追加打开同一个文件，一条不丢
+void test_threads() {
+    unlink(s_file.c_str());
+    const int threads = 4;
+    const int lines = 20000;
+    for (int round = 0; round < 2; ++round) {
+        yuan::BinLogger::ptr binlog(new yuan::BinLogger("binlog", s_file, 64 * 1024));
+        std::vector<yuan::Thread::ptr> thrs;
+        for (int i = 0; i < threads; ++i) {
+            thrs.push_back(yuan::Thread::ptr(new yuan::Thread([binlog, i, lines](){
+                for (int j = 0; j < lines; ++j) {
+                    YUAN_BINLOG_DEBUG(binlog, "thread %d line %d", i, j);
+                    // 缓冲区比较小，写得太快会丢，这里让后台线程跟上
+                    if (j % 1000 == 0) {
+                        binlog->flush();
+                    }
+                }
+            }, "binlog_" + std::to_string(i))));
+        }
+        for (auto &t : thrs) {
+            t->join();
+        }
+        YUAN_ASSERT2(binlog->getDropped() == 0, std::to_string(binlog->getDropped()));
+    }
+    int64_t count = 0;
+    std::vector<std::string> msgs = decode_messages(count);
+    YUAN_ASSERT2(count == 2 * threads * lines, std::to_string(count));
+    // 同一个线程的记录保持顺序
+    std::vector<int> next(threads, 0);
+    for (auto &msg : msgs) {
+        int t = 0, l = 0;
+        YUAN_ASSERT2(sscanf(msg.c_str(), "thread %d line %d", &t, &l) == 2, msg);
+        YUAN_ASSERT2(l == next[t] % lines, msg);
+        ++next[t];
+    }
+    YUAN_LOG_INFO(g_logger) << "test_threads ok, records=" << count;
+}
+
+// 同一个线程反复创建、销毁BinLogger，线程局部表里不能留下已经析构的BinLogger的缓冲区
+void test_recreate() {
+    for (int i = 0; i < 200; ++i) {
+        unlink(s_file.c_str());
+        yuan::BinLogger::ptr binlog(new yuan::BinLogger("binlog", s_file));
+        YUAN_BINLOG_INFO(binlog, "recreate %d", i);
+        binlog.reset();
+        int64_t count = 0;
+        std::vector<std::string> msgs = decode_messages(count);
+        YUAN_ASSERT2(count == 1 && msgs[0] == "recreate " + std::to_string(i), std::to_string(count));
+    }
+    YUAN_LOG_INFO(g_logger) << "test_recreate ok";
+}
+
+void bench() {
+    const int n = 1000000;
+    unlink(s_file.c_str());
+    yuan::BinLogger::ptr binlog(new yuan::BinLogger("binlog", s_file, 64 * 1024 * 1024));
+    std::string peer = "192.168.1.100:8080";
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        YUAN_BINLOG_DEBUG(binlog, "recv fd=%d len=%zu from %s", i, static_cast<size_t>(i * 3), peer);
+    }
+    uint64_t bin_ns = yuan::Clock::MonotonicNs() - start;
+    uint64_t dropped = binlog->getDropped();
+    binlog.reset();
+
+    // 同样的日志用文本格式写文件
+    yuan::Logger::ptr logger(new yuan::Logger("binlog_text"));
+    logger->addAppender(yuan::LogAppender::ptr(new yuan::FileLogAppender("test_binlog.txt")));
+    const int text_n = n / 10;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < text_n; ++i) {
+        YUAN_LOG_FMT_DEBUG(logger, "recv fd=%d len=%zu from %s", i, static_cast<size_t>(i * 3), peer.c_str());
+    }
+    uint64_t text_ns = yuan::Clock::MonotonicNs() - start;
+    unlink("test_binlog.txt");
+
+    YUAN_LOG_INFO(g_logger) << "binlog ns/call=" << static_cast<double>(bin_ns) / n << " dropped=" << dropped
+        << " text ns/call=" << static_cast<double>(text_ns) / text_n;
+    unlink(s_file.c_str());
+}
+
+int main(int argc, char **argv) {
+    test_decode();
+    test_threads();
+    test_recreate();
+    bench();
+    return 0;
+}
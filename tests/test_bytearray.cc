@@ -1,5 +1,6 @@
 #include "../yuan/bytearray.h"
 #include "../yuan/yuan_all_headers.h"
+#include <limits>
 
 static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
 
@@ -83,9 +84,441 @@ void test() {
 
 }
 
+static std::string make_data(size_t len) {
+    std::string data(len, '\0');
+    for (size_t i = 0; i < len; ++i) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    return data;
+}
+
+// 切片和原对象共享内存，互相写都不影响对方
+void test_slice() {
+    std::string data = make_data(10000);
+    for (size_t base_len : {1, 7, 4096}) {
+        yuan::ByteArray::ptr ba(new yuan::ByteArray(base_len));
+        ba->write(data.data(), data.size());
+        ba->setPosition(100);
+        yuan::ByteArray::ptr s1 = ba->slice(5000);
+        YUAN_ASSERT(ba->getPosition() == 100);
+        YUAN_ASSERT(s1->getPosition() == 0 && s1->getSize() == 5000);
+        YUAN_ASSERT(s1->toString() == data.substr(100, 5000));
+        yuan::ByteArray::ptr s2 = s1->slice(10, 4990);
+        YUAN_ASSERT(s2->toString() == data.substr(5090, 10));
+
+        std::vector<iovec> iovs;
+        s1->getReadBuffers(iovs, 100, 4900);
+        std::string tmp;
+        for (auto &i : iovs) {
+            tmp.append(static_cast<char*>(i.iov_base), i.iov_len);
+        }
+        YUAN_ASSERT(tmp == data.substr(5000, 100));
+
+        // 写原对象、写切片都先复制，不会改到对方
+        ba->setPosition(200);
+        ba->write("XXXX", 4);
+        YUAN_ASSERT(s1->toString() == data.substr(100, 5000));
+        s1->setPosition(0);
+        s1->write("YYYY", 4);
+        s1->setPosition(0);
+        YUAN_ASSERT(s1->toString() == "YYYY" + data.substr(104, 4996));
+        ba->setPosition(100);
+        YUAN_ASSERT(ba->toString().substr(0, 104) == data.substr(100, 100) + "XXXX");
+
+        // 原对象clear后重新写，切片的数据还在
+        ba->clear();
+        ba->write(std::string(20000, 'z').data(), 20000);
+        YUAN_ASSERT(s2->toString() == data.substr(5090, 10));
+        // 切片可以继续在末尾写
+        s2->setPosition(s2->getSize());
+        s2->writeFuint32(12345);
+        s2->setPosition(10);
+        YUAN_ASSERT(s2->readFuint32() == 12345);
+    }
+    YUAN_LOG_INFO(g_logger) << "test_slice ok";
+}
+
+// 拼接别的ByteArray的数据，不拷贝
+void test_splice() {
+    std::string data = make_data(10000);
+    for (size_t base_len : {1, 7, 4096}) {
+        yuan::ByteArray::ptr src(new yuan::ByteArray(base_len));
+        src->write(data.data(), data.size());
+        src->setPosition(10);
+
+        yuan::ByteArray::ptr dst(new yuan::ByteArray(base_len));
+        dst->writeFuint32(0x12345678);
+        dst->splice(*src, 3000);
+        YUAN_ASSERT(src->getPosition() == 10);
+        // 拼在size处，position不动
+        YUAN_ASSERT(dst->getPosition() == 4 && dst->getSize() == 3004);
+        dst->setPosition(dst->getSize());
+        dst->writeStringF16("tail");
+        dst->splice(*src);
+        // 和自己拼接
+        dst->setPosition(4);
+        yuan::ByteArray::ptr head = dst->slice(3000);
+        dst->setPosition(dst->getSize());
+        dst->splice(*head);
+
+        dst->setPosition(0);
+        YUAN_ASSERT(dst->readFuint32() == 0x12345678);
+        std::string buf(3000, '\0');
+        dst->read(&buf[0], buf.size());
+        YUAN_ASSERT(buf == data.substr(10, 3000));
+        YUAN_ASSERT(dst->readStringF16() == "tail");
+        buf.resize(data.size() - 10);
+        dst->read(&buf[0], buf.size());
+        YUAN_ASSERT(buf == data.substr(10));
+        buf.resize(3000);
+        dst->read(&buf[0], buf.size());
+        YUAN_ASSERT(buf == data.substr(10, 3000));
+        YUAN_ASSERT(dst->getReadSize() == 0);
+
+        // 拼接之后继续写、改原来的数据都不影响src
+        dst->writeFuint64(1);
+        dst->setPosition(4);
+        dst->write("QQQQ", 4);
+        src->setPosition(10);
+        YUAN_ASSERT(src->toString() == data.substr(10));
+
+        // position不在末尾时也拼到size处，可以边读边拼
+        dst->setPosition(0);
+        size_t size = dst->getSize();
+        dst->splice(*src, 5);
+        YUAN_ASSERT(dst->getPosition() == 0 && dst->getSize() == size + 5);
+        YUAN_ASSERT(dst->readFuint32() == 0x12345678);
+        dst->setPosition(size);
+        buf.resize(5);
+        dst->read(&buf[0], buf.size());
+        YUAN_ASSERT(buf == data.substr(10, 5));
+    }
+    YUAN_LOG_INFO(g_logger) << "test_splice ok";
+}
+
+// 一次收到的数据切成多个消息转发出去：切片+拼接对比read+write
+// 收包循环：prepare -> readv -> commit -> 按帧解析 -> consume，帧可能跨两次收取
+void test_prepare_commit() {
+    int fds[2];
+    YUAN_ASSERT(pipe(fds) == 0);
+    yuan::ByteArray::ptr ba(new yuan::ByteArray(128));
+
+    // 帧格式：4字节长度 + 内容
+    yuan::ByteArray frames(128);
+    std::vector<std::string> sent;
+    for (int i = 0; i < 200; ++i) {
+        sent.push_back(make_data(i * 7 % 300 + 1));
+        frames.writeFuint32(sent.back().size());
+        frames.write(sent.back().data(), sent.back().size());
+    }
+    frames.setPosition(0);
+    std::string stream = frames.toString();
+
+    size_t received = 0;
+    size_t max_capacity = 0;
+    std::vector<std::string> got;
+    for (size_t off = 0; off < stream.size(); off += 333) {
+        size_t n = std::min<size_t>(333, stream.size() - off);
+        YUAN_ASSERT(write(fds[1], stream.data() + off, n) == static_cast<ssize_t>(n));
+
+        std::vector<iovec> iovs;
+        size_t size = ba->getSize();
+        size_t pos = ba->getPosition();
+        YUAN_ASSERT(ba->prepare(iovs, 512) == 512);
+        // prepare不改变读写位置
+        YUAN_ASSERT(ba->getSize() == size && ba->getPosition() == pos);
+        ssize_t ret = readv(fds[0], &iovs[0], iovs.size());
+        YUAN_ASSERT(ret == static_cast<ssize_t>(n));
+        ba->commit(ret);
+        received += ret;
+        YUAN_ASSERT(ba->getSize() == size + ret && ba->getPosition() == pos);
+
+        // 只取完整的帧，剩下的半帧留到下次
+        while (ba->getReadSize() >= 4) {
+            yuan::ByteArray::ptr peek = ba->slice(4);
+            uint32_t len = peek->readFuint32();
+            if (ba->getReadSize() < 4 + len) {
+                break;
+            }
+            ba->consume(4);
+            got.push_back(ba->slice(len)->toString());
+            ba->consume(len);
+        }
+        max_capacity = std::max(max_capacity, ba->getSize() + 512);
+    }
+    YUAN_ASSERT(received == stream.size());
+    YUAN_ASSERT(got == sent);
+    // 读完的节点都释放了，不会随着收到的总量增长
+    YUAN_ASSERT(ba->getReadSize() == 0 && ba->getSize() == 0 && ba->getPosition() == 0);
+    YUAN_ASSERT(max_capacity < 2048);
+
+    // consume只释放读完的节点，没读完的还在，继续commit进来的数据接在后面
+    std::vector<iovec> iovs;
+    ba->prepare(iovs, 300);
+    std::string data = make_data(300);
+    size_t copied = 0;
+    for (auto &i : iovs) {
+        memcpy(i.iov_base, data.data() + copied, i.iov_len);
+        copied += i.iov_len;
+    }
+    ba->commit(300);
+    ba->consume(200);
+    YUAN_ASSERT(ba->getPosition() < 128 && ba->getSize() == ba->getPosition() + 100);
+    YUAN_ASSERT(ba->getReadSize() == 100);
+    YUAN_ASSERT(ba->toString() == data.substr(200));
+
+    bool thrown = false;
+    try {
+        ba->consume(101);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    YUAN_ASSERT(thrown);
+    close(fds[0]);
+    close(fds[1]);
+    YUAN_LOG_INFO(g_logger) << "test_prepare_commit ok";
+}
+
+void bench_slice(size_t msg_len, int count) {
+    const int n = 20000;
+    yuan::ByteArray::ptr recv(new yuan::ByteArray());
+    std::string msg = make_data(msg_len);
+    for (int i = 0; i < count; ++i) {
+        recv->write(msg.data(), msg.size());
+    }
+
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        recv->setPosition(0);
+        yuan::ByteArray out;
+        while (recv->getReadSize()) {
+            yuan::ByteArray::ptr body = recv->slice(msg_len);
+            recv->setPosition(recv->getPosition() + msg_len);
+            out.splice(*body);
+        }
+    }
+    uint64_t used_slice = yuan::Clock::MonotonicNs() - start;
+
+    start = yuan::Clock::MonotonicNs();
+    std::string body(msg_len, '\0');
+    for (int i = 0; i < n; ++i) {
+        recv->setPosition(0);
+        yuan::ByteArray out;
+        while (recv->getReadSize()) {
+            recv->read(&body[0], msg_len);
+            out.write(body.data(), body.size());
+        }
+    }
+    uint64_t used_copy = yuan::Clock::MonotonicNs() - start;
+    YUAN_LOG_INFO(g_logger) << count << " x " << msg_len << "B messages ns/round: slice+splice="
+        << static_cast<double>(used_slice) / n << " read+write=" << static_cast<double>(used_copy) / n;
+}
+
+// 各种长度的varint都要覆盖到：单字节、多字节、最长的、负数
+template<typename T>
+static std::vector<T> make_values(size_t len) {
+    std::vector<T> vec;
+    for (size_t i = 0; i < len; ++i) {
+        uint64_t r = (static_cast<uint64_t>(rand()) << 32) | static_cast<uint64_t>(rand());
+        // 连续一段小值，能走到一次处理多个单字节的分支
+        int bits = (i / 20) % 3 == 0 ? 7 : rand() % (sizeof(T) * 8 + 1);
+        T v = bits == 0 ? 0 : static_cast<T>(r >> (64 - bits));
+        // 在无符号数上取负，v为最小值时也没有溢出
+        vec.push_back(rand() % 4 == 0 ? static_cast<T>(0 - static_cast<typename std::make_unsigned<T>::type>(v)) : v);
+    }
+    vec.push_back(std::numeric_limits<T>::max());
+    vec.push_back(std::numeric_limits<T>::min());
+    return vec;
+}
+
+// zigzag编码的边界：最小值编码为全1，-1为1，1为2
+void test_zigzag() {
+    yuan::ByteArray ba(1);
+    ba.writeInt32(std::numeric_limits<int32_t>::min());
+    ba.writeInt32(std::numeric_limits<int32_t>::max());
+    ba.writeInt32(-1);
+    ba.writeInt64(std::numeric_limits<int64_t>::min());
+    ba.writeInt64(std::numeric_limits<int64_t>::max());
+    ba.writeInt64(1);
+    ba.setPosition(0);
+    YUAN_ASSERT(ba.readUint32() == 0xFFFFFFFFu);
+    YUAN_ASSERT(ba.readUint32() == 0xFFFFFFFEu);
+    YUAN_ASSERT(ba.readUint32() == 1);
+    YUAN_ASSERT(ba.readUint64() == 0xFFFFFFFFFFFFFFFFull);
+    YUAN_ASSERT(ba.readUint64() == 0xFFFFFFFFFFFFFFFEull);
+    YUAN_ASSERT(ba.readUint64() == 2);
+    YUAN_LOG_INFO(g_logger) << "test_zigzag ok";
+}
+
+// 批量读写和逐个读写的编码完全相同，可以交叉使用
+void test_array() {
+#define XX(type, write_fun, read_fun, write_array, read_array) \
+    for (size_t base_len : {1, 3, 7, 4096}) { \
+        for (bool little : {false, true}) { \
+            std::vector<type> vec = make_values<type>(1000); \
+            yuan::ByteArray one(base_len), bulk(base_len); \
+            one.setIsLittleEndian(little); \
+            bulk.setIsLittleEndian(little); \
+            for (auto i : vec) { \
+                one.write_fun(i); \
+            } \
+            bulk.write_array(&vec[0], vec.size()); \
+            one.setPosition(0); \
+            bulk.setPosition(0); \
+            YUAN_ASSERT(one.toString() == bulk.toString()); \
+            std::vector<type> out(vec.size()); \
+            one.read_array(&out[0], out.size()); \
+            YUAN_ASSERT(out == vec && one.getReadSize() == 0); \
+            for (size_t i = 0; i < vec.size(); ++i) { \
+                YUAN_ASSERT(bulk.read_fun() == vec[i]); \
+            } \
+            bool thrown = false; \
+            try { \
+                one.setPosition(one.getSize() - 1); \
+                one.read_array(&out[0], out.size()); \
+            } catch (std::out_of_range &) { \
+                thrown = true; \
+            } \
+            YUAN_ASSERT(thrown); \
+        } \
+    } \
+    YUAN_LOG_INFO(g_logger) << #write_array "/" #read_array " ok";
+
+    XX(int32_t, writeFint32, readFint32, writeFint32Array, readFint32Array);
+    XX(uint32_t, writeFuint32, readFuint32, writeFuint32Array, readFuint32Array);
+    XX(int64_t, writeFint64, readFint64, writeFint64Array, readFint64Array);
+    XX(uint64_t, writeFuint64, readFuint64, writeFuint64Array, readFuint64Array);
+    XX(int32_t, writeInt32, readInt32, writeInt32Array, readInt32Array);
+    XX(uint32_t, writeUint32, readUint32, writeUint32Array, readUint32Array);
+    XX(int64_t, writeInt64, readInt64, writeInt64Array, readInt64Array);
+    XX(uint64_t, writeUint64, readUint64, writeUint64Array, readUint64Array);
+#undef XX
+}
+
+// mmap的文件直接作为节点：读、发送都不拷贝，写的时候只复制被写的节点，文件不变
+void test_map_file() {
+    const std::string file = "/tmp/test_bytearray_map.dat";
+    const size_t count = 1000000;
+    {
+        yuan::ByteArray ba;
+        std::vector<uint32_t> vec(count);
+        for (size_t i = 0; i < count; ++i) {
+            vec[i] = i;
+        }
+        ba.writeFuint32Array(&vec[0], count);
+        ba.writeStringVint("tail");
+        ba.setPosition(0);
+        YUAN_ASSERT(ba.writeToFile(file));
+    }
+    size_t file_size = count * 4 + 5;
+
+    yuan::ByteArray::ptr ba = yuan::ByteArray::MapFile(file);
+    YUAN_ASSERT(ba && ba->getSize() == file_size && ba->getPosition() == 0);
+    // 各节点是同一块映射上连续的视图
+    std::vector<iovec> iovs;
+    YUAN_ASSERT(ba->getReadBuffers(iovs) == file_size);
+    YUAN_ASSERT(iovs.size() == (file_size + yuan::ByteArray::MAP_NODE_SIZE - 1) / yuan::ByteArray::MAP_NODE_SIZE);
+    for (size_t i = 1; i < iovs.size(); ++i) {
+        YUAN_ASSERT(static_cast<char*>(iovs[i].iov_base) == static_cast<char*>(iovs[i - 1].iov_base) + iovs[i - 1].iov_len);
+    }
 
+    // 类型化的读取，包括跨节点的
+    std::vector<uint32_t> out(count);
+    ba->readFuint32Array(&out[0], count);
+    for (size_t i = 0; i < count; ++i) {
+        YUAN_ASSERT(out[i] == i);
+    }
+    YUAN_ASSERT(ba->readStringVint() == "tail");
+    ba->setPosition(yuan::ByteArray::MAP_NODE_SIZE - 2);
+    uint32_t v = ba->readFuint32();
+    ba->setPosition(yuan::ByteArray::MAP_NODE_SIZE - 2);
+    YUAN_ASSERT(ba->readFuint32() == v);
+
+    // 在中间改写、在末尾追加都可以，映射是只读的，先复制
+    yuan::ByteArray::ptr copy = ba->slice(file_size, 0);
+    ba->setPosition(8);
+    ba->writeFuint32(0xdeadbeef);
+    ba->setPosition(ba->getSize());
+    ba->writeStringVint("more");
+    ba->setPosition(8);
+    YUAN_ASSERT(ba->readFuint32() == 0xdeadbeef);
+    YUAN_ASSERT(copy->readFuint32() == 0 && copy->readFuint32() == 1 && copy->readFuint32() == 2);
+    yuan::ByteArray::ptr again = yuan::ByteArray::MapFile(file);
+    again->setPosition(8);
+    YUAN_ASSERT(again->readFuint32() == 2 && again->getSize() == file_size);
+    iovs.clear();
+    ba->setPosition(0);
+    ba->getReadBuffers(iovs);
+    // 只有被写的第一个节点换成了自己的内存
+    YUAN_ASSERT(static_cast<char*>(iovs[1].iov_base) != static_cast<char*>(iovs[0].iov_base) + iovs[0].iov_len);
+    YUAN_ASSERT(static_cast<char*>(iovs[2].iov_base) == static_cast<char*>(iovs[1].iov_base) + iovs[1].iov_len);
+
+    YUAN_ASSERT(yuan::ByteArray::MapFile("/tmp/not_exist_test_bytearray_map") == nullptr);
+    ba.reset();
+    copy.reset();
+    again.reset();
+    unlink(file.c_str());
+    YUAN_LOG_INFO(g_logger) << "test_map_file ok";
+}
+
+// 序列化大量的id和时间戳：逐个调用和批量接口的对比
+void bench_array() {
+    const size_t n = 1000000;
+    std::vector<uint32_t> ids;
+    std::vector<int64_t> timestamps;
+    int64_t ts = 1700000000000LL;
+    for (size_t i = 0; i < n; ++i) {
+        // 大部分是小的id，夹杂一些大的
+        ids.push_back(i % 8 == 0 ? rand() : rand() % 100);
+        ts += rand() % 1000;
+        timestamps.push_back(ts);
+    }
+    std::vector<uint32_t> ids_out(n);
+    std::vector<int64_t> ts_out(n);
+
+#define XX(name, vec, out, write_fun, read_fun, write_array, read_array) { \
+    yuan::ByteArray one, bulk; \
+    uint64_t start = yuan::Clock::MonotonicNs(); \
+    for (auto i : vec) { \
+        one.write_fun(i); \
+    } \
+    uint64_t write_one = yuan::Clock::MonotonicNs() - start; \
+    start = yuan::Clock::MonotonicNs(); \
+    bulk.write_array(&vec[0], n); \
+    uint64_t write_bulk = yuan::Clock::MonotonicNs() - start; \
+    one.setPosition(0); \
+    bulk.setPosition(0); \
+    start = yuan::Clock::MonotonicNs(); \
+    for (size_t i = 0; i < n; ++i) { \
+        out[i] = one.read_fun(); \
+    } \
+    uint64_t read_one = yuan::Clock::MonotonicNs() - start; \
+    start = yuan::Clock::MonotonicNs(); \
+    bulk.read_array(&out[0], n); \
+    uint64_t read_bulk = yuan::Clock::MonotonicNs() - start; \
+    YUAN_ASSERT(out == vec); \
+    YUAN_LOG_INFO(g_logger) << name << " ns/value write: loop=" << static_cast<double>(write_one) / n \
+        << " array=" << static_cast<double>(write_bulk) / n \
+        << " read: loop=" << static_cast<double>(read_one) / n \
+        << " array=" << static_cast<double>(read_bulk) / n; \
+}
+    XX("varint uint32 ids", ids, ids_out, writeUint32, readUint32, writeUint32Array, readUint32Array);
+    XX("varint int64 timestamps", timestamps, ts_out, writeInt64, readInt64, writeInt64Array, readInt64Array);
+    XX("fixed uint32 ids", ids, ids_out, writeFuint32, readFuint32, writeFuint32Array, readFuint32Array);
+    XX("fixed int64 timestamps", timestamps, ts_out, writeFint64, readFint64, writeFint64Array, readFint64Array);
+#undef XX
+}
 
 int main(int argc, char **argv) {
     test();
+    test_slice();
+    test_splice();
+    test_prepare_commit();
+    test_zigzag();
+    test_array();
+    test_map_file();
+    bench_slice(1000, 64);
+    bench_slice(16 * 1024, 4);
+    bench_array();
     return 0;
 }
\ No newline at end of file
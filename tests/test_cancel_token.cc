@@ -0,0 +1,87 @@
+#include "../yuan/iomanager.h"
+#include "../yuan/socket.h"
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 还没开始执行的任务被取消后直接丢弃
+void test_drop_queued() {
+    yuan::IOManager iom(1, false, "cancel");
+    yuan::CancelToken::ptr token(new yuan::CancelToken);
+    std::atomic<bool> run = {false};
+    yuan::Semaphore sem;
+    // 先阻塞住唯一的线程，保证后面的任务还在队列里
+    iom.schedule([&sem](){
+        sem.wait();
+    });
+    iom.schedule([&run](){
+        run = true;
+    }, token);
+    token->cancel();
+    sem.post();
+    iom.stop();
+    YUAN_ASSERT(!run);
+    YUAN_LOG_INFO(g_logger) << "test_drop_queued ok";
+}
+
+// 阻塞在hook的sleep上的协程被提前唤醒
+void test_cancel_sleep() {
+    yuan::IOManager iom(2, false, "cancel");
+    yuan::CancelToken::ptr token(new yuan::CancelToken);
+    yuan::Semaphore sem;
+    uint64_t used_ms = 0;
+    int err = 0;
+    iom.schedule([&](){
+        uint64_t start = yuan::GetCurrentTimeMS();
+        int rt = usleep(10 * 1000 * 1000);
+        err = rt == -1 ? errno : 0;
+        used_ms = yuan::GetCurrentTimeMS() - start;
+        sem.post();
+    }, token);
+    iom.addTimer(100, [token](){
+        token->cancel();
+    });
+    sem.wait();
+    YUAN_LOG_INFO(g_logger) << "sleep cancelled used_ms=" << used_ms << " errno=" << err;
+    YUAN_ASSERT(err == ECANCELED);
+    YUAN_ASSERT(used_ms < 5000);
+}
+
+// 阻塞在hook的recv上的协程被唤醒，返回ECANCELED
+void test_cancel_recv() {
+    yuan::IOManager iom(2, false, "cancel");
+    yuan::CancelToken::ptr token(new yuan::CancelToken);
+    yuan::Semaphore sem;
+    int err = 0;
+    iom.schedule([&](){
+        yuan::Address::ptr addr = yuan::IPv4Address::Create("127.0.0.1", 0);
+        yuan::Socket::ptr server = yuan::Socket::CreateTCP(addr);
+        YUAN_ASSERT(server->bind(addr));
+        YUAN_ASSERT(server->listen());
+        yuan::Socket::ptr client = yuan::Socket::CreateTCP(addr);
+        YUAN_ASSERT(client->connect(server->getLocalAddress()));
+
+        // 对端一直不发数据，recv会一直阻塞直到被取消
+        yuan::Fiber::GetThis()->setCancelToken(token);
+        char buf[16];
+        int rt = client->recv(buf, sizeof(buf));
+        err = rt == -1 ? errno : 0;
+        yuan::Fiber::GetThis()->setCancelToken(nullptr);
+        sem.post();
+    });
+    iom.addTimer(100, [token](){
+        token->cancel();
+    });
+    sem.wait();
+    YUAN_LOG_INFO(g_logger) << "recv cancelled errno=" << err;
+    YUAN_ASSERT(err == ECANCELED);
+}
+
+int main(int argc, char **argv) {
+    g_logger->setLevel(yuan::LogLevel::INFO);
+    YUAN_GET_LOGGER("system")->setLevel(yuan::LogLevel::INFO);
+    test_drop_queued();
+    test_cancel_sleep();
+    test_cancel_recv();
+    return 0;
+}
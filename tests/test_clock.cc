@@ -0,0 +1,130 @@
+#include "../yuan/yuan_all_headers.h"
+#include "../yuan/iomanager.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static uint64_t abs_diff(uint64_t a, uint64_t b) {
+    return a > b ? a - b : b - a;
+}
+
+// 各种读法和精确的单调时间相差不大，且都是单调的
+void test_modes() {
+    // 第一次用TSC时才校准（忙等10ms），先校准再比较
+    yuan::Clock::HasTsc();
+    uint64_t precise = yuan::Clock::MonotonicNs();
+    YUAN_ASSERT(abs_diff(yuan::Clock::TscNs(), precise) < 5 * 1000 * 1000);
+    YUAN_ASSERT(abs_diff(yuan::Clock::CoarseNs(), precise) < 20 * 1000 * 1000);
+    YUAN_ASSERT(abs_diff(yuan::Clock::WallUs(), yuan::GetCurrentTimeUS()) < 5 * 1000);
+
+    for (int mode = yuan::Clock::PRECISE; mode <= yuan::Clock::TSC; ++mode) {
+        yuan::Clock::SetMode(static_cast<yuan::Clock::Mode>(mode));
+        uint64_t last = 0;
+        for (int i = 0; i < 10000; ++i) {
+            uint64_t now = yuan::Clock::NowNs();
+            YUAN_ASSERT(now >= last);
+            last = now;
+        }
+    }
+    YUAN_LOG_INFO(g_logger) << "has tsc=" << yuan::Clock::HasTsc();
+}
+
+// 缓存的时间只在Update时变化
+void test_cached() {
+    yuan::Clock::SetMode(yuan::Clock::CACHED);
+    uint64_t updated = yuan::Clock::Update();
+    usleep(2000);
+    YUAN_ASSERT(yuan::Clock::NowNs() == updated);
+    YUAN_ASSERT(yuan::Clock::CachedMs() == updated / 1000000);
+    uint64_t wall = yuan::Clock::WallUs();
+    usleep(2000);
+    YUAN_ASSERT(yuan::Clock::WallUs() == wall);
+    YUAN_ASSERT(yuan::Clock::Update() >= updated + 2 * 1000 * 1000);
+    YUAN_ASSERT(yuan::Clock::WallUs() >= wall + 2000);
+    yuan::Clock::SetMode(yuan::Clock::PRECISE);
+}
+
+// 日志的时间戳精确到微秒
+void test_log_time() {
+    yuan::Logger::ptr logger = YUAN_GET_LOGGER("clock");
+    yuan::LogFormatter formatter("%d{%H:%M:%S.%f}|%r");
+    yuan::LogEventWrap wrap(logger, yuan::LogLevel::DEBUG, __FILE__, __LINE__);
+    wrap.getSS() << "test_log_time event";
+    yuan::LogEvent::ptr event = wrap.getEvent();
+    YUAN_ASSERT(abs_diff(event->getTimeUs(), yuan::GetCurrentTimeUS()) < 5 * 1000);
+    std::string str = formatter.format(logger, yuan::LogLevel::DEBUG, event);
+    YUAN_ASSERT2(str.size() > 16 && str[8] == '.' && str[15] == '|', str);
+    char usec[7];
+    snprintf(usec, sizeof(usec), "%06lu", static_cast<unsigned long>(event->getTimeUs() % 1000000));
+    YUAN_ASSERT2(str.substr(9, 6) == usec, str);
+    YUAN_LOG_INFO(g_logger) << "test_log_time: " << str;
+}
+
+// 定时器基于缓存的时间，仍然要按时触发
+void test_timer() {
+    yuan::IOManager iom(1, false, "clock");
+    for (uint64_t ms : {10, 50, 200}) {
+        uint64_t start = yuan::Clock::MonotonicNs();
+        iom.addTimer(ms, [ms, start](){
+            uint64_t used = (yuan::Clock::MonotonicNs() - start) / 1000000;
+            YUAN_LOG_INFO(g_logger) << "timer " << ms << "ms fired after " << used << "ms";
+            YUAN_ASSERT(used + 1 >= ms && used < ms + 50);
+        });
+    }
+}
+
+// 定时器用的是单调时钟，开机不久（单调时间很小）时也不能把还没到期的定时器当成超时
+class TestTimerManager : public yuan::TimerManager {
+protected:
+    void onTimerInsertedAtFront() override {}
+};
+
+void test_timer_not_early() {
+    TestTimerManager tm;
+    int fired = 0;
+    tm.addTimer(1000, [&fired](){ ++fired; });
+    tm.addTimer(60 * 60 * 1000, [&fired](){ ++fired; }, true);
+    for (int i = 0; i < 10; ++i) {
+        yuan::Clock::Update();
+        std::vector<std::function<void()> > cbs;
+        tm.listExpiredCbs(cbs);
+        YUAN_ASSERT(cbs.empty());
+        usleep(1000);
+    }
+    YUAN_ASSERT(fired == 0 && tm.hasTimer());
+    YUAN_LOG_INFO(g_logger) << "test_timer_not_early ok, monotonic_ms=" << yuan::Clock::CachedMs();
+}
+
+// 各种模式读一次时钟的耗时
+void bench() {
+    const int n = 1000000;
+    for (int mode = yuan::Clock::PRECISE; mode <= yuan::Clock::TSC; ++mode) {
+        yuan::Clock::SetMode(static_cast<yuan::Clock::Mode>(mode));
+        uint64_t sum = 0;
+        uint64_t start = yuan::Clock::MonotonicNs();
+        for (int i = 0; i < n; ++i) {
+            sum += yuan::Clock::NowNs();
+        }
+        uint64_t used = yuan::Clock::MonotonicNs() - start;
+        YUAN_LOG_INFO(g_logger) << yuan::Clock::ModeToString(yuan::Clock::GetMode())
+            << " ns/read=" << static_cast<double>(used) / n << " sum=" << sum % 10;
+    }
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        yuan::GetCurrentTimeMS();
+    }
+    YUAN_LOG_INFO(g_logger) << "gettimeofday ns/read="
+        << static_cast<double>(yuan::Clock::MonotonicNs() - start) / n;
+    yuan::Clock::SetMode(yuan::Clock::PRECISE);
+}
+
+int main(int argc, char **argv) {
+    // 默认不用TSC，启动时不做校准
+    YUAN_ASSERT(yuan::Clock::GetMode() == yuan::Clock::PRECISE);
+    test_modes();
+    test_cached();
+    test_log_time();
+    test_timer();
+    test_timer_not_early();
+    bench();
+    return 0;
+}
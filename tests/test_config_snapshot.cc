@@ -0,0 +1,104 @@
+#include "../yuan/config.h"
+#include "../yuan/iomanager.h"
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static yuan::ConfigVar<int>::ptr g_int_value =
+    yuan::Config::Lookup("snapshot.int", 1, "snapshot int");
+static yuan::ConfigVar<std::vector<std::string> >::ptr g_vec_value =
+    yuan::Config::Lookup("snapshot.vec", std::vector<std::string>{"a", "b"}, "snapshot vec");
+
+// 回调在新值发布之后调用，回调里读到的就是新值
+void test_listener() {
+    int seen = 0;
+    uint64_t key = g_int_value->add_listener([&seen](const int &old_value, const int &new_value){
+        YUAN_ASSERT(g_int_value->getValue() == new_value);
+        YUAN_ASSERT(old_value + 1 == new_value);
+        seen = new_value;
+    });
+    g_int_value->setValue(2);
+    YUAN_ASSERT(seen == 2);
+    // 值不变时不回调
+    g_int_value->setValue(2);
+    g_int_value->del_listener(key);
+    g_int_value->setValue(1);
+    YUAN_ASSERT(seen == 2);
+    YUAN_LOG_INFO(g_logger) << "test_listener ok";
+}
+
+// 调度线程上无锁读，同时不断修改，读到的快照总是完整的
+void test_concurrent() {
+    const int rounds = 2000;
+    {
+        yuan::IOManager iom(4, false, "snapshot");
+        for (int i = 0; i < rounds; ++i) {
+            iom.schedule([](){
+                for (int k = 0; k < 100; ++k) {
+                    const std::vector<std::string> &vec = g_vec_value->getRef();
+                    YUAN_ASSERT(vec.size() == 2 && (vec[0] == "a" || vec[0] + "x" == vec[1]));
+                }
+            });
+            iom.schedule([i](){
+                std::string s = std::to_string(i);
+                g_vec_value->setValue(std::vector<std::string>{s, s + "x"});
+            });
+        }
+        // 普通线程里走加锁的路径
+        for (int i = 0; i < 10000; ++i) {
+            std::vector<std::string> vec = g_vec_value->getValue();
+            YUAN_ASSERT(vec.size() == 2 && (vec[0] == "a" || vec[0] + "x" == vec[1]));
+        }
+    }
+    YUAN_LOG_INFO(g_logger) << "test_concurrent ok, pending=" << yuan::EpochMgr::GetInstance()->getPending();
+}
+
+// 读一次配置的耗时：原来的加锁拷贝、在线线程的无锁拷贝和无锁引用
+void bench() {
+    const int n = 10000000;
+    uint64_t sum = 0;
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        sum += g_int_value->getValue();
+    }
+    uint64_t locked = yuan::Clock::MonotonicNs() - start;
+
+    yuan::EpochManager *epoch = yuan::EpochMgr::GetInstance();
+    epoch->registerThread();
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        sum += g_int_value->getValue();
+    }
+    uint64_t copy = yuan::Clock::MonotonicNs() - start;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        sum += g_int_value->getRef();
+    }
+    uint64_t ref = yuan::Clock::MonotonicNs() - start;
+
+    const int m = 1000000;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < m; ++i) {
+        sum += g_vec_value->getValue().size();
+    }
+    uint64_t vec_copy = yuan::Clock::MonotonicNs() - start;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < m; ++i) {
+        sum += g_vec_value->getRef().size();
+    }
+    uint64_t vec_ref = yuan::Clock::MonotonicNs() - start;
+    epoch->unregisterThread();
+
+    YUAN_LOG_INFO(g_logger) << "int ns/read: locked=" << static_cast<double>(locked) / n
+        << " lockfree copy=" << static_cast<double>(copy) / n
+        << " ref=" << static_cast<double>(ref) / n;
+    YUAN_LOG_INFO(g_logger) << "vector<string> ns/read: lockfree copy=" << static_cast<double>(vec_copy) / m
+        << " ref=" << static_cast<double>(vec_ref) / m << " sum=" << sum % 10;
+}
+
+int main(int argc, char **argv) {
+    test_listener();
+    test_concurrent();
+    bench();
+    return 0;
+}
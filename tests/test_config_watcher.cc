@@ -0,0 +1,114 @@
+#include "../yuan/config.h"
+#include "../yuan/config_watcher.h"
+#include "../yuan/yuan_all_headers.h"
+#include <fstream>
+#include <stdlib.h>
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static yuan::ConfigVar<int>::ptr g_timeout =
+    yuan::Config::Lookup("watch.timeout", 100, "watch timeout");
+static yuan::ConfigVar<std::string>::ptr g_name =
+    yuan::Config::Lookup("watch.name", std::string("yuan"), "watch name");
+static yuan::ConfigVar<int>::ptr g_pool_size =
+    yuan::Config::Lookup("watch.pool_size", 4, "watch pool size");
+
+static std::atomic<int> s_timeout_changes = {0};
+static std::atomic<int> s_name_changes = {0};
+static std::atomic<int> s_pool_changes = {0};
+
+static void write_file(const std::string &file, const std::string &content) {
+    std::ofstream ofs(file);
+    ofs << content;
+}
+
+// 编辑器的保存方式：写临时文件再rename
+static void replace_file(const std::string &file, const std::string &content) {
+    write_file(file + ".tmp", content);
+    YUAN_ASSERT(rename((file + ".tmp").c_str(), file.c_str()) == 0);
+}
+
+static bool wait_for(std::function<bool()> cond) {
+    for (int i = 0; i < 300; ++i) {
+        if (cond()) {
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    return false;
+}
+
+void test_watch() {
+    char tmpl[] = "/tmp/yuan_config_watch_XXXXXX";
+    std::string dir = mkdtemp(tmpl);
+    std::string main_file = dir + "/main.yml";
+    std::string pool_file = dir + "/pool.yml";
+    write_file(main_file, "watch:\n  timeout: 200\n  name: first\n");
+    write_file(pool_file, "watch:\n  pool_size: 8\n");
+
+    g_timeout->add_listener([](const int &, const int &){ ++s_timeout_changes; });
+    g_name->add_listener([](const std::string &, const std::string &){ ++s_name_changes; });
+    g_pool_size->add_listener([](const int &, const int &){ ++s_pool_changes; });
+
+    yuan::IOManager iom(1, false, "watch");
+    yuan::ConfigWatcher::ptr watcher = yuan::ConfigWatcher::Create(&iom);
+    YUAN_ASSERT(watcher);
+    std::vector<std::string> last_changed;
+    yuan::Mutex mutex;
+    watcher->setReloadCallback([&](const std::string &file, const std::vector<std::string> &changed){
+        yuan::Mutex::Lock lock(mutex);
+        last_changed = changed;
+    });
+
+    // 监听目录时立即加载所有yaml
+    YUAN_ASSERT(watcher->watch(dir));
+    YUAN_ASSERT(g_timeout->getValue() == 200 && g_name->getValue() == "first" && g_pool_size->getValue() == 8);
+    YUAN_ASSERT(watcher->getReloadCount() == 2);
+
+    // 只改timeout，只有timeout的回调被触发，pool.yml不会被重新加载
+    write_file(main_file, "watch:\n  timeout: 300\n  name: first\n");
+    YUAN_ASSERT(wait_for([](){ return g_timeout->getValue() == 300; }));
+    YUAN_ASSERT(s_timeout_changes == 2 && s_name_changes == 1 && s_pool_changes == 1);
+    YUAN_ASSERT(watcher->getReloadCount() == 3);
+    {
+        yuan::Mutex::Lock lock(mutex);
+        YUAN_ASSERT(last_changed.size() == 1 && last_changed[0] == "watch.timeout");
+    }
+
+    // rename方式的保存
+    replace_file(pool_file, "watch:\n  pool_size: 16\n");
+    YUAN_ASSERT(wait_for([](){ return g_pool_size->getValue() == 16; }));
+    YUAN_ASSERT(s_pool_changes == 2 && s_timeout_changes == 2);
+
+    // 内容没变、非yaml文件、不合法的yaml都不会改变配置
+    uint64_t reloads = watcher->getReloadCount();
+    write_file(pool_file, "watch:\n  pool_size: 16\n");
+    write_file(dir + "/notes.txt", "watch:\n  pool_size: 32\n");
+    write_file(main_file, "watch: [timeout: 1\n");
+    usleep(200 * 1000);
+    YUAN_ASSERT(watcher->getReloadCount() == reloads);
+    YUAN_ASSERT(g_pool_size->getValue() == 16 && g_timeout->getValue() == 300);
+
+    // 修正之后继续生效
+    write_file(main_file, "watch:\n  timeout: 300\n  name: second\n");
+    YUAN_ASSERT(wait_for([](){ return g_name->getValue() == "second"; }));
+    YUAN_ASSERT(s_timeout_changes == 2 && s_name_changes == 2);
+
+    // 停止后不再加载
+    watcher->stop();
+    write_file(main_file, "watch:\n  timeout: 400\n");
+    usleep(200 * 1000);
+    YUAN_ASSERT(g_timeout->getValue() == 300);
+    watcher.reset();
+
+    unlink(main_file.c_str());
+    unlink(pool_file.c_str());
+    unlink((dir + "/notes.txt").c_str());
+    rmdir(dir.c_str());
+    YUAN_LOG_INFO(g_logger) << "test_watch ok";
+}
+
+int main(int argc, char **argv) {
+    test_watch();
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "../yuan/epoch.h"
+#include "../yuan/iomanager.h"
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static const uint64_t MAGIC = 0x1234567887654321ULL;
+static std::atomic<uint64_t> s_destroyed = {0};
+
+struct Node {
+    Node(uint64_t v) : value(v) {}
+    ~Node() {
+        magic = 0;
+        ++s_destroyed;
+    }
+    uint64_t magic = MAGIC;
+    uint64_t value;
+};
+
+// 读者无锁读取，写者替换后retire旧节点
+static std::atomic<Node*> s_current = {nullptr};
+
+void test_basic() {
+    yuan::EpochManager *epoch = yuan::EpochMgr::GetInstance();
+    epoch->registerThread();
+    uint64_t destroyed = s_destroyed;
+    epoch->retire(new Node(1));
+    // 本线程还没经过静止点，不能回收
+    YUAN_ASSERT(epoch->tryReclaim() == 0);
+    epoch->quiescent();
+    YUAN_ASSERT(epoch->tryReclaim() == 1);
+    YUAN_ASSERT(s_destroyed == destroyed + 1);
+
+    // 离线的线程不阻止回收
+    epoch->retire(new Node(2));
+    epoch->offline();
+    YUAN_ASSERT(epoch->tryReclaim() == 1);
+    epoch->online();
+    epoch->unregisterThread();
+    YUAN_LOG_INFO(g_logger) << "test_basic ok";
+}
+
+// 多个调度线程上不断读取，同时写者不断替换并retire
+void test_scheduler() {
+    const int rounds = 2000;
+    uint64_t destroyed = s_destroyed;
+    s_current = new Node(0);
+    {
+        yuan::IOManager iom(4, false, "epoch");
+        std::atomic<uint64_t> reads = {0};
+        for (int i = 0; i < rounds; ++i) {
+            iom.schedule([&reads](){
+                for (int k = 0; k < 100; ++k) {
+                    Node *node = s_current.load(std::memory_order_acquire);
+                    YUAN_ASSERT(node->magic == MAGIC);
+                    ++reads;
+                }
+            });
+            iom.schedule([i](){
+                Node *old = s_current.exchange(new Node(i + 1), std::memory_order_acq_rel);
+                yuan::EpochMgr::GetInstance()->retire(old);
+            });
+        }
+        iom.stop();
+        YUAN_LOG_INFO(g_logger) << "reads=" << reads << " pending=" << yuan::EpochMgr::GetInstance()->getPending();
+    }
+    // 调度线程都已退出注销，剩下的都可以回收
+    yuan::EpochMgr::GetInstance()->tryReclaim();
+    YUAN_ASSERT(yuan::EpochMgr::GetInstance()->getPending() == 0);
+    YUAN_ASSERT(s_destroyed == destroyed + rounds);
+    delete s_current.exchange(nullptr);
+    YUAN_LOG_INFO(g_logger) << "test_scheduler ok";
+}
+
+int main(int argc, char **argv) {
+    test_basic();
+    test_scheduler();
+    return 0;
+}
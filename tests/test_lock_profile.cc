@@ -0,0 +1,67 @@
+#include "../yuan/iomanager.h"
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 一个持锁时间长、争抢多的锁，和一个几乎没有争抢的锁，统计结果里前者应该排在前面
+static yuan::Mutex s_hot;
+static yuan::Spinlock s_cold;
+static uint64_t s_count = 0;
+
+void test_sites() {
+    s_hot.setName("test::hot");
+    s_cold.setName("test::cold");
+    yuan::LockProfiler::Reset();
+    yuan::LockProfiler::SetSampleRate(1);
+    yuan::LockProfiler::SetEnabled(true);
+
+    std::vector<yuan::Thread::ptr> thrs;
+    for (int i = 0; i < 4; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([](){
+            for (int k = 0; k < 2000; ++k) {
+                {
+                    yuan::Mutex::Lock lock(s_hot);
+                    ++s_count;
+                    // 持锁期间让出CPU，制造争抢
+                    if (k % 10 == 0) {
+                        sched_yield();
+                    }
+                }
+                yuan::Spinlock::Lock lock(s_cold);
+            }
+        }, "lock_" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    yuan::LockProfiler::SetEnabled(false);
+
+    YUAN_ASSERT(s_count == 8000);
+    yuan::LockSite *hot = yuan::LockProfiler::GetSite("test::hot");
+    YUAN_ASSERT(hot->acquisitions == 8000);
+    YUAN_ASSERT(hot->holds == 8000);
+    YUAN_LOG_INFO(g_logger) << "\n" << yuan::LockProfiler::Dump();
+}
+
+// 打开采样，观察框架里各个锁的情况
+void test_framework() {
+    yuan::LockProfiler::Reset();
+    yuan::LockProfiler::SetSampleRate(4);
+    yuan::LockProfiler::SetEnabled(true);
+    {
+        yuan::IOManager iom(4, false, "profile");
+        for (int i = 0; i < 10000; ++i) {
+            iom.schedule([](){});
+        }
+    }
+    yuan::LockProfiler::SetEnabled(false);
+    YUAN_ASSERT(yuan::LockProfiler::GetSite("Scheduler::m_mutex")->acquisitions > 0);
+    YUAN_LOG_INFO(g_logger) << "\n" << yuan::LockProfiler::Dump();
+}
+
+int main(int argc, char **argv) {
+    YUAN_GET_LOGGER("system")->setLevel(yuan::LogLevel::INFO);
+    test_sites();
+    test_framework();
+    return 0;
+}
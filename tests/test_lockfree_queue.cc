@@ -0,0 +1,197 @@
+#include "../yuan/lockfree_queue.h"
+#include "../yuan/yuan_all_headers.h"
+
+#include <list>
+#include <sched.h>
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 对照组：目前代码里线程间传递数据的写法
+template<typename T>
+class MutexListQueue {
+public:
+    bool push(const T &v) {
+        yuan::Mutex::Lock lock(m_mutex);
+        m_list.push_back(v);
+        return true;
+    }
+
+    bool pop(T &v) {
+        yuan::Mutex::Lock lock(m_mutex);
+        if (m_list.empty()) {
+            return false;
+        }
+        v = m_list.front();
+        m_list.pop_front();
+        return true;
+    }
+
+    template<typename Iterator>
+    size_t pushBatch(Iterator begin, Iterator end) {
+        yuan::Mutex::Lock lock(m_mutex);
+        size_t n = 0;
+        for (; begin != end; ++begin, ++n) {
+            m_list.push_back(*begin);
+        }
+        return n;
+    }
+
+    size_t popBatch(std::vector<T> &out, size_t max) {
+        yuan::Mutex::Lock lock(m_mutex);
+        size_t n = 0;
+        for (; n < max && !m_list.empty(); ++n) {
+            out.push_back(m_list.front());
+            m_list.pop_front();
+        }
+        return n;
+    }
+private:
+    yuan::Mutex m_mutex;
+    std::list<T> m_list;
+};
+
+// MPSCQueue是无界的，push没有返回值
+template<typename Q>
+static bool do_push(Q &q, uint64_t v) { return q.push(v); }
+static bool do_push(yuan::MPSCQueue<uint64_t> &q, uint64_t v) { q.push(v); return true; }
+
+void test_correctness() {
+    yuan::MPMCQueue<int> mpmc(5);
+    YUAN_ASSERT(mpmc.capacity() == 8);
+    for (int i = 0; i < 8; ++i) {
+        YUAN_ASSERT(mpmc.push(i));
+    }
+    YUAN_ASSERT(!mpmc.push(8));
+    int v = 0;
+    for (int i = 0; i < 8; ++i) {
+        YUAN_ASSERT(mpmc.pop(v) && v == i);
+    }
+    YUAN_ASSERT(!mpmc.pop(v));
+
+    yuan::SPSCQueue<int> spsc(4);
+    std::vector<int> in = {1, 2, 3, 4, 5, 6};
+    YUAN_ASSERT(spsc.pushBatch(in.begin(), in.end()) == 4);
+    std::vector<int> out;
+    YUAN_ASSERT(spsc.popBatch(out, 3) == 3);
+    YUAN_ASSERT(spsc.pushBatch(in.begin() + 4, in.end()) == 2);
+    YUAN_ASSERT(spsc.popBatch(out, 10) == 3);
+    YUAN_ASSERT(out == std::vector<int>({1, 2, 3, 4, 5, 6}));
+
+    yuan::MPSCQueue<std::string> mpsc;
+    std::vector<std::string> strs = {"a", "b", "c"};
+    mpsc.push("x");
+    YUAN_ASSERT(mpsc.pushBatch(strs.begin(), strs.end()) == 3);
+    std::vector<std::string> strs_out;
+    YUAN_ASSERT(mpsc.popBatch(strs_out, 10) == 4);
+    YUAN_ASSERT(strs_out == std::vector<std::string>({"x", "a", "b", "c"}));
+    YUAN_ASSERT(mpsc.empty());
+    YUAN_LOG_INFO(g_logger) << "correctness ok";
+}
+
+/**
+ * @brief producers个线程共写入items个数，consumers个线程取出，校验取出的和并统计吞吐
+ * @param batch 大于1时使用批量接口
+ */
+template<typename Q>
+void bench(const std::string &name, Q &q, int producers, int consumers, uint64_t items, size_t batch) {
+    std::atomic<uint64_t> consumed = {0};
+    std::atomic<uint64_t> sum = {0};
+    uint64_t per_producer = items / producers;
+    uint64_t total = per_producer * producers;
+
+    std::vector<yuan::Thread::ptr> thrs;
+    uint64_t start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < producers; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([&q, i, per_producer, batch](){
+            uint64_t begin = i * per_producer + 1;
+            uint64_t end = begin + per_producer;
+            std::vector<uint64_t> buf;
+            for (uint64_t v = begin; v < end; ) {
+                if (batch > 1) {
+                    buf.clear();
+                    for (size_t k = 0; k < batch && v + k < end; ++k) {
+                        buf.push_back(v + k);
+                    }
+                    size_t n = q.pushBatch(buf.begin(), buf.end());
+                    v += n;
+                    if (n < buf.size()) {
+                        sched_yield();
+                    }
+                } else if (do_push(q, v)) {
+                    ++v;
+                } else {
+                    sched_yield();
+                }
+            }
+        }, name + "_p" + std::to_string(i))));
+    }
+    for (int i = 0; i < consumers; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([&q, &consumed, &sum, total, batch](){
+            std::vector<uint64_t> buf;
+            uint64_t local_sum = 0;
+            uint64_t local_count = 0;
+            while (consumed.load(std::memory_order_relaxed) < total) {
+                size_t n = 0;
+                if (batch > 1) {
+                    buf.clear();
+                    n = q.popBatch(buf, batch);
+                    for (auto v : buf) {
+                        local_sum += v;
+                    }
+                } else {
+                    uint64_t v = 0;
+                    if (q.pop(v)) {
+                        local_sum += v;
+                        n = 1;
+                    }
+                }
+                if (n) {
+                    local_count += n;
+                    consumed.fetch_add(n, std::memory_order_relaxed);
+                } else {
+                    sched_yield();
+                }
+            }
+            sum += local_sum;
+        }, name + "_c" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    uint64_t used = yuan::GetCurrentTimeUS() - start;
+    YUAN_ASSERT(sum == total * (total + 1) / 2);
+    YUAN_LOG_INFO(g_logger) << name << " producers=" << producers << " consumers=" << consumers
+        << " batch=" << batch << " items=" << total << " used_us=" << used
+        << " ops/s=" << (uint64_t)(total * 1000000.0 / (used ? used : 1));
+}
+
+template<typename Q>
+void bench_new(const std::string &name, Q *q, int producers, int consumers, uint64_t items, size_t batch) {
+    std::unique_ptr<Q> holder(q);
+    bench(name, *q, producers, consumers, items, batch);
+}
+
+int main(int argc, char **argv) {
+    test_correctness();
+
+    const uint64_t items = argc > 1 ? atoll(argv[1]) : 1000000;
+    const size_t cap = 4096;
+    typedef uint64_t T;
+    for (size_t batch : {1, 64}) {
+        YUAN_LOG_INFO(g_logger) << "==== 1 producer / 1 consumer, batch=" << batch;
+        bench_new("mutex_list", new MutexListQueue<T>, 1, 1, items, batch);
+        bench_new("spsc", new yuan::SPSCQueue<T>(cap), 1, 1, items, batch);
+        bench_new("mpsc", new yuan::MPSCQueue<T>, 1, 1, items, batch);
+        bench_new("mpmc", new yuan::MPMCQueue<T>(cap), 1, 1, items, batch);
+
+        YUAN_LOG_INFO(g_logger) << "==== 4 producers / 1 consumer, batch=" << batch;
+        bench_new("mutex_list", new MutexListQueue<T>, 4, 1, items, batch);
+        bench_new("mpsc", new yuan::MPSCQueue<T>, 4, 1, items, batch);
+        bench_new("mpmc", new yuan::MPMCQueue<T>(cap), 4, 1, items, batch);
+
+        YUAN_LOG_INFO(g_logger) << "==== 4 producers / 4 consumers, batch=" << batch;
+        bench_new("mutex_list", new MutexListQueue<T>, 4, 4, items, batch);
+        bench_new("mpmc", new yuan::MPMCQueue<T>(cap), 4, 4, items, batch);
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "../yuan/yuan_all_headers.h"
+
+#include <atomic>
+#include <fstream>
+#include <sys/wait.h>
+#include <new>
+
+// 统计整个进程的内存分配次数，用来验证写日志的路径上没有分配
+static std::atomic<uint64_t> s_allocs = {0};
+
+void *operator new(size_t size) {
+    ++s_allocs;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 只格式化不输出，测的是日志事件本身的开销
+class NullLogAppender : public yuan::LogAppender {
+public:
+    NullLogAppender(bool legacy) : m_legacy(legacy) {}
+
+    virtual void log(const std::shared_ptr<yuan::Logger> &logger, yuan::LogLevel::Level level
+                    , const yuan::LogEvent::ptr &event) override {
+        if (m_legacy) {
+            // 原来的做法：格式化成string
+            std::string str = m_formatter->format(logger, level, event);
+            m_bytes += str.size();
+        } else {
+            static thread_local yuan::LogStream t_stream;
+            t_stream.reset();
+            m_formatter->format(t_stream, logger, level, event);
+            m_bytes += t_stream.size();
+        }
+    }
+    std::string toYAMLString() override { return ""; }
+private:
+    bool m_legacy;
+    std::atomic<uint64_t> m_bytes = {0};
+};
+
+static yuan::Logger::ptr make_logger(bool legacy) {
+    yuan::Logger::ptr logger(new yuan::Logger(legacy ? "legacy" : "pooled"));
+    logger->addAppender(yuan::LogAppender::ptr(new NullLogAppender(legacy)));
+    return logger;
+}
+
+// 原来的宏：每条日志都new一个LogEvent
+#define LEGACY_LOG_INFO(logger) \
+    yuan::LogEventWrap(yuan::LogEvent::ptr(new yuan::LogEvent(logger, yuan::LogLevel::INFO, __FILE__, __LINE__ \
+        , yuan::GetThreadId(), yuan::GetFiberId(), time(nullptr), 0, yuan::Thread::GetName()))).getSS()
+
+static void write_logs(yuan::Logger::ptr logger, bool legacy, int lines) {
+    for (int i = 0; i < lines; ++i) {
+        if (legacy) {
+            LEGACY_LOG_INFO(logger) << "bench line " << i << " value=" << 3.14 << " xxxxxxxxxxxxxxxxxxxxxxxx";
+        } else {
+            YUAN_LOG_INFO(logger) << "bench line " << i << " value=" << 3.14 << " xxxxxxxxxxxxxxxxxxxxxxxx";
+        }
+    }
+}
+
+static void bench(bool legacy, int threads, int lines) {
+    yuan::Logger::ptr logger = make_logger(legacy);
+    std::vector<yuan::Thread::ptr> thrs;
+    uint64_t allocs = s_allocs;
+    uint64_t start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < threads; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([logger, legacy, lines](){
+            write_logs(logger, legacy, lines);
+        }, "bench_" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    uint64_t used = yuan::GetCurrentTimeUS() - start;
+    thrs.clear();
+    double total = static_cast<double>(threads) * lines;
+    YUAN_LOG_INFO(g_logger) << (legacy ? "legacy" : "pooled") << " threads=" << threads
+        << " lines=" << lines << " ns/line=" << used * 1000.0 / total
+        << " allocs/line=" << (s_allocs - allocs) / total;
+}
+
+// 线程缓存的event在稳定状态下不应再分配内存
+void test_no_alloc() {
+    yuan::Logger::ptr logger = make_logger(false);
+    write_logs(logger, false, 10);
+    uint64_t allocs = s_allocs;
+    write_logs(logger, false, 1000);
+    YUAN_ASSERT2(s_allocs == allocs, "allocs=" + std::to_string(s_allocs - allocs));
+
+    // 超出内联缓冲区的长日志也能完整输出，且格式化的结果正确
+    yuan::LogEvent::ptr event(new yuan::LogEvent(logger, yuan::LogLevel::INFO, __FILE__, __LINE__
+        , 0, 0, 0, 0, "t"));
+    std::string big(yuan::LogStream::INLINE_SIZE * 3, 'a');
+    event->getSS() << "head" << big;
+    event->format(" %d-%s", 42, big.c_str());
+    YUAN_ASSERT(event->getContent() == "head" + big + " 42-" + big);
+    event->reset(logger, yuan::LogLevel::INFO, __FILE__, __LINE__, 0, 0, 0, 0, "t");
+    event->format("%s=%d", "k", 1);
+    YUAN_ASSERT(event->getContent() == "k=1");
+}
+
+// 嵌套写日志：<<右边调用的函数里又写了日志，两条都要完整
+static std::string nested() {
+    YUAN_LOG_INFO(g_logger) << "inner log";
+    return "outer value";
+}
+
+void test_nested() {
+    YUAN_LOG_INFO(g_logger) << "outer log begin, " << nested() << ", outer log end";
+}
+
+// 同步appender每行都刷新：进程随后abort时日志不能留在缓冲区里丢掉
+void test_flush_before_abort() {
+    const std::string file = "/tmp/yuan_log_flush.log";
+    unlink(file.c_str());
+    pid_t pid = fork();
+    YUAN_ASSERT(pid >= 0);
+    if (pid == 0) {
+        yuan::Logger::ptr logger(new yuan::Logger("flush"));
+        logger->setFormatter("%m%n");
+        logger->addAppender(yuan::LogAppender::ptr(new yuan::FileLogAppender(file)));
+        YUAN_LOG_INFO(logger) << "before abort";
+        abort();
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    YUAN_ASSERT(WIFSIGNALED(status));
+    std::ifstream ifs(file);
+    std::string line;
+    std::getline(ifs, line);
+    YUAN_ASSERT2(line == "before abort", line);
+    YUAN_LOG_INFO(g_logger) << "test_flush_before_abort ok";
+}
+
+int main(int argc, char **argv) {
+    test_no_alloc();
+    test_nested();
+    test_flush_before_abort();
+
+    int lines = 100000;
+    for (int threads : {1, 4}) {
+        bench(true, threads, lines);
+        bench(false, threads, lines);
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static const char *s_pattern = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T<%f:%l>%T%m%n";
+
+// 原来的格式化方式：每项写ostringstream，每条日志都localtime_r加strftime
+static std::string legacy_format(yuan::LogLevel::Level level, yuan::LogEvent::ptr event) {
+    std::ostringstream os;
+    struct tm tm;
+    time_t t = event->getTime();
+    localtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    os << buf << '\t' << event->getThreadId() << '\t' << event->getThreadName()
+        << '\t' << event->getFiberId() << "\t[" << yuan::LogLevel::ToString(level)
+        << "]\t[" << event->getLogger()->getName() << "]\t<" << event->getFile()
+        << ':' << event->getLine() << ">\t" << event->getContent() << std::endl;
+    return os.str();
+}
+
+static yuan::LogEvent::ptr make_event(yuan::Logger::ptr logger, time_t t, int line) {
+    yuan::LogEvent::ptr event(new yuan::LogEvent(logger, yuan::LogLevel::INFO, __FILE__, line
+        , yuan::GetThreadId(), 0, t, 0, "main"));
+    event->getSS() << "formatter bench line xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+    return event;
+}
+
+// 和原来的格式化结果逐字节一致，跨秒时时间缓存要更新
+void test_same_output() {
+    yuan::LogFormatter formatter(s_pattern);
+    YUAN_ASSERT(!formatter.isError());
+    time_t now = time(nullptr);
+    for (int i = 0; i < 5; ++i) {
+        yuan::LogEvent::ptr event = make_event(g_logger, now + i / 2, -i * 1234567);
+        std::string expect = legacy_format(yuan::LogLevel::INFO, event);
+        std::string actual = formatter.format(g_logger, yuan::LogLevel::INFO, event);
+        YUAN_ASSERT2(expect == actual, expect + actual);
+    }
+
+    // 两个格式器的时间格式不同，缓存不能串
+    yuan::LogFormatter f1("%d{%H}|%r|%%|%x");
+    yuan::LogFormatter f2("%d{%Y}");
+    YUAN_ASSERT(f1.isError());
+    yuan::LogEvent::ptr event = make_event(g_logger, now, 1);
+    std::string s1 = f1.format(g_logger, yuan::LogLevel::INFO, event);
+    std::string s2 = f2.format(g_logger, yuan::LogLevel::INFO, event);
+    YUAN_ASSERT2(s1.size() > 4 && s1.substr(2, 3) == "|0|", s1);
+    YUAN_ASSERT2(s2.size() == 4, s2);
+    YUAN_LOG_INFO(g_logger) << "test_same_output ok, " << s1 << " " << s2;
+}
+
+void bench() {
+    yuan::LogFormatter formatter(s_pattern);
+    yuan::LogEvent::ptr event = make_event(g_logger, time(nullptr), __LINE__);
+    const int lines = 200000;
+    size_t bytes = 0;
+
+    uint64_t start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < lines; ++i) {
+        bytes += legacy_format(yuan::LogLevel::INFO, event).size();
+    }
+    uint64_t legacy_us = yuan::GetCurrentTimeUS() - start;
+
+    yuan::LogStream stream;
+    start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < lines; ++i) {
+        stream.reset();
+        formatter.format(stream, g_logger, yuan::LogLevel::INFO, event);
+        bytes += stream.size();
+    }
+    uint64_t compiled_us = yuan::GetCurrentTimeUS() - start;
+
+    YUAN_LOG_INFO(g_logger) << "lines=" << lines << " bytes=" << bytes
+        << " legacy ns/line=" << legacy_us * 1000.0 / lines
+        << " compiled ns/line=" << compiled_us * 1000.0 / lines
+        << " speedup=" << static_cast<double>(legacy_us) / (compiled_us ? compiled_us : 1);
+}
+
+int main(int argc, char **argv) {
+    test_same_output();
+    bench();
+    return 0;
+}
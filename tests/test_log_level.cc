@@ -0,0 +1,101 @@
+#include "../yuan/yuan_all_headers.h"
+
+// 这个文件里把编译期的日志级别下限提到WARN，DEBUG、INFO的日志语句应当被整条去掉
+#undef YUAN_LOG_ACTIVE_LEVEL
+#define YUAN_LOG_ACTIVE_LEVEL 3
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static int s_evaluated = 0;
+
+static int side_effect() {
+    ++s_evaluated;
+    return s_evaluated;
+}
+
+class CountLogAppender : public yuan::LogAppender {
+public:
+    virtual void log(const std::shared_ptr<yuan::Logger> &logger, yuan::LogLevel::Level level
+                    , const yuan::LogEvent::ptr &event) override {
+        ++count;
+        last = event->getContent();
+    }
+    std::string toYAMLString() override { return ""; }
+
+    int count = 0;
+    std::string last;
+};
+
+// 低于下限的语句不输出，参数也不求值；不低于下限的仍按logger的级别过滤
+void test_compile_level() {
+    yuan::Logger::ptr logger(new yuan::Logger("level"));
+    std::shared_ptr<CountLogAppender> appender(new CountLogAppender);
+    logger->addAppender(appender);
+    logger->setLevel(yuan::LogLevel::DEBUG);
+
+    YUAN_LOG_DEBUG(logger) << side_effect();
+    YUAN_LOG_INFO(logger) << side_effect();
+    YUAN_LOG_FMT_INFO(logger, "%d", side_effect());
+    YUAN_LOG_INFO_LIMIT(logger, 10, 1000) << side_effect();
+    YUAN_DLOG_DEBUG(logger) << side_effect();
+    YUAN_ASSERT2(s_evaluated == 0 && appender->count == 0, std::to_string(s_evaluated));
+
+    YUAN_LOG_WARN(logger) << "warn " << side_effect();
+    YUAN_ASSERT(s_evaluated == 1 && appender->count == 1 && appender->last == "warn 1");
+    logger->setLevel(yuan::LogLevel::ERROR);
+    YUAN_LOG_WARN(logger) << side_effect();
+    YUAN_LOG_ERROR(logger) << "error";
+    YUAN_ASSERT(s_evaluated == 1 && appender->count == 2 && appender->last == "error");
+    YUAN_LOG_INFO(g_logger) << "test_compile_level ok";
+}
+
+// YUAN_DASSERT只在定义了NDEBUG时去掉
+void test_dassert() {
+    s_evaluated = 0;
+    YUAN_DASSERT(side_effect() == 1);
+#ifdef NDEBUG
+    YUAN_ASSERT(s_evaluated == 0);
+#else
+    YUAN_ASSERT(s_evaluated == 1);
+#endif
+    YUAN_LOG_WARN(g_logger) << "test_dassert ok";
+}
+
+// 断言失败的日志带上表达式、附加信息和调用点的文件行号
+void test_assert_failed() {
+    yuan::Logger::ptr root = YUAN_GET_ROOT_LOGGER();
+    std::shared_ptr<CountLogAppender> appender(new CountLogAppender);
+    root->addAppender(appender);
+    yuan::AssertFailed(__FILE__, __LINE__, "1 == 2", "extra info");
+    root->delAppender(appender);
+    YUAN_ASSERT2(appender->count == 1 && appender->last.find("ASSERTION: 1 == 2\nextra info\nbacktrace\n") == 0
+        && appender->last.find("test_assert_failed") != std::string::npos, appender->last);
+    YUAN_LOG_WARN(g_logger) << "test_assert_failed ok";
+}
+
+// 编译期去掉的语句和运行时被过滤的语句的开销
+void bench() {
+    yuan::Logger::ptr logger(new yuan::Logger("level"));
+    logger->setLevel(yuan::LogLevel::FATAL);
+    const int n = 10000000;
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        YUAN_LOG_ERROR(logger) << "runtime filtered " << i;
+    }
+    uint64_t runtime_ns = yuan::Clock::MonotonicNs() - start;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        YUAN_LOG_DEBUG(logger) << "compiled out " << i;
+    }
+    uint64_t compiled_ns = yuan::Clock::MonotonicNs() - start;
+    YUAN_LOG_WARN(g_logger) << "ns/statement runtime filtered=" << static_cast<double>(runtime_ns) / n
+        << " compiled out=" << static_cast<double>(compiled_ns) / n;
+}
+
+int main(int argc, char **argv) {
+    test_compile_level();
+    test_dassert();
+    test_assert_failed();
+    bench();
+    return 0;
+}
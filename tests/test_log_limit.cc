@@ -0,0 +1,108 @@
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 只记录输出了哪些日志
+class CollectLogAppender : public yuan::LogAppender {
+public:
+    virtual void log(const std::shared_ptr<yuan::Logger> &logger, yuan::LogLevel::Level level
+                    , const yuan::LogEvent::ptr &event) override {
+        yuan::Mutex::Lock lock(m_lock);
+        lines.push_back(event->getContent());
+    }
+    std::string toYAMLString() override { return ""; }
+
+    yuan::Mutex m_lock;
+    std::vector<std::string> lines;
+};
+
+static yuan::Logger::ptr make_logger(std::shared_ptr<CollectLogAppender> &appender) {
+    yuan::Logger::ptr logger(new yuan::Logger("limit"));
+    appender.reset(new CollectLogAppender);
+    logger->addAppender(appender);
+    return logger;
+}
+
+// 每个周期最多n条，下个周期的第一条带上被压制的条数
+void test_limit() {
+    std::shared_ptr<CollectLogAppender> appender;
+    yuan::Logger::ptr logger = make_logger(appender);
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 10000; ++i) {
+            YUAN_LOG_ERROR_LIMIT(logger, 5, 200) << "accept errno=24 i=" << i;
+        }
+        usleep(250 * 1000);
+    }
+    YUAN_LOG_ERROR_LIMIT(logger, 5, 200) << "other site";
+    YUAN_ASSERT2(appender->lines.size() == 11, std::to_string(appender->lines.size()));
+    YUAN_ASSERT2(appender->lines[4] == "accept errno=24 i=4", appender->lines[4]);
+    YUAN_ASSERT2(appender->lines[5] == "[suppressed 9995 messages] accept errno=24 i=0", appender->lines[5]);
+    YUAN_ASSERT2(appender->lines[10] == "other site", appender->lines[10]);
+
+    // 级别不够的不计数
+    logger->setLevel(yuan::LogLevel::FATAL);
+    appender->lines.clear();
+    for (int i = 0; i < 100; ++i) {
+        YUAN_LOG_ERROR_LIMIT(logger, 1, 1000) << "filtered";
+    }
+    YUAN_ASSERT(appender->lines.empty());
+    YUAN_LOG_INFO(g_logger) << "test_limit ok";
+}
+
+// 每n条输出一条
+void test_sample() {
+    std::shared_ptr<CollectLogAppender> appender;
+    yuan::Logger::ptr logger = make_logger(appender);
+    for (int i = 0; i < 1000; ++i) {
+        YUAN_LOG_WARN_SAMPLE(logger, 100) << "sample i=" << i;
+    }
+    YUAN_ASSERT2(appender->lines.size() == 10, std::to_string(appender->lines.size()));
+    YUAN_ASSERT2(appender->lines[1] == "sample i=100", appender->lines[1]);
+    YUAN_LOG_INFO(g_logger) << "test_sample ok";
+}
+
+// 多线程同时刷一个调用点，输出的条数仍然受限
+void test_threads() {
+    std::shared_ptr<CollectLogAppender> appender;
+    yuan::Logger::ptr logger = make_logger(appender);
+    std::vector<yuan::Thread::ptr> thrs;
+    for (int i = 0; i < 4; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([logger](){
+            for (int j = 0; j < 100000; ++j) {
+                YUAN_LOG_ERROR_LIMIT(logger, 20, 1000) << "thread line " << j;
+            }
+        }, "limit_" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    YUAN_ASSERT2(appender->lines.size() >= 20 && appender->lines.size() <= 40, std::to_string(appender->lines.size()));
+    YUAN_LOG_INFO(g_logger) << "test_threads ok, lines=" << appender->lines.size();
+}
+
+// 被压制时的开销
+void bench() {
+    std::shared_ptr<CollectLogAppender> appender;
+    yuan::Logger::ptr logger = make_logger(appender);
+    const int n = 1000000;
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        YUAN_LOG_ERROR_LIMIT(logger, 1, 60000) << "bench " << i;
+    }
+    uint64_t limit_ns = yuan::Clock::MonotonicNs() - start;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        YUAN_LOG_ERROR_SAMPLE(logger, 1000000) << "bench " << i;
+    }
+    uint64_t sample_ns = yuan::Clock::MonotonicNs() - start;
+    YUAN_LOG_INFO(g_logger) << "suppressed ns/call limit=" << static_cast<double>(limit_ns) / n
+        << " sample=" << static_cast<double>(sample_ns) / n;
+}
+
+int main(int argc, char **argv) {
+    test_limit();
+    test_sample();
+    test_threads();
+    bench();
+    return 0;
+}
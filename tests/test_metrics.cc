@@ -0,0 +1,107 @@
+#include "../yuan/iomanager.h"
+#include "../yuan/metrics.h"
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+void test_histogram() {
+    yuan::Histogram h;
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        h.record(i);
+    }
+    YUAN_ASSERT(h.getCount() == 1000);
+    YUAN_ASSERT(h.getMax() == 1000);
+    YUAN_ASSERT(h.getSum() == 500500);
+    // 分位数是桶的上界，误差在2倍以内
+    YUAN_ASSERT(h.percentile(0.5) >= 500 && h.percentile(0.5) < 1024);
+    YUAN_ASSERT(h.percentile(1) == 1000);
+    YUAN_LOG_INFO(g_logger) << "histogram: " << h.toString();
+}
+
+void test_scheduler_metrics() {
+    yuan::Scheduler::SetHistogramsEnabled(true);
+    yuan::IOManager iom(2, false, "metrics");
+    static std::atomic<int> s_count = {0};
+    for (int i = 0; i < 10000; ++i) {
+        iom.schedule([](){
+            ++s_count;
+        });
+    }
+    // 还要有定时器和sleep，统计到epoll_wait的唤醒
+    iom.schedule([](){
+        usleep(10 * 1000);
+    });
+    while (s_count < 10000) {
+        usleep(1000);
+    }
+    usleep(50 * 1000);
+
+    std::vector<yuan::SchedulerThreadMetrics::ptr> metrics;
+    iom.getThreadMetrics(metrics);
+    uint64_t tasks = 0;
+    uint64_t runs = 0;
+    for (auto &m : metrics) {
+        tasks += m->tasks;
+        runs += m->runUs.getCount();
+    }
+    YUAN_ASSERT(metrics.size() == 2);
+    YUAN_ASSERT(tasks >= 10001);
+    YUAN_ASSERT(runs >= 10001);
+    YUAN_LOG_INFO(g_logger) << "\n" << iom.dumpMetrics();
+    yuan::Scheduler::SetHistogramsEnabled(false);
+}
+
+static yuan::IOManager *s_bench_iom = nullptr;
+static int s_bench_left = 0;
+static std::atomic<bool> s_bench_done = {false};
+
+// 空任务，执行完再把自己放回队列，队列里始终只有一个任务，测的就是调度本身的开销
+static void bench_task() {
+    if (--s_bench_left > 0) {
+        s_bench_iom->schedule(&bench_task);
+    } else {
+        s_bench_done = true;
+    }
+}
+
+static uint64_t bench_once(int n) {
+    s_bench_left = n;
+    s_bench_done = false;
+    uint64_t start = yuan::Clock::MonotonicNs();
+    s_bench_iom->schedule(&bench_task);
+    while (!s_bench_done) {
+        usleep(100);
+    }
+    return yuan::Clock::MonotonicNs() - start;
+}
+
+// 直方图开和关时，一个线程满负载执行空任务每个任务的耗时。开关交替跑几轮取各自最好的一次
+void bench() {
+    const int n = 200000;
+    const int rounds = 5;
+    yuan::IOManager iom(1, false, "bench");
+    s_bench_iom = &iom;
+    bench_once(n);
+
+    uint64_t off = UINT64_MAX;
+    uint64_t on = UINT64_MAX;
+    for (int i = 0; i < rounds; ++i) {
+        yuan::Scheduler::SetHistogramsEnabled(false);
+        off = std::min(off, bench_once(n));
+        yuan::Scheduler::SetHistogramsEnabled(true);
+        on = std::min(on, bench_once(n));
+    }
+    yuan::Scheduler::SetHistogramsEnabled(false);
+    s_bench_iom = nullptr;
+
+    YUAN_LOG_INFO(g_logger) << "empty task ns/task: histograms off=" << static_cast<double>(off) / n
+        << " on=" << static_cast<double>(on) / n
+        << " overhead=" << (static_cast<double>(on) - off) * 100 / off << "%";
+}
+
+int main(int argc, char **argv) {
+    test_histogram();
+    test_scheduler_metrics();
+    bench();
+    return 0;
+}
@@ -0,0 +1,282 @@
+#include <atomic>
+#include <thread>
+#include "../yuan/yuan_all_headers.h"
+#include "../yuan/log_config.h"
+#include "../yuan/net_log_appender.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 本地的日志收集端：在普通线程里阻塞地收，按行统计
+class Collector {
+public:
+    Collector(bool udp) : m_udp(udp) {
+        yuan::Address::ptr addr = yuan::IPAddress::Create("127.0.0.1", 0);
+        m_sock = udp ? yuan::Socket::CreateUDP(addr) : yuan::Socket::CreateTCP(addr);
+        YUAN_ASSERT(m_sock->bind(addr));
+        if (!udp) {
+            YUAN_ASSERT(m_sock->listen());
+        }
+        m_sock->setRecvTimeout(100);
+        m_thread.reset(new yuan::Thread(std::bind(&Collector::run, this), "collector"));
+    }
+
+    ~Collector() {
+        m_stop = true;
+        m_thread->join();
+    }
+
+    std::string address() {
+        return m_sock->getLocalAddress()->toString();
+    }
+
+    // 等到收到count行，超时返回false
+    bool wait(size_t count, uint64_t timeout_ms = 5000) {
+        uint64_t start = yuan::GetCurrentTimeMS();
+        while (yuan::GetCurrentTimeMS() - start < timeout_ms) {
+            if (lines() >= count) {
+                return true;
+            }
+            usleep(10 * 1000);
+        }
+        return false;
+    }
+
+    size_t lines() {
+        yuan::Mutex::Lock lock(m_mutex);
+        return m_lines.size();
+    }
+
+    std::vector<std::string> getLines() {
+        yuan::Mutex::Lock lock(m_mutex);
+        return m_lines;
+    }
+
+    // 断开当前连接，模拟收集端重启
+    void dropConnection() { m_drop = true; }
+    size_t datagrams() const { return m_datagrams; }
+private:
+    void add(const char *data, size_t len) {
+        yuan::Mutex::Lock lock(m_mutex);
+        m_partial.append(data, len);
+        size_t pos = 0;
+        while (true) {
+            size_t n = m_partial.find('\n', pos);
+            if (n == std::string::npos) {
+                break;
+            }
+            m_lines.push_back(m_partial.substr(pos, n - pos));
+            pos = n + 1;
+        }
+        m_partial.erase(0, pos);
+    }
+
+    void run() {
+        char buf[70000];
+        yuan::Socket::ptr client;
+        while (!m_stop) {
+            if (m_udp) {
+                // 没有connect的UDP socket，Socket::recv会直接返回-1，用系统调用收
+                int n = ::recv(m_sock->getSocketFd(), buf, sizeof(buf), 0);
+                if (n > 0) {
+                    ++m_datagrams;
+                    add(buf, n);
+                }
+                continue;
+            }
+            if (m_drop && client) {
+                client->close();
+                client.reset();
+                m_drop = false;
+                yuan::Mutex::Lock lock(m_mutex);
+                m_partial.clear();
+            }
+            if (!client) {
+                client = m_sock->accept();
+                if (client) {
+                    client->setRecvTimeout(100);
+                }
+                continue;
+            }
+            int n = client->recv(buf, sizeof(buf));
+            if (n > 0) {
+                add(buf, n);
+            } else if (n == 0) {
+                client.reset();
+            }
+        }
+    }
+private:
+    bool m_udp;
+    yuan::Socket::ptr m_sock;
+    yuan::Thread::ptr m_thread;
+    std::atomic<bool> m_stop = {false};
+    std::atomic<bool> m_drop = {false};
+    std::atomic<size_t> m_datagrams = {0};
+    yuan::Mutex m_mutex;
+    std::string m_partial;
+    std::vector<std::string> m_lines;
+};
+
+static yuan::Logger::ptr make_logger(yuan::LogAppender::ptr appender) {
+    yuan::Logger::ptr logger(new yuan::Logger("net"));
+    logger->setFormatter("%m%n");
+    logger->addAppender(appender);
+    return logger;
+}
+
+// TCP：按批发送，收集端断开后重连，日志不丢
+void test_tcp() {
+    Collector collector(false);
+    yuan::NetworkLogAppender::ptr appender(new yuan::NetworkLogAppender(collector.address()
+        , yuan::NetworkLogAppender::TCP, 100000, 4096, 10));
+    yuan::Logger::ptr logger = make_logger(appender);
+    for (int i = 0; i < 1000; ++i) {
+        YUAN_LOG_INFO(logger) << "tcp line " << i;
+    }
+    YUAN_ASSERT2(collector.wait(1000), std::to_string(collector.lines()));
+    YUAN_ASSERT(appender->isConnected());
+
+    collector.dropConnection();
+    usleep(200 * 1000);
+    for (int i = 1000; i < 2000; ++i) {
+        YUAN_LOG_INFO(logger) << "tcp line " << i;
+        if (i % 100 == 0) {
+            usleep(10 * 1000);
+        }
+    }
+    YUAN_ASSERT2(collector.wait(2000), std::to_string(collector.lines()));
+    // 重发可能导致重复，但每一行都要收到
+    std::set<std::string> seen;
+    for (auto &line : collector.getLines()) {
+        seen.insert(line);
+    }
+    for (int i = 0; i < 2000; ++i) {
+        YUAN_ASSERT2(seen.count("tcp line " + std::to_string(i)), i);
+    }
+    YUAN_LOG_INFO(g_logger) << "test_tcp ok, received=" << collector.lines() << " sent=" << appender->getSent();
+}
+
+// UDP：多行拼进一个数据报，行不会被拆开
+void test_udp() {
+    Collector collector(true);
+    yuan::NetworkLogAppender::ptr appender(new yuan::NetworkLogAppender(collector.address()
+        , yuan::NetworkLogAppender::UDP, 10000, 1024, 10));
+    yuan::Logger::ptr logger = make_logger(appender);
+    for (int i = 0; i < 500; ++i) {
+        YUAN_LOG_INFO(logger) << "udp line " << i;
+    }
+    YUAN_ASSERT2(collector.wait(500), std::to_string(collector.lines()));
+    std::vector<std::string> lines = collector.getLines();
+    for (int i = 0; i < 500; ++i) {
+        YUAN_ASSERT2(lines[i] == "udp line " + std::to_string(i), lines[i]);
+    }
+    YUAN_ASSERT2(collector.datagrams() < 100, collector.datagrams());
+    YUAN_LOG_INFO(g_logger) << "test_udp ok, datagrams=" << collector.datagrams();
+}
+
+// 收集端不在时，写日志不阻塞，超出队列的被丢弃
+void test_bounded() {
+    yuan::Address::ptr addr = yuan::IPAddress::Create("127.0.0.1", 0);
+    yuan::Socket::ptr sock = yuan::Socket::CreateTCP(addr);
+    YUAN_ASSERT(sock->bind(addr));
+    // 只绑定不监听，连接会被拒绝
+    std::string address = sock->getLocalAddress()->toString();
+    yuan::NetworkLogAppender::ptr appender(new yuan::NetworkLogAppender(address
+        , yuan::NetworkLogAppender::TCP, 1024, 4096, 10));
+    yuan::Logger::ptr logger = make_logger(appender);
+    uint64_t start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < 20000; ++i) {
+        YUAN_LOG_INFO(logger) << "bounded line " << i;
+    }
+    uint64_t used = yuan::GetCurrentTimeUS() - start;
+    YUAN_ASSERT2(appender->getDropped() >= 20000 - 1024, appender->getDropped());
+    YUAN_ASSERT(!appender->isConnected());
+    YUAN_LOG_INFO(g_logger) << "test_bounded ok, dropped=" << appender->getDropped()
+        << " us/line=" << static_cast<double>(used) / 20000;
+}
+
+// 收集端连不上、发送协程在退避中时，析构不用等完退避时间和连接超时
+void test_stop_in_backoff() {
+    yuan::Address::ptr addr = yuan::IPAddress::Create("127.0.0.1", 0);
+    yuan::Socket::ptr sock = yuan::Socket::CreateTCP(addr);
+    YUAN_ASSERT(sock->bind(addr));
+    std::string address = sock->getLocalAddress()->toString();
+    yuan::NetworkLogAppender::ptr appender(new yuan::NetworkLogAppender(address
+        , yuan::NetworkLogAppender::TCP, 1024, 4096, 10));
+    yuan::Logger::ptr logger = make_logger(appender);
+    YUAN_LOG_INFO(logger) << "never sent";
+    // 退避时间涨到800ms以上：100+200+400+800
+    usleep(1600 * 1000);
+    logger->clearAppenders();
+    uint64_t start = yuan::GetCurrentTimeMS();
+    appender.reset();
+    uint64_t used = yuan::GetCurrentTimeMS() - start;
+    YUAN_ASSERT2(used < 300, used);
+    YUAN_LOG_INFO(g_logger) << "test_stop_in_backoff ok, destruct ms=" << used;
+}
+
+// 通过log.yml配置
+void test_config() {
+    Collector collector(false);
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: net_cfg\n"
+        "    level: info\n"
+        "    formatter: \"%m%n\"\n"
+        "    appenders:\n"
+        "      - type: NetworkLogAppender\n"
+        "        address: " + collector.address() + "\n"
+        "        protocol: tcp\n"
+        "        queue_size: 1000\n"
+        "        batch_size: 8192\n"
+        "        flush_interval: 10\n");
+    yuan::Config::LoadFromYaml(root);
+    yuan::Logger::ptr logger = YUAN_GET_LOGGER("net_cfg");
+    std::string yaml = logger->toYAMLString();
+    YUAN_ASSERT2(yaml.find("NetworkLogAppender") != std::string::npos
+        && yaml.find("queue_size: 1024") != std::string::npos, yaml);
+    YUAN_LOG_INFO(logger) << "config line";
+    YUAN_ASSERT(collector.wait(1));
+    YUAN_ASSERT2(collector.getLines()[0] == "config line", collector.getLines()[0]);
+    logger->clearAppenders();
+    YUAN_LOG_INFO(g_logger) << "test_config ok";
+}
+
+// root上配了NetworkLogAppender时clearAppenders：appender析构要停发送线程，
+// 发送线程退出时写的日志又会走到root，不能在root的锁里析构
+void test_clear_root() {
+    yuan::Logger::ptr root = YUAN_GET_ROOT_LOGGER();
+    root->clearAppenders();
+    root->addAppender(yuan::LogAppender::ptr(new yuan::NetworkLogAppender("127.0.0.1:1"
+        , yuan::NetworkLogAppender::TCP, 1024, 4096, 10)));
+    YUAN_LOG_INFO(root) << "to nowhere";
+    // 等发送协程至少连一次失败、写过错误日志
+    usleep(200 * 1000);
+
+    std::atomic<bool> done = {false};
+    std::thread t([root, &done]() {
+        root->clearAppenders();
+        done = true;
+    });
+    uint64_t start = yuan::GetCurrentTimeMS();
+    while (!done && yuan::GetCurrentTimeMS() - start < 10000) {
+        usleep(10 * 1000);
+    }
+    if (!done) {
+        fprintf(stderr, "test_clear_root: clearAppenders deadlocked\n");
+        abort();
+    }
+    t.join();
+    root->addAppender(yuan::LogAppender::ptr(new yuan::StdoutLogAppender));
+    YUAN_LOG_INFO(g_logger) << "test_clear_root ok";
+}
+
+int main(int argc, char **argv) {
+    test_tcp();
+    test_udp();
+    test_bounded();
+    test_stop_in_backoff();
+    test_config();
+    test_clear_root();
+    return 0;
+}
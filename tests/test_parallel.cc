@@ -0,0 +1,112 @@
+#include "../yuan/iomanager.h"
+#include "../yuan/parallel.h"
+#include "../yuan/yuan_all_headers.h"
+
+#include <math.h>
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 模拟CPU密集的计算
+static double heavy(size_t i) {
+    double v = i;
+    for (int k = 0; k < 200; ++k) {
+        v = sqrt(v + k) * 1.0001;
+    }
+    return v;
+}
+
+void test_correctness(yuan::Scheduler *scheduler) {
+    const size_t n = 100000;
+    std::vector<int> touched(n, 0);
+    yuan::parallel_for(0, n, 1000, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            ++touched[i];
+        }
+    }, scheduler);
+    for (size_t i = 0; i < n; ++i) {
+        YUAN_ASSERT(touched[i] == 1);
+    }
+
+    uint64_t sum = yuan::parallel_reduce(0, n, 1000, (uint64_t)0, [](size_t b, size_t e) {
+        uint64_t s = 0;
+        for (size_t i = b; i < e; ++i) {
+            s += i;
+        }
+        return s;
+    }, [](uint64_t a, uint64_t b) { return a + b; }, scheduler);
+    YUAN_ASSERT(sum == (uint64_t)n * (n - 1) / 2);
+
+    // reduce只要求结合律，按区间顺序拼接字符串可以验证顺序
+    std::string str = yuan::parallel_reduce(0, 26, 3, std::string(), [](size_t b, size_t e) {
+        std::string s;
+        for (size_t i = b; i < e; ++i) {
+            s.push_back('a' + i);
+        }
+        return s;
+    }, [](const std::string &a, const std::string &b) { return a + b; }, scheduler);
+    YUAN_ASSERT(str == "abcdefghijklmnopqrstuvwxyz");
+
+    std::vector<int> vec(n);
+    for (auto &v : vec) {
+        v = rand();
+    }
+    yuan::parallel_sort(vec.begin(), vec.end(), 4096, scheduler);
+    YUAN_ASSERT(std::is_sorted(vec.begin(), vec.end()));
+    YUAN_LOG_INFO(g_logger) << "correctness ok";
+}
+
+// 在调度器的协程里调用，只挂起协程，且可以嵌套
+void test_in_fiber() {
+    yuan::IOManager iom(2, false, "parallel");
+    yuan::Semaphore sem;
+    iom.schedule([&sem](){
+        std::vector<int> out(64, 0);
+        yuan::parallel_for(0, 8, 1, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                yuan::parallel_for(i * 8, i * 8 + 8, 2, [&](size_t b2, size_t e2) {
+                    for (size_t j = b2; j < e2; ++j) {
+                        out[j] = j;
+                    }
+                });
+            }
+        });
+        for (int i = 0; i < 64; ++i) {
+            YUAN_ASSERT(out[i] == i);
+        }
+        test_correctness(yuan::Scheduler::GetThis());
+        sem.post();
+    });
+    sem.wait();
+}
+
+// 不同线程数下的耗时，计算量相同，理想情况下耗时和线程数成反比
+void bench() {
+    const size_t n = 200000;
+    std::vector<double> out(n);
+    uint64_t base_us = 0;
+    for (size_t threads = 1; threads <= 8; threads *= 2) {
+        yuan::IOManager iom(threads, false, "bench");
+        uint64_t start = yuan::GetCurrentTimeUS();
+        yuan::parallel_for(0, n, 1000, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                out[i] = heavy(i);
+            }
+        }, &iom);
+        uint64_t used = yuan::GetCurrentTimeUS() - start;
+        if (threads == 1) {
+            base_us = used;
+        }
+        YUAN_LOG_INFO(g_logger) << "parallel_for threads=" << threads << " used_us=" << used
+            << " speedup=" << (double)base_us / used;
+    }
+}
+
+int main(int argc, char **argv) {
+    {
+        yuan::IOManager iom(2, false, "parallel");
+        test_correctness(&iom);
+    }
+    test_in_fiber();
+    bench();
+    return 0;
+}
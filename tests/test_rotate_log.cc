@@ -0,0 +1,185 @@
+#include "../yuan/yuan_all_headers.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+static const std::string s_dir = "rotate_log_test";
+static const std::string s_file = s_dir + "/rotate.log";
+
+// 列出滚动出来的旧文件
+static std::vector<std::string> list_rotated() {
+    std::vector<std::string> files;
+    DIR *d = opendir(s_dir.c_str());
+    YUAN_ASSERT(d);
+    while (struct dirent *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.compare(0, 11, "rotate.log.") == 0) {
+            files.push_back(s_dir + "/" + name);
+        }
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// 数文件里的行数，.gz用zlib读
+static size_t count_lines(const std::string &path) {
+    gzFile gz = gzopen(path.c_str(), "rb");
+    YUAN_ASSERT(gz);
+    char buf[4096];
+    size_t lines = 0;
+    int n = 0;
+    while ((n = gzread(gz, buf, sizeof(buf))) > 0) {
+        lines += std::count(buf, buf + n, '\n');
+    }
+    gzclose(gz);
+    return lines;
+}
+
+static void clear_dir() {
+    mkdir(s_dir.c_str(), 0755);
+    DIR *d = opendir(s_dir.c_str());
+    YUAN_ASSERT(d);
+    while (struct dirent *entry = readdir(d)) {
+        if (entry->d_name[0] != '.') {
+            unlink((s_dir + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(d);
+}
+
+static yuan::Logger::ptr make_logger(yuan::LogAppender::ptr appender) {
+    yuan::Logger::ptr logger = YUAN_GET_LOGGER("rotate");
+    logger->clearAppenders();
+    logger->addAppender(appender);
+    return logger;
+}
+
+// 按大小滚动，旧文件压缩成.gz，不限个数时一行都不能丢
+void test_size() {
+    clear_dir();
+    yuan::RotatingFileLogAppender::ptr appender(new yuan::RotatingFileLogAppender(s_file, 64 * 1024, 0, 0, true));
+    yuan::Logger::ptr logger = make_logger(appender);
+    const int threads = 4;
+    const int lines = 5000;
+    std::vector<yuan::Thread::ptr> thrs;
+    for (int i = 0; i < threads; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([logger, lines](){
+            for (int j = 0; j < lines; ++j) {
+                YUAN_LOG_INFO(logger) << "rotate size line " << j << " xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+            }
+        }, "rotate_" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    appender->waitBackground();
+
+    std::vector<std::string> files = list_rotated();
+    YUAN_ASSERT(files.size() > 5);
+    size_t total = count_lines(s_file);
+    for (auto &file : files) {
+        YUAN_ASSERT2(file.size() > 3 && file.compare(file.size() - 3, 3, ".gz") == 0, file);
+        total += count_lines(file);
+    }
+    YUAN_ASSERT2(total == static_cast<size_t>(threads) * lines, std::to_string(total));
+    YUAN_LOG_INFO(g_logger) << "test_size ok, rotated files=" << files.size() << " lines=" << total;
+    logger->clearAppenders();
+}
+
+// 只保留最新的max_files个旧文件
+void test_retention() {
+    clear_dir();
+    yuan::RotatingFileLogAppender::ptr appender(new yuan::RotatingFileLogAppender(s_file, 0, 0, 3, false));
+    yuan::Logger::ptr logger = make_logger(appender);
+    for (int i = 0; i < 8; ++i) {
+        YUAN_LOG_INFO(logger) << "rotate retention " << i;
+        appender->rotate();
+    }
+    appender->waitBackground();
+    std::vector<std::string> files = list_rotated();
+    YUAN_ASSERT2(files.size() == 3, std::to_string(files.size()));
+    // 保留的是最后三次滚动出来的
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::ifstream ifs(files[i]);
+        std::string line;
+        std::getline(ifs, line);
+        YUAN_ASSERT2(line.find("rotate retention " + std::to_string(5 + i)) != std::string::npos, line);
+    }
+    YUAN_LOG_INFO(g_logger) << "test_retention ok";
+    logger->clearAppenders();
+}
+
+// 按时间滚动：间隔1秒，跨秒写日志会滚动
+void test_interval() {
+    clear_dir();
+    yuan::RotatingFileLogAppender::ptr appender(new yuan::RotatingFileLogAppender(s_file, 0, 1, 0, true));
+    yuan::Logger::ptr logger = make_logger(appender);
+    for (int i = 0; i < 3; ++i) {
+        YUAN_LOG_INFO(logger) << "rotate interval " << i;
+        usleep(1100 * 1000);
+    }
+    appender->waitBackground();
+    std::vector<std::string> files = list_rotated();
+    YUAN_ASSERT2(files.size() >= 2, std::to_string(files.size()));
+    YUAN_LOG_INFO(g_logger) << "test_interval ok, rotated files=" << files.size();
+    logger->clearAppenders();
+}
+
+// 析构时不等后台线程：还没压缩的旧文件由后台线程在appender析构后继续处理完
+void test_destroy_pending() {
+    clear_dir();
+    {
+        yuan::RotatingFileLogAppender::ptr appender(new yuan::RotatingFileLogAppender(s_file, 0, 0, 0, true));
+        yuan::Logger::ptr logger = make_logger(appender);
+        for (int i = 0; i < 20000; ++i) {
+            YUAN_LOG_INFO(logger) << "rotate pending line " << i << " xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+        }
+        appender->rotate();
+        logger->clearAppenders();
+    }
+    uint64_t start = yuan::GetCurrentTimeMS();
+    std::vector<std::string> files;
+    while (yuan::GetCurrentTimeMS() - start < 10000) {
+        files = list_rotated();
+        if (files.size() == 1 && files[0].compare(files[0].size() - 3, 3, ".gz") == 0) {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    YUAN_ASSERT2(files.size() == 1 && files[0].compare(files[0].size() - 3, 3, ".gz") == 0
+        , files.empty() ? "" : files[0]);
+    YUAN_ASSERT2(count_lines(files[0]) == 20000, std::to_string(count_lines(files[0])));
+    YUAN_LOG_INFO(g_logger) << "test_destroy_pending ok";
+}
+
+// 通过配置创建
+void test_config() {
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: rotate_cfg\n"
+        "    level: info\n"
+        "    appenders:\n"
+        "      - type: RotatingFileLogAppender\n"
+        "        file: " + s_dir + "/cfg.log\n"
+        "        max_size: 1024\n"
+        "        max_files: 2\n"
+        "        compress: false\n");
+    yuan::Config::LoadFromYaml(root);
+    std::string yaml = YUAN_GET_LOGGER("rotate_cfg")->toYAMLString();
+    YUAN_ASSERT2(yaml.find("RotatingFileLogAppender") != std::string::npos
+        && yaml.find("max_size: 1024") != std::string::npos, yaml);
+    YUAN_LOG_INFO(g_logger) << "test_config ok";
+}
+
+int main(int argc, char **argv) {
+    test_size();
+    test_retention();
+    test_interval();
+    test_destroy_pending();
+    test_config();
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 写者保证a和b始终相等，读者在读锁内检查
+struct Table {
+    uint64_t a = 0;
+    uint64_t b = 0;
+};
+
+/**
+ * @brief threads个线程各执行ops次操作，每write_every次操作里有一次写，其余为读
+ * @return 每秒操作数
+ */
+template<typename RWMutexType>
+uint64_t bench(int threads, uint64_t ops, uint64_t write_every) {
+    RWMutexType mutex;
+    Table table;
+    std::vector<yuan::Thread::ptr> thrs;
+    uint64_t start = yuan::GetCurrentTimeUS();
+    for (int i = 0; i < threads; ++i) {
+        thrs.push_back(yuan::Thread::ptr(new yuan::Thread([&mutex, &table, ops, write_every](){
+            uint64_t sum = 0;
+            for (uint64_t k = 1; k <= ops; ++k) {
+                if (write_every && k % write_every == 0) {
+                    typename RWMutexType::WriteLock lock(mutex);
+                    ++table.a;
+                    ++table.b;
+                } else {
+                    typename RWMutexType::ReadLock lock(mutex);
+                    YUAN_ASSERT(table.a == table.b);
+                    sum += table.a;
+                }
+            }
+            (void)sum;
+        }, "rw_" + std::to_string(i))));
+    }
+    for (auto &t : thrs) {
+        t->join();
+    }
+    uint64_t used = yuan::GetCurrentTimeUS() - start;
+    YUAN_ASSERT(table.a == (write_every ? (ops / write_every) * threads : 0));
+    return threads * ops * 1000000.0 / (used ? used : 1);
+}
+
+int main(int argc, char **argv) {
+    uint64_t ops = argc > 1 ? atoll(argv[1]) : 1000000;
+    for (uint64_t write_every : {0, 1000, 100}) {
+        YUAN_LOG_INFO(g_logger) << "==== write ratio: "
+            << (write_every ? "1/" + std::to_string(write_every) : std::string("0"));
+        for (int threads = 1; threads <= 8; threads *= 2) {
+            uint64_t rw = bench<yuan::RWMutex>(threads, ops, write_every);
+            uint64_t brw = bench<yuan::BRWMutex>(threads, ops, write_every);
+            YUAN_LOG_INFO(g_logger) << "threads=" << threads << " RWMutex ops/s=" << rw
+                << " BRWMutex ops/s=" << brw << " ratio=" << (double)brw / rw;
+        }
+    }
+    return 0;
+}
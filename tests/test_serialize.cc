@@ -0,0 +1,221 @@
+#include "../yuan/bytearray.h"
+#include "../yuan/serialize.h"
+#include "../yuan/yuan_all_headers.h"
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+struct Point {
+    Point(int32_t x_ = 0, int32_t y_ = 0) : x(x_), y(y_) {}
+    int32_t x;
+    int32_t y;
+    YUAN_SERIALIZE_FIELDS(x, y)
+
+    bool operator==(const Point &o) const { return x == o.x && y == o.y; }
+};
+
+struct Message {
+    bool flag = false;
+    int8_t i8 = 0;
+    uint16_t u16 = 0;
+    int32_t i32 = 0;
+    uint32_t u32 = 0;
+    int64_t i64 = 0;
+    uint64_t u64 = 0;
+    float f = 0;
+    double d = 0;
+    std::string name;
+    Point pos;
+    std::vector<uint32_t> ids;
+    std::vector<int64_t> timestamps;
+    std::vector<std::string> tags;
+    std::vector<Point> path;
+    std::map<std::string, Point> named;
+    std::unordered_map<uint32_t, std::vector<std::string> > groups;
+    YUAN_SERIALIZE_FIELDS(flag, i8, u16, i32, u32, i64, u64, f, d, name, pos,
+                          ids, timestamps, tags, path, named, groups)
+
+    bool operator==(const Message &o) const {
+        return flag == o.flag && i8 == o.i8 && u16 == o.u16 && i32 == o.i32 && u32 == o.u32
+            && i64 == o.i64 && u64 == o.u64 && f == o.f && d == o.d && name == o.name && pos == o.pos
+            && ids == o.ids && timestamps == o.timestamps && tags == o.tags && path == o.path
+            && named == o.named && groups == o.groups;
+    }
+};
+
+static Message make_message(int n) {
+    Message m;
+    m.flag = true;
+    m.i8 = -5;
+    m.u16 = 0xabcd;
+    m.i32 = -123456;
+    m.u32 = 4000000000U;
+    m.i64 = -1234567890123LL;
+    m.u64 = ~0ULL;
+    m.f = 1.5f;
+    m.d = -3.25;
+    m.name = "message";
+    m.pos = {-1, 2};
+    for (int i = 0; i < n; ++i) {
+        m.ids.push_back(i * 37);
+        m.timestamps.push_back(1700000000000LL + i);
+        m.tags.push_back("tag" + std::to_string(i));
+        m.path.push_back({i, -i});
+        m.named["p" + std::to_string(i)] = {i * 2, i * 3};
+        m.groups[i].push_back(std::to_string(i));
+    }
+    return m;
+}
+
+// 和手写的逐个写入编码相同
+static void write_by_hand(yuan::ByteArray &ba, const Point &p) {
+    ba.writeInt32(p.x);
+    ba.writeInt32(p.y);
+}
+
+void test_compatible() {
+    Message m = make_message(3);
+    m.groups.clear();
+    for (size_t base_len : {1, 7, 4096}) {
+        for (bool little : {false, true}) {
+            yuan::ByteArray by_hand(base_len), generated(base_len);
+            by_hand.setIsLittleEndian(little);
+            generated.setIsLittleEndian(little);
+            by_hand.writeFuint8(m.flag);
+            by_hand.writeFint8(m.i8);
+            by_hand.writeFuint16(m.u16);
+            by_hand.writeInt32(m.i32);
+            by_hand.writeUint32(m.u32);
+            by_hand.writeInt64(m.i64);
+            by_hand.writeUint64(m.u64);
+            by_hand.writeFloat(m.f);
+            by_hand.writeDouble(m.d);
+            by_hand.writeStringVint(m.name);
+            write_by_hand(by_hand, m.pos);
+            by_hand.writeUint64(m.ids.size());
+            for (auto i : m.ids) {
+                by_hand.writeUint32(i);
+            }
+            by_hand.writeUint64(m.timestamps.size());
+            for (auto i : m.timestamps) {
+                by_hand.writeInt64(i);
+            }
+            by_hand.writeUint64(m.tags.size());
+            for (auto &i : m.tags) {
+                by_hand.writeStringVint(i);
+            }
+            by_hand.writeUint64(m.path.size());
+            for (auto &i : m.path) {
+                write_by_hand(by_hand, i);
+            }
+            by_hand.writeUint64(m.named.size());
+            for (auto &i : m.named) {
+                by_hand.writeStringVint(i.first);
+                write_by_hand(by_hand, i.second);
+            }
+            by_hand.writeUint64(0);
+
+            // 前面已有数据时也是写在position处
+            generated.writeStringVint("head");
+            size_t size = yuan::Serialize(generated, m);
+            YUAN_ASSERT(size == yuan::SerializedSize(m) && size == by_hand.getSize());
+            YUAN_ASSERT(generated.getPosition() == generated.getSize());
+            generated.setPosition(0);
+            YUAN_ASSERT(generated.readStringVint() == "head");
+            by_hand.setPosition(0);
+            YUAN_ASSERT(generated.toString() == by_hand.toString());
+        }
+    }
+    YUAN_LOG_INFO(g_logger) << "test_compatible ok";
+}
+
+void test_roundtrip() {
+    for (size_t base_len : {3, 4096}) {
+        Message m = make_message(100);
+        yuan::ByteArray ba(base_len);
+        yuan::Serialize(ba, m);
+        yuan::Serialize(ba, m.pos);
+        ba.setPosition(0);
+        Message out;
+        Point pos;
+        yuan::Deserialize(ba, out);
+        yuan::Deserialize(ba, pos);
+        YUAN_ASSERT(out == m && pos == m.pos && ba.getReadSize() == 0);
+    }
+
+    // 数据不完整、个数不对都抛出异常，不会按错误的个数分配内存
+    Message m = make_message(10);
+    yuan::ByteArray ba;
+    size_t size = yuan::Serialize(ba, m);
+    for (size_t cut : {size - 1, size / 2, static_cast<size_t>(1)}) {
+        yuan::ByteArray part;
+        ba.setPosition(0);
+        std::string data = ba.toString().substr(0, cut);
+        part.write(data.data(), data.size());
+        part.setPosition(0);
+        bool thrown = false;
+        try {
+            Message out;
+            yuan::Deserialize(part, out);
+        } catch (std::out_of_range &) {
+            thrown = true;
+        }
+        YUAN_ASSERT(thrown);
+    }
+    yuan::ByteArray bad;
+    bad.writeUint64(1ULL << 40);
+    bad.setPosition(0);
+    bool thrown = false;
+    try {
+        std::vector<std::string> out;
+        yuan::Deserialize(bad, out);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    YUAN_ASSERT(thrown);
+    YUAN_LOG_INFO(g_logger) << "test_roundtrip ok";
+}
+
+// 生成的代码和手写逐个write的对比
+void bench() {
+    const int n = 20000;
+    std::vector<Point> points(64);
+    for (size_t i = 0; i < points.size(); ++i) {
+        points[i] = {static_cast<int32_t>(i * 1000), -static_cast<int32_t>(i)};
+    }
+    Message m = make_message(16);
+    m.path = points;
+
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        yuan::ByteArray ba;
+        ba.writeUint64(m.path.size());
+        for (auto &p : m.path) {
+            write_by_hand(ba, p);
+        }
+        for (auto &t : m.tags) {
+            ba.writeStringVint(t);
+        }
+        for (auto t : m.timestamps) {
+            ba.writeInt64(t);
+        }
+    }
+    uint64_t used_hand = yuan::Clock::MonotonicNs() - start;
+
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        yuan::ByteArray ba;
+        yuan::Serialize(ba, m.path);
+        yuan::Serialize(ba, m.tags);
+        yuan::Serialize(ba, m.timestamps);
+    }
+    uint64_t used_gen = yuan::Clock::MonotonicNs() - start;
+    YUAN_LOG_INFO(g_logger) << "encode ns/message: by hand=" << static_cast<double>(used_hand) / n
+        << " generated=" << static_cast<double>(used_gen) / n;
+}
+
+int main(int argc, char **argv) {
+    test_compatible();
+    test_roundtrip();
+    bench();
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "../yuan/bytearray.h"
+#include "../yuan/slab_allocator.h"
+#include "../yuan/yuan_all_headers.h"
+#include <string.h>
+
+static yuan::Logger::ptr g_logger = YUAN_GET_ROOT_LOGGER();
+
+// 各种大小都能分配，内容互不覆盖，释放后的块被重复使用
+void test_basic() {
+    std::vector<std::pair<char*, size_t> > blocks;
+    for (size_t size : {1, 63, 64, 65, 1000, 4096, 4097, 65536, 65537, 200000}) {
+        for (int i = 0; i < 20; ++i) {
+            char *p = static_cast<char*>(yuan::SlabAllocator::Alloc(size));
+            memset(p, static_cast<int>(blocks.size() & 0xff), size);
+            blocks.push_back({p, size});
+        }
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        for (size_t k = 0; k < blocks[i].second; k += 61) {
+            YUAN_ASSERT(static_cast<unsigned char>(blocks[i].first[k]) == (i & 0xff));
+        }
+    }
+    for (auto &i : blocks) {
+        yuan::SlabAllocator::Free(i.first, i.second);
+    }
+
+    yuan::SlabAllocator::Stats before = yuan::SlabAllocator::GetStats();
+    void *p = yuan::SlabAllocator::Alloc(4096);
+    yuan::SlabAllocator::Free(p, 4096);
+    YUAN_ASSERT(yuan::SlabAllocator::Alloc(4096) == p);
+    yuan::SlabAllocator::Free(p, 4096);
+    yuan::SlabAllocator::Stats after = yuan::SlabAllocator::GetStats();
+    YUAN_ASSERT(after.hits == before.hits + 2);
+    YUAN_ASSERT(after.allocs == before.allocs + 2 && after.frees == before.frees + 2);
+    YUAN_ASSERT(after.largeAllocs == 40);
+    YUAN_LOG_INFO(g_logger) << "test_basic ok, " << after;
+}
+
+// 一个线程分配，另一个线程释放，最后所有块都回到空闲链表
+void test_cross_thread() {
+    const int n = 100000;
+    yuan::SlabAllocator::Stats before = yuan::SlabAllocator::GetStats();
+    std::vector<void*> ptrs(n);
+    yuan::Thread::ptr producer(new yuan::Thread([&ptrs](){
+        for (size_t i = 0; i < ptrs.size(); ++i) {
+            ptrs[i] = yuan::SlabAllocator::Alloc(512);
+            memset(ptrs[i], 1, 512);
+        }
+    }, "slab_alloc"));
+    producer->join();
+    yuan::Thread::ptr consumer(new yuan::Thread([&ptrs](){
+        for (auto &i : ptrs) {
+            yuan::SlabAllocator::Free(i, 512);
+        }
+    }, "slab_free"));
+    consumer->join();
+    yuan::SlabAllocator::Stats after = yuan::SlabAllocator::GetStats();
+    YUAN_ASSERT(after.allocs - before.allocs == n && after.frees - before.frees == n);
+    // 两个线程都退出了，缓存的块都还给了全局
+    YUAN_ASSERT(after.centralCachedBlocks >= before.centralCachedBlocks + n);
+    YUAN_LOG_INFO(g_logger) << "test_cross_thread ok, " << after;
+}
+
+// 打开大页后新的slab用2MB的块，系统没有预留大页时退化为普通页，都要能用
+void test_huge_page() {
+    yuan::ConfigVar<bool>::ptr huge = yuan::Config::Lookup<bool>("bytearray.huge_page");
+    YUAN_ASSERT(huge);
+    huge->setValue(true);
+    yuan::SlabAllocator::Stats before = yuan::SlabAllocator::GetStats();
+    std::vector<void*> ptrs;
+    // 用一个还没用过的分级，保证会新建slab
+    for (int i = 0; i < 100; ++i) {
+        ptrs.push_back(yuan::SlabAllocator::Alloc(32 * 1024));
+        memset(ptrs.back(), 2, 32 * 1024);
+    }
+    for (auto &i : ptrs) {
+        yuan::SlabAllocator::Free(i, 32 * 1024);
+    }
+    yuan::SlabAllocator::Stats after = yuan::SlabAllocator::GetStats();
+    YUAN_ASSERT(after.slabBytes - before.slabBytes >= 2 * 1024 * 1024);
+    huge->setValue(false);
+    YUAN_LOG_INFO(g_logger) << "test_huge_page ok, huge_page_slabs=" << after.hugePageSlabs;
+}
+
+// echo服务的典型写法：每次循环clear后再getWriteBuffers
+void bench() {
+    const int n = 200000;
+    yuan::ByteArray::ptr ba(new yuan::ByteArray(4096));
+    std::vector<iovec> iovs;
+    yuan::SlabAllocator::Stats before = yuan::SlabAllocator::GetStats();
+    uint64_t start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        ba->clear();
+        iovs.clear();
+        ba->getWriteBuffers(iovs, 16 * 1024);
+    }
+    uint64_t used = yuan::Clock::MonotonicNs() - start;
+    yuan::SlabAllocator::Stats after = yuan::SlabAllocator::GetStats();
+    YUAN_ASSERT(after.slabs == before.slabs);
+
+    YUAN_LOG_INFO(g_logger) << "clear+getWriteBuffers(16KB) ns/loop=" << static_cast<double>(used) / n
+        << " hits=" << after.hits - before.hits;
+
+    // 单纯分配释放4块4KB
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        void *bufs[4];
+        for (auto &b : bufs) {
+            b = yuan::SlabAllocator::Alloc(4096);
+            static_cast<char*>(b)[0] = 0;
+        }
+        for (auto &b : bufs) {
+            yuan::SlabAllocator::Free(b, 4096);
+        }
+    }
+    uint64_t used_slab = yuan::Clock::MonotonicNs() - start;
+    start = yuan::Clock::MonotonicNs();
+    for (int i = 0; i < n; ++i) {
+        char *bufs[4];
+        for (auto &b : bufs) {
+            b = new char[4096];
+            b[0] = 0;
+        }
+        for (auto &b : bufs) {
+            delete [] b;
+        }
+    }
+    uint64_t used_new = yuan::Clock::MonotonicNs() - start;
+    YUAN_LOG_INFO(g_logger) << "4 x 4KB alloc+free ns/loop: slab=" << static_cast<double>(used_slab) / n
+        << " new[]/delete[]=" << static_cast<double>(used_new) / n;
+}
+
+int main(int argc, char **argv) {
+    test_basic();
+    test_cross_thread();
+    test_huge_page();
+    bench();
+    return 0;
+}
@@ -0,0 +1,528 @@
+#include "binlog.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "bytearray.h"
+#include "clock.h"
+
+namespace yuan {
+
+static Logger::ptr g_logger = YUAN_GET_LOGGER("system");
+
+static const char s_magic[] = "YBLG";
+static const uint32_t s_version = 1;
+
+enum BinLogTag {
+    TAG_SITE = 1,
+    TAG_CHUNK = 2
+};
+
+// 所有注册过的调用点，下标为id-1。调用点是静态变量，不会被释放
+struct BinLogSiteInfo {
+    BinLogSite *site;
+    const char *types;
+};
+
+static Mutex &GetSitesMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+static std::vector<BinLogSiteInfo> &GetSites() {
+    static std::vector<BinLogSiteInfo> s_sites;
+    return s_sites;
+}
+
+uint32_t BinLogger::RegisterSite(BinLogSite &site, const char *types) {
+    Mutex::Lock lock(GetSitesMutex());
+    uint32_t id = site.id.load(std::memory_order_relaxed);
+    if (id) {
+        return id;
+    }
+    std::vector<BinLogSiteInfo> &sites = GetSites();
+    sites.push_back({&site, types});
+    id = sites.size();
+    site.id.store(id, std::memory_order_release);
+    return id;
+}
+
+// 单生产者单消费者的字节环形缓冲区，结构同AsyncFileLogAppender::Buffer。里面都是完整的记录
+struct BinLogger::Buffer {
+    Buffer(size_t size)
+        : threadId(GetThreadId())
+        , threadName(Thread::GetName()) {
+        size_t cap = 4096;
+        while (cap < size) {
+            cap <<= 1;
+        }
+        mask = cap - 1;
+        data.reset(new char[cap]);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    char pad0[YUAN_CACHELINE_SIZE];
+    // 消费者修改
+    std::atomic<size_t> head = {0};
+    char pad1[YUAN_CACHELINE_SIZE];
+    // 生产者修改
+    std::atomic<size_t> tail = {0};
+    char pad2[YUAN_CACHELINE_SIZE];
+    size_t mask;
+    std::unique_ptr<char[]> data;
+    pid_t threadId;
+    std::string threadName;
+    // 缓冲区尾部的连续空间不够时，先编码到这里再分两段拷贝
+    std::string scratch;
+    // BinLogger析构后置位，线程局部表里的这一项可以删了
+    std::atomic<bool> dead = {false};
+};
+
+static void AppendVarint(std::string &out, uint64_t v) {
+    char buf[10];
+    out.append(buf, binlog_detail::PutVarint(buf, v) - buf);
+}
+
+static void AppendString(std::string &out, const char *str, size_t len) {
+    AppendVarint(out, len);
+    out.append(str, len);
+}
+
+static std::atomic<uint64_t> s_binlogger_id = {0};
+// 当前线程在各个BinLogger里的缓冲区，key为BinLogger的id。再缓存最近用的一个，省去查表。
+// 持有引用是为了让后台线程知道线程是否已退出；BinLogger析构后对应的项在下次查表未命中时清掉
+static thread_local std::unordered_map<uint64_t, std::shared_ptr<BinLogger::Buffer> > t_binlog_buffers;
+static thread_local uint64_t t_last_binlogger_id = 0;
+static thread_local BinLogger::Buffer *t_last_binlog_buffer = nullptr;
+
+BinLogger::BinLogger(const std::string &name, const std::string &filename, size_t buffer_size
+        , uint32_t flush_interval_ms, LogLevel::Level level)
+    : m_name(name)
+    , m_filename(filename)
+    , m_bufferSize(buffer_size)
+    , m_flushInterval(flush_interval_ms ? flush_interval_ms : 1)
+    , m_level(level)
+    , m_id(++s_binlogger_id) {
+    m_buffersMutex.setName("BinLogger::m_buffersMutex");
+    m_writeMutex.setName("BinLogger::m_writeMutex");
+    m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        YUAN_LOG_ERROR(g_logger) << "BinLogger open file=" << m_filename << " errno=" << errno
+            << " strerr=" << strerror(errno);
+    }
+    // 追加写时文件里可能已经有别的进程写的内容，每次打开都写文件头，解码时遇到文件头就重置调用点表
+    std::string header(s_magic, 4);
+    AppendVarint(header, s_version);
+    AppendString(header, m_name.data(), m_name.size());
+    writeAll(header.data(), header.size());
+    m_thread.reset(new Thread(std::bind(&BinLogger::run, this), "binlog_flusher"));
+}
+
+BinLogger::~BinLogger() {
+    // 后台线程退出前会把所有缓冲区写完
+    m_stopping = true;
+    m_semaphore.post();
+    m_thread->join();
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    // 还活着的线程的缓冲区由它们的线程局部表持有，先把内存还掉，只留一个空壳等它们清理
+    for (auto &buffer : m_buffers) {
+        buffer->data.reset();
+        std::string().swap(buffer->scratch);
+        buffer->dead.store(true, std::memory_order_release);
+    }
+}
+
+BinLogger::Buffer *BinLogger::getBuffer() {
+    if (YUAN_LIKELY(t_last_binlogger_id == m_id)) {
+        return t_last_binlog_buffer;
+    }
+    Buffer *buffer = nullptr;
+    auto it = t_binlog_buffers.find(m_id);
+    if (it != t_binlog_buffers.end()) {
+        buffer = it->second.get();
+    } else {
+        // 顺便清掉已经析构的BinLogger留下的项
+        for (auto cur = t_binlog_buffers.begin(); cur != t_binlog_buffers.end();) {
+            if (cur->second->dead.load(std::memory_order_acquire)) {
+                cur = t_binlog_buffers.erase(cur);
+            } else {
+                ++cur;
+            }
+        }
+        std::shared_ptr<Buffer> ptr(new Buffer(m_bufferSize));
+        {
+            Mutex::Lock lock(m_buffersMutex);
+            m_buffers.push_back(ptr);
+        }
+        t_binlog_buffers[m_id] = ptr;
+        buffer = ptr.get();
+    }
+    t_last_binlogger_id = m_id;
+    t_last_binlog_buffer = buffer;
+    return buffer;
+}
+
+char *BinLogger::reserve(Buffer *buffer, size_t max) {
+    size_t t = buffer->tail.load(std::memory_order_relaxed);
+    size_t free = buffer->capacity() - (t - buffer->head.load(std::memory_order_acquire));
+    if (YUAN_UNLIKELY(free < max)) {
+        // 按最大长度估计，可能实际放得下，但调试日志不值得为此多编码一次
+        ++m_dropped;
+        m_semaphore.post();
+        return nullptr;
+    }
+    size_t pos = t & buffer->mask;
+    if (YUAN_LIKELY(buffer->capacity() - pos >= max)) {
+        return &buffer->data[pos];
+    }
+    buffer->scratch.resize(max);
+    return &buffer->scratch[0];
+}
+
+void BinLogger::commit(Buffer *buffer, char *p, size_t len) {
+    size_t t = buffer->tail.load(std::memory_order_relaxed);
+    if (YUAN_UNLIKELY(p == buffer->scratch.data())) {
+        size_t pos = t & buffer->mask;
+        size_t first = std::min(len, buffer->capacity() - pos);
+        memcpy(&buffer->data[pos], p, first);
+        memcpy(&buffer->data[0], p + first, len - first);
+    }
+    buffer->tail.store(t + len, std::memory_order_release);
+}
+
+char *BinLogger::writeHeader(char *p, uint32_t id) {
+    p = binlog_detail::PutVarint(p, id);
+    p = binlog_detail::PutVarint(p, Clock::WallUs());
+    return binlog_detail::PutVarint(p, GetFiberId());
+}
+
+void BinLogger::flush() {
+    Mutex::Lock lock(m_writeMutex);
+    drain();
+}
+
+void BinLogger::writeAll(const char *data, size_t len) {
+    if (m_fd < 0) {
+        return;
+    }
+    while (len > 0) {
+        ssize_t n = write(m_fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            YUAN_LOG_ERROR(g_logger) << "BinLogger write file=" << m_filename << " errno=" << errno
+                << " strerr=" << strerror(errno);
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void BinLogger::drain() {
+    std::vector<std::shared_ptr<Buffer> > buffers;
+    {
+        Mutex::Lock lock(m_buffersMutex);
+        buffers = m_buffers;
+    }
+    // 先读各缓冲区的tail，再取调用点表：读到的记录引用的调用点一定已经注册
+    std::vector<size_t> tails(buffers.size());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        tails[i] = buffers[i]->tail.load(std::memory_order_acquire);
+    }
+
+    m_out.clear();
+    {
+        Mutex::Lock lock(GetSitesMutex());
+        const std::vector<BinLogSiteInfo> &sites = GetSites();
+        for (; m_writtenSites < sites.size(); ++m_writtenSites) {
+            const BinLogSiteInfo &info = sites[m_writtenSites];
+            m_out.push_back(TAG_SITE);
+            AppendVarint(m_out, m_writtenSites + 1);
+            AppendVarint(m_out, info.site->level);
+            AppendVarint(m_out, info.site->line);
+            AppendString(m_out, info.site->file, strlen(info.site->file));
+            AppendString(m_out, info.site->fmt, strlen(info.site->fmt));
+            AppendString(m_out, info.types, strlen(info.types));
+        }
+    }
+
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        Buffer *buffer = buffers[i].get();
+        size_t h = buffer->head.load(std::memory_order_relaxed);
+        size_t len = tails[i] - h;
+        if (len == 0) {
+            continue;
+        }
+        m_out.push_back(TAG_CHUNK);
+        AppendVarint(m_out, buffer->threadId);
+        AppendString(m_out, buffer->threadName.data(), buffer->threadName.size());
+        AppendVarint(m_out, len);
+        size_t pos = h & buffer->mask;
+        size_t first = std::min(len, buffer->capacity() - pos);
+        m_out.append(&buffer->data[pos], first);
+        m_out.append(&buffer->data[0], len - first);
+        buffer->head.store(tails[i], std::memory_order_release);
+    }
+    if (!m_out.empty()) {
+        writeAll(m_out.data(), m_out.size());
+    }
+    // 不让偶尔的大批次一直占着内存
+    if (m_out.capacity() > 4 * 1024 * 1024) {
+        std::string().swap(m_out);
+    }
+
+    // 线程已经退出（只剩这里的引用）且数据写完的缓冲区可以释放了
+    Mutex::Lock lock(m_buffersMutex);
+    for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+        // buffers里还有一份引用
+        if (it->use_count() == 2 && (*it)->head == (*it)->tail) {
+            it = m_buffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void BinLogger::run() {
+    while (true) {
+        m_semaphore.timedwait(m_flushInterval);
+        // 先读标志再写文件：析构时置位之前写入的记录，一定会在这一轮被写完
+        bool stopping = m_stopping;
+        {
+            Mutex::Lock lock(m_writeMutex);
+            drain();
+        }
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+/**
+ * BinLogDecoder的实现
+ */
+namespace {
+
+struct DecodedSite {
+    LogLevel::Level level = LogLevel::UNKNOWN;
+    uint32_t line = 0;
+    std::string file;
+    std::string fmt;
+    std::string types;
+};
+
+struct DecodedArg {
+    char type;
+    int64_t i;
+    uint64_t u;
+    double f;
+    std::string s;
+};
+
+}
+
+// 把一个转换说明（不含长度修饰符和转换字符）按参数的实际类型补全后格式化
+static void AppendArg(std::string &out, std::string spec, char conv, const DecodedArg &arg) {
+    char buf[128];
+    int n = 0;
+    switch (arg.type) {
+        case 'i':
+        case 'c':
+            if (conv == 'c') {
+                n = snprintf(buf, sizeof(buf), (spec + "c").c_str(), static_cast<int>(arg.i));
+            } else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+                n = snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), static_cast<unsigned long long>(arg.i));
+            } else {
+                n = snprintf(buf, sizeof(buf), (spec + "lld").c_str(), static_cast<long long>(arg.i));
+            }
+            break;
+        case 'u':
+            if (conv == 'c') {
+                n = snprintf(buf, sizeof(buf), (spec + "c").c_str(), static_cast<int>(arg.u));
+            } else if (conv == 'x' || conv == 'X' || conv == 'o') {
+                n = snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), static_cast<unsigned long long>(arg.u));
+            } else {
+                n = snprintf(buf, sizeof(buf), (spec + "llu").c_str(), static_cast<unsigned long long>(arg.u));
+            }
+            break;
+        case 'f':
+            if (strchr("fFeEgGaA", conv) == nullptr) {
+                conv = 'g';
+            }
+            n = snprintf(buf, sizeof(buf), (spec + conv).c_str(), arg.f);
+            break;
+        case 'p':
+            n = snprintf(buf, sizeof(buf), (spec + "p").c_str(), reinterpret_cast<void*>(arg.u));
+            break;
+        case 's':
+            if (spec == "%") {
+                out.append(arg.s);
+                return;
+            }
+            n = snprintf(buf, sizeof(buf), (spec + "s").c_str(), arg.s.c_str());
+            break;
+        default:
+            return;
+    }
+    if (n > 0) {
+        out.append(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1));
+    }
+}
+
+static void FormatMessage(std::string &out, const std::string &fmt, const std::vector<DecodedArg> &args) {
+    size_t next = 0;
+    for (size_t i = 0; i < fmt.size(); ++i) {
+        if (fmt[i] != '%') {
+            out.push_back(fmt[i]);
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            out.push_back('%');
+            ++i;
+            continue;
+        }
+        // 标志、宽度、精度原样保留
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0123456789.", fmt[j])) {
+            ++j;
+        }
+        std::string spec = fmt.substr(i, j - i);
+        // 长度修饰符忽略，按实际类型决定
+        while (j < fmt.size() && strchr("hlLqjzt", fmt[j])) {
+            ++j;
+        }
+        if (j >= fmt.size()) {
+            out.append(fmt, i, std::string::npos);
+            return;
+        }
+        if (next < args.size()) {
+            AppendArg(out, spec, fmt[j], args[next++]);
+        } else {
+            out.append(fmt, i, j - i + 1);
+        }
+        i = j;
+    }
+}
+
+int64_t BinLogDecoder::DecodeFile(const std::string &filename, std::ostream &os) {
+    ByteArray ba;
+    if (!ba.readFromFile(filename)) {
+        return -1;
+    }
+    ba.setPosition(0);
+    ba.setIsLittleEndian(true);
+
+    std::vector<DecodedSite> sites;
+    std::vector<DecodedArg> args;
+    std::string logger_name;
+    std::string line;
+    int64_t count = 0;
+    try {
+        while (ba.getReadSize() > 0) {
+            uint8_t tag = ba.readFuint8();
+            if (tag == static_cast<uint8_t>(s_magic[0])) {
+                char magic[3];
+                ba.read(magic, 3);
+                if (memcmp(magic, s_magic + 1, 3) != 0) {
+                    return -1;
+                }
+                uint32_t version = ba.readUint32();
+                if (version != s_version) {
+                    YUAN_LOG_ERROR(g_logger) << "BinLogDecoder unknown version=" << version;
+                    return -1;
+                }
+                logger_name = ba.readStringVint();
+                sites.clear();
+            } else if (tag == TAG_SITE) {
+                uint32_t id = ba.readUint32();
+                if (id == 0) {
+                    return -1;
+                }
+                if (sites.size() < id) {
+                    sites.resize(id);
+                }
+                DecodedSite &site = sites[id - 1];
+                site.level = static_cast<LogLevel::Level>(ba.readUint32());
+                site.line = ba.readUint32();
+                site.file = ba.readStringVint();
+                site.fmt = ba.readStringVint();
+                site.types = ba.readStringVint();
+            } else if (tag == TAG_CHUNK) {
+                uint64_t thread_id = ba.readUint64();
+                std::string thread_name = ba.readStringVint();
+                uint64_t len = ba.readUint64();
+                size_t end = ba.getPosition() + len;
+                while (ba.getPosition() < end) {
+                    uint32_t id = ba.readUint32();
+                    if (id == 0 || id > sites.size()) {
+                        YUAN_LOG_ERROR(g_logger) << "BinLogDecoder unknown site id=" << id;
+                        return -1;
+                    }
+                    const DecodedSite &site = sites[id - 1];
+                    uint64_t time_us = ba.readUint64();
+                    uint64_t fiber_id = ba.readUint64();
+                    args.resize(site.types.size());
+                    for (size_t k = 0; k < site.types.size(); ++k) {
+                        DecodedArg &arg = args[k];
+                        arg.type = site.types[k];
+                        switch (arg.type) {
+                            case 'i':
+                                arg.i = ba.readInt64();
+                                break;
+                            case 'u':
+                            case 'p':
+                                arg.u = ba.readUint64();
+                                break;
+                            case 'c':
+                                arg.i = static_cast<char>(ba.readFuint8());
+                                break;
+                            case 'f':
+                                arg.f = ba.readDouble();
+                                break;
+                            case 's':
+                                arg.s = ba.readStringVint();
+                                break;
+                            default:
+                                return -1;
+                        }
+                    }
+
+                    char buf[64];
+                    time_t sec = time_us / 1000000;
+                    struct tm tm;
+                    localtime_r(&sec, &tm);
+                    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+                    snprintf(buf + n, sizeof(buf) - n, ".%06u", static_cast<uint32_t>(time_us % 1000000));
+                    line.clear();
+                    line.append(buf).append("\t").append(std::to_string(thread_id))
+                        .append("\t").append(thread_name).append("\t").append(std::to_string(fiber_id))
+                        .append("\t[").append(LogLevel::ToString(site.level)).append("]\t[")
+                        .append(logger_name).append("]\t<").append(site.file).append(":")
+                        .append(std::to_string(site.line)).append(">\t");
+                    FormatMessage(line, site.fmt, args);
+                    line.push_back('\n');
+                    os.write(line.data(), line.size());
+                    ++count;
+                }
+            } else {
+                YUAN_LOG_ERROR(g_logger) << "BinLogDecoder unknown tag=" << static_cast<int>(tag)
+                    << " position=" << ba.getPosition() - 1;
+                return -1;
+            }
+        }
+    } catch (std::out_of_range &e) {
+        // 文件被截断（比如进程崩溃时最后一批没写完）
+        YUAN_LOG_ERROR(g_logger) << "BinLogDecoder file=" << filename << " truncated after "
+            << count << " records";
+        return -1;
+    }
+    return count;
+}
+
+}
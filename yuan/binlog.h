@@ -0,0 +1,264 @@
+#ifndef __YUAN_BINLOG_H__
+#define __YUAN_BINLOG_H__
+
+/**
+ * @file binlog.h
+ * 二进制日志（延迟格式化）。调用处不做任何文本格式化，只记录调用点的id和参数的原始值，
+ * 由离线工具（samples/binlog_decoder.cc，或者BinLogDecoder）还原成文本。用于量很大的调试日志
+ *
+ * 用法和YUAN_LOG_FMT_xxx一样，格式串为printf风格：
+ *     static yuan::BinLogger::ptr g_binlog(new yuan::BinLogger("rpc", "rpc.binlog"));
+ *     YUAN_BINLOG_DEBUG(g_binlog, "recv fd=%d len=%zu from %s", fd, len, peer.c_str());
+ * 格式串必须是字符串字面量（只保存指针）。参数支持整数、浮点、bool、字符串(const char* / std::string)和指针。
+ * 整数按实际类型编码，格式串里的长度修饰符（l、ll、z等）解码时会被忽略，不会出现printf类型不匹配的问题
+ *
+ * 文件格式，整数都是varint（同ByteArray::writeUint64），有符号数先zigzag，字符串为varint长度+内容，浮点为8字节小端：
+ *     文件头：  "YBLG" 版本号 logger名
+ *     调用点：  1 id 级别 行号 文件名 格式串 参数类型串
+ *     数据块：  2 线程id 线程名 字节数 记录...
+ *     记录：    调用点id 时间(微秒) 协程id 参数...
+ * 调用点第一次被使用时注册，后台线程在写出引用它的记录之前先写出它的定义，所以文件是自描述的
+ */
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+#include "log.h"
+#include "macro.h"
+#include "thread.h"
+
+#define YUAN_BINLOG_LEVEL(binlogger, lvl, fmt, ...) \
+    do { \
+        static yuan::BinLogSite _yuan_binlog_site = {fmt, __FILE__, __LINE__, lvl, {0}}; \
+        if ((lvl) >= YUAN_LOG_ACTIVE_LEVEL && lvl >= (binlogger)->getLevel()) { \
+            (binlogger)->log(_yuan_binlog_site, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define YUAN_BINLOG_DEBUG(binlogger, fmt, ...) YUAN_BINLOG_LEVEL(binlogger, yuan::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define YUAN_BINLOG_INFO(binlogger, fmt, ...) YUAN_BINLOG_LEVEL(binlogger, yuan::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define YUAN_BINLOG_WARN(binlogger, fmt, ...) YUAN_BINLOG_LEVEL(binlogger, yuan::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define YUAN_BINLOG_ERROR(binlogger, fmt, ...) YUAN_BINLOG_LEVEL(binlogger, yuan::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+
+namespace yuan {
+
+// 一个调用点，静态存储，常量初始化，不需要加锁
+struct BinLogSite {
+    const char *fmt;
+    const char *file;
+    int line;
+    LogLevel::Level level;
+    // 全局唯一的id，0为还没注册
+    std::atomic<uint32_t> id;
+};
+
+namespace binlog_detail {
+
+// 参数的编码。TYPE写入调用点的类型串，解码时据此读取：i有符号整数 u无符号整数 c字符 f浮点 s字符串 p指针
+template<class T, class Enable = void>
+struct Arg;
+
+inline char *PutVarint(char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
+
+inline char *PutString(char *p, const char *str, size_t len) {
+    p = PutVarint(p, len);
+    memcpy(p, str, len);
+    return p + len;
+}
+
+template<class T>
+struct Arg<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value
+        && !std::is_same<T, char>::value>::type> {
+    static const char TYPE = 'i';
+    static size_t MaxSize(T) { return 10; }
+    static char *Encode(char *p, T v) {
+        int64_t s = v;
+        return PutVarint(p, (static_cast<uint64_t>(s) << 1) ^ static_cast<uint64_t>(s >> 63));
+    }
+};
+
+template<class T>
+struct Arg<T, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value
+        && !std::is_same<T, bool>::value && !std::is_same<T, char>::value>::type> {
+    static const char TYPE = 'u';
+    static size_t MaxSize(T) { return 10; }
+    static char *Encode(char *p, T v) { return PutVarint(p, v); }
+};
+
+template<>
+struct Arg<bool> {
+    static const char TYPE = 'u';
+    static size_t MaxSize(bool) { return 1; }
+    static char *Encode(char *p, bool v) { *p = v ? 1 : 0; return p + 1; }
+};
+
+template<>
+struct Arg<char> {
+    static const char TYPE = 'c';
+    static size_t MaxSize(char) { return 1; }
+    static char *Encode(char *p, char v) { *p = v; return p + 1; }
+};
+
+template<class T>
+struct Arg<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static const char TYPE = 'f';
+    static size_t MaxSize(T) { return 8; }
+    static char *Encode(char *p, T v) {
+        double d = v;
+        memcpy(p, &d, 8);
+        return p + 8;
+    }
+};
+
+template<>
+struct Arg<const char*> {
+    static const char TYPE = 's';
+    static size_t MaxSize(const char *v) { return 10 + (v ? strlen(v) : 0); }
+    static char *Encode(char *p, const char *v) { return v ? PutString(p, v, strlen(v)) : PutVarint(p, 0); }
+};
+
+template<>
+struct Arg<char*> : public Arg<const char*> {};
+
+template<>
+struct Arg<std::string> {
+    static const char TYPE = 's';
+    static size_t MaxSize(const std::string &v) { return 10 + v.size(); }
+    static char *Encode(char *p, const std::string &v) { return PutString(p, v.data(), v.size()); }
+};
+
+template<class T>
+struct Arg<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+    static const char TYPE = 'p';
+    static size_t MaxSize(const T*) { return 10; }
+    static char *Encode(char *p, const T *v) { return PutVarint(p, reinterpret_cast<uintptr_t>(v)); }
+};
+
+template<class T>
+struct ArgOf : public Arg<typename std::decay<T>::type> {};
+
+// 编译期生成的参数类型串
+template<class... Args>
+struct Types {
+    static const char value[sizeof...(Args) + 1];
+};
+
+template<class... Args>
+const char Types<Args...>::value[sizeof...(Args) + 1] = {ArgOf<Args>::TYPE..., '\0'};
+
+inline size_t MaxSize() { return 0; }
+
+template<class T, class... Args>
+size_t MaxSize(const T &v, const Args&... args) {
+    return ArgOf<T>::MaxSize(v) + MaxSize(args...);
+}
+
+inline char *Encode(char *p) { return p; }
+
+template<class T, class... Args>
+char *Encode(char *p, const T &v, const Args&... args) {
+    return Encode(ArgOf<T>::Encode(p, v), args...);
+}
+
+}
+
+/**
+ * @brief 二进制日志的输出端
+ * 和AsyncFileLogAppender一样，每个线程有自己的环形缓冲区，调用处把记录直接编码进去，后台线程批量写文件。
+ * 缓冲区满时丢弃（调试日志不值得阻塞业务线程），丢弃条数见getDropped
+ */
+class BinLogger {
+public:
+    typedef std::shared_ptr<BinLogger> ptr;
+    struct Buffer;
+
+    /**
+     * @param buffer_size 每个线程缓冲区的大小，会向上取整到2的幂
+     * @param flush_interval_ms 后台线程最长多久写一次文件
+     */
+    BinLogger(const std::string &name, const std::string &filename, size_t buffer_size = 1024 * 1024
+        , uint32_t flush_interval_ms = 100, LogLevel::Level level = LogLevel::DEBUG);
+    ~BinLogger();
+
+    const std::string &getName() const { return m_name; }
+    LogLevel::Level getLevel() const { return m_level; }
+    void setLevel(LogLevel::Level level) { m_level = level; }
+    uint64_t getDropped() const { return m_dropped; }
+    // 把调用时所有线程缓冲区里的记录写到文件后才返回
+    void flush();
+
+    template<class... Args>
+    void log(BinLogSite &site, const Args&... args) {
+        uint32_t id = site.id.load(std::memory_order_acquire);
+        if (YUAN_UNLIKELY(!id)) {
+            id = RegisterSite(site, binlog_detail::Types<Args...>::value);
+        }
+        // 记录头：调用点id、时间、协程id，最多30字节
+        size_t max = 30 + binlog_detail::MaxSize(args...);
+        Buffer *buffer = getBuffer();
+        char *p = reserve(buffer, max);
+        if (YUAN_UNLIKELY(!p)) {
+            return;
+        }
+        char *end = writeHeader(p, id);
+        end = binlog_detail::Encode(end, args...);
+        commit(buffer, p, end - p);
+    }
+
+    // 注册调用点，返回它的id。types为参数类型串
+    static uint32_t RegisterSite(BinLogSite &site, const char *types);
+private:
+    Buffer *getBuffer();
+    // 在缓冲区里预留max字节的连续空间，空间不够时返回nullptr（记为丢弃）
+    char *reserve(Buffer *buffer, size_t max);
+    void commit(Buffer *buffer, char *p, size_t len);
+    static char *writeHeader(char *p, uint32_t id);
+    // 把所有缓冲区里的数据写入文件。调用者要持有m_writeMutex
+    void drain();
+    void writeAll(const char *data, size_t len);
+    void run();
+private:
+    std::string m_name;
+    std::string m_filename;
+    int m_fd = -1;
+    size_t m_bufferSize;
+    uint32_t m_flushInterval;
+    LogLevel::Level m_level;
+    uint64_t m_id;
+    // 已经写进文件的调用点个数，调用点按id顺序写
+    uint32_t m_writtenSites = 0;
+
+    Mutex m_buffersMutex;
+    std::vector<std::shared_ptr<Buffer> > m_buffers;
+    Mutex m_writeMutex;
+    Semaphore m_semaphore;
+    Thread::ptr m_thread;
+    std::atomic<bool> m_stopping = {false};
+    std::atomic<uint64_t> m_dropped = {0};
+    // drain时拼接数据块的缓冲区
+    std::string m_out;
+};
+
+/**
+ * @brief 把二进制日志还原成文本，每条一行，格式和默认的日志格式相同：
+ * 时间 线程id 线程名 协程id [级别] [logger名] <文件:行号> 内容
+ */
+class BinLogDecoder {
+public:
+    // 解码整个文件输出到os，返回解码的记录条数，文件格式错误返回-1（已解码的部分仍会输出）
+    static int64_t DecodeFile(const std::string &filename, std::ostream &os);
+};
+
+}
+
+#endif
@@ -1,12 +1,24 @@
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
+#include <new>
+#include <stdexcept>
 #include <sstream>
 #include <string>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "bytearray.h"
+#include "crc32c.h"
 #include "endian.h"
 #include "log.h"
+#include "slab_allocator.h"
 
 namespace yuan {
 
@@ -15,20 +27,63 @@ static Logger::ptr g_system_logger = YUAN_GET_LOGGER("system");
 /**
  * 自定义的单链表Node的函数实现
  */
+static ByteArray::Buffer *NewBuffer(size_t size) {
+    // Buffer头也从SlabAllocator分配，和数据分开，数据块仍然是整的2的幂
+    ByteArray::Buffer *buffer = static_cast<ByteArray::Buffer*>(SlabAllocator::Alloc(sizeof(ByteArray::Buffer)));
+    buffer->data = static_cast<char*>(SlabAllocator::Alloc(size));
+    buffer->size = size;
+    new (&buffer->refs) std::atomic<uint32_t>(1);
+    buffer->mapped = false;
+    return buffer;
+}
+
+static void UnrefBuffer(ByteArray::Buffer *buffer) {
+    if (buffer && buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (buffer->mapped) {
+            munmap(buffer->data, buffer->size);
+        } else {
+            SlabAllocator::Free(buffer->data, buffer->size);
+        }
+        SlabAllocator::Free(buffer, sizeof(ByteArray::Buffer));
+    }
+}
+
 ByteArray::Node::Node(size_t s)
-    : ptr(new char[s])
-    , size(s)
-    , next(nullptr) {}
+    : size(s)
+    , next(nullptr)
+    , buffer(NewBuffer(s)) {
+    ptr = buffer->data;
+}
+
+ByteArray::Node::Node(const Node &other, size_t offset, size_t len)
+    : ptr(other.ptr + offset)
+    , size(len)
+    , next(nullptr)
+    , buffer(other.buffer) {
+    buffer->refs.fetch_add(1, std::memory_order_relaxed);
+}
 
 ByteArray::Node::Node()
     : ptr(nullptr)
     , size(0)
-    , next(nullptr) {}
+    , next(nullptr)
+    , buffer(nullptr) {}
 
 ByteArray::Node::~Node() {
-    if (ptr) {
-        delete [] ptr;
+    UnrefBuffer(buffer);
+}
+
+void ByteArray::Node::makeWritable() {
+    // 只有自己引用时不会有别人再加引用（ByteArray本身不是线程安全的），不需要更强的同步
+    // 文件的映射是只读的，即使只有自己引用也要复制
+    if (!buffer || (!buffer->mapped && buffer->refs.load(std::memory_order_acquire) == 1)) {
+        return;
     }
+    Buffer *copy = NewBuffer(size);
+    memcpy(copy->data, ptr, size);
+    UnrefBuffer(buffer);
+    buffer = copy;
+    ptr = copy->data;
 }
 
 /**
@@ -42,7 +97,18 @@ ByteArray::ByteArray(size_t base_size)
 // 网络字节序默认是大端
     , m_endian(YUAN_BIG_ENDIAN)
     , m_root(new Node(base_size))
-    , m_cur(m_root) {}
+    , m_cur(m_root)
+    , m_curPos(0) {}
+
+ByteArray::ByteArray(Node *root, size_t size, size_t base_size, int8_t endian)
+    : m_baseSize(base_size)
+    , m_position(0)
+    , m_size(size)
+    , m_capacity(size)
+    , m_endian(endian)
+    , m_root(root)
+    , m_cur(root)
+    , m_curPos(0) {}
 
 ByteArray::~ByteArray() {
     Node *temp = m_root;
@@ -53,6 +119,63 @@ ByteArray::~ByteArray() {
     }
 }
 
+const size_t ByteArray::MAP_NODE_SIZE;
+
+ByteArray::ptr ByteArray::MapFile(const std::string &name, size_t base_size) {
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        YUAN_LOG_ERROR(g_system_logger) << "MapFile name=" << name << " open failed"
+            << " errno=" << errno << " strerr=" << strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        YUAN_LOG_ERROR(g_system_logger) << "MapFile name=" << name << " fstat failed"
+            << " errno=" << errno << " strerr=" << strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return ByteArray::ptr(new ByteArray(base_size));
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后fd就不需要了
+    close(fd);
+    if (data == MAP_FAILED) {
+        YUAN_LOG_ERROR(g_system_logger) << "MapFile name=" << name << " mmap " << size << " bytes failed"
+            << " errno=" << errno << " strerr=" << strerror(errno);
+        return nullptr;
+    }
+    // 大文件一般是从头到尾顺序地读或者发送
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    Buffer *buffer = static_cast<Buffer*>(SlabAllocator::Alloc(sizeof(Buffer)));
+    buffer->data = static_cast<char*>(data);
+    buffer->size = size;
+    new (&buffer->refs) std::atomic<uint32_t>(1);
+    buffer->mapped = true;
+
+    // 用一个临时的整块节点切出各个节点，每个都持有一份引用
+    Node whole;
+    whole.ptr = buffer->data;
+    whole.size = size;
+    whole.buffer = buffer;
+    Node *root = nullptr;
+    Node *tail = nullptr;
+    for (size_t offset = 0; offset < size; offset += MAP_NODE_SIZE) {
+        Node *node = new Node(whole, offset, std::min(MAP_NODE_SIZE, size - offset));
+        if (tail) {
+            tail->next = node;
+        } else {
+            root = node;
+        }
+        tail = node;
+    }
+    return ByteArray::ptr(new ByteArray(root, size, base_size, YUAN_BIG_ENDIAN));
+}
+
 void ByteArray::writeFint8(int8_t value) {
     write(&value, sizeof(value));
 }
@@ -105,13 +228,9 @@ void ByteArray::writeFuint64(uint64_t value) {
 }
 
 // 按照google压缩算法，负数压缩效果不好。所以转成正数。为和正数区分，则用奇偶区分。如1转为2，-1转为1
+// 在无符号数上移位，避免有符号数溢出（如INT32_MIN取负）的未定义行为。value >> 31为符号位扩展成的全0或全1
 static uint32_t EncodeZigzag32(int32_t value) {
-    if (value < 0) {
-        // TODO:这里对于INT32_MIN存在问题
-        return ((uint32_t)(-value)) * 2 - 1;
-    } else {
-        return value * 2;
-    }
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
 }
 
 // 上面编码的解码
@@ -121,18 +240,324 @@ static int32_t DecodeZigzag32(uint32_t value) {
 }
 
 static uint64_t EncodeZigzag64(int64_t value) {
-    if (value < 0) {
-        // TODO:这里对于INT64_MIN存在问题
-        return ((uint64_t)(-value)) * 2 - 1;
-    } else {
-        return value * 2;
-    }
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
 }
 
 static int64_t DecodeZigzag64(uint64_t value) {
     return (value >> 1) ^ -(value & 1);
 }
 
+/**
+ * 批量读写数组用的编解码函数。x86上有AVX2和BMI2时用向量指令，否则用普通的循环
+ * 编译时不要求-mavx2，只给这几个函数打开对应的指令集，运行时检测CPU再决定调用哪个
+ */
+namespace {
+
+// varint最长的字节数：uint32_t为5，uint64_t为10
+template<typename T>
+struct VarintTraits {
+    static const size_t MAX_BYTES = (sizeof(T) * 8 + 6) / 7;
+};
+
+// 解码时一段连续内存至少剩这么多字节才走批量解码，保证一次8字节的读取和最长的varint都不越界
+static const size_t s_varint_margin = 16;
+
+template<typename T>
+void ByteSwapScalar(T *dst, const T *src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = byteswap(src[i]);
+    }
+}
+
+// 和writeUint32/writeUint64的编码相同，out至少要有MAX_BYTES字节
+template<typename T>
+inline size_t EncodeVarintScalar(uint8_t *out, T value) {
+    size_t i = 0;
+    while (value >= 0x80) {
+        out[i++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[i++] = value;
+    return i;
+}
+
+// 和readUint32/readUint64的解码相同，最多读MAX_BYTES字节
+template<typename T>
+inline size_t DecodeVarintScalar(const uint8_t *in, T &value) {
+    value = 0;
+    size_t i = 0;
+    for (size_t shift = 0; shift < sizeof(T) * 8; shift += 7) {
+        uint8_t tmp = in[i++];
+        value |= static_cast<T>(tmp & 0x7f) << shift;
+        if (tmp < 0x80) {
+            break;
+        }
+    }
+    return i;
+}
+
+template<typename T>
+size_t EncodeVarintArrayScalar(uint8_t *out, const T *values, size_t count) {
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i) {
+        pos += EncodeVarintScalar(out + pos, values[i]);
+    }
+    return pos;
+}
+
+// 从in中解码最多count个，in剩余不足s_varint_margin字节时停下。返回用掉的字节数，decoded为解码的个数
+template<typename T>
+size_t DecodeVarintArrayScalar(const uint8_t *in, size_t len, T *values, size_t count, size_t &decoded) {
+    size_t pos = 0;
+    decoded = 0;
+    while (decoded < count && len - pos >= s_varint_margin) {
+        pos += DecodeVarintScalar(in + pos, values[decoded++]);
+    }
+    return pos;
+}
+
+#if defined(__x86_64__)
+
+static const uint64_t s_varint_payload = 0x7f7f7f7f7f7f7f7fULL;
+static const uint64_t s_varint_cont = 0x8080808080808080ULL;
+
+__attribute__((target("avx2")))
+void ByteSwap32Avx2(uint32_t *dst, const uint32_t *src, size_t count) {
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v, mask));
+    }
+    ByteSwapScalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void ByteSwap64Avx2(uint64_t *dst, const uint64_t *src, size_t count) {
+    const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v, mask));
+    }
+    ByteSwapScalar(dst + i, src + i, count - i);
+}
+
+// 第1到len-1个字节的最高位为1（后面还有），len为1到8
+inline uint64_t VarintContBits(size_t len) {
+    return ((1ULL << (8 * (len - 1))) - 1) & s_varint_cont;
+}
+
+/**
+ * 编码：连续8个值都小于128时（小的id很常见）一次比较、一次shuffle打包成8个字节；
+ * 否则每个值用pdep把7位一组散到各字节，再补上后续标志位，不用逐字节循环。out末尾要多留8字节
+ */
+__attribute__((target("avx2,bmi2")))
+size_t EncodeVarint32Simd(uint8_t *out, const uint32_t *values, size_t count) {
+    const __m256i high = _mm256_set1_epi32(~0x7f);
+    const __m256i pack = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < count) {
+        if (i + 8 <= count) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            if (_mm256_testz_si256(v, high)) {
+                __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pack), lanes);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + pos), _mm256_castsi256_si128(bytes));
+                pos += 8;
+                i += 8;
+                continue;
+            }
+        }
+        uint32_t value = values[i++];
+        size_t len = (32 - __builtin_clz(value | 1) + 6) / 7;
+        uint64_t word = _pdep_u64(value, s_varint_payload) | VarintContBits(len);
+        memcpy(out + pos, &word, sizeof(word));
+        pos += len;
+    }
+    return pos;
+}
+
+__attribute__((target("avx2,bmi2")))
+size_t EncodeVarint64Simd(uint8_t *out, const uint64_t *values, size_t count) {
+    const __m256i high = _mm256_set1_epi64x(~0x7fLL);
+    const __m256i pack = _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < count) {
+        if (i + 4 <= count) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            if (_mm256_testz_si256(v, high)) {
+                // 每个128位里的2个字节在最低的16位，合起来是低32位里的4个字节
+                __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pack), lanes);
+                uint32_t word = _mm_cvtsi128_si32(_mm256_castsi256_si128(bytes)) & 0xffff;
+                word |= static_cast<uint32_t>(_mm256_extract_epi32(bytes, 1)) << 16;
+                memcpy(out + pos, &word, sizeof(word));
+                pos += 4;
+                i += 4;
+                continue;
+            }
+        }
+        uint64_t value = values[i++];
+        size_t len = (64 - __builtin_clzll(value | 1) + 6) / 7;
+        if (len <= 8) {
+            uint64_t word = _pdep_u64(value, s_varint_payload) | VarintContBits(len);
+            memcpy(out + pos, &word, sizeof(word));
+            pos += len;
+        } else {
+            // 超过56位的部分还剩1到2个字节
+            uint64_t word = _pdep_u64(value, s_varint_payload) | s_varint_cont;
+            memcpy(out + pos, &word, sizeof(word));
+            pos += 8;
+            pos += EncodeVarintScalar(out + pos, value >> 56);
+        }
+    }
+    return pos;
+}
+
+/**
+ * 解码：16个字节的最高位都是0时就是16个单字节的值，直接零扩展；
+ * 否则一次读8个字节，由后续标志位找到结束的字节，再用pext把7位一组收拢
+ */
+__attribute__((target("avx2,bmi2")))
+size_t DecodeVarint32Simd(const uint8_t *in, size_t len, uint32_t *values, size_t count, size_t &decoded) {
+    size_t pos = 0;
+    decoded = 0;
+    while (decoded < count && len - pos >= s_varint_margin) {
+        if (decoded + 16 <= count) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+            if (_mm_movemask_epi8(bytes) == 0) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + decoded), _mm256_cvtepu8_epi32(bytes));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + decoded + 8),
+                                    _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+                pos += 16;
+                decoded += 16;
+                continue;
+            }
+        }
+        uint64_t word;
+        memcpy(&word, in + pos, sizeof(word));
+        uint64_t stop = ~word & s_varint_cont;
+        size_t n = stop ? (__builtin_ctzll(stop) >> 3) + 1 : 8;
+        // 和readUint32一样最多读5个字节
+        n = n > VarintTraits<uint32_t>::MAX_BYTES ? VarintTraits<uint32_t>::MAX_BYTES : n;
+        values[decoded++] = static_cast<uint32_t>(_pext_u64(word, s_varint_payload >> (64 - 8 * n)));
+        pos += n;
+    }
+    return pos;
+}
+
+__attribute__((target("avx2,bmi2")))
+size_t DecodeVarint64Simd(const uint8_t *in, size_t len, uint64_t *values, size_t count, size_t &decoded) {
+    size_t pos = 0;
+    decoded = 0;
+    while (decoded < count && len - pos >= s_varint_margin) {
+        if (decoded + 16 <= count) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+            if (_mm_movemask_epi8(bytes) == 0) {
+                for (int k = 0; k < 4; ++k) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(values + decoded + 4 * k),
+                                        _mm256_cvtepu8_epi64(bytes));
+                    bytes = _mm_srli_si128(bytes, 4);
+                }
+                pos += 16;
+                decoded += 16;
+                continue;
+            }
+        }
+        uint64_t word;
+        memcpy(&word, in + pos, sizeof(word));
+        uint64_t stop = ~word & s_varint_cont;
+        if (stop) {
+            size_t n = (__builtin_ctzll(stop) >> 3) + 1;
+            values[decoded++] = _pext_u64(word, s_varint_payload >> (64 - 8 * n));
+            pos += n;
+        } else {
+            // 前8个字节都没结束，和readUint64一样最多再读2个字节
+            uint64_t high = in[pos + 8] & 0x7f;
+            size_t n = 9;
+            if (in[pos + 8] >= 0x80) {
+                high |= static_cast<uint64_t>(in[pos + 9] & 0x7f) << 7;
+                n = 10;
+            }
+            values[decoded++] = _pext_u64(word, s_varint_payload) | (high << 56);
+            pos += n;
+        }
+    }
+    return pos;
+}
+
+static bool HasAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+}
+
+static const bool s_has_avx2 = HasAvx2();
+
+#endif
+
+void ByteSwapArray(uint32_t *dst, const uint32_t *src, size_t count) {
+#if defined(__x86_64__)
+    if (s_has_avx2) {
+        return ByteSwap32Avx2(dst, src, count);
+    }
+#endif
+    ByteSwapScalar(dst, src, count);
+}
+
+void ByteSwapArray(uint64_t *dst, const uint64_t *src, size_t count) {
+#if defined(__x86_64__)
+    if (s_has_avx2) {
+        return ByteSwap64Avx2(dst, src, count);
+    }
+#endif
+    ByteSwapScalar(dst, src, count);
+}
+
+size_t EncodeVarintArray(uint8_t *out, const uint32_t *values, size_t count) {
+#if defined(__x86_64__)
+    if (s_has_avx2) {
+        return EncodeVarint32Simd(out, values, count);
+    }
+#endif
+    return EncodeVarintArrayScalar(out, values, count);
+}
+
+size_t EncodeVarintArray(uint8_t *out, const uint64_t *values, size_t count) {
+#if defined(__x86_64__)
+    if (s_has_avx2) {
+        return EncodeVarint64Simd(out, values, count);
+    }
+#endif
+    return EncodeVarintArrayScalar(out, values, count);
+}
+
+size_t DecodeVarintArray(const uint8_t *in, size_t len, uint32_t *values, size_t count, size_t &decoded) {
+#if defined(__x86_64__)
+    if (s_has_avx2) {
+        return DecodeVarint32Simd(in, len, values, count, decoded);
+    }
+#endif
+    return DecodeVarintArrayScalar(in, len, values, count, decoded);
+}
+
+size_t DecodeVarintArray(const uint8_t *in, size_t len, uint64_t *values, size_t count, size_t &decoded) {
+#if defined(__x86_64__)
+    if (s_has_avx2) {
+        return DecodeVarint64Simd(in, len, values, count, decoded);
+    }
+#endif
+    return DecodeVarintArrayScalar(in, len, values, count, decoded);
+}
+
+}
+
 void ByteArray::writeInt32(int32_t value) {
     uint32_t tmp = EncodeZigzag32(value);
     writeUint32(tmp);
@@ -287,6 +712,149 @@ uint64_t ByteArray::readUint64() {
     return result;
 }
 
+// 批量写时每次在栈上编码这么多个，再整段write
+static const size_t s_array_batch = 256;
+
+template<typename T>
+void ByteArray::writeFixedArray(const T *values, size_t count) {
+    if (m_endian == YUAN_BYTE_ORDER) {
+        write(values, count * sizeof(T));
+        return;
+    }
+    addCapacity(count * sizeof(T));
+    T buff[s_array_batch];
+    for (size_t i = 0; i < count; i += s_array_batch) {
+        size_t n = std::min(s_array_batch, count - i);
+        ByteSwapArray(buff, values + i, n);
+        write(buff, n * sizeof(T));
+    }
+}
+
+template<typename T>
+void ByteArray::readFixedArray(T *values, size_t count) {
+    // 直接读到结果里，再原地转换字节序
+    read(values, count * sizeof(T));
+    if (m_endian != YUAN_BYTE_ORDER) {
+        ByteSwapArray(values, values, count);
+    }
+}
+
+template<typename T>
+void ByteArray::writeVarintArray(const T *values, size_t count) {
+    // 多留8字节给一次写8字节的编码
+    uint8_t buff[s_array_batch * VarintTraits<T>::MAX_BYTES + 8];
+    for (size_t i = 0; i < count; i += s_array_batch) {
+        size_t n = std::min(s_array_batch, count - i);
+        write(buff, EncodeVarintArray(buff, values + i, n));
+    }
+}
+
+template<typename T>
+void ByteArray::readVarintArray(T *values, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        // 当前节点里连续可读的一段直接解码，剩下不足s_varint_margin字节时（可能跨节点）逐个读
+        size_t node_pos = m_position - m_curPos;
+        size_t len = m_cur ? std::min(m_cur->size - node_pos, getReadSize()) : 0;
+        size_t decoded = 0;
+        if (len >= s_varint_margin) {
+            size_t used = DecodeVarintArray(reinterpret_cast<const uint8_t*>(m_cur->ptr + node_pos), len,
+                                            values + i, count - i, decoded);
+            setPosition(m_position + used);
+            i += decoded;
+        }
+        if (decoded == 0 && i < count) {
+            values[i++] = sizeof(T) == sizeof(uint32_t) ? readUint32() : readUint64();
+        }
+    }
+}
+
+void ByteArray::writeFint32Array(const int32_t *values, size_t count) {
+    writeFixedArray(reinterpret_cast<const uint32_t*>(values), count);
+}
+
+void ByteArray::writeFuint32Array(const uint32_t *values, size_t count) {
+    writeFixedArray(values, count);
+}
+
+void ByteArray::writeFint64Array(const int64_t *values, size_t count) {
+    writeFixedArray(reinterpret_cast<const uint64_t*>(values), count);
+}
+
+void ByteArray::writeFuint64Array(const uint64_t *values, size_t count) {
+    writeFixedArray(values, count);
+}
+
+void ByteArray::writeInt32Array(const int32_t *values, size_t count) {
+    uint32_t buff[s_array_batch];
+    for (size_t i = 0; i < count; i += s_array_batch) {
+        size_t n = std::min(s_array_batch, count - i);
+        for (size_t k = 0; k < n; ++k) {
+            buff[k] = EncodeZigzag32(values[i + k]);
+        }
+        writeVarintArray(buff, n);
+    }
+}
+
+void ByteArray::writeUint32Array(const uint32_t *values, size_t count) {
+    writeVarintArray(values, count);
+}
+
+void ByteArray::writeInt64Array(const int64_t *values, size_t count) {
+    uint64_t buff[s_array_batch];
+    for (size_t i = 0; i < count; i += s_array_batch) {
+        size_t n = std::min(s_array_batch, count - i);
+        for (size_t k = 0; k < n; ++k) {
+            buff[k] = EncodeZigzag64(values[i + k]);
+        }
+        writeVarintArray(buff, n);
+    }
+}
+
+void ByteArray::writeUint64Array(const uint64_t *values, size_t count) {
+    writeVarintArray(values, count);
+}
+
+void ByteArray::readFint32Array(int32_t *values, size_t count) {
+    readFixedArray(reinterpret_cast<uint32_t*>(values), count);
+}
+
+void ByteArray::readFuint32Array(uint32_t *values, size_t count) {
+    readFixedArray(values, count);
+}
+
+void ByteArray::readFint64Array(int64_t *values, size_t count) {
+    readFixedArray(reinterpret_cast<uint64_t*>(values), count);
+}
+
+void ByteArray::readFuint64Array(uint64_t *values, size_t count) {
+    readFixedArray(values, count);
+}
+
+void ByteArray::readInt32Array(int32_t *values, size_t count) {
+    uint32_t *tmp = reinterpret_cast<uint32_t*>(values);
+    readVarintArray(tmp, count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = DecodeZigzag32(tmp[i]);
+    }
+}
+
+void ByteArray::readUint32Array(uint32_t *values, size_t count) {
+    readVarintArray(values, count);
+}
+
+void ByteArray::readInt64Array(int64_t *values, size_t count) {
+    uint64_t *tmp = reinterpret_cast<uint64_t*>(values);
+    readVarintArray(tmp, count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = DecodeZigzag64(tmp[i]);
+    }
+}
+
+void ByteArray::readUint64Array(uint64_t *values, size_t count) {
+    readVarintArray(values, count);
+}
+
 float ByteArray::readFloat() {
     uint32_t v = readFuint32();
     float value;
@@ -323,7 +891,7 @@ std::string ByteArray::readStringF64() {
 }
 
 std::string ByteArray::readStringVint() {
-    uint64_t len = readFuint64();
+    uint64_t len = readUint64();
     std::string buff(len, '\0');
     read(&buff[0], len);
     return buff;
@@ -331,7 +899,6 @@ std::string ByteArray::readStringVint() {
 
 void ByteArray::clear() {
     m_position = m_size = 0;
-    m_capacity = m_baseSize;
 
     m_cur = m_root->next;
     Node *temp;
@@ -340,8 +907,15 @@ void ByteArray::clear() {
         m_cur = m_cur->next;
         delete temp;
     }
-    m_cur = m_root;
     m_root->next = nullptr;
+    // 根节点是共享来的（切片、拼接），换成自己的，免得之后写的时候再复制
+    if (m_root->size != m_baseSize || m_root->buffer->refs.load(std::memory_order_acquire) != 1) {
+        delete m_root;
+        m_root = new Node(m_baseSize);
+    }
+    m_capacity = m_root->size;
+    m_cur = m_root;
+    m_curPos = 0;
 }
 
 void ByteArray::write(const void *buf, size_t size) {
@@ -350,24 +924,25 @@ void ByteArray::write(const void *buf, size_t size) {
     }
 
     addCapacity(size);
-    size_t node_pos = m_position % m_baseSize;
+    size_t node_pos = m_position - m_curPos;
     size_t node_cap = m_cur->size - node_pos;
     size_t buf_pos = 0;
 
     while (size > 0) {
+        m_cur->makeWritable();
         if (size <= node_cap) {
             memcpy(m_cur->ptr + node_pos, (const char *)buf + buf_pos, size);
+            m_position += size;
             if (node_cap == size) {
-                m_cur = m_cur->next;
+                nextNode();
             }
-            m_position += size;
             size = 0;
         } else {
             memcpy(m_cur->ptr + node_pos, (const char *)buf + buf_pos, node_cap);
-            m_cur = m_cur->next;
             m_position += node_cap;
             size -= node_cap;
             buf_pos += node_cap;
+            nextNode();
             node_pos = 0;
             node_cap = m_cur->size;
         }
@@ -383,61 +958,164 @@ void ByteArray::read(void *buf, size_t size) {
         throw std::out_of_range("not enough len");
     }
 
-    size_t node_pos = m_position % m_cur->size;
-    size_t node_cap = m_cur->size - node_pos;
+    size_t node_pos = m_position - m_curPos;
+    size_t node_cap = m_cur ? m_cur->size - node_pos : 0;
     size_t buf_pos = 0;
 
     while (size > 0) {
         if (size <= node_cap) {
             memcpy((char *)buf + buf_pos, m_cur->ptr + node_pos, size);
+            m_position += size;
             if (size == node_cap) {
-                m_cur = m_cur->next;
+                nextNode();
             }
-            m_position += size;
             size = 0;
         } else {
             memcpy((char *)buf + buf_pos, m_cur->ptr + node_pos, node_cap);
-            m_cur = m_cur->next;
             m_position += node_cap;
             size -= node_cap;
-            node_pos = 0;
             buf_pos += node_cap;
+            nextNode();
+            node_pos = 0;
             node_cap = m_cur->size;
         }
     }
 }
 
 void ByteArray::read(void *buf, size_t size, size_t position) const {
-    size_t read_size = m_size - position;
-    if (size > read_size) {
+    if (position > m_size || size > m_size - position) {
         throw std::out_of_range("not enough len");
     }
 
-    size_t node_pos = position % m_cur->size;
-    size_t node_cap = m_cur->size - node_pos;
+    size_t node_pos = 0;
+    Node *cur = locate(position, node_pos);
+    size_t node_cap = cur ? cur->size - node_pos : 0;
     size_t buf_pos = 0;
-    Node *cur = m_cur;
 
     while (size > 0) {
         if (size <= node_cap) {
             memcpy((char *)buf + buf_pos, cur->ptr + node_pos, size);
-            if (size == node_cap) {
-                cur = cur->next;
-            }
-            position += size;
             size = 0;
         } else {
             memcpy((char *)buf + buf_pos, cur->ptr + node_pos, node_cap);
-            cur = cur->next;
-            position += node_cap;
             size -= node_cap;
-            node_pos = 0;
             buf_pos += node_cap;
+            cur = cur->next;
+            node_pos = 0;
             node_cap = cur->size;
         }
     }
 }
 
+ByteArray::Node *ByteArray::locate(size_t position, size_t &node_pos) const {
+    Node *cur = m_root;
+    size_t start = 0;
+    // 大多数情况是在当前节点之后，从m_cur开始找
+    if (m_cur && position >= m_curPos) {
+        cur = m_cur;
+        start = m_curPos;
+    }
+    while (cur && position >= start + cur->size) {
+        start += cur->size;
+        cur = cur->next;
+    }
+    node_pos = position - start;
+    return cur;
+}
+
+void ByteArray::nextNode() {
+    m_curPos += m_cur->size;
+    m_cur = m_cur->next;
+}
+
+ByteArray::Node *ByteArray::shareNodes(size_t position, size_t len, Node *&tail) const {
+    size_t node_pos = 0;
+    Node *cur = locate(position, node_pos);
+    Node *head = nullptr;
+    tail = nullptr;
+    while (len > 0) {
+        size_t n = std::min(len, cur->size - node_pos);
+        Node *node = new Node(*cur, node_pos, n);
+        if (tail) {
+            tail->next = node;
+        } else {
+            head = node;
+        }
+        tail = node;
+        len -= n;
+        cur = cur->next;
+        node_pos = 0;
+    }
+    return head;
+}
+
+ByteArray::ptr ByteArray::slice(size_t len) const {
+    return slice(len, m_position);
+}
+
+ByteArray::ptr ByteArray::slice(size_t len, size_t position) const {
+    if (position > m_size || len > m_size - position) {
+        throw std::out_of_range("slice out of range");
+    }
+    if (len == 0) {
+        ByteArray::ptr ba(new ByteArray(m_baseSize));
+        ba->m_endian = m_endian;
+        return ba;
+    }
+    Node *tail = nullptr;
+    Node *head = shareNodes(position, len, tail);
+    return ByteArray::ptr(new ByteArray(head, len, m_baseSize, m_endian));
+}
+
+void ByteArray::splice(const ByteArray &other, size_t len) {
+    len = std::min<size_t>(len, other.getReadSize());
+    if (len == 0) {
+        return;
+    }
+    // 先生成共享的节点，other就是自己时也没问题
+    Node *tail = nullptr;
+    Node *head = other.shareNodes(other.m_position, len, tail);
+
+    // 和prepare/commit一样拼在size处，position不动
+    bool at_end = m_position == m_size;
+    if (getCapacity() == 0) {
+        // 保证size处有节点，下面边界的情况要用它来交换
+        addCapacity(1);
+    }
+    size_t used = 0;
+    Node *at = locate(m_size, used);
+    if (used > 0) {
+        // size在节点中间，节点后半截的空间放弃掉
+        m_capacity -= at->size - used;
+        at->size = used;
+        tail->next = at->next;
+        at->next = head;
+    } else {
+        // 正好在节点边界上，要插在at之前。单链表找前一个节点要从头遍历，
+        // 所以把at和head的内容交换：at变成拼接的第一个节点，head节点装着原来预留的空间接在最后
+        std::swap(at->ptr, head->ptr);
+        std::swap(at->size, head->size);
+        std::swap(at->buffer, head->buffer);
+        Node *spare_next = at->next;
+        if (head == tail) {
+            at->next = head;
+        } else {
+            at->next = head->next;
+            tail->next = head;
+        }
+        head->next = spare_next;
+    }
+    m_capacity += len;
+    m_size += len;
+
+    // position在原来的末尾时，m_cur可能是被截短的节点，重新定位到拼接进来的第一个节点
+    if (at_end) {
+        size_t node_pos = 0;
+        m_cur = locate(m_position, node_pos);
+        m_curPos = m_position - node_pos;
+    }
+}
+
 void ByteArray::setPosition(size_t val) {
     if (val > m_capacity) {
         throw std::out_of_range("setPosition out of capacity");
@@ -447,16 +1125,11 @@ void ByteArray::setPosition(size_t val) {
     if (val > m_size) {
         m_size = val;
     }
+    // 注意val在节点边界的情况，m_cur指向下一个节点（可能为空）
+    size_t node_pos = 0;
+    m_cur = locate(val, node_pos);
+    m_curPos = val - node_pos;
     m_position = val;
-    m_cur = m_root;
-    // 注意val是m_cur->size整数倍的边界情况，m_cur易空指针
-    while (val > m_cur->size) {
-        val -= m_cur->size;
-        m_cur = m_cur->next;
-    }
-    if (val == m_cur->size) {
-        m_cur = m_cur->next;
-    }
 }
 
 bool ByteArray::writeToFile(const std::string &name) const {
@@ -468,18 +1141,11 @@ bool ByteArray::writeToFile(const std::string &name) const {
         return false;
     }
 
-    size_t read_size = getReadSize();
-    size_t pos = m_position;
-    Node *cur = m_cur;
-
-    while (read_size > 0) {
-        size_t node_pos = pos % m_baseSize;
-        size_t len = (read_size > m_baseSize ? m_baseSize : read_size) - node_pos;
+    std::vector<iovec> iovs;
+    getReadBuffers(iovs, getReadSize());
+    for (auto &i : iovs) {
         // 二进制要用write，是unformatted output function
-        ofs.write(cur->ptr + node_pos, len);
-        cur = cur->next;
-        pos += len;
-        read_size -= len;
+        ofs.write(static_cast<const char*>(i.iov_base), i.iov_len);
     }
 
     return true;
@@ -516,7 +1182,7 @@ void ByteArray::addCapacity(size_t value) {
     value -= old_cap;
     size_t new_nodes = value / m_baseSize + (value % m_baseSize ? 1 : 0);
 
-    Node *tmp = m_root;
+    Node *tmp = m_cur ? m_cur : m_root;
     while (tmp->next) {
         tmp = tmp->next;
     }
@@ -575,14 +1241,19 @@ const std::string ByteArray::toHexString() const {
 }
 
 uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len) const  {
-    len = len > getReadSize() ? getReadSize() : len;
+    return getReadBuffers(buffers, len, m_position);
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len, size_t position) const {
+    size_t read_size = position < m_size ? m_size - position : 0;
+    len = len > read_size ? read_size : len;
     if (len == 0) {
         return 0;
     }
 
-    size_t node_pos = m_position % m_baseSize;
-    size_t node_cap = m_cur->size - node_pos;
-    Node *cur = m_cur;
+    size_t node_pos = 0;
+    Node *cur = locate(position, node_pos);
+    size_t node_cap = cur->size - node_pos;
     iovec iov;
 
     uint64_t size = len;
@@ -595,7 +1266,7 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len) co
         } else {
             iov.iov_base = cur->ptr + node_pos;
             iov.iov_len = node_cap;
-            len -= node_pos;
+            len -= node_cap;
             cur = cur->next;
             node_pos = 0;
             node_cap = cur->size;
@@ -606,27 +1277,43 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len) co
     return size;
 }
 
-uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len, size_t position) const {
-    size_t read_size = m_size - position;
-    len = len > read_size ? read_size : len;
+uint32_t ByteArray::getCrc32c(size_t position, size_t len, uint32_t crc) const {
+    if (position > m_size || len > m_size - position) {
+        throw std::out_of_range("getCrc32c out of range");
+    }
     if (len == 0) {
-        return 0;
+        return crc;
     }
-
-    size_t node_count = position / m_baseSize;
-    Node *cur = m_root;
-    while (node_count > 0) {
+    // 和getReadBuffers一样逐个节点走，每个节点内是连续的内存
+    size_t node_pos = 0;
+    Node *cur = locate(position, node_pos);
+    while (len > 0) {
+        size_t n = std::min(len, cur->size - node_pos);
+        crc = Crc32c::Extend(crc, cur->ptr + node_pos, n);
+        len -= n;
         cur = cur->next;
-        --node_count;
+        node_pos = 0;
+    }
+    return crc;
+}
+
+uint64_t ByteArray::getWriteBuffers(std::vector<iovec> &buffers, uint64_t len) {
+    if (len == 0) {
+        return 0;
     }
+    // 和上面的关键区别在这里，要扩容
+    addCapacity(len);
 
-    size_t node_pos = position % m_baseSize;
-    size_t node_cap = cur->size - node_pos;
+    size_t node_pos = m_position - m_curPos;
+    size_t node_cap = m_cur->size - node_pos;
+    Node *cur = m_cur;
     iovec iov;
 
     uint64_t size = len;
 
     while (len > 0) {
+        // 交出去的内存会被写，共享的要先复制
+        cur->makeWritable();
         if (node_cap >= len) {
             iov.iov_base = cur->ptr + node_pos;
             iov.iov_len = len;
@@ -634,7 +1321,7 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len, si
         } else {
             iov.iov_base = cur->ptr + node_pos;
             iov.iov_len = node_cap;
-            len -= node_pos;
+            len -= node_cap;
             cur = cur->next;
             node_pos = 0;
             node_cap = cur->size;
@@ -645,37 +1332,70 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len, si
     return size;
 }
 
-uint64_t ByteArray::getWriteBuffers(std::vector<iovec> &buffers, uint64_t len) {
+uint64_t ByteArray::prepare(std::vector<iovec> &buffers, uint64_t len) {
     if (len == 0) {
         return 0;
     }
-    // 和上面的关键区别在这里，要扩容
     addCapacity(len);
 
-    size_t node_pos = m_position % m_baseSize;
-    size_t node_cap = m_cur->size - node_pos;
-    Node *cur = m_cur;
+    // 写的位置是m_size，一般就在m_cur或者之后的节点里
+    size_t node_pos = 0;
+    Node *cur = locate(m_size, node_pos);
+    size_t node_cap = cur->size - node_pos;
     iovec iov;
 
     uint64_t size = len;
 
     while (len > 0) {
-        if (node_cap >= len) {
-            iov.iov_base = cur->ptr + node_pos;
-            iov.iov_len = len;
-            len = 0;
-        } else {
-            iov.iov_base = cur->ptr + node_pos;
-            iov.iov_len = node_cap;
-            len -= node_pos;
+        cur->makeWritable();
+        iov.iov_base = cur->ptr + node_pos;
+        iov.iov_len = std::min(len, static_cast<uint64_t>(node_cap));
+        len -= iov.iov_len;
+        buffers.push_back(iov);
+        if (len > 0) {
             cur = cur->next;
             node_pos = 0;
             node_cap = cur->size;
         }
-        buffers.push_back(iov);
     }
 
     return size;
 }
 
-}
\ No newline at end of file
+void ByteArray::commit(size_t len) {
+    if (len > getCapacity()) {
+        throw std::out_of_range("commit out of capacity");
+    }
+    // prepare里的addCapacity已经保证了m_cur不为空，这里只移动写的位置
+    m_size += len;
+}
+
+void ByteArray::consume(size_t len) {
+    if (len > getReadSize()) {
+        throw std::out_of_range("consume not enough len");
+    }
+    m_position += len;
+    // 全部读完了，直接回到只有一个节点的状态
+    if (m_position == m_size) {
+        clear();
+        return;
+    }
+
+    size_t node_pos = 0;
+    m_cur = locate(m_position, node_pos);
+    m_curPos = m_position - node_pos;
+    // m_cur之前的节点都读完了，释放掉
+    size_t released = 0;
+    while (m_root != m_cur) {
+        Node *temp = m_root;
+        m_root = m_root->next;
+        released += temp->size;
+        delete temp;
+    }
+    m_position -= released;
+    m_size -= released;
+    m_capacity -= released;
+    m_curPos -= released;
+}
+
+}
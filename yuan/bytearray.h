@@ -8,12 +8,14 @@
  * 还涉及到了压缩算法
  */
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
 #include <string>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <vector>
+#include "slab_allocator.h"
 
 namespace yuan {
 
@@ -21,20 +23,50 @@ class ByteArray {
 public:
     typedef std::shared_ptr<ByteArray> ptr;
 
+    // Node底层的内存块，带引用计数，可以被多个ByteArray的Node共享（slice、splice）
+    struct Buffer {
+        char *data;
+        size_t size;
+        std::atomic<uint32_t> refs;
+        // 为true时data是文件的只读mmap（见MapFile），释放时munmap，写之前总是先复制
+        bool mapped;
+    };
+
     // 用链表来存储，Node代表一块内存空间，如果写满了则再分配一块。不使用数组，因为还要动态扩展且不一定能轻易的分配出连续的大空间
+    // 内存从SlabAllocator分配，clear后再写不会反复new/delete
+    // Node是Buffer中[ptr, ptr + size)这一段的视图。共享的节点大小不一定是base_size
     struct Node {
         Node(size_t s);
+        // 共享other中从offset开始的len字节，不拷贝
+        Node(const Node &other, size_t offset, size_t len);
         Node();
         ~Node();
 
+        // 写时复制：Buffer还被别的Node引用时，先复制一份自己的再写，不影响共享它的ByteArray
+        void makeWritable();
+
+        // 切片、拼接时节点的创建很频繁，节点本身也从SlabAllocator分配
+        static void *operator new(size_t size) { return SlabAllocator::Alloc(size); }
+        static void operator delete(void *ptr, size_t size) { SlabAllocator::Free(ptr, size); }
+
         char *ptr;
         size_t size;
         Node *next;
+        Buffer *buffer;
     };
 
     ByteArray(size_t base_size = 4096);
     ~ByteArray();
 
+    /**
+     * @brief 把文件只读地mmap进来作为节点，不拷贝。适合几百MB的大文件：直接getReadBuffers发出去，或者用readXXX解析
+     * 文件按MAP_NODE_SIZE切成多个节点共享同一个映射，写到其中的节点时只复制那一个节点，文件本身不会被修改。
+     * 映射期间文件不能被截断，否则访问时会SIGBUS
+     * @return 打开或者映射失败时返回nullptr。空文件返回一个空的ByteArray
+     */
+    static ByteArray::ptr MapFile(const std::string &name, size_t base_size = 4096);
+    static const size_t MAP_NODE_SIZE = 1024 * 1024;
+
     /**
      * 以下都为读写方法
      */
@@ -87,6 +119,30 @@ public:
     int64_t readInt64();
     uint64_t readUint64();
 
+    /**
+     * 批量读写整数数组，编码和逐个调用writeFint32/writeUint32等完全相同，可以混用
+     * 大量的id、时间戳等走这里：字节序转换和varint的编解码在x86上用AVX2/BMI2一次处理多个（运行时检测CPU），
+     * 整段数据一次写入或者在节点内直接解码，不再每个字节都走一遍write/read的边界检查
+     */
+    void writeFint32Array(const int32_t *values, size_t count);
+    void writeFuint32Array(const uint32_t *values, size_t count);
+    void writeFint64Array(const int64_t *values, size_t count);
+    void writeFuint64Array(const uint64_t *values, size_t count);
+    void writeInt32Array(const int32_t *values, size_t count);
+    void writeUint32Array(const uint32_t *values, size_t count);
+    void writeInt64Array(const int64_t *values, size_t count);
+    void writeUint64Array(const uint64_t *values, size_t count);
+
+    // 数据不够时和readFint32等一样抛出std::out_of_range，此时values中可能已经写入了一部分
+    void readFint32Array(int32_t *values, size_t count);
+    void readFuint32Array(uint32_t *values, size_t count);
+    void readFint64Array(int64_t *values, size_t count);
+    void readFuint64Array(uint64_t *values, size_t count);
+    void readInt32Array(int32_t *values, size_t count);
+    void readUint32Array(uint32_t *values, size_t count);
+    void readInt64Array(int64_t *values, size_t count);
+    void readUint64Array(uint64_t *values, size_t count);
+
     // 读取浮点型
     float readFloat();
     double readDouble();
@@ -110,12 +166,25 @@ public:
     // 有点像peek的感觉，读取数据，但不改变m_position等成员变量的值
     void read(void *buf, size_t size, size_t position) const;
 
+    /**
+     * 零拷贝的切片和拼接：节点的内存带引用计数，可以在多个ByteArray之间共享。
+     * 收到的数据可以不经memcpy地交给解析、body或者再发出去。共享的内存被写时会先复制（见Node::makeWritable），
+     * 所以切片和原对象之间互不影响
+     */
+    // 从当前position开始的len字节生成一个新的ByteArray（position为0），不移动本对象的position
+    ByteArray::ptr slice(size_t len) const;
+    // 从position开始的len字节生成一个新的ByteArray
+    ByteArray::ptr slice(size_t len, size_t position) const;
+    // 把other从它的position开始的len字节拼接到本对象的末尾（size处），other不变。
+    // 和prepare/commit一样只移动size，不移动position，所以可以边读边把数据拼到后面
+    void splice(const ByteArray &other, size_t len = ~0ULL);
+
     size_t getPosition() const { return m_position; }
     void setPosition(size_t val);
 
     // 方便的写入文件，可以用来当数据有问题时，做调试
     bool writeToFile(const std::string &name) const;
-    // 从文件读出
+    // 从文件读出，会拷贝一份。大文件用MapFile
     bool readFromFile(const std::string &name);
 
     size_t getBaseSize() const { return m_baseSize; }
@@ -139,13 +208,50 @@ public:
     uint64_t getReadBuffers(std::vector<iovec> &buffers, uint64_t len = ~0ULL) const;
     // 只读不改。从指定位置读取。注意这种方式的后续读取，position无法更新，故需在调用处手动更新
     uint64_t getReadBuffers(std::vector<iovec> &buffers, uint64_t len, size_t position) const;
+    /**
+     * @brief [position, position + len)这段数据的CRC32C（见crc32c.h），逐个节点计算，不拷贝，不改变position
+     * crc为前面数据的结果，可以边写边算：每写完一段，传入上次的结果算新写的这段。越界时抛出std::out_of_range
+     */
+    uint32_t getCrc32c(size_t position, size_t len, uint32_t crc = 0) const;
+    // 从当前position开始所有还没读的数据的CRC32C
+    uint32_t getCrc32c() const { return getCrc32c(m_position, getReadSize()); }
     // socket获取到数据要向这里写入，提前告知要写入的数据大小，ByteArray增加容量，开辟好空间。注意这种方式的写入，position和size都无法更新，故需在调用处手动更新。设计的不好
+    // 新代码用下面的prepare/commit
     uint64_t getWriteBuffers(std::vector<iovec> &buffers, uint64_t len);
+
+    /**
+     * 读写分离的用法：size是写的位置，position是读的位置。收到的数据总是追加在末尾，从position开始读，
+     * 不用再手动setPosition来回挪。典型的收包循环：prepare -> recv -> commit -> 解析(readXXX) -> consume
+     */
+    // 在末尾（size处）预留至少len字节的空间，返回这段空间的iovec，可以直接交给recv/readv。position和size都不变
+    uint64_t prepare(std::vector<iovec> &buffers, uint64_t len);
+    // 确认prepare的空间里写入了len字节，只增加size，O(1)。len超过剩余空间时抛出std::out_of_range
+    void commit(size_t len);
+    // 丢弃position之后的len字节（position前移），并释放已经读完的节点，长连接的缓冲区不会一直变大
+    // 释放后position和size都减去被释放的字节数。len超过可读的数据时抛出std::out_of_range
+    void consume(size_t len);
 private:
+    // 切片用：直接接管一串节点，size为节点大小之和
+    ByteArray(Node *root, size_t size, size_t base_size, int8_t endian);
     // 添加内存空间
     void addCapacity(size_t value);
+    // 找到position所在的节点，node_pos为在节点内的偏移。position等于容量时返回nullptr
+    Node *locate(size_t position, size_t &node_pos) const;
+    // m_cur移到下一个节点
+    void nextNode();
+    // 为[position, position + len)生成一串共享的节点，tail为最后一个
+    Node *shareNodes(size_t position, size_t len, Node *&tail) const;
     // 获取剩余的可用空间
     size_t getCapacity() const { return m_capacity - m_size; }
+    // 批量读写的实现，T为uint32_t或uint64_t
+    template<typename T>
+    void writeFixedArray(const T *values, size_t count);
+    template<typename T>
+    void readFixedArray(T *values, size_t count);
+    template<typename T>
+    void writeVarintArray(const T *values, size_t count);
+    template<typename T>
+    void readVarintArray(T *values, size_t count);
 
 private:
     // 每个node占多大内存,单位为字节
@@ -162,6 +268,8 @@ private:
     Node *m_root;
     // 链表的当前节点
     Node *m_cur;
+    // m_cur在整个ByteArray里的起始位置。节点大小不一定相同，不能再用m_position % m_baseSize计算
+    size_t m_curPos;
 };
 
 }
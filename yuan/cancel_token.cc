@@ -0,0 +1,32 @@
+#include "cancel_token.h"
+
+namespace yuan {
+
+void CancelToken::cancel() {
+    MutexType::Lock lock(m_mutex);
+    if (m_cancelled) {
+        return;
+    }
+    m_cancelled.store(true, std::memory_order_release);
+    for (auto &i : m_wakers) {
+        i.second();
+    }
+    m_wakers.clear();
+}
+
+uint64_t CancelToken::addWaker(std::function<void()> cb) {
+    MutexType::Lock lock(m_mutex);
+    if (m_cancelled) {
+        return 0;
+    }
+    uint64_t id = ++m_nextId;
+    m_wakers[id] = std::move(cb);
+    return id;
+}
+
+void CancelToken::delWaker(uint64_t id) {
+    MutexType::Lock lock(m_mutex);
+    m_wakers.erase(id);
+}
+
+}
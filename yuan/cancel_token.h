@@ -0,0 +1,45 @@
+#ifndef __YUAN_CANCEL_TOKEN_H__
+#define __YUAN_CANCEL_TOKEN_H__
+
+/**
+ * @file cancel_token.h
+ * 取消令牌。绑定到协程（或随任务一起schedule）后，调用cancel可以：
+ * 1.丢弃任务队列里还没开始执行的任务
+ * 2.唤醒阻塞在hook的IO、sleep上的协程，被hook的函数返回-1，errno为ECANCELED
+ * 典型场景：客户端断开连接后，取消为它发起的所有上游调用
+ */
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include "thread.h"
+
+namespace yuan {
+
+class CancelToken : Noncopyable {
+public:
+    typedef std::shared_ptr<CancelToken> ptr;
+    typedef Mutex MutexType;
+
+    CancelToken() {}
+
+    // 只有第一次调用生效。会在调用线程上同步执行所有已注册的唤醒函数
+    void cancel();
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+    // 注册取消时要执行的唤醒函数，返回用于注销的id。已经被取消则不注册，返回0
+    uint64_t addWaker(std::function<void()> cb);
+    // 注销唤醒函数。返回后可以保证该唤醒函数不在执行中，之后也不会再被执行
+    void delWaker(uint64_t id);
+private:
+    // 唤醒函数在持有该锁时执行，这样delWaker返回后唤醒函数引用的资源可以安全释放
+    MutexType m_mutex;
+    std::atomic<bool> m_cancelled = {false};
+    uint64_t m_nextId = 0;
+    std::map<uint64_t, std::function<void()> > m_wakers;
+};
+
+}
+
+#endif
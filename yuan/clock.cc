@@ -0,0 +1,195 @@
+#include "clock.h"
+#include <atomic>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#include "config.h"
+#include "log.h"
+
+namespace yuan {
+
+static Logger::ptr g_logger = YUAN_GET_LOGGER("system");
+
+// 默认precise：tsc要先花10ms忙等校准，不能让每个链接了libyuan的进程（包括从不读时钟的）在静态初始化时都付出这个代价，
+// 需要时通过配置打开，那时才校准
+static ConfigVar<std::string>::ptr g_clock_mode =
+    Config::Lookup("clock.mode", std::string("precise"), "clock mode: precise, cached, coarse, tsc");
+
+static std::atomic<int> s_clock_mode = {Clock::PRECISE};
+
+// 每个线程缓存的单调时间，以及单调时间到墙上时间的差值
+static thread_local uint64_t t_cached_ns = 0;
+static thread_local uint64_t t_cached_wall_us = 0;
+static thread_local int64_t t_wall_offset_us = 0;
+static thread_local uint64_t t_wall_offset_ns = 0;
+
+static uint64_t ReadClock(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const uint64_t s_start_ns = ReadClock(CLOCK_MONOTONIC);
+
+// TSC换算成纳秒：ns = baseNs + (tsc - baseTsc) * mult >> 32。第一次使用时（切到TSC模式或直接调用TscNs）用CLOCK_MONOTONIC校准
+struct TscState {
+    TscState() {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, ebx, ecx, edx;
+        // CPUID.80000007H:EDX[8]为invariant TSC，频率恒定且不受节能状态影响
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) {
+            return;
+        }
+        uint64_t ns0 = ReadClock(CLOCK_MONOTONIC);
+        uint64_t tsc0 = __rdtsc();
+        uint64_t ns1 = ns0;
+        // 校准10ms，误差在十万分之一的量级
+        while (ns1 - ns0 < 10 * 1000 * 1000) {
+            ns1 = ReadClock(CLOCK_MONOTONIC);
+        }
+        uint64_t tsc1 = __rdtsc();
+        if (tsc1 <= tsc0) {
+            return;
+        }
+        mult = ((ns1 - ns0) << 32) / (tsc1 - tsc0);
+        baseTsc = tsc1;
+        baseNs = ns1;
+        ok = true;
+#endif
+    }
+
+    bool ok = false;
+    uint64_t baseTsc = 0;
+    uint64_t baseNs = 0;
+    uint64_t mult = 0;
+};
+
+static TscState &GetTscState() {
+    static TscState s_tsc;
+    return s_tsc;
+}
+
+Clock::Mode Clock::ModeFromString(const std::string &str) {
+    if (str == "cached" || str == "CACHED") {
+        return CACHED;
+    } else if (str == "coarse" || str == "COARSE") {
+        return COARSE;
+    } else if (str == "tsc" || str == "TSC") {
+        return TSC;
+    }
+    return PRECISE;
+}
+
+const char *Clock::ModeToString(Mode mode) {
+    switch (mode) {
+        case CACHED:
+            return "cached";
+        case COARSE:
+            return "coarse";
+        case TSC:
+            return "tsc";
+        default:
+            return "precise";
+    }
+}
+
+void Clock::SetMode(Mode mode) {
+    if (mode == TSC && !HasTsc()) {
+        YUAN_LOG_WARN(g_logger) << "clock mode tsc is not supported by cpu, use precise";
+        mode = PRECISE;
+    }
+    s_clock_mode = mode;
+}
+
+Clock::Mode Clock::GetMode() {
+    return static_cast<Mode>(s_clock_mode.load(std::memory_order_relaxed));
+}
+
+bool Clock::HasTsc() {
+    return GetTscState().ok;
+}
+
+uint64_t Clock::NowNs() {
+    switch (s_clock_mode.load(std::memory_order_relaxed)) {
+        case CACHED:
+            return CachedNs();
+        case COARSE:
+            return CoarseNs();
+        case TSC:
+            return TscNs();
+        default:
+            return MonotonicNs();
+    }
+}
+
+uint64_t Clock::WallUs() {
+    switch (s_clock_mode.load(std::memory_order_relaxed)) {
+        case CACHED:
+            if (t_cached_wall_us) {
+                return t_cached_wall_us;
+            }
+            break;
+        case COARSE:
+            return ReadClock(CLOCK_REALTIME_COARSE) / 1000;
+        default:
+            break;
+    }
+    return ReadClock(CLOCK_REALTIME) / 1000;
+}
+
+uint64_t Clock::StartNs() {
+    return s_start_ns;
+}
+
+uint64_t Clock::MonotonicNs() {
+    return ReadClock(CLOCK_MONOTONIC);
+}
+
+uint64_t Clock::CoarseNs() {
+    return ReadClock(CLOCK_MONOTONIC_COARSE);
+}
+
+uint64_t Clock::TscNs() {
+#if defined(__x86_64__) || defined(__i386__)
+    const TscState &state = GetTscState();
+    if (state.ok) {
+        uint64_t tsc = __rdtsc();
+        // 校准点之前读到的值（其他核上的TSC略有偏差）按校准点算，保证单调
+        uint64_t delta = tsc > state.baseTsc ? tsc - state.baseTsc : 0;
+        return state.baseNs + static_cast<uint64_t>((static_cast<unsigned __int128>(delta) * state.mult) >> 32);
+    }
+#endif
+    return MonotonicNs();
+}
+
+uint64_t Clock::CachedNs() {
+    return t_cached_ns ? t_cached_ns : MonotonicNs();
+}
+
+uint64_t Clock::Update() {
+    uint64_t now = MonotonicNs();
+    t_cached_ns = now;
+    // 墙上时间可能被调整，每秒重新取一次和单调时间的差值，其余时候直接换算，一次刷新只读一次时钟
+    if (now - t_wall_offset_ns >= 1000000000ULL) {
+        t_wall_offset_us = static_cast<int64_t>(ReadClock(CLOCK_REALTIME) / 1000) - static_cast<int64_t>(now / 1000);
+        t_wall_offset_ns = now;
+    }
+    t_cached_wall_us = now / 1000 + t_wall_offset_us;
+    return now;
+}
+
+struct ClockIniter {
+    ClockIniter() {
+        Clock::SetMode(Clock::ModeFromString(g_clock_mode->getValue()));
+        g_clock_mode->add_listener([](const std::string &old_value, const std::string &new_value){
+            YUAN_LOG_INFO(g_logger) << "clock mode changed from " << old_value << " to " << new_value;
+            Clock::SetMode(Clock::ModeFromString(new_value));
+        });
+    }
+};
+
+static ClockIniter s_clock_initer;
+
+}
@@ -0,0 +1,58 @@
+#ifndef __YUAN_CLOCK_H__
+#define __YUAN_CLOCK_H__
+
+/**
+ * @file clock.h
+ * 时钟服务。统一提供单调时间（测耗时、定时器）和墙上时间（日志的时间戳）
+ * 读时钟有几种模式，见Clock::Mode，可以通过配置项clock.mode切换，默认为precise
+ */
+
+#include <stdint.h>
+#include <string>
+
+namespace yuan {
+
+class Clock {
+public:
+    enum Mode {
+        // clock_gettime(CLOCK_MONOTONIC/CLOCK_REALTIME)，纳秒精度，走vDSO不陷入内核
+        PRECISE = 0,
+        // 读当前线程缓存的时间，只是一次内存访问。缓存由Update刷新：IOManager每轮循环、Scheduler每执行一个任务前都会刷新，
+        // 所以会落后于真实时间，最多落后一个任务的执行时长。没有刷新过的线程退化为PRECISE
+        CACHED,
+        // CLOCK_MONOTONIC_COARSE/CLOCK_REALTIME_COARSE，精度为一个时钟节拍（通常1~4ms）
+        COARSE,
+        // 读CPU的时间戳计数器再换算成纳秒，最快。只有CPU支持恒定速率的TSC时可用，否则退化为PRECISE。
+        // 墙上时间仍用PRECISE，避免长时间运行后和系统时间产生偏差
+        TSC
+    };
+
+    static Mode ModeFromString(const std::string &str);
+    static const char *ModeToString(Mode mode);
+    // 设为TSC但CPU不支持时，会设为PRECISE
+    static void SetMode(Mode mode);
+    static Mode GetMode();
+    static bool HasTsc();
+
+    // 按当前模式读取单调时间
+    static uint64_t NowNs();
+    static uint64_t NowUs() { return NowNs() / 1000; }
+    static uint64_t NowMs() { return NowNs() / 1000000; }
+    // 按当前模式读取墙上时间，距1970-01-01的微秒数
+    static uint64_t WallUs();
+    // 进程启动时的单调时间
+    static uint64_t StartNs();
+
+    // 以下不受模式影响
+    static uint64_t MonotonicNs();
+    static uint64_t CoarseNs();
+    static uint64_t TscNs();
+    static uint64_t CachedNs();
+    static uint64_t CachedMs() { return CachedNs() / 1000000; }
+    // 刷新当前线程缓存的时间，返回刷新后的单调时间（纳秒）
+    static uint64_t Update();
+};
+
+}
+
+#endif
@@ -30,7 +30,7 @@ ConfigVarBase::ptr Config::LookupBase(const std::string &name) {
 }
 
 // 根据yaml文件（配置）中的值，相应修改已经存储在Config中（约定）的值
-void Config::LoadFromYaml(const YAML::Node &root) {
+void Config::LoadFromYaml(const YAML::Node &root, std::vector<std::string> *changed) {
     std::list<std::pair<std::string, YAML::Node>> all_nodes;
     ListAllMember("", root, all_nodes);
 
@@ -43,6 +43,8 @@ void Config::LoadFromYaml(const YAML::Node &root) {
         ConfigVarBase::ptr var = LookupBase(key);
 
         if (var) {
+            // 值没变时setValue不会回调，这里只是为了告诉调用者哪些变了
+            std::string old_value = changed ? var->toString() : "";
             if (i.second.IsScalar()) {
                 var->fromString(i.second.Scalar());
             } else {
@@ -50,6 +52,9 @@ void Config::LoadFromYaml(const YAML::Node &root) {
                 ss << i.second;
                 var->fromString(ss.str());
             }
+            if (changed && var->toString() != old_value) {
+                changed->push_back(key);
+            }
         }
     }
 }
@@ -12,6 +12,7 @@
  * 想换为xml或json也很简单，修改序列化和反序列化的方式即可
  */
 
+#include <atomic>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -22,6 +23,8 @@
 // 定义各种类序列化和反序列化为yaml格式的头文件
 #include "convert.h"
 #include <functional>
+#include "epoch.h"
+#include "macro.h"
 #include "thread.h"
 
 namespace yuan {
@@ -38,6 +41,7 @@ public:
         , m_description(description) {
             // 把所有字母转为小写，方便使用
             std::transform(m_name.begin(), m_name.end(), m_name.begin(), ::tolower);
+            m_mutex.setName("ConfigVar::m_mutex");
         }
 
     virtual ~ConfigVarBase() {}
@@ -69,7 +73,14 @@ public:
             , const T &default_value
             , const std::string &description = "")
         : ConfigVarBase(name, description)
-        , m_val(default_value) {}
+        , m_val(new T(default_value)) {
+        m_setMutex.setName("ConfigVar::m_setMutex");
+    }
+
+    ~ConfigVar() {
+        // 旧的快照都交给了EpochMgr，这里只释放当前的
+        delete m_val.load(std::memory_order_relaxed);
+    }
 
     virtual std::string toString() override {
         try { 
@@ -97,25 +108,46 @@ public:
         return false;
     }
 
-    const T getValue() { 
+    // 返回当前值的拷贝，任何线程都能用。EpochMgr在线的线程（调度器的线程）里不加锁
+    const T getValue() {
+        if (EpochMgr::GetInstance()->isOnline()) {
+            return *m_val.load(std::memory_order_acquire);
+        }
         RWMutexType::ReadLock lock(m_mutex);
-        return m_val;
+        return *m_val.load(std::memory_order_relaxed);
     }
+
+    /**
+     * @brief 无锁、不拷贝地读当前值，给热路径用
+     * 值保存在不可变的快照里，setValue发布新快照，旧快照交给EpochMgr延迟释放（RCU的思路）。
+     * 因此只能在EpochMgr在线的线程里调用（调度器的线程自动满足，其他线程要先registerThread），
+     * 返回的引用在当前线程的下一个静止点之前有效：在调度器的任务里不要跨越协程切换持有它，需要的话先拷贝
+     */
+    const T &getRef() const {
+        YUAN_DASSERT(EpochMgr::GetInstance()->isOnline());
+        return *m_val.load(std::memory_order_acquire);
+    }
+
     void setValue(const T &val) { 
-        // 细节：下面分别加了读锁和写锁。注意加了作用域，来让读锁使用后被释放。降低死锁概率
+        // 写者之间串行，保证回调按发布的顺序被调用
+        Mutex::Lock set_lock(m_setMutex);
+        const T *old_val = m_val.load(std::memory_order_relaxed);
+        if (val == *old_val) {
+            return;
+        }
+        const T *new_val = new T(val);
+        {
+            RWMutexType::WriteLock lock(m_mutex);
+            m_val.store(new_val, std::memory_order_release);
+        }
+        // 新值发布之后再回调，回调里读到的一定是新值。旧快照在回调结束前不会被释放
         {
             RWMutexType::ReadLock lock(m_mutex);
-            if (val == m_val) {
-                return;
-            }
-            // 在改变值的时候调用回调函数
             for (auto &cb : m_cbs) {
-                cb.second(m_val, val);
+                cb.second(*old_val, *new_val);
             }
         }
-
-        RWMutexType::WriteLock lock(m_mutex);
-        m_val = val;
+        EpochMgr::GetInstance()->retire(const_cast<T*>(old_val));
      }
     std::string getTypename() const override { return typeid(T).name(); }
 
@@ -145,7 +177,10 @@ public:
         }
     }
 private:
-    T m_val;
+    // 当前值的快照，发布后不再修改
+    std::atomic<const T*> m_val;
+    // 串行化setValue
+    Mutex m_setMutex;
     // 变更回调函数集合。为什么用map？因为function没有比较函数，放在vector里无法移除某个指定function，故使用map。
     // uint64_t key 要求唯一，一般可以使用hash
     std::map<uint64_t, on_change_cb> m_cbs;
@@ -208,7 +243,8 @@ public:
 
     static ConfigVarBase::ptr LookupBase(const std::string &name);
 
-    static void LoadFromYaml(const YAML::Node &root);
+    // changed不为空时，放入值真正发生变化的约定项的名字
+    static void LoadFromYaml(const YAML::Node &root, std::vector<std::string> *changed = nullptr);
     // 方便调试时使用，可以让使用者看到配置系统里目前都有什么约定。传入回调
     static void Visit(std::function<void(ConfigVarBase::ptr)> cb);
 private:
@@ -222,6 +258,8 @@ private:
 
     static RWMutexType &GetMutex() {
         static RWMutexType s_mutex;
+        static bool s_named = (s_mutex.setName("Config::GetMutex"), true);
+        (void)s_named;
         return s_mutex;
     }
 };
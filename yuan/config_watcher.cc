@@ -0,0 +1,257 @@
+#include "config_watcher.h"
+#include <algorithm>
+#include <errno.h>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config.h"
+#include "log.h"
+
+namespace yuan {
+
+static Logger::ptr g_logger = YUAN_GET_LOGGER("system");
+
+static bool IsYamlFile(const std::string &name) {
+    auto ends_with = [&name](const std::string &suffix) {
+        return name.size() > suffix.size()
+            && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return ends_with(".yml") || ends_with(".yaml");
+}
+
+ConfigWatcher::ptr ConfigWatcher::Create(IOManager *iom) {
+    if (!iom) {
+        YUAN_LOG_ERROR(g_logger) << "ConfigWatcher::Create need an IOManager";
+        return nullptr;
+    }
+    ConfigWatcher::ptr watcher(new ConfigWatcher(iom));
+    if (!watcher->init()) {
+        return nullptr;
+    }
+    return watcher;
+}
+
+ConfigWatcher::ConfigWatcher(IOManager *iom)
+    : m_iom(iom) {
+    m_mutex.setName("ConfigWatcher::m_mutex");
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+bool ConfigWatcher::init() {
+    // 非阻塞，读到EAGAIN就说明事件取完了
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        YUAN_LOG_ERROR(g_logger) << "inotify_init1 fail errno=" << errno << " strerr=" << strerror(errno);
+        return false;
+    }
+    // addEvent要在IOManager的线程里调用，事件触发时回调才会调度到这个IOManager上。
+    // 注册之前的改动会留在inotify fd里，注册时就是可读的，不会丢
+    std::weak_ptr<ConfigWatcher> weak_self(shared_from_this());
+    m_iom->schedule([weak_self](){
+        ConfigWatcher::ptr self = weak_self.lock();
+        if (self) {
+            MutexType::Lock lock(self->m_mutex);
+            if (!self->m_stopping) {
+                self->addEvent();
+            }
+        }
+    });
+    return true;
+}
+
+void ConfigWatcher::addEvent() {
+    // 回调里持有weak_ptr，watcher析构后事件再触发也不会访问到野指针
+    std::weak_ptr<ConfigWatcher> weak_self(shared_from_this());
+    if (m_iom->addEvent(m_fd, IOManager::READ, [weak_self](){
+        ConfigWatcher::ptr self = weak_self.lock();
+        if (self) {
+            self->onEvent();
+        }
+    })) {
+        YUAN_LOG_ERROR(g_logger) << "ConfigWatcher addEvent fd=" << m_fd << " fail";
+    }
+}
+
+bool ConfigWatcher::watch(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st)) {
+        YUAN_LOG_ERROR(g_logger) << "ConfigWatcher watch path=" << path
+            << " fail errno=" << errno << " strerr=" << strerror(errno);
+        return false;
+    }
+    std::string dir = path;
+    std::string name;
+    bool is_dir = S_ISDIR(st.st_mode);
+    if (!is_dir) {
+        size_t pos = path.rfind('/');
+        dir = pos == std::string::npos ? "." : (pos == 0 ? "/" : path.substr(0, pos));
+        name = path.substr(pos == std::string::npos ? 0 : pos + 1);
+    }
+    while (dir.size() > 1 && dir.back() == '/') {
+        dir.pop_back();
+    }
+
+    std::vector<std::string> files;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            return false;
+        }
+        // 同一个目录多次add_watch返回同一个wd，不会重复监听
+        int wd = inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            YUAN_LOG_ERROR(g_logger) << "inotify_add_watch dir=" << dir
+                << " fail errno=" << errno << " strerr=" << strerror(errno);
+            return false;
+        }
+        WatchDir &watch_dir = m_dirs[wd];
+        watch_dir.path = dir;
+        if (is_dir) {
+            watch_dir.all = true;
+        } else {
+            watch_dir.files.insert(name);
+        }
+    }
+
+    if (is_dir) {
+        DIR *d = opendir(dir.c_str());
+        if (d) {
+            struct dirent *dp = nullptr;
+            while ((dp = readdir(d)) != nullptr) {
+                if (IsYamlFile(dp->d_name)) {
+                    files.push_back(dir + "/" + dp->d_name);
+                }
+            }
+            closedir(d);
+        }
+        // 目录下文件的加载顺序固定，后加载的覆盖先加载的
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(dir + "/" + name);
+    }
+    for (auto &i : files) {
+        reload(i);
+    }
+    return true;
+}
+
+void ConfigWatcher::stop() {
+    MutexType::Lock lock(m_mutex);
+    if (m_stopping) {
+        return;
+    }
+    m_stopping = true;
+    if (m_fd >= 0) {
+        m_iom->delEvent(m_fd, IOManager::READ);
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void ConfigWatcher::setReloadCallback(reload_cb cb) {
+    MutexType::Lock lock(m_mutex);
+    m_cb = cb;
+}
+
+void ConfigWatcher::onEvent() {
+    // 一次保存常常产生好几个事件，同一个文件只加载一次
+    std::set<std::string> files;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while (true) {
+            ssize_t len = read(m_fd, buf, sizeof(buf));
+            if (len <= 0) {
+                if (len < 0 && errno != EAGAIN && errno != EINTR) {
+                    YUAN_LOG_ERROR(g_logger) << "ConfigWatcher read inotify fd=" << m_fd
+                        << " fail errno=" << errno << " strerr=" << strerror(errno);
+                }
+                if (len < 0 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (char *p = buf; p < buf + len; ) {
+                struct inotify_event *event = reinterpret_cast<struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                auto it = m_dirs.find(event->wd);
+                if (it == m_dirs.end()) {
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    // 目录被删除了
+                    YUAN_LOG_WARN(g_logger) << "ConfigWatcher dir=" << it->second.path << " is gone";
+                    m_dirs.erase(it);
+                    continue;
+                }
+                if (!event->len || (event->mask & IN_ISDIR)) {
+                    continue;
+                }
+                std::string name(event->name);
+                if (it->second.all ? IsYamlFile(name) : it->second.files.count(name) > 0) {
+                    files.insert(it->second.path + "/" + name);
+                }
+            }
+        }
+        // 事件触发一次就被移除了，要继续监听
+        addEvent();
+    }
+    for (auto &i : files) {
+        reload(i);
+    }
+}
+
+void ConfigWatcher::reload(const std::string &file) {
+    std::ifstream ifs(file);
+    if (!ifs) {
+        YUAN_LOG_ERROR(g_logger) << "ConfigWatcher open file=" << file << " fail";
+        return;
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    std::string content = ss.str();
+
+    reload_cb cb;
+    {
+        MutexType::Lock lock(m_mutex);
+        // 只是touch了一下或者内容改回原样，不用加载
+        auto it = m_contents.find(file);
+        if (it != m_contents.end() && it->second == content) {
+            return;
+        }
+        m_contents[file] = content;
+        cb = m_cb;
+    }
+
+    std::vector<std::string> changed;
+    try {
+        Config::LoadFromYaml(YAML::Load(content), &changed);
+    } catch (std::exception &e) {
+        // 改到一半的文件可能不是合法的yaml，等下一次保存
+        YUAN_LOG_ERROR(g_logger) << "ConfigWatcher load file=" << file << " fail: " << e.what();
+        MutexType::Lock lock(m_mutex);
+        m_contents.erase(file);
+        return;
+    }
+    ++m_reloadCount;
+    std::stringstream keys;
+    for (auto &i : changed) {
+        keys << " " << i;
+    }
+    YUAN_LOG_INFO(g_logger) << "ConfigWatcher reload file=" << file << " changed:" << keys.str();
+    if (cb) {
+        cb(file, changed);
+    }
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef __YUAN_CONFIG_WATCHER_H__
+#define __YUAN_CONFIG_WATCHER_H__
+
+/**
+ * @file config_watcher.h
+ * 配置文件热加载：用inotify监听yaml配置文件，文件改动后只重新加载改动的文件，
+ * 只有值真正变化的约定项才会触发add_listener注册的回调。这样日志级别、超时等可以在不重启的情况下调整
+ * inotify的fd注册在IOManager上，平时不占线程
+ */
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "iomanager.h"
+#include "thread.h"
+
+namespace yuan {
+
+class ConfigWatcher : public std::enable_shared_from_this<ConfigWatcher> {
+public:
+    typedef std::shared_ptr<ConfigWatcher> ptr;
+    typedef Mutex MutexType;
+    // 每次重新加载一个文件后回调，changed为值发生变化的约定项
+    typedef std::function<void(const std::string &file, const std::vector<std::string> &changed)> reload_cb;
+
+    // 必须用shared_ptr持有，inotify事件的回调里用weak_ptr判断是否还存活。要在iom析构之前stop或析构
+    static ConfigWatcher::ptr Create(IOManager *iom = IOManager::GetThis());
+    ~ConfigWatcher();
+
+    /**
+     * @brief 监听一个yaml文件，或者目录下所有.yml/.yaml文件（不递归），并立即加载一次
+     * 监听的是所在目录而不是文件本身：编辑器保存时常常是写临时文件再rename，直接监听文件会丢掉后续的修改
+     */
+    bool watch(const std::string &path);
+    // 停止监听，之后的文件改动不再加载
+    void stop();
+
+    void setReloadCallback(reload_cb cb);
+    // 实际重新加载（内容有变化）的次数
+    uint64_t getReloadCount() const { return m_reloadCount; }
+private:
+    ConfigWatcher(IOManager *iom);
+    bool init();
+    // 注册读事件，事件触发一次后要重新注册
+    void addEvent();
+    void onEvent();
+    // 重新加载一个文件，内容和上次加载的相同时跳过
+    void reload(const std::string &file);
+private:
+    // 一个被监听的目录
+    struct WatchDir {
+        std::string path;
+        // 监听目录下所有的yaml文件
+        bool all = false;
+        // 只监听其中的这些文件
+        std::set<std::string> files;
+    };
+
+    IOManager *m_iom;
+    int m_fd = -1;
+    bool m_stopping = false;
+    std::atomic<uint64_t> m_reloadCount = {0};
+    // 保护以下成员
+    MutexType m_mutex;
+    // inotify的watch描述符 -> 目录
+    std::map<int, WatchDir> m_dirs;
+    // 文件 -> 上次加载的内容
+    std::map<std::string, std::string> m_contents;
+    reload_cb m_cb;
+};
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "crc32c.h"
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#include "endian.h"
+
+namespace yuan {
+
+namespace {
+
+// Castagnoli多项式按位反转后的形式
+static const uint32_t s_poly = 0x82f63b78;
+
+/**
+ * slicing-by-8的8张表：s_table[0]是普通的逐字节查表，s_table[k][i]为字节i后面再跟k个0字节的结果，
+ * 这样8个字节各查一张表再异或起来，一次就能处理8个字节
+ */
+struct Tables {
+    uint32_t table[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc >> 1) ^ (s_poly & (0 - (crc & 1)));
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+// 其他文件的静态初始化里也可能用到，不依赖初始化顺序
+const Tables &GetTables() {
+    static const Tables s_tables;
+    return s_tables;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t ExtendSse42(uint32_t crc, const uint8_t *p, size_t len) {
+    // 先按字节处理到8字节对齐
+    while (len > 0 && (reinterpret_cast<uintptr_t>(p) & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --len;
+    }
+    uint64_t crc64 = crc;
+    // 展开4次，减少循环本身的开销
+    while (len >= 32) {
+        uint64_t w[4];
+        memcpy(w, p, sizeof(w));
+        crc64 = _mm_crc32_u64(crc64, w[0]);
+        crc64 = _mm_crc32_u64(crc64, w[1]);
+        crc64 = _mm_crc32_u64(crc64, w[2]);
+        crc64 = _mm_crc32_u64(crc64, w[3]);
+        p += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        crc64 = _mm_crc32_u64(crc64, w);
+        p += 8;
+        len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        --len;
+    }
+    return crc;
+}
+
+static bool HasSse42() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+static const bool s_has_sse42 = HasSse42();
+
+#endif
+
+}
+
+uint32_t Crc32c::ExtendPortable(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    const uint32_t (&t)[8][256] = GetTables().table;
+#if YUAN_BYTE_ORDER == YUAN_LITTLE_ENDIAN
+    while (len >= 8) {
+        uint32_t one;
+        uint32_t two;
+        memcpy(&one, p, sizeof(one));
+        memcpy(&two, p + 4, sizeof(two));
+        one ^= crc;
+        crc = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^ t[5][(one >> 16) & 0xff] ^ t[4][one >> 24]
+            ^ t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^ t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+        --len;
+    }
+    return ~crc;
+}
+
+uint32_t Crc32c::Extend(uint32_t crc, const void *data, size_t len) {
+#if defined(__x86_64__)
+    if (s_has_sse42) {
+        return ~ExtendSse42(~crc, static_cast<const uint8_t*>(data), len);
+    }
+#endif
+    return ExtendPortable(crc, data, len);
+}
+
+bool Crc32c::IsHardwareAccelerated() {
+#if defined(__x86_64__)
+    return s_has_sse42;
+#else
+    return false;
+#endif
+}
+
+}
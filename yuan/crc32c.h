@@ -0,0 +1,33 @@
+#ifndef __YUAN_CRC32C_H__
+#define __YUAN_CRC32C_H__
+
+/**
+ * @file crc32c.h
+ * CRC32C（Castagnoli多项式，和iSCSI、ext4、leveldb等用的相同）校验，给二进制协议的每条消息做完整性检查
+ * x86上有SSE4.2时用crc32指令（运行时检测CPU），否则用slicing-by-8查表，一次处理8个字节
+ * ByteArray上的一段数据见ByteArray::getCrc32c，不需要先拷贝成连续的内存
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace yuan {
+
+class Crc32c {
+public:
+    // 一段数据的CRC32C
+    static uint32_t Value(const void *data, size_t len) { return Extend(0, data, len); }
+    /**
+     * @brief 增量计算：crc为前面数据的结果，返回前面的数据接上data之后的结果。
+     * 即Extend(Value(a), b) == Value(a + b)，边写边算时每次传入上次的结果即可
+     */
+    static uint32_t Extend(uint32_t crc, const void *data, size_t len);
+    // 不用硬件指令的实现，结果和Extend相同
+    static uint32_t ExtendPortable(uint32_t crc, const void *data, size_t len);
+    // 当前CPU是否支持crc32指令
+    static bool IsHardwareAccelerated();
+};
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "epoch.h"
+#include <algorithm>
+#include "macro.h"
+
+namespace yuan {
+
+// 当前线程在EpochManager里的记录。一个线程只会属于一个EpochManager（全局单例）
+static thread_local void *t_record = nullptr;
+
+// 每隔多少个静止点尝试一次回收
+static const uint32_t s_reclaim_interval = 64;
+
+EpochManager::EpochManager() {
+    // 从1开始，0用来表示线程离线
+    m_epoch.store(1, std::memory_order_relaxed);
+    m_pending.store(0, std::memory_order_relaxed);
+}
+
+EpochManager::~EpochManager() {
+    // 进程退出时，所有等待回收的都直接释放
+    for (auto &i : m_retired) {
+        i.deleter(i.ptr);
+    }
+    for (auto &i : m_records) {
+        delete i;
+    }
+}
+
+EpochManager::ThreadRecord *EpochManager::getRecord() {
+    return static_cast<ThreadRecord*>(t_record);
+}
+
+void EpochManager::registerThread() {
+    ThreadRecord *record = getRecord();
+    if (record) {
+        ++record->refs;
+        return;
+    }
+    record = new ThreadRecord;
+    record->refs = 1;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_records.push_back(record);
+    }
+    t_record = record;
+    online();
+}
+
+void EpochManager::unregisterThread() {
+    ThreadRecord *record = getRecord();
+    if (!record || --record->refs > 0) {
+        return;
+    }
+    {
+        MutexType::Lock lock(m_mutex);
+        m_records.erase(std::find(m_records.begin(), m_records.end(), record));
+    }
+    t_record = nullptr;
+    delete record;
+    tryReclaim();
+}
+
+void EpochManager::quiescent() {
+    ThreadRecord *record = getRecord();
+    if (!record) {
+        return;
+    }
+    // 读者的快速路径：一次load和一次store，没有读改写
+    // release保证之前对受保护数据的读取都在这次store之前完成
+    record->epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_release);
+    if (YUAN_UNLIKELY(++record->ticks % s_reclaim_interval == 0)
+            && m_pending.load(std::memory_order_relaxed)) {
+        tryReclaim();
+    }
+}
+
+void EpochManager::offline() {
+    ThreadRecord *record = getRecord();
+    if (record) {
+        record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void EpochManager::online() {
+    ThreadRecord *record = getRecord();
+    if (record) {
+        // 和回收线程扫描记录之间需要store-load的顺序：要么回收线程看到本线程在线，要么本线程之后读到的都是新数据
+        record->epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+bool EpochManager::isOnline() const {
+    ThreadRecord *record = static_cast<ThreadRecord*>(t_record);
+    return record && record->epoch.load(std::memory_order_relaxed) != 0;
+}
+
+void EpochManager::retire(void *p, Deleter deleter) {
+    if (!p) {
+        return;
+    }
+    // 推进全局纪元。在线线程的记录不小于item.epoch，说明它在p被摘下之后经过了静止点
+    uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_retired.push_back({p, deleter, epoch});
+    }
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t EpochManager::tryReclaim() {
+    std::list<RetiredItem> reclaim;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_retired.empty()) {
+            return 0;
+        }
+        // 所有在线线程里最小的纪元
+        uint64_t min_epoch = UINT64_MAX;
+        for (auto &i : m_records) {
+            uint64_t e = i->epoch.load(std::memory_order_seq_cst);
+            if (e != 0 && e < min_epoch) {
+                min_epoch = e;
+            }
+        }
+        // 多个写者并发retire时，m_retired不一定严格按纪元排列，所以要完整遍历
+        auto it = m_retired.begin();
+        while (it != m_retired.end()) {
+            auto cur = it++;
+            if (cur->epoch <= min_epoch) {
+                reclaim.splice(reclaim.end(), m_retired, cur);
+            }
+        }
+    }
+    // 在锁外释放，deleter里可能还会retire
+    for (auto &i : reclaim) {
+        i.deleter(i.ptr);
+    }
+    m_pending.fetch_sub(reclaim.size(), std::memory_order_relaxed);
+    return reclaim.size();
+}
+
+}
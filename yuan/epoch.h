@@ -0,0 +1,90 @@
+#ifndef __YUAN_EPOCH_H__
+#define __YUAN_EPOCH_H__
+
+/**
+ * @file epoch.h
+ * 基于静止状态(QSBR, quiescent-state-based reclamation)的内存回收，给无锁数据结构安全地释放旧节点用
+ * 思路：写者把旧节点从数据结构上摘下后不立即释放，而是retire，记下当时的纪元(epoch)。
+ * 每个注册过的线程在“静止点”（此时不持有任何受保护的指针）把全局纪元抄到自己的记录里。
+ * 所有在线线程都越过了某个纪元后，该纪元之前retire的节点就不会再有人访问，可以释放
+ * 读者不需要任何原子的读改写，只在静止点做一次普通的store
+ *
+ * Scheduler的每个线程会自动注册，run方法每次循环都是一个静止点，idle期间为离线状态，不会拖住回收。
+ * 因此在调度器的任务里读受保护的指针时，不能跨越协程切换（hook的IO、sleep等）持有它，需要的话先拷贝出来
+ * 调度器之外的线程要访问受保护的数据，需要自己registerThread，并定期调用quiescent
+ */
+
+#include <atomic>
+#include <list>
+#include <vector>
+#include "singleton.h"
+#include "thread.h"
+
+namespace yuan {
+
+class EpochManager : Noncopyable {
+public:
+    typedef Mutex MutexType;
+    typedef void (*Deleter)(void *);
+
+    EpochManager();
+    ~EpochManager();
+
+    // 注册/注销当前线程。可以嵌套调用，注销次数和注册次数相同时才真正注销
+    void registerThread();
+    void unregisterThread();
+
+    // 静止点：当前线程声明自己不再持有任何受保护的指针。未注册的线程调用无效果
+    void quiescent();
+    // 离线期间（比如阻塞在epoll_wait上）不会阻止回收，但也不能访问受保护的数据
+    void offline();
+    void online();
+    // 当前线程是否已注册且在线，在线时可以访问受保护的数据
+    bool isOnline() const;
+
+    // 延迟释放。p已经不能被新的读者访问到，等所有线程都越过当前纪元后调用deleter(p)
+    void retire(void *p, Deleter deleter);
+    template<typename T>
+    void retire(T *p) {
+        retire(p, [](void *ptr) { delete static_cast<T*>(ptr); });
+    }
+
+    // 尝试回收，返回释放的个数。quiescent里会按需自动调用，一般不需要手动调用
+    size_t tryReclaim();
+    // 等待回收的个数
+    size_t getPending() const { return m_pending.load(std::memory_order_relaxed); }
+    uint64_t getEpoch() const { return m_epoch.load(std::memory_order_relaxed); }
+private:
+    // 每个线程的记录。epoch为0表示离线
+    struct ThreadRecord {
+        std::atomic<uint64_t> epoch = {0};
+        // 嵌套注册的次数
+        int refs = 0;
+        // 静止点计数，用来控制自动回收的频率
+        uint32_t ticks = 0;
+        char pad[YUAN_CACHELINE_SIZE];
+    };
+
+    struct RetiredItem {
+        void *ptr;
+        Deleter deleter;
+        uint64_t epoch;
+    };
+
+    ThreadRecord *getRecord();
+private:
+    std::atomic<uint64_t> m_epoch;
+    char m_pad0[YUAN_CACHELINE_SIZE];
+    std::atomic<size_t> m_pending;
+    char m_pad1[YUAN_CACHELINE_SIZE];
+    // 保护m_records和m_retired
+    MutexType m_mutex;
+    std::vector<ThreadRecord*> m_records;
+    std::list<RetiredItem> m_retired;
+};
+
+typedef Singleton<EpochManager> EpochMgr;
+
+}
+
+#endif
@@ -79,6 +79,7 @@ void FdCtx::setTimeout(int type, uint64_t timeout) {
  * FdManager的方法实现
  */
 FdManager::FdManager() {
+    m_mutex.setName("FdManager::m_mutex");
     m_datas.resize(64);
 }
 
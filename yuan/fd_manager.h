@@ -56,7 +56,8 @@ private:
 // fd管理类，使用时要用下面的单例模式
 class FdManager {
 public:
-    typedef RWMutex RWMutexType;
+    // 每次hook的IO都要读fd表，写只发生在新建fd时，用偏向读者的读写锁
+    typedef BRWMutex RWMutexType;
     FdManager();
 
     // auto_create为true，则fd封装类不存在就创建一个
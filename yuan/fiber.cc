@@ -49,7 +49,7 @@ Fiber::Fiber() {
 
     ++s_fiber_count;
 
-    YUAN_LOG_DEBUG(g_system_logger) << "Thread main fiber construct: id " << m_id;
+    YUAN_DLOG_DEBUG(g_system_logger) << "Thread main fiber construct: id " << m_id;
 }
 
 // 这个方法是真正构造工作的协程
@@ -71,10 +71,10 @@ Fiber::Fiber(std::function<void()> cb, size_t stackSize, bool use_caller) : m_id
     
     if (!use_caller) {
         makecontext(&m_ctx, MainFunc, 0);
-        YUAN_LOG_DEBUG(g_system_logger) << "Thread sub fiber construct: id " << m_id;
+        YUAN_DLOG_DEBUG(g_system_logger) << "Thread sub fiber construct: id " << m_id;
     } else {
         makecontext(&m_ctx, CallerMainFunc, 0);
-        YUAN_LOG_DEBUG(g_system_logger) << "Thread sub Scheduler root fiber construct: id " << m_id;
+        YUAN_DLOG_DEBUG(g_system_logger) << "Thread sub Scheduler root fiber construct: id " << m_id;
     }
 }
 
@@ -94,7 +94,7 @@ Fiber::~Fiber() {
     }
 
     // 调试，确保所有协程都析构
-    YUAN_LOG_DEBUG(g_system_logger) << "~Fiber: id " << m_id;
+    YUAN_DLOG_DEBUG(g_system_logger) << "~Fiber: id " << m_id;
 }
 
 void Fiber::reset(std::function<void()> cb) {
@@ -113,6 +113,7 @@ void Fiber::reset(std::function<void()> cb) {
     makecontext(&m_ctx, MainFunc, 0);
 
     m_cb = cb;
+    m_cancelToken = nullptr;
     m_state = INIT;
 }
 
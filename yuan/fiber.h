@@ -11,6 +11,7 @@
 #include <ucontext.h>
 #include <functional>
 #include <memory>
+#include "cancel_token.h"
 #include "thread.h"
 
 namespace yuan {
@@ -54,6 +55,9 @@ public:
     uint64_t getId() const { return m_id; }
     State getState() const { return m_state; }
     void setState(State state) { m_state = state; }
+    // 绑定到协程上的取消令牌，hook的IO和sleep会检查它。reset时会被清除
+    CancelToken::ptr getCancelToken() const { return m_cancelToken; }
+    void setCancelToken(CancelToken::ptr token) { m_cancelToken = token; }
 public:
     // 设置当前协程
     static void SetThis(Fiber *fiber);
@@ -82,6 +86,7 @@ private:
     ucontext_t m_ctx;
     // void()因为协程库API传入的工作函数也是该signature
     std::function<void()> m_cb;
+    CancelToken::ptr m_cancelToken;
 };
 
 }
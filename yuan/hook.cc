@@ -89,6 +89,66 @@ struct timer_info {
     int cancelled = 0;
 };
 
+// 在当前协程的取消令牌上注册唤醒函数：令牌被取消时，以ECANCELED取消在fd上监听的事件，强制唤醒当前协程
+// 返回注册的id。返回0且token不为空，说明令牌已经被取消
+static uint64_t add_cancel_waker(yuan::CancelToken::ptr token, std::weak_ptr<timer_info> wtinfo
+                , yuan::IOManager *iomanager, int fd, uint32_t event) {
+    if (!token) {
+        return 0;
+    }
+    return token->addWaker([wtinfo, iomanager, fd, event](){
+        auto t = wtinfo.lock();
+        if (!t || t->cancelled) {
+            return;
+        }
+        t->cancelled = ECANCELED;
+        iomanager->cancelEvent(fd, static_cast<yuan::IOManager::Event>(event));
+    });
+}
+
+// 可取消的sleep。返回0表示睡足了时间，返回ECANCELED表示被取消令牌提前唤醒
+static int do_sleep(uint64_t ms) {
+    yuan::Fiber::ptr fiber = yuan::Fiber::GetThis();
+    yuan::IOManager *iomanager = yuan::IOManager::GetThis();
+    yuan::CancelToken::ptr token = fiber->getCancelToken();
+    if (token && token->isCancelled()) {
+        return ECANCELED;
+    }
+    // sleep被hook为，当前协程放弃执行权，添加定时器，到了指定时间再被放到任务队列里被执行
+    // 注意下面bind的使用、加转型是因为Scheduler里有多个schedule的实现，不强转就不知道要bind哪一个。另外有默认值的参数这里也要明确赋值，不能像函数调用一样
+    yuan::Timer::ptr timer = iomanager->addTimer(ms
+        , std::bind(static_cast<void(yuan::Scheduler::*)(yuan::Fiber::ptr, int thread)>(&yuan::Scheduler::schedule)
+            , iomanager, fiber, -1));
+    // iomanager->addTimer(ms, [iomanager, fiber](){
+    //     iomanager->schedule(fiber);
+    // });
+
+    int rt = 0;
+    uint64_t waker_id = 0;
+    if (token) {
+        // 定时器和取消只有一方能唤醒协程：谁成功把定时器从队列里取消掉（或定时器已经触发），谁负责唤醒
+        std::shared_ptr<int> cancelled(new int(0));
+        waker_id = token->addWaker([timer, iomanager, fiber, cancelled](){
+            if (timer->cancel()) {
+                *cancelled = ECANCELED;
+                iomanager->schedule(fiber);
+            }
+        });
+        if (!waker_id && timer->cancel()) {
+            return ECANCELED;
+        }
+        fiber.reset();
+        yuan::Fiber::YieldToHold();
+        // delWaker返回后，唤醒函数不会再执行，可以安全地读取结果
+        token->delWaker(waker_id);
+        rt = *cancelled;
+    } else {
+        fiber.reset();
+        yuan::Fiber::YieldToHold();
+    }
+    return rt;
+}
+
 // 重点：hook socket IO的统一实现方法。想要实现用法是同步的，但实际上是异步的效果。即有异步的高效性，又避免了使用异步时各种回调的复杂性。
 // fun是要hook的系统函数，timeout_so是超时类型
 template<typename OriginFun, typename ... Args>
@@ -116,6 +176,11 @@ static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name, uint32_t
 
     uint64_t timeout = fd_ctx->getTimeout(timeout_so);
     std::shared_ptr<timer_info> tinfo(new timer_info);
+    yuan::CancelToken::ptr token = yuan::Fiber::GetThis()->getCancelToken();
+    if (token && token->isCancelled()) {
+        errno = ECANCELED;
+        return -1;
+    }
 
 retry:
     ssize_t n = fun(fd, std::forward<Args>(args)...);
@@ -149,7 +214,8 @@ retry:
         // 在epoll里继续监听该fd上的该事件。参数没加回调，则当前协程为唤醒对象。返回值不为0，则添加监听失败
         int ret = iomanager->addEvent(fd, static_cast<yuan::IOManager::Event>(event));
         if (ret) {
-            YUAN_LOG_ERROR(yuan::g_system_logger) << hook_fun_name << "addEvent("
+            // 出错时往往是所有连接都在出错，限流防止日志刷屏
+            YUAN_LOG_ERROR_LIMIT(yuan::g_system_logger, 10, 1000) << hook_fun_name << "addEvent("
                 << fd << " , " << event << ")";
             if (timer) {
                 // 监听事件失败，则定时器也取消掉
@@ -159,13 +225,27 @@ retry:
         }
         // epoll添加事件监听成功 
         else {
+            // 事件添加成功后再注册取消的唤醒函数，否则取消时可能还没有事件可以cancel，协程就永远挂起了
+            uint64_t waker_id = add_cancel_waker(token, wtinfo, iomanager, fd, event);
+            if (token && !waker_id) {
+                // 令牌在这期间被取消了，撤掉刚加的事件，直接返回
+                iomanager->delEvent(fd, static_cast<yuan::IOManager::Event>(event));
+                if (timer) {
+                    timer->cancel();
+                }
+                errno = ECANCELED;
+                return -1;
+            }
             // YieldToHold和YieldToReady的区别主要看scheduler.cc里的run方法
             yuan::Fiber::YieldToHold();
-            // 协程被唤醒，可能从两个点唤醒回来：监听的事件及时发生，或超时导致上面的cancelEvent被调用到。
-            // 无论哪种情况，有定时器就要cancel掉
+            // 协程被唤醒，可能从三个点唤醒回来：监听的事件及时发生，或超时、取消导致cancelEvent被调用到。
+            // 无论哪种情况，有定时器就要cancel掉，唤醒函数也要注销
             if (timer) {
                 timer->cancel();
             }
+            if (waker_id) {
+                token->delWaker(waker_id);
+            }
             // 判断是因为哪种情况被唤醒的。如果已经超时，则不再尝试读写数据，直接返回
             if (tinfo->cancelled) {
                 errno = tinfo->cancelled;
@@ -195,18 +275,12 @@ unsigned int sleep(unsigned int seconds) {
         return sleep_f(seconds);
     }
 
-    yuan::Fiber::ptr fiber = yuan::Fiber::GetThis();
-    yuan::IOManager *iomanager = yuan::IOManager::GetThis();
-    // sleep被hook为，当前协程放弃执行权，添加定时器，到了指定时间再被放到任务队列里被执行
-    // 注意下面bind的使用、加转型是因为Scheduler里有两个schedule的实现，不强转就不知道要bind哪一个。另外有默认值的参数这里也要明确赋值，不能像函数调用一样
-    iomanager->addTimer(seconds * 1000
-        , std::bind(static_cast<void(yuan::Scheduler::*)(yuan::Fiber::ptr, int thread)>(&yuan::Scheduler::schedule)
-            , iomanager, fiber, -1));
-    // iomanager->addTimer(seconds * 1000, [iomanager, fiber](){
-    //     iomanager->schedule(fiber);
-    // });
-    yuan::Fiber::YieldToHold();
-
+    // sleep被hook为，当前协程放弃执行权，到了指定时间再被放到任务队列里被执行。具体看do_sleep
+    // 被取消时和被信号打断一样，返回没睡完的秒数（这里简单返回全部），errno为ECANCELED
+    if (do_sleep(seconds * 1000)) {
+        errno = ECANCELED;
+        return seconds;
+    }
     return 0;
 }
 
@@ -217,17 +291,10 @@ int usleep(useconds_t usec) {
         return usleep_f(usec);
     }
 
-    yuan::Fiber::ptr fiber = yuan::Fiber::GetThis();
-    yuan::IOManager *iomanager = yuan::IOManager::GetThis();
-    // usleep被hook为，当前协程放弃执行权，添加定时器，到了指定时间再被放到任务队列里被执行
-    iomanager->addTimer(usec / 1000, 
-        std::bind(static_cast<void(yuan::Scheduler::*)(yuan::Fiber::ptr, int thread)>(&yuan::Scheduler::schedule)
-            , iomanager, fiber, -1));
-    // iomanager->addTimer(usec / 1000, [iomanager, fiber](){
-    //     iomanager->schedule(fiber);
-    // });
-    yuan::Fiber::YieldToHold();
-
+    if (do_sleep(usec / 1000)) {
+        errno = ECANCELED;
+        return -1;
+    }
     return 0;
 }
 
@@ -239,13 +306,13 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
     }
 
     int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
-    yuan::Fiber::ptr fiber = yuan::Fiber::GetThis();
-    yuan::IOManager *iomanager = yuan::IOManager::GetThis();
-    iomanager->addTimer(timeout_ms, 
-        std::bind(static_cast<void(yuan::Scheduler::*)(yuan::Fiber::ptr, int thread)>(&yuan::Scheduler::schedule)
-            , iomanager, fiber, -1));
-    yuan::Fiber::YieldToHold();
-
+    if (do_sleep(timeout_ms)) {
+        if (rem) {
+            *rem = *req;
+        }
+        errno = ECANCELED;
+        return -1;
+    }
     return 0;
 }
 
@@ -288,6 +355,7 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
     yuan::Timer::ptr timer;
     std::shared_ptr<timer_info> tinfo(new timer_info);
     std::weak_ptr<timer_info> wtinfo(tinfo);
+    yuan::CancelToken::ptr token = yuan::Fiber::GetThis()->getCancelToken();
 
     if (timeout_ms != static_cast<uint64_t>(-1)) {
         timer = iomanager->addConditionTimer(timeout_ms, [iomanager, sockfd, wtinfo](){
@@ -303,10 +371,22 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
     // connect非阻塞时要监听写事件
     int ret = iomanager->addEvent(sockfd, yuan::IOManager::WRITE);
     if (ret == 0) {
+        uint64_t waker_id = add_cancel_waker(token, wtinfo, iomanager, sockfd, yuan::IOManager::WRITE);
+        if (token && !waker_id) {
+            iomanager->delEvent(sockfd, yuan::IOManager::WRITE);
+            if (timer) {
+                timer->cancel();
+            }
+            errno = ECANCELED;
+            return -1;
+        }
         yuan::Fiber::YieldToHold();
         if (timer) {
             timer->cancel();
         }
+        if (waker_id) {
+            token->delWaker(waker_id);
+        }
         if (tinfo->cancelled) {
             errno = tinfo->cancelled;
             return -1;
@@ -315,7 +395,7 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
         if (timer) {
             timer->cancel();
         }
-        YUAN_LOG_ERROR(yuan::g_system_logger) << "connect addEvent(" << sockfd << ", WRITE) ERROR";
+        YUAN_LOG_ERROR_LIMIT(yuan::g_system_logger, 10, 1000) << "connect addEvent(" << sockfd << ", WRITE) ERROR";
     }
 
     // sockfd上有写事件不代表connect成功，还需下面的判断。看man connect的EINPROGRESS部分
@@ -14,7 +14,9 @@ int32_t FunctionServlet::handle(HttpRequest::ptr req
 }
 
 ServletDispatch::ServletDispatch(const std::string &name)
-    : Servlet(name), m_default(new NotFoundServlet()) {}
+    : Servlet(name), m_default(new NotFoundServlet()) {
+    m_mutex.setName("ServletDispatch::m_mutex");
+}
 
 int32_t ServletDispatch::handle(HttpRequest::ptr req
                                 , HttpResponse::ptr resp, HttpSession::ptr session) {
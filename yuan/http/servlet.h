@@ -46,8 +46,8 @@ private:
 class ServletDispatch : public Servlet {
 public:
     typedef std::shared_ptr<ServletDispatch> ptr;
-    // 明显写少读多，故用读写锁
-    typedef RWMutex RWMutexType;
+    // 明显写少读多，故用偏向读者的读写锁
+    typedef BRWMutex RWMutexType;
 
     ServletDispatch(const std::string &name = "ServletDispatch");
     // 查找到符合req里path的Servlet，交给它来执行
@@ -6,6 +6,7 @@
 #include <sys/epoll.h>
 #include <unistd.h>
 
+#include "clock.h"
 #include "macro.h"
 #include "iomanager.h"
 #include "log.h"
@@ -56,6 +57,7 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
 IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
     : Scheduler(threads, use_caller, name) {
 
+    m_mutex.setName("IOManager::m_mutex");
     m_epfd = epoll_create(1);
     YUAN_ASSERT(m_epfd > 0);
 
@@ -265,6 +267,7 @@ void IOManager::tickle() {
     }
     int ret = write(m_tickleFds[1], "T", 1);
     YUAN_ASSERT(ret == 1);
+    ++m_ticklesSent;
 }
 
 bool IOManager::stopping() {
@@ -286,8 +289,11 @@ void IOManager::idle() {
     std::shared_ptr<epoll_event> events_ptr(epevents, [](epoll_event *ep_event){
         delete [] ep_event;
     });
+    SchedulerThreadMetrics *metrics = GetThreadMetrics();
 
     while (true) {
+        // 每轮循环刷新一次缓存的时间，定时器都用它
+        Clock::Update();
         // 距最近的定时器执行还有多长时间
         uint64_t next_timeout = 0;
         if (stopping(next_timeout)) {
@@ -312,6 +318,15 @@ void IOManager::idle() {
             }
         } while (true);
 
+        if (metrics) {
+            ++metrics->epollWakeups;
+            if (IsHistogramsEnabled()) {
+                metrics->eventsPerWait.record(ret > 0 ? ret : 0);
+            }
+        }
+
+        // epoll_wait可能等了很久
+        Clock::Update();
         // 先处理epoll_wait唤醒是因为有定时任务的情况
         std::vector<std::function<void()>> timer_cbs;
         listExpiredCbs(timer_cbs);
@@ -326,7 +341,11 @@ void IOManager::idle() {
             if (ep_event.data.fd == m_tickleFds[0]) {
                 uint8_t dummy;
                 // 可能有多个其他线程都tickle了，把管道中的数据都取出来。但这些数据没有用，仅仅是通知
-                while (read(m_tickleFds[0], &dummy, 1) == 1);
+                while (read(m_tickleFds[0], &dummy, 1) == 1) {
+                    if (metrics) {
+                        ++metrics->ticklesReceived;
+                    }
+                }
                 continue;
             }
 
@@ -343,7 +362,9 @@ void IOManager::idle() {
 
             FdContext *fd_ctx = static_cast<FdContext*>(ep_event.data.ptr);
             FdContext::MutexType::Lock lock(fd_ctx->mutex);
-            if ((fd_ctx->events & real_events) == NONE) {
+            // EPOLLERR/EPOLLHUP时上面把读写都置上了，只触发真正注册过的事件
+            real_events &= fd_ctx->events;
+            if (real_events == NONE) {
                 continue;
             }
 
@@ -387,6 +408,7 @@ void IOManager::resizeFdContexts(size_t size) {
     for (size_t i = 0; i < m_fdContexts.size(); ++i) {
         if (!m_fdContexts[i]) {
             m_fdContexts[i] = new FdContext();
+            m_fdContexts[i]->mutex.setName("IOManager::FdContext::mutex");
         }
         m_fdContexts[i]->fd = i;
     }
@@ -15,7 +15,8 @@ namespace yuan {
 class IOManager : public Scheduler, public TimerManager {
 public:
     typedef std::shared_ptr<IOManager> ptr;
-    typedef RWMutex RWMutexType;
+    // 保护m_fdContexts。每次添加删除事件都要读，只有扩容时写
+    typedef BRWMutex RWMutexType;
 
     enum Event {
         NONE = 0x0,
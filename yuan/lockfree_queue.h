@@ -0,0 +1,335 @@
+#ifndef __YUAN_LOCKFREE_QUEUE_H__
+#define __YUAN_LOCKFREE_QUEUE_H__
+
+/**
+ * @file lockfree_queue.h
+ * 无锁队列，用于线程间传递任务或数据，替代Mutex + std::list的写法
+ * MPMCQueue: 有界，多生产者多消费者。Dmitry Vyukov的环形队列：http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ * MPSCQueue: 无界，多生产者单消费者。Vyukov的链表队列，入队只有一次原子交换，适合很多线程往一个线程投递
+ * SPSCQueue: 有界，单生产者单消费者。只用load/store，开销最低
+ * 生产者和消费者频繁修改的下标之间用填充隔开，放在不同的缓存行上
+ * 所有的操作都不阻塞：队列满或空时直接返回false，由调用者决定是重试、让出还是丢弃
+ */
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+#include <vector>
+#include "noncopyable.h"
+#include "thread.h"
+
+namespace yuan {
+
+// 向上取整到2的幂，用位与代替取模
+static inline size_t RoundUpPowerOfTwo(size_t n) {
+    size_t rt = 1;
+    while (rt < n) {
+        rt <<= 1;
+    }
+    return rt;
+}
+
+// 有界的多生产者多消费者队列。T需要能默认构造和移动赋值
+// 每个槽位有一个序号：等于下标时表示空闲可写，等于下标+1时表示有数据可读。生产者和消费者各自用CAS抢下标
+template<typename T>
+class MPMCQueue : Noncopyable {
+public:
+    // 容量会向上取整到2的幂
+    MPMCQueue(size_t capacity)
+        : m_mask(RoundUpPowerOfTwo(capacity < 2 ? 2 : capacity) - 1)
+        , m_cells(m_mask + 1) {
+        for (size_t i = 0; i <= m_mask; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    bool push(const T &v) {
+        T tmp(v);
+        return push(std::move(tmp));
+    }
+
+    bool push(T &&v) {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位上还是上一圈没被取走的数据：队列满
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &v) {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 队列空
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        v = std::move(cell->data);
+        // 留给下一圈的生产者
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 批量入队，返回成功入队的个数。遇到队列满就停止，[begin + 返回值, end)没有入队
+    template<typename Iterator>
+    size_t pushBatch(Iterator begin, Iterator end) {
+        size_t n = 0;
+        for (; begin != end && push(*begin); ++begin, ++n);
+        return n;
+    }
+
+    // 批量出队，最多取max个追加到out里，返回取出的个数
+    size_t popBatch(std::vector<T> &out, size_t max) {
+        size_t n = 0;
+        T v;
+        for (; n < max && pop(v); ++n) {
+            out.push_back(std::move(v));
+        }
+        return n;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+    // 近似值，并发修改时只能作为参考
+    size_t size() const {
+        size_t enq = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t deq = m_dequeuePos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+    bool empty() const { return size() == 0; }
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    char m_pad0[YUAN_CACHELINE_SIZE];
+    const size_t m_mask;
+    std::vector<Cell> m_cells;
+    char m_pad1[YUAN_CACHELINE_SIZE];
+    std::atomic<size_t> m_enqueuePos;
+    char m_pad2[YUAN_CACHELINE_SIZE];
+    std::atomic<size_t> m_dequeuePos;
+    char m_pad3[YUAN_CACHELINE_SIZE];
+};
+
+// 无界的多生产者单消费者队列。pop只能在同一个线程（或同一时刻只有一个线程）调用
+// 注意：生产者交换完m_head、还没链接上next时，消费者会暂时看不到这个及之后的元素，pop返回false，稍后重试即可
+template<typename T>
+class MPSCQueue : Noncopyable {
+public:
+    MPSCQueue() {
+        // 哨兵节点。m_tail始终指向已经被消费过的节点
+        Node *stub = new Node;
+        m_head.store(stub, std::memory_order_relaxed);
+        m_tail = stub;
+    }
+
+    ~MPSCQueue() {
+        Node *node = m_tail;
+        while (node) {
+            Node *next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    void push(const T &v) {
+        Node *node = new Node(v);
+        link(node, node);
+    }
+
+    void push(T &&v) {
+        Node *node = new Node(std::move(v));
+        link(node, node);
+    }
+
+    // 批量入队：先在本地串好链表，再用一次原子交换挂到队尾，多个元素保证连续
+    template<typename Iterator>
+    size_t pushBatch(Iterator begin, Iterator end) {
+        if (begin == end) {
+            return 0;
+        }
+        size_t n = 1;
+        Node *first = new Node(*begin);
+        Node *last = first;
+        for (++begin; begin != end; ++begin, ++n) {
+            Node *node = new Node(*begin);
+            last->next.store(node, std::memory_order_relaxed);
+            last = node;
+        }
+        link(first, last);
+        return n;
+    }
+
+    bool pop(T &v) {
+        Node *tail = m_tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        v = std::move(next->value);
+        m_tail = next;
+        delete tail;
+        return true;
+    }
+
+    size_t popBatch(std::vector<T> &out, size_t max) {
+        size_t n = 0;
+        T v;
+        for (; n < max && pop(v); ++n) {
+            out.push_back(std::move(v));
+        }
+        return n;
+    }
+
+    // 只能在消费者线程调用
+    bool empty() const { return !m_tail->next.load(std::memory_order_acquire); }
+private:
+    struct Node {
+        Node() : next(nullptr) {}
+        Node(const T &v) : next(nullptr), value(v) {}
+        Node(T &&v) : next(nullptr), value(std::move(v)) {}
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    void link(Node *first, Node *last) {
+        Node *prev = m_head.exchange(last, std::memory_order_acq_rel);
+        prev->next.store(first, std::memory_order_release);
+    }
+private:
+    char m_pad0[YUAN_CACHELINE_SIZE];
+    // 生产者修改
+    std::atomic<Node*> m_head;
+    char m_pad1[YUAN_CACHELINE_SIZE];
+    // 消费者修改
+    Node *m_tail;
+    char m_pad2[YUAN_CACHELINE_SIZE];
+};
+
+// 有界的单生产者单消费者环形队列
+// 生产者和消费者各自缓存一份对方的下标，只有看起来满（空）时才去读对方的真实下标，减少缓存行在两个核之间来回传递
+template<typename T>
+class SPSCQueue : Noncopyable {
+public:
+    SPSCQueue(size_t capacity)
+        : m_mask(RoundUpPowerOfTwo(capacity < 2 ? 2 : capacity) - 1)
+        , m_buffer(m_mask + 1) {
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+    bool push(const T &v) {
+        T tmp(v);
+        return push(std::move(tmp));
+    }
+
+    bool push(T &&v) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask) {
+                return false;
+            }
+        }
+        m_buffer[tail & m_mask] = std::move(v);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &v) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+        v = std::move(m_buffer[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 批量入队：全部写完后只发布一次下标
+    template<typename Iterator>
+    size_t pushBatch(Iterator begin, Iterator end) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_cachedHead = m_head.load(std::memory_order_acquire);
+        size_t free = m_mask + 1 - (tail - m_cachedHead);
+        size_t n = 0;
+        for (; begin != end && n < free; ++begin, ++n) {
+            m_buffer[(tail + n) & m_mask] = *begin;
+        }
+        if (n) {
+            m_tail.store(tail + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    // 批量出队：全部取完后只发布一次下标
+    size_t popBatch(std::vector<T> &out, size_t max) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+        size_t n = m_cachedTail - head;
+        if (n > max) {
+            n = max;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            out.push_back(std::move(m_buffer[(head + i) & m_mask]));
+        }
+        if (n) {
+            m_head.store(head + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+    size_t size() const {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+private:
+    char m_pad0[YUAN_CACHELINE_SIZE];
+    const size_t m_mask;
+    std::vector<T> m_buffer;
+    char m_pad1[YUAN_CACHELINE_SIZE];
+    // 消费者修改的下标，以及消费者缓存的生产者下标
+    std::atomic<size_t> m_head;
+    size_t m_cachedTail = 0;
+    char m_pad2[YUAN_CACHELINE_SIZE];
+    // 生产者修改的下标，以及生产者缓存的消费者下标
+    std::atomic<size_t> m_tail;
+    size_t m_cachedHead = 0;
+    char m_pad3[YUAN_CACHELINE_SIZE];
+};
+
+}
+
+#endif
@@ -1,9 +1,22 @@
 #include "log.h"
+#include <algorithm>
 #include <map>
 #include <functional>
 #include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <zlib.h>
+#include "clock.h"
+#include "macro.h"
 #include "config.h"
 #include "log_config.h"
+#include "net_log_appender.h"
 
 namespace yuan {
 
@@ -48,6 +61,130 @@ LogLevel::Level LogLevel::FromString(const std::string &str) {
 #undef XX
 }
 
+LogStream::Buffer::Buffer() {
+    setp(m_inline, m_inline + INLINE_SIZE);
+}
+
+void LogStream::Buffer::reserve(size_t n) {
+    if (avail() >= n) {
+        return;
+    }
+    size_t used = size();
+    size_t cap = (epptr() - pbase()) * 2;
+    while (cap - used < n) {
+        cap *= 2;
+    }
+    if (pbase() == m_inline) {
+        m_heap.resize(cap);
+        memcpy(&m_heap[0], m_inline, used);
+    } else {
+        // vector扩容时会把已有的内容拷过去
+        m_heap.resize(cap);
+    }
+    setp(&m_heap[0], &m_heap[0] + m_heap.size());
+    advance(used);
+}
+
+void LogStream::Buffer::reset() {
+    if (pbase() != m_inline && m_heap.size() > MAX_KEEP_SIZE) {
+        std::vector<char>().swap(m_heap);
+        setp(m_inline, m_inline + INLINE_SIZE);
+    } else {
+        setp(pbase(), epptr());
+    }
+}
+
+LogStream::Buffer::int_type LogStream::Buffer::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    reserve(1);
+    *pptr() = traits_type::to_char_type(c);
+    advance(1);
+    return c;
+}
+
+std::streamsize LogStream::Buffer::xsputn(const char *s, std::streamsize n) {
+    reserve(n);
+    memcpy(pptr(), s, n);
+    advance(n);
+    return n;
+}
+
+// 基类构造时m_buf还没构造，先传空指针，构造完再设置
+LogStream::LogStream() : std::ostream(nullptr) {
+    rdbuf(&m_buf);
+}
+
+void LogStream::reset() {
+    m_buf.reset();
+    clear();
+}
+
+void LogStream::appendf(const char *fmt, va_list al) {
+    va_list copy;
+    va_copy(copy, al);
+    int len = vsnprintf(m_buf.cur(), m_buf.avail(), fmt, copy);
+    va_end(copy);
+    if (len < 0) {
+        return;
+    }
+    // vsnprintf要多写一个'\0'，所以相等时也是放不下
+    if (static_cast<size_t>(len) >= m_buf.avail()) {
+        m_buf.reserve(len + 1);
+        vsnprintf(m_buf.cur(), m_buf.avail(), fmt, al);
+    }
+    m_buf.advance(len);
+}
+
+// 00到99的两位数字表，整数转字符串时每次查表转换两位，除法次数减半
+static const char s_digits2[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// 整数转字符串写到p，返回写完后的位置。uint64_t最多20位
+static char *AppendUInt(char *p, uint64_t v) {
+    // 先从后往前写到临时缓冲区，再拷过去
+    char buf[20];
+    char *end = buf + sizeof(buf);
+    char *begin = end;
+    while (v >= 100) {
+        size_t idx = (v % 100) * 2;
+        v /= 100;
+        begin -= 2;
+        begin[0] = s_digits2[idx];
+        begin[1] = s_digits2[idx + 1];
+    }
+    if (v < 10) {
+        *--begin = static_cast<char>('0' + v);
+    } else {
+        size_t idx = v * 2;
+        begin -= 2;
+        begin[0] = s_digits2[idx];
+        begin[1] = s_digits2[idx + 1];
+    }
+    memcpy(p, begin, end - begin);
+    return p + (end - begin);
+}
+
+// 最多21个字节
+static char *AppendInt(char *p, int64_t v) {
+    if (v < 0) {
+        *p++ = '-';
+        // 直接取负在INT64_MIN时会溢出
+        return AppendUInt(p, ~static_cast<uint64_t>(v) + 1);
+    }
+    return AppendUInt(p, v);
+}
+
+static char *AppendString(char *p, const char *str, size_t len) {
+    memcpy(p, str, len);
+    return p + len;
+}
+
 LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *file, int32_t line, uint32_t threadId, uint32_t fiberId
         , uint64_t time, uint32_t elapse, const std::string &thread_name)
     : m_file(file)
@@ -55,11 +192,28 @@ LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const
     , m_threadId(threadId) 
     , m_threadName(thread_name)
     , m_fiberId(fiberId)
-    , m_time(time)
+    , m_timeUs(time * 1000000)
     , m_elapse(elapse)
     , m_logger(logger)
     , m_level(level) {}
 
+void LogEvent::reset(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const char *file, int32_t line
+        , uint32_t threadId, uint32_t fiberId, uint64_t time_us, uint32_t elapse, const std::string &thread_name) {
+    m_file = file;
+    m_line = line;
+    m_threadId = threadId;
+    // 线程名基本不变，assign会复用已有的内存
+    m_threadName.assign(thread_name);
+    m_fiberId = fiberId;
+    m_timeUs = time_us;
+    m_elapse = elapse;
+    m_ss.reset();
+    if (m_logger != logger) {
+        m_logger = logger;
+    }
+    m_level = level;
+}
+
 void LogEvent::format(const char *fmt, ...) {
     va_list al;
     va_start(al, fmt);
@@ -67,189 +221,143 @@ void LogEvent::format(const char *fmt, ...) {
     va_end(al);
 }
 void LogEvent::format(const char *fmt, va_list al) {
-    char *buf = nullptr;
-    // 该方法会给buf malloc空间，所以后面要free
-    int len = vasprintf(&buf, fmt, al);
-    if (len != -1) {
-        m_ss << std::string(buf, len);
-        free(buf);
-    }
-}
-
-LogEventWrap::LogEventWrap(LogEvent::ptr event) : m_event(event) {
-
-}
-LogEventWrap::~LogEventWrap() {
-    m_event->getLogger()->log(m_event->getLevel(), m_event);
+    m_ss.appendf(fmt, al);
 }
 
-
-/**
- * 以下各项FormatItem的实现是针对log4j的日志格式https://blog.csdn.net/ctwy291314/article/details/83822254
- * 中的各项的具体实现
- */
-
-class MessageFormatItem : public LogFormatter::FormatItem {
-public:
-    MessageFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getContent();
-    }
-};
-
-class LevelFormatItem : public LogFormatter::FormatItem {
-public:
-    LevelFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << LogLevel::ToString(level);
-    }
+// 每个线程缓存的event。按顺序找第一个空闲的，嵌套写日志时会用到后面的
+struct LogEventSlot {
+    LogEvent::ptr event;
+    // 协程在写日志的过程中被切走，可能在别的线程上写完，所以用原子变量
+    std::atomic<bool> busy = {false};
 };
+static const size_t s_log_event_slots = 4;
+static thread_local LogEventSlot t_log_events[s_log_event_slots];
 
-class ElapseFormatItem : public LogFormatter::FormatItem {
-public:
-    ElapseFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getElapse();
-    }
-};
+LogEventWrap::LogEventWrap(LogEvent::ptr event) : m_event(&m_owned), m_owned(event) {
+}
 
-// 日志器的名称
-class LoggerNameFormatItem : public LogFormatter::FormatItem {
-public:
-    LoggerNameFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        // 不能直接用logger，因为传入的logger可能是实际logger里的m_root，当实际logger没有配置时，m_root为兜底方案
-        os << event->getLogger()->getName();
+LogEventWrap::LogEventWrap(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const char *file, int32_t line)
+    : m_event(&m_owned) {
+    LogEvent::ptr *event = nullptr;
+    for (size_t i = 0; i < s_log_event_slots; ++i) {
+        LogEventSlot &slot = t_log_events[i];
+        if (!slot.busy.load(std::memory_order_relaxed)) {
+            slot.busy.store(true, std::memory_order_relaxed);
+            event = &slot.event;
+            m_busy = &slot.busy;
+            break;
+        }
     }
-};
-
-class ThreadIdFormatItem : public LogFormatter::FormatItem {
-public:
-    ThreadIdFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getThreadId();
+    if (YUAN_UNLIKELY(!event)) {
+        // 嵌套太深，退化为每次新建
+        event = &m_owned;
     }
-};
-
-// 多线程，且会有多个线程池，打印出Thread name能提示更多信息
-class ThreadNameFormatItem : public LogFormatter::FormatItem {
-public:
-    ThreadNameFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getThreadName();
+    if (YUAN_UNLIKELY(!*event)) {
+        event->reset(new LogEvent(logger, level, file, line, 0, 0, 0, 0, ""));
     }
-};
+    // 启动到现在的毫秒数，对应%r
+    uint32_t elapse = (Clock::NowNs() - Clock::StartNs()) / 1000000;
+    (*event)->reset(logger, level, file, line, GetThreadId(), GetFiberId()
+        , Clock::WallUs(), elapse, Thread::GetName());
+    m_event = event;
+}
 
-class FiberIdFormatItem : public LogFormatter::FormatItem {
-public:
-    FiberIdFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getFiberId();
+LogEventWrap::~LogEventWrap() {
+    const LogEvent::ptr &event = *m_event;
+    event->getLogger()->log(event->getLevel(), event);
+    if (m_busy) {
+        m_busy->store(false, std::memory_order_release);
     }
-};
+}
 
-class DateTimeFormatItem : public LogFormatter::FormatItem {
-public:
-    explicit DateTimeFormatItem(const std::string &format) : m_format(format) {
-        if (format.empty()) {
-            m_format = "%D";
-        }
-    }
-    // 时间应根据pattern里面的%t{fff}的fff来格式化
-    // 具体日期格式：https://blog.csdn.net/clarkness/article/details/90047406
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        struct tm tm;
-        time_t eventTime = event->getTime();
-        localtime_r(&eventTime, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-        os << buf;
-    }
-private:
-    std::string m_format;
-};
+// 当前线程格式化日志用的缓冲区，清空后返回
+static LogStream &GetFormatStream() {
+    static thread_local LogStream t_stream;
+    t_stream.reset();
+    return t_stream;
+}
 
-class FilenameFormatItem : public LogFormatter::FormatItem {
-public:
-    FilenameFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getFile();
-    }
-};
+/**
+ * LogRateLimiter的实现
+ */
+LogRateLimiter::LogRateLimiter(uint32_t n, uint32_t interval_ms)
+    : m_n(n)
+    , m_intervalNs(interval_ms * 1000000ULL)
+    , m_windowStart(Clock::CoarseNs()) {
+}
 
-class LineFormatItem : public LogFormatter::FormatItem {
-public:
-    LineFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << event->getLine();
+LogRateLimiter::Decision LogRateLimiter::check() {
+    // 粗粒度时钟只读一个内存里的值，精度为一个时钟节拍，对限流足够
+    uint64_t now = Clock::CoarseNs();
+    uint64_t start = m_windowStart.load(std::memory_order_relaxed);
+    if (YUAN_UNLIKELY(now - start >= m_intervalNs)
+            && m_windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        // 开启新窗口的线程负责重置计数。和其他线程的fetch_add之间有竞争，最多让一个窗口多放或少放几条
+        m_count.store(1, std::memory_order_relaxed);
+        return {m_n > 0, m_suppressed.exchange(0, std::memory_order_relaxed)};
     }
-};
-
-class NewLineFormatItem : public LogFormatter::FormatItem {
-public:
-    NewLineFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << std::endl;
+    if (m_count.fetch_add(1, std::memory_order_relaxed) < m_n) {
+        return {true, 0};
     }
-};
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    m_suppressedTotal.fetch_add(1, std::memory_order_relaxed);
+    return {false, 0};
+}
 
-class StringFormatItem : public LogFormatter::FormatItem {
-public:
-    StringFormatItem(const std::string &str)
-        : m_string(str) {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << m_string;
+std::ostream &operator<<(std::ostream &os, const LogRateLimiter::Decision &decision) {
+    if (decision.suppressed) {
+        os << "[suppressed " << decision.suppressed << " messages] ";
     }
-private:
-    std::string m_string;
-};
+    return os;
+}
 
-// log4j里没有tab的格式，而又比较常用，所以增加一个，对应时用T对应，和线程分开
-class TabFormatItem : public LogFormatter::FormatItem {
-public:
-    TabFormatItem(const std::string &str = "") {}
-    virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-        os << '\t';
-    }
-};
 
 /**
  * Logger的实现
  */
 
-Logger::Logger(const std::string &name) : m_name(name), m_level(LogLevel::DEBUG) {
+Logger::Logger(const std::string &name)
+    : m_name(name)
+    , m_level(LogLevel::DEBUG)
+    , m_appenders(std::make_shared<std::vector<LogAppender::ptr> >()) {
+    m_mutex.setName("Logger::m_mutex");
     // 默认的日志输出格式
-    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T<%f:%l>%T%m%n"));
+    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S.%f}%T%t%T%N%T%F%T[%p]%T[%c]%T<%f:%l>%T%m%n"));
 }
-void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
+void Logger::log(LogLevel::Level level, const LogEvent::ptr &event) {
     if (level >= m_level) {
-        MutexType::Lock lock(m_mutex);
+        std::shared_ptr<const std::vector<LogAppender::ptr> > appenders;
+        {
+            MutexType::Lock lock(m_mutex);
+            appenders = m_appenders;
+        }
         // 如果用户并没有对该logger进行配置，则走默认root的日志行为
-        if (!m_appenders.empty()) {
+        if (!appenders->empty()) {
             auto self = shared_from_this();
-            for (auto &appender : m_appenders) {
+            for (auto &appender : *appenders) {
                 appender->log(self, level, event);
             }
-        } else {
+        } else if (m_root) {
+            // root自己的m_root为空，root的appender被清空后日志直接丢弃
             m_root->log(level, event);
-        }    
+        }
     }
 }
 
 // 以下几个方法都调用log，但更方便使用
-void Logger::debug(LogEvent::ptr event) {
+void Logger::debug(const LogEvent::ptr &event) {
     log(LogLevel::DEBUG, event);
 }
-void Logger::info(LogEvent::ptr event) {
+void Logger::info(const LogEvent::ptr &event) {
     log(LogLevel::INFO, event);
 }
-void Logger::warn(LogEvent::ptr event) {
+void Logger::warn(const LogEvent::ptr &event) {
     log(LogLevel::WARN, event);
 }
-void Logger::error(LogEvent::ptr event) {
+void Logger::error(const LogEvent::ptr &event) {
     log(LogLevel::ERROR, event);
 }
-void Logger::fatal(LogEvent::ptr event) {
+void Logger::fatal(const LogEvent::ptr &event) {
     log(LogLevel::FATAL, event);
 }
 
@@ -261,22 +369,34 @@ void Logger::addAppender(LogAppender::ptr appender) {
         MutexType::Lock lock1(appender->m_mutex);
         // Logger是LogAppender的友元。不走appender的setFormatter方法，因为这里只是沿用logger的formatter，appender自己没有
         appender->m_formatter = m_formatter;
+        ++appender->m_formatterVersion;
     }
-    m_appenders.push_back(appender);
+    std::shared_ptr<std::vector<LogAppender::ptr> > appenders(new std::vector<LogAppender::ptr>(*m_appenders));
+    appenders->push_back(appender);
+    m_appenders = appenders;
 }
 
+// 旧的appender列表放到锁外释放：有的appender析构时要停线程（如NetworkLogAppender的IOManager），
+// 那些线程退出时也会写日志，在锁里析构就死锁了。正在log的线程可能还持有旧列表，那时由它最后释放
 void Logger::delAppender(LogAppender::ptr appender) {
+    std::shared_ptr<const std::vector<LogAppender::ptr> > removed;
     MutexType::Lock lock(m_mutex);
-    for (auto it = m_appenders.begin(); it != m_appenders.end(); ++it) {
+    std::shared_ptr<std::vector<LogAppender::ptr> > appenders(new std::vector<LogAppender::ptr>(*m_appenders));
+    for (auto it = appenders->begin(); it != appenders->end(); ++it) {
         if (*it == appender) {
-            m_appenders.erase(it);
+            appenders->erase(it);
+            removed.swap(m_appenders);
+            m_appenders = appenders;
             break;
         }
     }
+    lock.unlock();
 }
 void Logger::clearAppenders() {
+    std::shared_ptr<const std::vector<LogAppender::ptr> > removed(std::make_shared<std::vector<LogAppender::ptr> >());
     MutexType::Lock lock(m_mutex);
-    m_appenders.clear();
+    removed.swap(m_appenders);
+    lock.unlock();
 }
 
 void Logger::setFormatter(const std::string &format) {
@@ -295,10 +415,11 @@ void Logger::setFormatter(LogFormatter::ptr formatter) {
     m_formatter = formatter;
 
     // 有些Appender没有自己的Formatter，要跟着Logger进行变化
-    for (auto &appender : m_appenders) {
+    for (auto &appender : *m_appenders) {
         MutexType::Lock lock1(appender->m_mutex);
         if (!appender->m_hasFormatter) {
             appender->m_formatter = formatter;
+            ++appender->m_formatterVersion;
         }
     }
 }
@@ -317,7 +438,7 @@ std::string Logger::toYAMLString() {
     if (m_formatter) {
         node["formatter"] = m_formatter->getPattern();
     }
-    for (auto &app : m_appenders) {
+    for (auto &app : *m_appenders) {
         node["appenders"].push_back(YAML::Load(app->toYAMLString()));
     }
     std::stringstream ss;
@@ -345,6 +466,7 @@ void LogAppender::setFormatter(LogFormatter::ptr formatter) {
     if (formatter) {
         m_formatter = formatter; 
         m_hasFormatter = true;
+        ++m_formatterVersion;
     }
 }
 
@@ -366,7 +488,7 @@ FileLogAppender::~FileLogAppender() {
 }
 
 
-void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+void FileLogAppender::log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
     if (level >= m_level) {
         uint64_t now = time(nullptr);
         if (now - m_lastTime > 3) {
@@ -377,7 +499,9 @@ void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level,
         MutexType::Lock lock(m_mutex);
         // 需考虑异常情况。输出过程中如果输出文件被删除了。shell里可以先ps aux拿到进程号，再ls -lh /proc/进程号/fd，看到所有fd的状态。
         // 需做兜底处理。这里的<<感知不到文件被删除（还需研究），故隔一段时间reopen一次
-        m_filestream << m_formatter->format(logger, level, event);
+        m_formatter->format(m_filestream, logger, level, event);
+        // 和原来%n用std::endl时一样每行都刷新，进程崩溃（如断言失败abort）前的日志不会留在缓冲区里丢掉
+        m_filestream.flush();
     }
 }
 
@@ -407,10 +531,665 @@ std::string FileLogAppender::toYAMLString() {
     return ss.str();
 }
 
-void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+/**
+ * AsyncFileLogAppender的实现
+ */
+// 单生产者（写日志的线程）单消费者（后台线程）的字节环形缓冲区。写入的都是格式化好的日志，后台线程直接写文件
+struct AsyncFileLogAppender::Buffer {
+    Buffer(size_t size) {
+        size_t cap = 4096;
+        while (cap < size) {
+            cap <<= 1;
+        }
+        mask = cap - 1;
+        data.reset(new char[cap]);
+    }
+
+    size_t capacity() const { return mask + 1; }
+    size_t used() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire);
+    }
+
+    // 生产者调用，调用前要确认空间足够
+    void write(const char *str, size_t len) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t pos = t & mask;
+        size_t first = std::min(len, capacity() - pos);
+        memcpy(&data[pos], str, first);
+        if (first < len) {
+            memcpy(&data[0], str + first, len - first);
+        }
+        tail.store(t + len, std::memory_order_release);
+    }
+
+    char pad0[YUAN_CACHELINE_SIZE];
+    // 消费者修改
+    std::atomic<size_t> head = {0};
+    char pad1[YUAN_CACHELINE_SIZE];
+    // 生产者修改
+    std::atomic<size_t> tail = {0};
+    char pad2[YUAN_CACHELINE_SIZE];
+    size_t mask;
+    std::unique_ptr<char[]> data;
+    // 以下只有生产者线程访问：缓存的formatter及其版本，采样计数
+    LogFormatter::ptr formatter;
+    uint64_t formatterVersion = UINT64_MAX;
+    uint64_t sampleCount = 0;
+    // appender析构后置位，线程局部表里的这一项可以删了
+    std::atomic<bool> dead = {false};
+};
+
+static std::atomic<uint64_t> s_async_appender_id = {0};
+// 当前线程在各个AsyncFileLogAppender里的缓冲区，key为appender的id。
+// 持有引用是为了让后台线程知道线程是否已退出；appender析构后对应的项在下次查表未命中时清掉
+static thread_local std::unordered_map<uint64_t, std::shared_ptr<AsyncFileLogAppender::Buffer> > t_async_buffers;
+
+AsyncFileLogAppender::OverflowPolicy AsyncFileLogAppender::PolicyFromString(const std::string &str) {
+    if (str == "drop" || str == "DROP") {
+        return DROP;
+    } else if (str == "sample" || str == "SAMPLE") {
+        return SAMPLE;
+    }
+    return BLOCK;
+}
+
+const char *AsyncFileLogAppender::PolicyToString(OverflowPolicy policy) {
+    switch (policy) {
+        case DROP:
+            return "drop";
+        case SAMPLE:
+            return "sample";
+        default:
+            return "block";
+    }
+}
+
+AsyncFileLogAppender::AsyncFileLogAppender(const std::string &filename, size_t buffer_size
+        , OverflowPolicy policy, uint32_t flush_interval_ms, uint32_t sample_rate)
+    : m_filename(filename)
+    , m_bufferSize(buffer_size)
+    , m_policy(policy)
+    , m_flushInterval(flush_interval_ms ? flush_interval_ms : 1)
+    , m_sampleRate(sample_rate ? sample_rate : 1)
+    , m_id(++s_async_appender_id) {
+    m_buffersMutex.setName("AsyncFileLogAppender::m_buffersMutex");
+    m_writeMutex.setName("AsyncFileLogAppender::m_writeMutex");
+    reopen();
+    m_thread.reset(new Thread(std::bind(&AsyncFileLogAppender::run, this), "log_flusher"));
+}
+
+AsyncFileLogAppender::~AsyncFileLogAppender() {
+    // 后台线程退出前会把所有缓冲区写完
+    m_stopping = true;
+    m_semaphore.post();
+    m_thread->join();
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    // 还活着的线程的缓冲区由它们的线程局部表持有，先把内存还掉，只留一个空壳等它们清理
+    for (auto &buffer : m_buffers) {
+        buffer->data.reset();
+        buffer->formatter.reset();
+        buffer->dead.store(true, std::memory_order_release);
+    }
+}
+
+AsyncFileLogAppender::Buffer *AsyncFileLogAppender::getBuffer() {
+    auto it = t_async_buffers.find(m_id);
+    if (YUAN_LIKELY(it != t_async_buffers.end())) {
+        return it->second.get();
+    }
+    // 未命中的次数和本线程用到的appender个数相当，顺便清掉已经析构的appender留下的项
+    for (auto cur = t_async_buffers.begin(); cur != t_async_buffers.end();) {
+        if (cur->second->dead.load(std::memory_order_acquire)) {
+            cur = t_async_buffers.erase(cur);
+        } else {
+            ++cur;
+        }
+    }
+    std::shared_ptr<Buffer> buffer(new Buffer(m_bufferSize));
+    {
+        Mutex::Lock lock(m_buffersMutex);
+        m_buffers.push_back(buffer);
+    }
+    t_async_buffers[m_id] = buffer;
+    return buffer.get();
+}
+
+void AsyncFileLogAppender::log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
+    if (level < m_level) {
+        return;
+    }
+    Buffer *buffer = getBuffer();
+    // formatter很少变化，版本号没变就用缓存的，不用加锁
+    uint64_t version = m_formatterVersion.load(std::memory_order_acquire);
+    if (YUAN_UNLIKELY(version != buffer->formatterVersion)) {
+        MutexType::Lock lock(m_mutex);
+        buffer->formatter = m_formatter;
+        buffer->formatterVersion = version;
+    }
+    if (!buffer->formatter) {
+        return;
+    }
+
+    LogStream &str = GetFormatStream();
+    buffer->formatter->format(str, logger, level, event);
+    size_t cap = buffer->capacity();
+    if (YUAN_UNLIKELY(str.size() > cap)) {
+        // 比整个缓冲区还大的日志，先把缓冲区写完保证顺序，再直接写文件
+        Mutex::Lock lock(m_writeMutex);
+        drain();
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(str.data());
+        iov.iov_len = str.size();
+        writeAll(&iov, 1);
+        return;
+    }
+
+    size_t used = buffer->used();
+    if (m_policy == SAMPLE && level < LogLevel::ERROR && used >= cap / 4 * 3) {
+        // 压力较大时开始采样
+        if (++buffer->sampleCount % m_sampleRate != 0) {
+            ++m_dropped;
+            return;
+        }
+    }
+    if (cap - used < str.size()) {
+        if (m_policy == DROP || (m_policy == SAMPLE && level < LogLevel::ERROR)) {
+            ++m_dropped;
+            m_semaphore.post();
+            return;
+        }
+        // 等待后台线程腾出空间。注意不能用被hook的sleep：格式化好的日志在线程局部的流里，让出协程后会被同线程的其他协程覆盖
+        m_semaphore.post();
+        while (cap - buffer->used() < str.size()) {
+            sched_yield();
+        }
+        used = buffer->used();
+    }
+    buffer->write(str.data(), str.size());
+    // 过半时提前唤醒后台线程，不用等到定时写入
+    if (used < cap / 2 && used + str.size() >= cap / 2) {
+        m_semaphore.post();
+    }
+    if (YUAN_UNLIKELY(level == LogLevel::FATAL)) {
+        flush();
+    }
+}
+
+void AsyncFileLogAppender::flush() {
+    Mutex::Lock lock(m_writeMutex);
+    drain();
+    if (m_fd >= 0) {
+        fdatasync(m_fd);
+    }
+}
+
+void AsyncFileLogAppender::reopen() {
+    int fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cout << "AsyncFileLogAppender open file=" << m_filename << " error, errno=" << errno << std::endl;
+        return;
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    m_fd = fd;
+}
+
+void AsyncFileLogAppender::writeAll(struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(m_fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 写失败（如磁盘满）时丢弃这一批，不能让写日志的线程一直阻塞
+            std::cout << "AsyncFileLogAppender write file=" << m_filename << " error, errno=" << errno << std::endl;
+            return;
+        }
+        // 部分写入，跳过已写完的部分
+        while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+size_t AsyncFileLogAppender::drain() {
+    std::vector<std::shared_ptr<Buffer> > buffers;
+    {
+        Mutex::Lock lock(m_buffersMutex);
+        buffers = m_buffers;
+    }
+
+    static const size_t MAX_IOV = 64;
+    struct iovec iov[MAX_IOV];
+    // 和iov对应，写完后要推进的缓冲区和位置
+    std::vector<std::pair<Buffer*, size_t> > done;
+    size_t iovcnt = 0;
+    size_t total = 0;
+    for (size_t i = 0; i <= buffers.size(); ++i) {
+        // 每个缓冲区最多占两个iov（数据可能绕回到开头），放不下或者遍历完了就写一次
+        if (iovcnt + 2 > MAX_IOV || i == buffers.size()) {
+            if (iovcnt) {
+                writeAll(iov, iovcnt);
+                for (auto &d : done) {
+                    d.first->head.store(d.second, std::memory_order_release);
+                }
+                iovcnt = 0;
+                done.clear();
+            }
+            if (i == buffers.size()) {
+                break;
+            }
+        }
+        Buffer *buffer = buffers[i].get();
+        size_t h = buffer->head.load(std::memory_order_relaxed);
+        size_t t = buffer->tail.load(std::memory_order_acquire);
+        if (h == t) {
+            continue;
+        }
+        size_t pos = h & buffer->mask;
+        size_t len = t - h;
+        size_t first = std::min(len, buffer->capacity() - pos);
+        iov[iovcnt].iov_base = &buffer->data[pos];
+        iov[iovcnt++].iov_len = first;
+        if (first < len) {
+            iov[iovcnt].iov_base = &buffer->data[0];
+            iov[iovcnt++].iov_len = len - first;
+        }
+        done.push_back(std::make_pair(buffer, t));
+        total += len;
+    }
+
+    uint64_t dropped = m_dropped;
+    if (dropped != m_reportedDropped) {
+        std::string msg = "AsyncFileLogAppender dropped " + std::to_string(dropped - m_reportedDropped)
+            + " logs because buffer is full\n";
+        m_reportedDropped = dropped;
+        struct iovec v;
+        v.iov_base = &msg[0];
+        v.iov_len = msg.size();
+        writeAll(&v, 1);
+    }
+
+    // 线程已经退出（只剩这里的引用）且数据写完的缓冲区可以释放了
+    {
+        Mutex::Lock lock(m_buffersMutex);
+        for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+            // buffers里还有一份引用
+            if (it->use_count() == 2 && (*it)->used() == 0) {
+                it = m_buffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return total;
+}
+
+void AsyncFileLogAppender::run() {
+    while (true) {
+        m_semaphore.timedwait(m_flushInterval);
+        // 先读标志再写文件：析构时置位之前写入的日志，一定会在这一轮被写完
+        bool stopping = m_stopping;
+        {
+            Mutex::Lock lock(m_writeMutex);
+            // 和FileLogAppender一样，隔一段时间重新打开一次，防止文件被删除后日志写不进去
+            uint64_t now = time(nullptr);
+            if (now - m_lastReopen > 3) {
+                reopen();
+                m_lastReopen = now;
+            }
+            drain();
+        }
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+std::string AsyncFileLogAppender::toYAMLString() {
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "AsyncFileLogAppender";
+    node["file"] = m_filename;
+    node["buffer_size"] = m_bufferSize;
+    node["overflow"] = PolicyToString(m_policy);
+    node["flush_interval"] = m_flushInterval;
+    if (m_level != LogLevel::UNKNOWN) {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if (m_hasFormatter && m_formatter) {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+/**
+ * RotatingFileLogAppender的实现
+ */
+struct RotatingFileLogAppender::Background {
+    Background(const std::string &filename, uint32_t max_files, bool compress_old)
+        : filename(filename)
+        , maxFiles(max_files)
+        , compressOld(compress_old) {
+        mutex.setName("RotatingFileLogAppender::Background::mutex");
+    }
+
+    // 后台线程执行的函数
+    void run();
+    void compress(const std::string &path);
+    // 删除多余的旧文件
+    void cleanup();
+
+    const std::string filename;
+    const uint32_t maxFiles;
+    const bool compressOld;
+    // 后台线程要处理的文件
+    Mutex mutex;
+    std::list<std::string> pending;
+    // 已交给后台线程、还没处理完的个数
+    size_t working = 0;
+    Semaphore semaphore;
+    bool stopping = false;
+};
+
+RotatingFileLogAppender::RotatingFileLogAppender(const std::string &filename, uint64_t max_size
+        , uint32_t rotate_interval, uint32_t max_files, bool compress)
+    : m_filename(filename)
+    , m_maxSize(max_size)
+    , m_rotateInterval(rotate_interval)
+    , m_maxFiles(max_files)
+    , m_compress(compress)
+    , m_background(std::make_shared<Background>(filename, max_files, compress)) {
+    time_t now = time(nullptr);
+    {
+        MutexType::Lock lock(m_mutex);
+        reopenNoLock();
+        m_lastCheck = now;
+        if (m_rotateInterval) {
+            m_nextRotate = nextRotateTime(now);
+        }
+    }
+    m_thread.reset(new Thread(std::bind(&Background::run, m_background), "log_rotate"));
+}
+
+RotatingFileLogAppender::~RotatingFileLogAppender() {
+    {
+        Mutex::Lock lock(m_background->mutex);
+        m_background->stopping = true;
+    }
+    m_background->semaphore.post();
+    // 不等后台线程，Thread析构时detach
+    m_thread.reset();
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool RotatingFileLogAppender::reopenNoLock() {
+    int fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cout << "RotatingFileLogAppender open file=" << m_filename << " error, errno=" << errno << std::endl;
+        return false;
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    m_fd = fd;
+    struct stat st;
+    m_size = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+    return true;
+}
+
+time_t RotatingFileLogAppender::nextRotateTime(time_t now) const {
+    // 按本地时间对齐，如每天的滚动发生在本地的0点
+    struct tm tm;
+    localtime_r(&now, &tm);
+    time_t local = now + tm.tm_gmtoff;
+    return (local / m_rotateInterval + 1) * m_rotateInterval - tm.tm_gmtoff;
+}
+
+void RotatingFileLogAppender::log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
+    if (level < m_level) {
+        return;
+    }
+    LogFormatter::ptr formatter;
+    {
+        MutexType::Lock lock(m_mutex);
+        formatter = m_formatter;
+    }
+    if (!formatter) {
+        return;
+    }
+    // 在锁外格式化
+    LogStream &str = GetFormatStream();
+    formatter->format(str, logger, level, event);
+
+    time_t now = event->getTime();
+    MutexType::Lock lock(m_mutex);
+    if ((m_nextRotate && now >= m_nextRotate)
+            || (m_maxSize && m_size > 0 && m_size + str.size() > m_maxSize)) {
+        rotateNoLock(now);
+    } else if (now - m_lastCheck > 3) {
+        // 和FileLogAppender一样，防止文件被删除或被外部移走后日志写不进去
+        m_lastCheck = now;
+        struct stat path_st, fd_st;
+        if (m_fd < 0 || stat(m_filename.c_str(), &path_st) != 0
+                || fstat(m_fd, &fd_st) != 0 || path_st.st_ino != fd_st.st_ino) {
+            reopenNoLock();
+        }
+    }
+    if (m_fd < 0) {
+        return;
+    }
+    const char *data = str.data();
+    size_t left = str.size();
+    while (left > 0) {
+        ssize_t n = write(m_fd, data, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += n;
+        left -= n;
+        m_size += n;
+    }
+}
+
+void RotatingFileLogAppender::rotate() {
+    MutexType::Lock lock(m_mutex);
+    rotateNoLock(time(nullptr));
+}
+
+void RotatingFileLogAppender::rotateNoLock(time_t now) {
+    if (m_rotateInterval) {
+        m_nextRotate = nextRotateTime(now);
+    }
+    if (now == m_lastRotate) {
+        ++m_rotateSeq;
+    } else {
+        m_lastRotate = now;
+        m_rotateSeq = 0;
+    }
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char buf[64];
+    size_t len = strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+    if (m_rotateSeq) {
+        // 补齐位数，按文件名排序就是时间顺序
+        snprintf(buf + len, sizeof(buf) - len, ".%03u", m_rotateSeq);
+    }
+    std::string rotated = m_filename + "." + buf;
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (rename(m_filename.c_str(), rotated.c_str()) == 0) {
+        Mutex::Lock lock(m_background->mutex);
+        m_background->pending.push_back(rotated);
+    } else if (errno != ENOENT) {
+        std::cout << "RotatingFileLogAppender rename " << m_filename << " to " << rotated
+            << " error, errno=" << errno << std::endl;
+    }
+    reopenNoLock();
+    m_background->semaphore.post();
+}
+
+void RotatingFileLogAppender::waitBackground() {
+    while (true) {
+        {
+            Mutex::Lock lock(m_background->mutex);
+            if (m_background->pending.empty() && m_background->working == 0) {
+                return;
+            }
+        }
+        usleep(1000);
+    }
+}
+
+void RotatingFileLogAppender::Background::run() {
+    while (true) {
+        semaphore.wait();
+        std::list<std::string> files;
+        bool stop = false;
+        {
+            Mutex::Lock lock(mutex);
+            files.swap(pending);
+            working = files.size();
+            stop = stopping;
+        }
+        for (auto &file : files) {
+            if (compressOld) {
+                compress(file);
+            }
+        }
+        cleanup();
+        {
+            Mutex::Lock lock(mutex);
+            working = 0;
+        }
+        if (stop) {
+            break;
+        }
+    }
+}
+
+void RotatingFileLogAppender::Background::compress(const std::string &path) {
+    // 先写临时文件，写完再改名，中途退出不会留下不完整的.gz
+    std::string tmp = path + ".gz.tmp";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    gzFile gz = gzopen(tmp.c_str(), "wb");
+    if (!gz) {
+        close(fd);
+        return;
+    }
+    bool ok = true;
+    std::unique_ptr<char[]> buf(new char[64 * 1024]);
+    while (true) {
+        ssize_t n = read(fd, buf.get(), 64 * 1024);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        if (gzwrite(gz, buf.get(), n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    close(fd);
+    if (gzclose(gz) != Z_OK) {
+        ok = false;
+    }
+    if (ok && rename(tmp.c_str(), (path + ".gz").c_str()) == 0) {
+        unlink(path.c_str());
+    } else {
+        std::cout << "RotatingFileLogAppender compress file=" << path << " error" << std::endl;
+        unlink(tmp.c_str());
+    }
+}
+
+void RotatingFileLogAppender::Background::cleanup() {
+    if (maxFiles == 0) {
+        return;
+    }
+    size_t pos = filename.rfind('/');
+    std::string dir = pos == std::string::npos ? "." : filename.substr(0, pos + 1);
+    std::string prefix = (pos == std::string::npos ? filename : filename.substr(pos + 1)) + ".";
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    // 滚动出来的文件名为 前缀 + 时间[.序号][.gz]，按去掉.gz后的名字排序就是时间顺序
+    std::vector<std::pair<std::string, std::string> > files;
+    while (struct dirent *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0
+                || !isdigit(name[prefix.size()])) {
+            continue;
+        }
+        std::string key = name;
+        if (key.size() > 4 && key.compare(key.size() - 4, 4, ".tmp") == 0) {
+            continue;
+        }
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, ".gz") == 0) {
+            key.resize(key.size() - 3);
+        }
+        files.push_back(std::make_pair(key, name));
+    }
+    closedir(d);
+    if (files.size() <= maxFiles) {
+        return;
+    }
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size() - maxFiles; ++i) {
+        std::string path = (pos == std::string::npos ? "" : dir) + files[i].second;
+        unlink(path.c_str());
+    }
+}
+
+std::string RotatingFileLogAppender::toYAMLString() {
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "RotatingFileLogAppender";
+    node["file"] = m_filename;
+    node["max_size"] = m_maxSize;
+    node["rotate_interval"] = m_rotateInterval;
+    node["max_files"] = m_maxFiles;
+    node["compress"] = m_compress;
+    if (m_level != LogLevel::UNKNOWN) {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if (m_hasFormatter && m_formatter) {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+void StdoutLogAppender::log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
     if (level >= m_level) {
         MutexType::Lock lock(m_mutex);
-        std::cout << m_formatter->format(logger, level, event);
+        m_formatter->format(std::cout, logger, level, event);
+        std::cout.flush();
     }
 }
 
@@ -436,13 +1215,116 @@ LogFormatter::LogFormatter(const std::string &pattern) : m_pattern(pattern) {
     init();
 }
 
-// 输出到ostringstream中，再转string
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-    std::ostringstream oss;
-    for (auto &item : m_items) {
-        item->format(oss, logger, level, event);
+// 当前线程缓存的格式化好的时间，按DATETIME项的id直接映射
+struct DateTimeCache {
+    uint64_t id = 0;
+    time_t time = -1;
+    size_t len = 0;
+    char buf[64];
+};
+static const size_t s_datetime_cache_size = 8;
+static thread_local DateTimeCache t_datetime_cache[s_datetime_cache_size];
+static std::atomic<uint64_t> s_datetime_op_id = {0};
+
+// 时间应根据pattern里面的%d{fff}的fff来格式化
+// 具体日期格式：https://blog.csdn.net/clarkness/article/details/90047406
+char *LogFormatter::AppendDateTime(char *p, const Op &op, time_t time) {
+    DateTimeCache &cache = t_datetime_cache[op.id % s_datetime_cache_size];
+    if (YUAN_UNLIKELY(cache.id != op.id || cache.time != time)) {
+        struct tm tm;
+        localtime_r(&time, &tm);
+        cache.len = strftime(cache.buf, sizeof(cache.buf), op.str.c_str(), &tm);
+        cache.id = op.id;
+        cache.time = time;
+    }
+    return AppendString(p, cache.buf, cache.len);
+}
+
+void LogFormatter::format(LogStream &stream, const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
+    // 不能直接用logger，因为传入的logger可能是实际logger里的m_root，当实际logger没有配置时，m_root为兜底方案
+    const std::string &logger_name = event->getLogger()->getName();
+    const std::string &thread_name = event->getThreadName();
+    const char *file = event->getFile();
+    size_t file_len = m_filenameCount ? strlen(file) : 0;
+    size_t content_len = event->getContentSize();
+    // 先算出这一行长度的上限，一次预留好空间，之后直接往指针上写，不用每项都检查空间
+    size_t max_len = m_fixedSize + m_messageCount * content_len + m_loggerNameCount * logger_name.size()
+        + m_threadNameCount * thread_name.size() + m_filenameCount * file_len;
+    char *begin = stream.prepare(max_len);
+    char *p = begin;
+
+    for (auto &op : m_ops) {
+        switch (op.type) {
+            case Op::STRING:
+                p = AppendString(p, op.str.data(), op.str.size());
+                break;
+            case Op::MESSAGE:
+                p = AppendString(p, event->getContentData(), content_len);
+                break;
+            case Op::LEVEL: {
+                const char *str = LogLevel::ToString(level);
+                p = AppendString(p, str, strlen(str));
+                break;
+            }
+            case Op::ELAPSE:
+                p = AppendUInt(p, event->getElapse());
+                break;
+            case Op::LOGGER_NAME:
+                p = AppendString(p, logger_name.data(), logger_name.size());
+                break;
+            case Op::THREAD_ID:
+                p = AppendUInt(p, event->getThreadId());
+                break;
+            case Op::THREAD_NAME:
+                // 多线程，且会有多个线程池，打印出Thread name能提示更多信息
+                p = AppendString(p, thread_name.data(), thread_name.size());
+                break;
+            case Op::FIBER_ID:
+                p = AppendUInt(p, event->getFiberId());
+                break;
+            case Op::DATETIME:
+                p = AppendDateTime(p, op, event->getTime());
+                break;
+            case Op::MICROSECOND: {
+                uint64_t us = event->getTimeUs() % 1000000;
+                // 补齐6位
+                for (int i = 5; i >= 0; --i) {
+                    p[i] = static_cast<char>('0' + us % 10);
+                    us /= 10;
+                }
+                p += 6;
+                break;
+            }
+            case Op::FILENAME:
+                p = AppendString(p, file, file_len);
+                break;
+            case Op::LINE:
+                p = AppendInt(p, event->getLine());
+                break;
+            case Op::NEWLINE:
+                // 不在这里用std::endl：格式化是写到内部缓冲区再一次性输出的，刷新由各appender在写完一行后自己做
+                *p++ = '\n';
+                break;
+            case Op::TAB:
+                *p++ = '\t';
+                break;
+        }
     }
-    return oss.str();
+    stream.commit(p - begin);
+}
+
+// 输出到LogStream中，再转string
+std::string LogFormatter::format(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
+    LogStream &stream = GetFormatStream();
+    format(stream, logger, level, event);
+    return stream.str();
+}
+
+std::ostream &LogFormatter::format(std::ostream &os, const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
+    LogStream &stream = GetFormatStream();
+    format(stream, logger, level, event);
+    os.write(stream.data(), stream.size());
+    return os;
 }
 
 // 参照log4j的日志输出格式：https://blog.csdn.net/ctwy291314/article/details/83822254
@@ -519,51 +1401,116 @@ void LogFormatter::init() {
     if (!nstr.empty()) {
         vec.push_back(std::make_tuple(nstr, "", 0));
     }
-    // 以下写法为了用map存储各种字符对应的不同FormatItem子类类型，注意不是存的子类对象，而是function，
-    // 因为每次fmt可能会不同
-    static std::map<std::string, std::function<FormatItem::ptr(const std::string &fmt)>> s_format_items = {
-#define XX(type, C) \
-        {#type, [](const std::string &fmt) { return FormatItem::ptr(new C(fmt)); }}
+    // 各种字符对应的Op类型
+    static std::map<std::string, Op::Type> s_op_types = {
+#define XX(C, type) \
+        {#C, Op::type}
         // 以下有些是按照log4j标准，有些是自己补充的，以这里的为准
-        XX(m, MessageFormatItem),
-        XX(p, LevelFormatItem),
-        XX(r, ElapseFormatItem),
-        XX(c, LoggerNameFormatItem),
-        XX(t, ThreadIdFormatItem),
-        XX(N, ThreadNameFormatItem),
-        XX(n, NewLineFormatItem),
-        XX(d, DateTimeFormatItem),
-        XX(f, FilenameFormatItem),
-        XX(l, LineFormatItem),
-        XX(T, TabFormatItem),
-        XX(F, FiberIdFormatItem)
-
+        XX(m, MESSAGE),
+        XX(p, LEVEL),
+        XX(r, ELAPSE),
+        XX(c, LOGGER_NAME),
+        XX(t, THREAD_ID),
+        XX(N, THREAD_NAME),
+        XX(n, NEWLINE),
+        XX(d, DATETIME),
+        XX(f, FILENAME),
+        XX(l, LINE),
+        // log4j里没有tab的格式，而又比较常用，所以增加一个，对应时用T对应，和线程分开
+        XX(T, TAB),
+        XX(F, FIBER_ID)
 #undef XX
     };
 
     for (auto &t : vec) {
+        Op op;
         if (std::get<2>(t) == 0) {
-            m_items.push_back(StringFormatItem::ptr(new StringFormatItem(std::get<0>(t))));
+            op.type = Op::STRING;
+            op.str = std::get<0>(t);
         } else {
-            auto it = s_format_items.find(std::get<0>(t));
-            if (it == s_format_items.end()) {
-                m_items.push_back(StringFormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(t) + ">>")));
+            auto it = s_op_types.find(std::get<0>(t));
+            if (it == s_op_types.end()) {
+                op.type = Op::STRING;
+                op.str = "<<error_format %" + std::get<0>(t) + ">>";
                 m_error = true;
             } else {
-                m_items.push_back(it->second(std::get<1>(t)));
+                op.type = it->second;
+                op.str = std::get<1>(t);
+                if (op.type == Op::DATETIME) {
+                    addDateTimeOps(op.str.empty() ? "%D" : op.str);
+                    continue;
+                }
             }
         }
+        addOp(op);
         // 以下为调试内容。注意区分调试时的输出，上线前要去掉
         // std::cout << std::get<0>(t) << " - " << std::get<1>(t) << " - " << std::get<2>(t) << std::endl;
     }
+}
 
+// strftime不支持微秒，所以在%f处把时间格式拆开，前后两段分别按秒缓存，中间插入微秒
+void LogFormatter::addDateTimeOps(const std::string &format) {
+    size_t begin = 0;
+    while (true) {
+        size_t pos = format.find("%f", begin);
+        std::string part = format.substr(begin, pos == std::string::npos ? std::string::npos : pos - begin);
+        if (!part.empty()) {
+            Op op;
+            op.type = Op::DATETIME;
+            op.str = part;
+            op.id = ++s_datetime_op_id;
+            addOp(op);
+        }
+        if (pos == std::string::npos) {
+            break;
+        }
+        Op op;
+        op.type = Op::MICROSECOND;
+        addOp(op);
+        begin = pos + 2;
+    }
+}
 
+void LogFormatter::addOp(const Op &op) {
+    // 相邻的字符串合并成一项
+    if (op.type == Op::STRING && !m_ops.empty() && m_ops.back().type == Op::STRING) {
+        m_ops.back().str += op.str;
+    } else {
+        m_ops.push_back(op);
+    }
+    switch (op.type) {
+        case Op::STRING:
+            m_fixedSize += op.str.size();
+            break;
+        case Op::MESSAGE:
+            ++m_messageCount;
+            break;
+        case Op::LOGGER_NAME:
+            ++m_loggerNameCount;
+            break;
+        case Op::THREAD_NAME:
+            ++m_threadNameCount;
+            break;
+        case Op::FILENAME:
+            ++m_filenameCount;
+            break;
+        case Op::DATETIME:
+            // DateTimeCache::buf的大小
+            m_fixedSize += 64;
+            break;
+        default:
+            // 级别名、整数、微秒、换行和tab都不超过21个字节
+            m_fixedSize += 21;
+            break;
+    }
 }
+
 /**
  * LoggerManager
  * 
  */
 LoggerManager::LoggerManager() {
+    m_mutex.setName("LoggerManager::m_mutex");
     m_root.reset(new Logger());
     m_root->addAppender(LogAppender::ptr(new StdoutLogAppender()));
 
@@ -638,6 +1585,17 @@ struct LogIniter {
                         appender.reset(new FileLogAppender(appenderDefine.file));
                     } else if (appenderDefine.type == 2) {
                         appender.reset(new StdoutLogAppender());
+                    } else if (appenderDefine.type == 3) {
+                        appender.reset(new AsyncFileLogAppender(appenderDefine.file, appenderDefine.buffer_size
+                            , AsyncFileLogAppender::PolicyFromString(appenderDefine.overflow)
+                            , appenderDefine.flush_interval));
+                    } else if (appenderDefine.type == 4) {
+                        appender.reset(new RotatingFileLogAppender(appenderDefine.file, appenderDefine.max_size
+                            , appenderDefine.rotate_interval, appenderDefine.max_files, appenderDefine.compress));
+                    } else if (appenderDefine.type == 5) {
+                        appender.reset(new NetworkLogAppender(appenderDefine.address
+                            , NetworkLogAppender::ProtocolFromString(appenderDefine.protocol)
+                            , appenderDefine.queue_size, appenderDefine.batch_size, appenderDefine.flush_interval));
                     }
                     appender->setLevel(appenderDefine.level);
                     if (!appenderDefine.formatter.empty()) {
@@ -10,18 +10,27 @@
 #include <iostream>
 #include <vector>
 #include <stdarg.h>
+#include <sys/uio.h>
 #include <map>
 #include "singleton.h"
 #include "util.h"
 #include "thread.h"
 
 // 定义一些宏让日志系统更好用。注意宏里的namespace千万别忽略
-// 返回stringstream更方便使用者流式调用并增加自己的输出内容
+// 返回输出流更方便使用者流式调用并增加自己的输出内容
 //  注意:__FILE__原本是绝对路径，但在CMakeLists.txt里配置为了相对路径。
+// LogEventWrap会复用当前线程的LogEvent，写一条日志正常情况下不需要分配内存
+
+// 编译期的日志级别下限（1 DEBUG 2 INFO 3 WARN 4 ERROR 5 FATAL），低于它的日志语句条件恒为假，整条被编译器去掉，
+// 连logger->getLevel()都不会调用。通过CMake的YUAN_LOG_ACTIVE_LEVEL变量（或者-DYUAN_LOG_ACTIVE_LEVEL=N）指定。
+// 不低于它的日志仍然按logger的级别在运行时过滤
+#ifndef YUAN_LOG_ACTIVE_LEVEL
+#define YUAN_LOG_ACTIVE_LEVEL 1
+#endif
+
 #define YUAN_LOG_LEVEL(logger, level) \
-    if(level >= logger->getLevel()) \
-        yuan::LogEventWrap(yuan::LogEvent::ptr(new yuan::LogEvent(logger, level, __FILE__, __LINE__ \
-        , yuan::GetThreadId(), yuan::GetFiberId(), time(nullptr), 0, yuan::Thread::GetName()))).getSS()
+    if((level) >= YUAN_LOG_ACTIVE_LEVEL && level >= logger->getLevel()) \
+        yuan::LogEventWrap(logger, level, __FILE__, __LINE__).getSS()
 
 #define YUAN_LOG_DEBUG(logger) YUAN_LOG_LEVEL(logger, yuan::LogLevel::DEBUG)
 #define YUAN_LOG_INFO(logger) YUAN_LOG_LEVEL(logger, yuan::LogLevel::INFO)
@@ -31,9 +40,8 @@
 
 // 让用户可以像printf一样调用，再原来的日志后增加自定义内容
 #define YUAN_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-    if(level >= logger->getLevel()) \
-        yuan::LogEventWrap(yuan::LogEvent::ptr(new yuan::LogEvent(logger, level, __FILE__, __LINE__ \
-        , yuan::GetThreadId(), yuan::GetFiberId(), time(nullptr), 0, yuan::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+    if((level) >= YUAN_LOG_ACTIVE_LEVEL && level >= logger->getLevel()) \
+        yuan::LogEventWrap(logger, level, __FILE__, __LINE__).getEvent()->format(fmt, __VA_ARGS__)
 
 #define YUAN_LOG_FMT_DEBUG(logger, fmt, ...) YUAN_LOG_FMT_LEVEL(logger, yuan::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define YUAN_LOG_FMT_INFO(logger, fmt, ...) YUAN_LOG_FMT_LEVEL(logger, yuan::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -41,6 +49,47 @@
 #define YUAN_LOG_FMT_ERROR(logger, fmt, ...) YUAN_LOG_FMT_LEVEL(logger, yuan::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define YUAN_LOG_FMT_FATAL(logger, fmt, ...) YUAN_LOG_FMT_LEVEL(logger, yuan::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+// 按调用点限流：每interval_ms毫秒最多输出n条，超出的只计数。
+// 下一个周期输出的第一条日志前面会带上"[suppressed K messages] "，K为上个周期被压制的条数
+// 判断只有一次粗粒度时钟读取和一次原子加，适合放在可能被刷屏的错误日志上
+#define YUAN_LOG_LEVEL_LIMIT(logger, level, n, interval_ms) \
+    if((level) >= YUAN_LOG_ACTIVE_LEVEL && level >= logger->getLevel()) \
+        if (yuan::LogRateLimiter::Decision _yuan_log_decision = [&](){ \
+                static yuan::LogRateLimiter s_limiter(n, interval_ms); \
+                return s_limiter.check(); }()) \
+            yuan::LogEventWrap(logger, level, __FILE__, __LINE__).getSS() << _yuan_log_decision
+
+#define YUAN_LOG_DEBUG_LIMIT(logger, n, interval_ms) YUAN_LOG_LEVEL_LIMIT(logger, yuan::LogLevel::DEBUG, n, interval_ms)
+#define YUAN_LOG_INFO_LIMIT(logger, n, interval_ms) YUAN_LOG_LEVEL_LIMIT(logger, yuan::LogLevel::INFO, n, interval_ms)
+#define YUAN_LOG_WARN_LIMIT(logger, n, interval_ms) YUAN_LOG_LEVEL_LIMIT(logger, yuan::LogLevel::WARN, n, interval_ms)
+#define YUAN_LOG_ERROR_LIMIT(logger, n, interval_ms) YUAN_LOG_LEVEL_LIMIT(logger, yuan::LogLevel::ERROR, n, interval_ms)
+#define YUAN_LOG_FATAL_LIMIT(logger, n, interval_ms) YUAN_LOG_LEVEL_LIMIT(logger, yuan::LogLevel::FATAL, n, interval_ms)
+
+// 按调用点采样：每n条输出一条（第1、n+1、2n+1...条），判断只有一个静态计数器的原子加
+#define YUAN_LOG_LEVEL_SAMPLE(logger, level, n) \
+    if((level) >= YUAN_LOG_ACTIVE_LEVEL && level >= logger->getLevel()) \
+        if ([&](){ \
+                static std::atomic<uint64_t> s_count(0); \
+                return s_count.fetch_add(1, std::memory_order_relaxed) % (n) == 0; }()) \
+            yuan::LogEventWrap(logger, level, __FILE__, __LINE__).getSS()
+
+#define YUAN_LOG_DEBUG_SAMPLE(logger, n) YUAN_LOG_LEVEL_SAMPLE(logger, yuan::LogLevel::DEBUG, n)
+#define YUAN_LOG_INFO_SAMPLE(logger, n) YUAN_LOG_LEVEL_SAMPLE(logger, yuan::LogLevel::INFO, n)
+#define YUAN_LOG_WARN_SAMPLE(logger, n) YUAN_LOG_LEVEL_SAMPLE(logger, yuan::LogLevel::WARN, n)
+#define YUAN_LOG_ERROR_SAMPLE(logger, n) YUAN_LOG_LEVEL_SAMPLE(logger, yuan::LogLevel::ERROR, n)
+#define YUAN_LOG_FATAL_SAMPLE(logger, n) YUAN_LOG_LEVEL_SAMPLE(logger, yuan::LogLevel::FATAL, n)
+
+// 热路径上的调试日志（如每个协程的创建销毁、每次tickle）。定义了NDEBUG时（CMAKE_BUILD_TYPE=Release）整条语句被去掉，
+// <<右边的参数也不会求值；否则和YUAN_LOG_xxx一样
+#ifdef NDEBUG
+#define YUAN_DLOG_LEVEL(logger, level) if (false) YUAN_LOG_LEVEL(logger, level)
+#else
+#define YUAN_DLOG_LEVEL(logger, level) YUAN_LOG_LEVEL(logger, level)
+#endif
+
+#define YUAN_DLOG_DEBUG(logger) YUAN_DLOG_LEVEL(logger, yuan::LogLevel::DEBUG)
+#define YUAN_DLOG_INFO(logger) YUAN_DLOG_LEVEL(logger, yuan::LogLevel::INFO)
+
 #define YUAN_GET_ROOT_LOGGER() yuan::LoggerMgr::GetInstance()->getRootLogger()
 #define YUAN_GET_LOGGER(name) yuan::LoggerMgr::GetInstance()->getLogger(name)
 
@@ -64,6 +113,50 @@ public:
     static Level FromString(const std::string &str);
 };
 
+// 日志内容的输出流。先写进对象内固定大小的缓冲区，写满了才换到堆上，大部分日志不需要分配内存
+// 用法和stringstream一样，但reset后缓冲区可以复用
+class LogStream : public std::ostream {
+public:
+    static const size_t INLINE_SIZE = 4096;
+    // 超过这个大小的堆内存在reset时释放，避免偶尔一条超长的日志让线程一直占着大块内存
+    static const size_t MAX_KEEP_SIZE = 64 * 1024;
+
+    LogStream();
+
+    const char *data() const { return m_buf.data(); }
+    size_t size() const { return m_buf.size(); }
+    std::string str() const { return std::string(data(), size()); }
+    // 清空内容和错误状态
+    void reset();
+    // 按printf的格式追加，内容放得下时直接格式化进缓冲区，不经过临时内存
+    void appendf(const char *fmt, va_list al);
+    // 直接写缓冲区，不经过ostream的格式化和locale，供LogFormatter使用。
+    // prepare保证至少有n个字节可写，返回写入位置；写完后用commit提交实际写入的长度
+    char *prepare(size_t n) { m_buf.reserve(n); return m_buf.cur(); }
+    void commit(size_t n) { m_buf.advance(n); }
+private:
+    class Buffer : public std::streambuf {
+    public:
+        Buffer();
+        const char *data() const { return pbase(); }
+        size_t size() const { return pptr() - pbase(); }
+        char *cur() { return pptr(); }
+        size_t avail() const { return epptr() - pptr(); }
+        void advance(size_t n) { pbump(static_cast<int>(n)); }
+        // 保证还能写入n个字节
+        void reserve(size_t n);
+        void reset();
+    protected:
+        virtual int_type overflow(int_type c) override;
+        virtual std::streamsize xsputn(const char *s, std::streamsize n) override;
+    private:
+        char m_inline[INLINE_SIZE];
+        std::vector<char> m_heap;
+    };
+
+    Buffer m_buf;
+};
+
 class LogEvent {
 public:
     using ptr = std::shared_ptr<LogEvent>;
@@ -71,17 +164,28 @@ public:
         , const char *file, int32_t line, uint32_t threadId, uint32_t fiberId
         , uint64_t time, uint32_t elapse, const std::string &thread_name);
 
+    // 复用已有的对象记录新的一条日志，字符串的内存都会复用。注意time_us是微秒
+    void reset(const std::shared_ptr<Logger> &logger, LogLevel::Level level
+        , const char *file, int32_t line, uint32_t threadId, uint32_t fiberId
+        , uint64_t time_us, uint32_t elapse, const std::string &thread_name);
+
     const char *getFile() { return m_file; }
     int32_t getLine() { return m_line; }
     uint32_t getThreadId() { return m_threadId; }
-    const std::string getThreadName() { return m_threadName; }
+    const std::string &getThreadName() { return m_threadName; }
     uint32_t getFiberId() { return m_fiberId; }
-    uint64_t getTime() { return m_time; }
+    // 秒
+    uint64_t getTime() { return m_timeUs / 1000000; }
+    // 微秒
+    uint64_t getTimeUs() { return m_timeUs; }
     uint32_t getElapse() { return m_elapse; }
     std::string getContent() { return m_ss.str(); }
+    // 不拷贝地访问用户输入的内容
+    const char *getContentData() { return m_ss.data(); }
+    size_t getContentSize() { return m_ss.size(); }
 
-    std::stringstream &getSS() { return m_ss; }
-    std::shared_ptr<Logger> getLogger() { return m_logger; }
+    LogStream &getSS() { return m_ss; }
+    const std::shared_ptr<Logger> &getLogger() { return m_logger; }
     LogLevel::Level getLevel() { return m_level; }
 
     // 这两个format方法是为了让用户可以像printf一样传format附加到原本的日志输出后
@@ -96,12 +200,12 @@ private:
     std::string m_threadName;
     // 协程ID
     uint32_t m_fiberId = 0;
-    // 时间戳
-    uint64_t m_time = 0;
+    // 时间戳，微秒
+    uint64_t m_timeUs = 0;
     // 程序启动到现在的毫秒数
     uint32_t m_elapse = 0;
     // 存储用户自己输入的数据，对应日志格式%m
-    std::stringstream m_ss;
+    LogStream m_ss;
 
     std::shared_ptr<Logger> m_logger;
     LogLevel::Level m_level;
@@ -111,41 +215,108 @@ private:
 // 增加一个包装类，利用临时对象当前行会被销毁的特性，在析构函数里调用日志输出
 class LogEventWrap {
 public:
+    // 使用外部创建的event
     LogEventWrap(LogEvent::ptr event);
+    // 使用当前线程缓存的event。写日志的过程中可能又写日志（如在<<里调用的函数也打了日志），所以按嵌套深度各缓存一个
+    LogEventWrap(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const char *file, int32_t line);
     ~LogEventWrap();
 
-    std::stringstream &getSS() { return m_event->getSS(); }
-    LogEvent::ptr getEvent() { return m_event; }
+    LogStream &getSS() { return (*m_event)->getSS(); }
+    const LogEvent::ptr &getEvent() { return *m_event; }
+private:
+    // 指向m_owned或者线程缓存里的event
+    const LogEvent::ptr *m_event;
+    LogEvent::ptr m_owned;
+    // 使用线程缓存时，写完日志要把占用标记清掉
+    std::atomic<bool> *m_busy = nullptr;
+};
+
+// 一个调用点的限流器，配合YUAN_LOG_LEVEL_LIMIT使用。
+// 周期是固定窗口：窗口过期后第一个调用的线程开启新窗口，并带走上个窗口被压制的条数。
+// 如果之后再也没有日志通过，最后一个窗口被压制的条数不会输出
+class LogRateLimiter {
+public:
+    struct Decision {
+        bool allow;
+        // 上个周期被压制的条数，只有新周期的第一条日志不为0
+        uint64_t suppressed;
+        explicit operator bool() const { return allow; }
+    };
+
+    LogRateLimiter(uint32_t n, uint32_t interval_ms);
+    Decision check();
+    uint64_t getSuppressedTotal() const { return m_suppressedTotal; }
 private:
-    LogEvent::ptr m_event;
+    uint32_t m_n;
+    uint64_t m_intervalNs;
+    std::atomic<uint64_t> m_windowStart;
+    std::atomic<uint32_t> m_count = {0};
+    std::atomic<uint64_t> m_suppressed = {0};
+    std::atomic<uint64_t> m_suppressedTotal = {0};
 };
 
+// 有被压制的日志时输出"[suppressed K messages] "
+std::ostream &operator<<(std::ostream &os, const LogRateLimiter::Decision &decision);
+
 // 日志格式器。方法不需要加锁，因为没有改变其成员的方法
+// pattern在构造时编译成一串Op，格式化时按顺序直接往LogStream的缓冲区里追加，没有虚函数调用和ostream的格式化开销
 class LogFormatter {
 public:
     typedef std::shared_ptr<LogFormatter> ptr;
     explicit LogFormatter(const std::string &pattern);
 
     // 固定化格式输出
-    std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-public:
-    // 日志解析的子模块, 会根据不同日志输出格式来实现子类：https://blog.csdn.net/ctwy291314/article/details/83822254
-    class FormatItem {
-    public:
-        typedef std::shared_ptr<FormatItem> ptr;
-        virtual ~FormatItem() {}
-        // os通常传stringstream
-        virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
-    };
+    std::string format(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event);
+    // 追加到stream的末尾。最快的方式
+    void format(LogStream &stream, const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event);
+    // 先格式化到线程缓存的LogStream，再一次写入os
+    std::ostream &format(std::ostream &os, const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event);
 
     bool isError() const { return m_error; }
     const std::string getPattern() const { return m_pattern; }
+private:
+    // 日志格式中的一项，对应log4j的各种格式：https://blog.csdn.net/ctwy291314/article/details/83822254
+    struct Op {
+        enum Type {
+            STRING = 0,
+            MESSAGE,
+            LEVEL,
+            ELAPSE,
+            LOGGER_NAME,
+            THREAD_ID,
+            THREAD_NAME,
+            FIBER_ID,
+            DATETIME,
+            // 时间戳的微秒部分，固定6位。对应%d{}里的%f
+            MICROSECOND,
+            FILENAME,
+            LINE,
+            NEWLINE,
+            TAB
+        };
+        Type type;
+        // STRING时为要输出的内容，DATETIME时为strftime的格式
+        std::string str;
+        // DATETIME用来在线程的时间缓存里找到自己的那一项
+        uint64_t id = 0;
+    };
+    // 格式化好的时间写到p，返回写完后的位置。同一秒内的时间只格式化一次
+    static char *AppendDateTime(char *p, const Op &op, time_t time);
 private:
     std::string m_pattern;
-    std::vector<FormatItem::ptr> m_items;
+    std::vector<Op> m_ops;
+    // 除了日志内容、名字、文件名这些变长的项，一行最多输出多少字节
+    size_t m_fixedSize = 0;
+    // 各种变长项的个数，用来计算一行的长度上限
+    size_t m_messageCount = 0;
+    size_t m_loggerNameCount = 0;
+    size_t m_threadNameCount = 0;
+    size_t m_filenameCount = 0;
     // 标记输入的格式字符串是否有模式错误
     bool m_error = false;
     void init();
+    void addOp(const Op &op);
+    void addDateTimeOps(const std::string &format);
 };
 
 // 日志输出地
@@ -155,9 +326,10 @@ public:
     typedef std::shared_ptr<LogAppender> ptr;
     // typedef的妙用：可以在这里方便的改变使用的锁的类型。（相当于把类型当变量）
     typedef Spinlock MutexType;
+    LogAppender() { m_mutex.setName("LogAppender::m_mutex"); }
     virtual ~LogAppender() {}
 
-    virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+    virtual void log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) = 0;
 
     void setLevel(LogLevel::Level level) { m_level = level; }
     void setFormatter(const std::string &format);
@@ -174,6 +346,8 @@ protected:
     LogFormatter::ptr m_formatter;
     // 标志自己是否有formatter，还是沿用Logger里的，只要被调用过setFormatter，就会设置为true
     bool m_hasFormatter = false;
+    // m_formatter每次被修改都加1。不加锁的appender可以缓存formatter，版本变了再重新加锁获取
+    std::atomic<uint64_t> m_formatterVersion = {0};
     // 写比较多，故用普通锁即可
     MutexType m_mutex;
 };
@@ -188,13 +362,13 @@ public:
     typedef Spinlock MutexType;
 
     explicit Logger(const std::string &name = "root");
-    void log(LogLevel::Level level, LogEvent::ptr event);
+    void log(LogLevel::Level level, const LogEvent::ptr &event);
 
-    void debug(LogEvent::ptr event);
-    void info(LogEvent::ptr event);
-    void warn(LogEvent::ptr event);
-    void error(LogEvent::ptr event);
-    void fatal(LogEvent::ptr event);
+    void debug(const LogEvent::ptr &event);
+    void info(const LogEvent::ptr &event);
+    void warn(const LogEvent::ptr &event);
+    void error(const LogEvent::ptr &event);
+    void fatal(const LogEvent::ptr &event);
 
     const std::string &getName() { return m_name; }
     LogLevel::Level getLevel() const { return m_level; }
@@ -214,8 +388,8 @@ private:
     std::string m_name;
     // 满足该日志级别才会输出
     LogLevel::Level m_level;
-    // Appender集合
-    std::list<LogAppender::ptr> m_appenders;
+    // Appender集合，写时复制：log只在锁里拷贝指针，在锁外调用各个appender，生产者之间不互相串行
+    std::shared_ptr<const std::vector<LogAppender::ptr> > m_appenders;
     // 可能有的LogAppender自己不提供formatter，因此就用Logger的
     LogFormatter::ptr m_formatter;
     // 如果用户并没有对该logger进行配置，则走默认root的日志行为
@@ -228,7 +402,7 @@ private:
 class StdoutLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<StdoutLogAppender> ptr;
-    virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+    virtual void log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) override;
     std::string toYAMLString() override;
 private:
 };
@@ -240,7 +414,7 @@ public:
     explicit FileLogAppender(const std::string &filename);
     ~FileLogAppender();
 
-    virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+    virtual void log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) override;
 
     // 重新打开文件，打开成功则返回true
     bool reopen();
@@ -253,6 +427,131 @@ private:
     uint64_t m_lastTime = 0;
 };
 
+/**
+ * @brief 异步写文件的Appender
+ * 每个写日志的线程有自己的环形缓冲区（单生产者单消费者），在本线程格式化后拷贝进去，不用加锁，也不会阻塞在磁盘上。
+ * 后台线程把所有缓冲区里的数据用一次writev批量写入文件。同一个线程的日志保持顺序，不同线程之间按批次交错
+ * 缓冲区满时的策略见OverflowPolicy。FATAL日志写入后会同步刷盘；析构时会写完所有缓冲的日志
+ */
+class AsyncFileLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<AsyncFileLogAppender> ptr;
+
+    enum OverflowPolicy {
+        // 等待后台线程腾出空间
+        BLOCK = 0,
+        // 直接丢弃
+        DROP = 1,
+        // 缓冲区使用超过3/4后，ERROR以下的日志每sample_rate条只保留一条；满了则丢弃。ERROR及以上等待
+        SAMPLE = 2
+    };
+
+    static OverflowPolicy PolicyFromString(const std::string &str);
+    static const char *PolicyToString(OverflowPolicy policy);
+
+    /**
+     * @param buffer_size 每个线程缓冲区的大小，会向上取整到2的幂
+     * @param flush_interval_ms 后台线程最长多久写一次文件
+     */
+    AsyncFileLogAppender(const std::string &filename, size_t buffer_size = 1024 * 1024
+        , OverflowPolicy policy = BLOCK, uint32_t flush_interval_ms = 100, uint32_t sample_rate = 10);
+    ~AsyncFileLogAppender();
+
+    virtual void log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+    // 把调用时所有线程缓冲区里的日志写到文件后才返回
+    void flush();
+    // 因缓冲区满被丢弃的日志条数
+    uint64_t getDropped() const { return m_dropped; }
+    std::string toYAMLString() override;
+public:
+    struct Buffer;
+private:
+    // 获取当前线程的缓冲区，没有则创建
+    Buffer *getBuffer();
+    // 把所有缓冲区里的数据写入文件。调用者要持有m_writeMutex
+    size_t drain();
+    void reopen();
+    void writeAll(iovec *iov, int iovcnt);
+    // 后台线程执行的函数
+    void run();
+private:
+    std::string m_filename;
+    int m_fd = -1;
+    size_t m_bufferSize;
+    OverflowPolicy m_policy;
+    uint32_t m_flushInterval;
+    uint32_t m_sampleRate;
+    // 每个appender有唯一id，线程里用它找到自己的缓冲区
+    uint64_t m_id;
+
+    // 保护m_buffers
+    Mutex m_buffersMutex;
+    std::vector<std::shared_ptr<Buffer> > m_buffers;
+    // 消费者只能有一个：后台线程或者调用flush的线程
+    Mutex m_writeMutex;
+    Semaphore m_semaphore;
+    Thread::ptr m_thread;
+    std::atomic<bool> m_stopping = {false};
+    std::atomic<uint64_t> m_dropped = {0};
+    uint64_t m_reportedDropped = 0;
+    uint64_t m_lastReopen = 0;
+};
+
+/**
+ * @brief 按大小和时间滚动的文件Appender
+ * 当前文件写满max_size字节，或者到了下一个rotate_interval秒的整点（按本地时间对齐，如3600为每小时、86400为每天），
+ * 就把当前文件改名为"文件名.年月日-时分秒"，再新建文件继续写。改名和新建很快，写日志的线程自己做。
+ * 压缩（gzip）和删除超出max_files个数的旧文件比较慢，交给后台线程，不阻塞写日志的线程
+ * 不需要外部的logrotate，也就没有copytruncate丢日志的问题
+ */
+class RotatingFileLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<RotatingFileLogAppender> ptr;
+
+    /**
+     * @param max_size 单个文件的最大字节数，0为不按大小滚动
+     * @param rotate_interval 按时间滚动的间隔（秒），0为不按时间滚动
+     * @param max_files 最多保留多少个滚动出来的旧文件，0为不限制
+     * @param compress 旧文件是否压缩为.gz
+     */
+    RotatingFileLogAppender(const std::string &filename, uint64_t max_size = 100 * 1024 * 1024
+        , uint32_t rotate_interval = 0, uint32_t max_files = 10, bool compress = true);
+    ~RotatingFileLogAppender();
+
+    virtual void log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+    // 立即滚动一次
+    void rotate();
+    // 等后台线程处理完已经滚动出来的文件（压缩、清理）
+    void waitBackground();
+    std::string toYAMLString() override;
+private:
+    // 调用者要持有m_mutex
+    void rotateNoLock(time_t now);
+    bool reopenNoLock();
+    // 下一个按时间滚动的时间点
+    time_t nextRotateTime(time_t now) const;
+private:
+    std::string m_filename;
+    int m_fd = -1;
+    uint64_t m_maxSize;
+    uint32_t m_rotateInterval;
+    uint32_t m_maxFiles;
+    bool m_compress;
+    // 当前文件已写入的字节数
+    uint64_t m_size = 0;
+    time_t m_nextRotate = 0;
+    time_t m_lastCheck = 0;
+    // 同一秒内多次滚动时，文件名后面加序号区分
+    time_t m_lastRotate = 0;
+    uint32_t m_rotateSeq = 0;
+
+    // 后台线程的状态，由后台线程共同持有。析构时不join（可能正压缩一个大文件，而析构可能发生在别的锁里），
+    // 后台线程处理完剩下的文件后自己退出
+    struct Background;
+    std::shared_ptr<Background> m_background;
+    Thread::ptr m_thread;
+};
+
 // 管理所有logger，要用的时候直接从里面拿即可。单例类，使用时用下面LoggerMgr
 class LoggerManager {
 public:
@@ -14,16 +14,37 @@ namespace yuan {
  * 在struct里data members 不应该用m开头
  */
 struct LogAppenderDefine {
-    // 1 File 2 Stdout
+    // 1 File 2 Stdout 3 AsyncFile 4 RotatingFile 5 Network
     int type = 0;
     LogLevel::Level level = LogLevel::UNKNOWN;
     std::string formatter;
     std::string file;
+    // 以下只有AsyncFile使用
+    size_t buffer_size = 1024 * 1024;
+    std::string overflow = "block";
+    // AsyncFile和Network使用
+    uint32_t flush_interval = 100;
+    // 以下只有RotatingFile使用
+    uint64_t max_size = 100 * 1024 * 1024;
+    uint32_t rotate_interval = 0;
+    uint32_t max_files = 10;
+    bool compress = true;
+    // 以下只有Network使用
+    std::string address;
+    std::string protocol = "tcp";
+    size_t queue_size = 10000;
+    size_t batch_size = 64 * 1024;
 
     // 因为ConfigVar里判断值是否变化并通知监听者时用到了比较
     bool operator==(const LogAppenderDefine &rhs) const {
         return type == rhs.type && level == rhs.level
-                && formatter == rhs.formatter && file == rhs.file;
+                && formatter == rhs.formatter && file == rhs.file
+                && buffer_size == rhs.buffer_size && overflow == rhs.overflow
+                && flush_interval == rhs.flush_interval && max_size == rhs.max_size
+                && rotate_interval == rhs.rotate_interval && max_files == rhs.max_files
+                && compress == rhs.compress && address == rhs.address
+                && protocol == rhs.protocol && queue_size == rhs.queue_size
+                && batch_size == rhs.batch_size;
     }
 };
 
@@ -87,6 +108,60 @@ public:
                         lad.file = appenderNode["file"].as<std::string>();
                     } else if (type == "StdoutLogAppender") {
                         lad.type = 2;
+                    } else if (type == "AsyncFileLogAppender") {
+                        lad.type = 3;
+                        if (!appenderNode["file"].IsDefined()) {
+                            std::cout << "log config error: asyncFileLogAppender file is null, " << appenderNode << std::endl;
+                            continue;
+                        }
+                        lad.file = appenderNode["file"].as<std::string>();
+                        if (appenderNode["buffer_size"].IsDefined()) {
+                            lad.buffer_size = appenderNode["buffer_size"].as<size_t>();
+                        }
+                        if (appenderNode["overflow"].IsDefined()) {
+                            lad.overflow = appenderNode["overflow"].as<std::string>();
+                        }
+                        if (appenderNode["flush_interval"].IsDefined()) {
+                            lad.flush_interval = appenderNode["flush_interval"].as<uint32_t>();
+                        }
+                    } else if (type == "RotatingFileLogAppender") {
+                        lad.type = 4;
+                        if (!appenderNode["file"].IsDefined()) {
+                            std::cout << "log config error: rotatingFileLogAppender file is null, " << appenderNode << std::endl;
+                            continue;
+                        }
+                        lad.file = appenderNode["file"].as<std::string>();
+                        if (appenderNode["max_size"].IsDefined()) {
+                            lad.max_size = appenderNode["max_size"].as<uint64_t>();
+                        }
+                        if (appenderNode["rotate_interval"].IsDefined()) {
+                            lad.rotate_interval = appenderNode["rotate_interval"].as<uint32_t>();
+                        }
+                        if (appenderNode["max_files"].IsDefined()) {
+                            lad.max_files = appenderNode["max_files"].as<uint32_t>();
+                        }
+                        if (appenderNode["compress"].IsDefined()) {
+                            lad.compress = appenderNode["compress"].as<bool>();
+                        }
+                    } else if (type == "NetworkLogAppender") {
+                        lad.type = 5;
+                        if (!appenderNode["address"].IsDefined()) {
+                            std::cout << "log config error: networkLogAppender address is null, " << appenderNode << std::endl;
+                            continue;
+                        }
+                        lad.address = appenderNode["address"].as<std::string>();
+                        if (appenderNode["protocol"].IsDefined()) {
+                            lad.protocol = appenderNode["protocol"].as<std::string>();
+                        }
+                        if (appenderNode["queue_size"].IsDefined()) {
+                            lad.queue_size = appenderNode["queue_size"].as<size_t>();
+                        }
+                        if (appenderNode["batch_size"].IsDefined()) {
+                            lad.batch_size = appenderNode["batch_size"].as<size_t>();
+                        }
+                        if (appenderNode["flush_interval"].IsDefined()) {
+                            lad.flush_interval = appenderNode["flush_interval"].as<uint32_t>();
+                        }
                     } else {
                         std::cout << "log config error: appender type invalid, " << appenderNode << std::endl;
                         continue;
@@ -126,6 +201,26 @@ public:
                     appNode["file"] = appender.file;
                 } else if (appender.type == 2) {
                     appNode["type"] = "StdoutLogAppender";
+                } else if (appender.type == 3) {
+                    appNode["type"] = "AsyncFileLogAppender";
+                    appNode["file"] = appender.file;
+                    appNode["buffer_size"] = appender.buffer_size;
+                    appNode["overflow"] = appender.overflow;
+                    appNode["flush_interval"] = appender.flush_interval;
+                } else if (appender.type == 4) {
+                    appNode["type"] = "RotatingFileLogAppender";
+                    appNode["file"] = appender.file;
+                    appNode["max_size"] = appender.max_size;
+                    appNode["rotate_interval"] = appender.rotate_interval;
+                    appNode["max_files"] = appender.max_files;
+                    appNode["compress"] = appender.compress;
+                } else if (appender.type == 5) {
+                    appNode["type"] = "NetworkLogAppender";
+                    appNode["address"] = appender.address;
+                    appNode["protocol"] = appender.protocol;
+                    appNode["queue_size"] = appender.queue_size;
+                    appNode["batch_size"] = appender.batch_size;
+                    appNode["flush_interval"] = appender.flush_interval;
                 }
                 if(log.level != LogLevel::UNKNOWN) {
                     appNode["level"] = LogLevel::ToString(appender.level);
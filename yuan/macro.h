@@ -7,6 +7,7 @@
 
 #include <string.h>
 #include <assert.h>
+#include <sstream>
 #include "util.h"
 #include "log.h"
 
@@ -20,20 +21,30 @@
 #endif
 
 // assert报错后只能返回assert有问题的那一行信息。而获取到整个函数调用栈更好debug一些。可以man backtrace了解
-// ASSERT的事情都较少可能发生，所以用YUAN_UNLIKELY
+// ASSERT的事情都较少可能发生，所以用YUAN_UNLIKELY。失败时的日志和调用栈放在冷函数AssertFailed里，
+// 调用处只有一次判断，不会展开出构造日志的代码
 #define YUAN_ASSERT(x) \
     if (YUAN_UNLIKELY(!(x))) { \
-        YUAN_LOG_ERROR(YUAN_GET_ROOT_LOGGER()) << "ASSERTION: " #x \
-            << "\nbacktrace\n" << yuan::BacktraceToString(100, 2, "    "); \
+        yuan::AssertFailed(__FILE__, __LINE__, #x, nullptr); \
         assert(x); \
     }
 
 #define YUAN_ASSERT2(x, w) \
     if (YUAN_UNLIKELY(!(x))) { \
-        YUAN_LOG_ERROR(YUAN_GET_ROOT_LOGGER()) << "ASSERTION: " #x \
-            << "\n" << w \
-            << "\nbacktrace\n" << yuan::BacktraceToString(100, 2, "    "); \
+        std::ostringstream _yuan_assert_ss; \
+        _yuan_assert_ss << w; \
+        yuan::AssertFailed(__FILE__, __LINE__, #x, _yuan_assert_ss.str().c_str()); \
         assert(x); \
     }
 
+// 只用于检查开销较大、又不守护状态机一致性的断言。定义了NDEBUG时整条去掉，x不会求值；否则和YUAN_ASSERT一样。
+// 协程切换、事件触发这类状态检查要一直保留，用YUAN_ASSERT
+#ifdef NDEBUG
+#define YUAN_DASSERT(x) if (false) { YUAN_ASSERT(x) }
+#define YUAN_DASSERT2(x, w) if (false) { YUAN_ASSERT2(x, w) }
+#else
+#define YUAN_DASSERT(x) YUAN_ASSERT(x)
+#define YUAN_DASSERT2(x, w) YUAN_ASSERT2(x, w)
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "metrics.h"
+#include <cmath>
+#include <sstream>
+
+namespace yuan {
+
+double Histogram::getAverage() const {
+    uint64_t count = getCount();
+    return count ? static_cast<double>(getSum()) / count : 0;
+}
+
+uint64_t Histogram::percentile(double p) const {
+    uint64_t count = getCount();
+    if (count == 0) {
+        return 0;
+    }
+    // 向上取整，保证p=1时落在最后一个有数据的桶上
+    uint64_t target = static_cast<uint64_t>(std::ceil(p * count));
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += getBucket(i);
+        if (seen >= target) {
+            // 桶的上界。但不会超过实际观察到的最大值
+            uint64_t upper = i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (1ULL << i) - 1);
+            uint64_t max = getMax();
+            return upper < max ? upper : max;
+        }
+    }
+    return getMax();
+}
+
+void Histogram::merge(const Histogram &other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        m_buckets[i].fetch_add(other.getBucket(i), std::memory_order_relaxed);
+    }
+    m_count.fetch_add(other.getCount(), std::memory_order_relaxed);
+    m_sum.fetch_add(other.getSum(), std::memory_order_relaxed);
+    uint64_t value = other.getMax();
+    uint64_t old_max = m_max.load(std::memory_order_relaxed);
+    while (value > old_max
+            && !m_max.compare_exchange_weak(old_max, value, std::memory_order_relaxed));
+}
+
+void Histogram::reset() {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+std::string Histogram::toString() const {
+    std::stringstream ss;
+    ss << "count=" << getCount()
+        << " avg=" << static_cast<uint64_t>(getAverage())
+        << " p50=" << percentile(0.5)
+        << " p90=" << percentile(0.9)
+        << " p99=" << percentile(0.99)
+        << " max=" << getMax();
+    return ss.str();
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef __YUAN_METRICS_H__
+#define __YUAN_METRICS_H__
+
+/**
+ * @file metrics.h
+ * 运行时统计用的基础组件。目前提供直方图，供调度器等模块统计等待时间、执行时间等分布
+ * 设计目标是开销足够低，可以在满负载下常开：只用relaxed的原子操作，不加锁
+ */
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+namespace yuan {
+
+// 以2的幂划分桶的直方图。第i个桶记录[2^(i-1), 2^i)范围内的值，第0个桶只记录0
+// 分位数是近似值（返回桶的上界），但足够定位问题。推荐每个线程持有自己的直方图，读取时再汇总，避免多线程争抢同一缓存行
+class Histogram {
+public:
+    static const size_t BUCKETS = 65;
+
+    Histogram() { reset(); }
+
+    void record(uint64_t value) {
+        size_t idx = value ? 64 - __builtin_clzll(value) : 0;
+        m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        // 只有变大时才写，大多数情况下只有一次load
+        uint64_t old_max = m_max.load(std::memory_order_relaxed);
+        while (value > old_max
+                && !m_max.compare_exchange_weak(old_max, value, std::memory_order_relaxed));
+    }
+
+    uint64_t getCount() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t getSum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t getMax() const { return m_max.load(std::memory_order_relaxed); }
+    uint64_t getBucket(size_t idx) const { return m_buckets[idx].load(std::memory_order_relaxed); }
+    double getAverage() const;
+    // p的范围为[0, 1]。返回值为近似值
+    uint64_t percentile(double p) const;
+
+    // 把other的数据累加进来，用于汇总多个线程的直方图
+    void merge(const Histogram &other);
+    void reset();
+
+    // 格式: count=.. avg=.. p50=.. p90=.. p99=.. max=..
+    std::string toString() const;
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+}
+
+#endif
@@ -0,0 +1,311 @@
+#include "net_log_appender.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "config.h"
+#include "macro.h"
+
+namespace yuan {
+
+// 自己的错误日志都限流：root可能就配置了这个appender，断线时不能自己给自己刷屏
+static Logger::ptr g_logger = YUAN_GET_LOGGER("net_log");
+
+// UDP数据报的最大长度
+static const size_t s_max_datagram = 65507;
+
+NetworkLogAppender::Protocol NetworkLogAppender::ProtocolFromString(const std::string &str) {
+    if (str == "udp" || str == "UDP") {
+        return UDP;
+    }
+    return TCP;
+}
+
+const char *NetworkLogAppender::ProtocolToString(Protocol protocol) {
+    return protocol == UDP ? "udp" : "tcp";
+}
+
+class NetworkLogAppender::Sender {
+public:
+    Sender(const std::string &address, Protocol protocol, size_t queue_size
+            , size_t batch_size, uint32_t flush_interval_ms)
+        : m_address(address)
+        , m_protocol(protocol)
+        , m_batchSize(batch_size ? batch_size : 1)
+        , m_flushInterval(flush_interval_ms ? flush_interval_ms : 1)
+        , m_queue(queue_size) {
+        if (m_protocol == UDP && m_batchSize > s_max_datagram) {
+            m_batchSize = s_max_datagram;
+        }
+    }
+
+    // 发送协程
+    void run();
+    // 解析地址、建立连接（UDP只创建socket），失败返回false
+    bool connect();
+    // 从队列里取日志拼成一批，返回批里的条数
+    size_t fillBatch();
+    bool sendBatch();
+    // 睡ms毫秒，析构时提前醒来
+    void waitFor(uint64_t ms);
+public:
+    const std::string m_address;
+    const Protocol m_protocol;
+    size_t m_batchSize;
+    const uint32_t m_flushInterval;
+
+    MPMCQueue<std::string> m_queue;
+    std::atomic<uint64_t> m_dropped = {0};
+    uint64_t m_reportedDropped = 0;
+    std::atomic<uint64_t> m_sent = {0};
+    std::atomic<bool> m_connected = {false};
+    std::atomic<bool> m_stopping = {false};
+
+    // 以下只有发送协程访问
+    Address::ptr m_addr;
+    Socket::ptr m_sock;
+    uint64_t m_reconnectDelay = 0;
+    std::string m_batch;
+    size_t m_batchLines = 0;
+    // 放不进当前批次、留给下一批的一行
+    std::string m_carry;
+    bool m_hasCarry = false;
+};
+
+NetworkLogAppender::NetworkLogAppender(const std::string &address, Protocol protocol, size_t queue_size
+        , size_t batch_size, uint32_t flush_interval_ms)
+    : m_sender(std::make_shared<Sender>(address, protocol, queue_size, batch_size, flush_interval_ms)) {
+    m_iom.reset(new IOManager(1, false, "log_net"));
+    // 协程持有Sender的引用，不依赖appender的生命周期
+    m_iom->schedule(std::bind(&Sender::run, m_sender));
+}
+
+NetworkLogAppender::~NetworkLogAppender() {
+    m_sender->m_stopping = true;
+    if (IOManager::GetThis() == m_iom.get()) {
+        // 在发送线程上析构（发送协程或调度器自己写日志时持有了最后一个引用），不能join自己
+        std::shared_ptr<IOManager> iom;
+        iom.swap(m_iom);
+        Thread::ptr thread(new Thread([iom]() mutable {
+            iom.reset();
+        }, "log_net_stop"));
+        // Thread析构时detach
+        return;
+    }
+    // IOManager析构时会等发送协程退出
+    m_iom.reset();
+}
+
+uint64_t NetworkLogAppender::getDropped() const {
+    return m_sender->m_dropped;
+}
+
+uint64_t NetworkLogAppender::getSent() const {
+    return m_sender->m_sent;
+}
+
+bool NetworkLogAppender::isConnected() const {
+    return m_sender->m_connected;
+}
+
+void NetworkLogAppender::log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) {
+    if (level < m_level) {
+        return;
+    }
+    LogFormatter::ptr formatter;
+    {
+        MutexType::Lock lock(m_mutex);
+        formatter = m_formatter;
+    }
+    if (!formatter) {
+        return;
+    }
+    if (!m_sender->m_queue.push(formatter->format(logger, level, event))) {
+        ++m_sender->m_dropped;
+    }
+}
+
+bool NetworkLogAppender::Sender::connect() {
+    if (!m_addr) {
+        m_addr = Address::LookupAny(m_address);
+        if (!m_addr) {
+            YUAN_LOG_ERROR_LIMIT(g_logger, 1, 10000) << "NetworkLogAppender lookup address=" << m_address << " fail";
+            return false;
+        }
+    }
+    if (m_protocol == UDP) {
+        // UDP的connect只是记下默认的目的地址，之后直接send
+        m_sock = Socket::CreateUDP(m_addr);
+        if (!m_sock->connect(m_addr)) {
+            m_sock.reset();
+            m_addr.reset();
+            return false;
+        }
+        return true;
+    }
+    m_sock = Socket::CreateTCP(m_addr);
+    if (!m_sock->connect(m_addr, 1000)) {
+        YUAN_LOG_ERROR_LIMIT(g_logger, 1, 10000) << "NetworkLogAppender connect " << *m_addr
+            << " fail errno=" << errno << " strerr=" << strerror(errno);
+        m_sock.reset();
+        // 地址可能变了（如域名切换），下次重新解析
+        m_addr.reset();
+        return false;
+    }
+    // 收集端卡住时send不能一直挂着
+    m_sock->setSendTimeout(3000);
+    YUAN_LOG_INFO(g_logger) << "NetworkLogAppender connected to " << *m_addr;
+    return true;
+}
+
+size_t NetworkLogAppender::Sender::fillBatch() {
+    uint64_t dropped = m_dropped;
+    if (dropped != m_reportedDropped && m_batch.empty()) {
+        m_batch = "NetworkLogAppender dropped " + std::to_string(dropped - m_reportedDropped)
+            + " logs because queue is full\n";
+        m_reportedDropped = dropped;
+    }
+    std::string line;
+    while (true) {
+        if (m_hasCarry) {
+            line.swap(m_carry);
+            m_hasCarry = false;
+        } else if (!m_queue.pop(line)) {
+            break;
+        }
+        if (!m_batch.empty() && m_batch.size() + line.size() > m_batchSize) {
+            m_carry.swap(line);
+            m_hasCarry = true;
+            break;
+        }
+        if (m_protocol == UDP && line.size() > m_batchSize) {
+            // 一个数据报放不下的一行只能截断
+            line.resize(m_batchSize);
+        }
+        m_batch.append(line);
+        ++m_batchLines;
+    }
+    return m_batchLines;
+}
+
+bool NetworkLogAppender::Sender::sendBatch() {
+    if (m_protocol == UDP) {
+        int rt = m_sock->send(m_batch.data(), m_batch.size());
+        if (rt < 0) {
+            // UDP发不出去（如本机缓冲区满、对端端口没有监听）就丢掉，不重试
+            YUAN_LOG_ERROR_LIMIT(g_logger, 1, 10000) << "NetworkLogAppender send to " << *m_addr
+                << " fail errno=" << errno << " strerr=" << strerror(errno);
+        } else {
+            m_sent += m_batchLines;
+        }
+        return true;
+    }
+    // 对端已经关闭时，send仍会成功把数据写进内核缓冲区，之后才收到RST，这一批就丢了。
+    // 所以发送前先看一下连接是否已被对端关闭（收集端不会给我们发数据，可读就是关闭或出错）
+    struct pollfd pfd;
+    pfd.fd = m_sock->getSocketFd();
+    pfd.events = POLLIN | POLLRDHUP;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+        YUAN_LOG_ERROR_LIMIT(g_logger, 1, 10000) << "NetworkLogAppender connection to " << *m_addr
+            << " closed by peer";
+        return false;
+    }
+    const char *data = m_batch.data();
+    size_t left = m_batch.size();
+    while (left > 0) {
+        // 对端关闭时不要产生SIGPIPE
+        int rt = m_sock->send(data, left, MSG_NOSIGNAL);
+        if (rt <= 0) {
+            YUAN_LOG_ERROR_LIMIT(g_logger, 1, 10000) << "NetworkLogAppender send to " << *m_addr
+                << " fail rt=" << rt << " errno=" << errno << " strerr=" << strerror(errno);
+            return false;
+        }
+        data += rt;
+        left -= rt;
+    }
+    m_sent += m_batchLines;
+    return true;
+}
+
+void NetworkLogAppender::Sender::run() {
+    while (true) {
+        // 析构时置位之前放进队列的日志，在连接正常时一定会被发完
+        bool stopping = m_stopping;
+        if (!m_sock) {
+            // 析构时如果已经在退避重连（收集端连不上），不再等一次连接超时，剩下的日志丢弃
+            if (stopping && (m_reconnectDelay || (m_batch.empty() && !m_hasCarry && m_queue.empty()))) {
+                break;
+            }
+            if (!connect()) {
+                if (stopping) {
+                    break;
+                }
+                // 指数退避，在这个IOManager里usleep被hook为定时器，不占线程
+                m_reconnectDelay = m_reconnectDelay ? std::min<uint64_t>(m_reconnectDelay * 2, 5000) : 100;
+                waitFor(m_reconnectDelay);
+                continue;
+            }
+            m_reconnectDelay = 0;
+            m_connected = true;
+        }
+
+        if (m_batch.empty()) {
+            m_batchLines = 0;
+            fillBatch();
+        }
+        if (m_batch.empty()) {
+            if (stopping) {
+                break;
+            }
+            waitFor(m_flushInterval);
+            continue;
+        }
+        if (!sendBatch()) {
+            // 这一批留着，重连后重发
+            m_sock->close();
+            m_sock.reset();
+            m_connected = false;
+            if (stopping) {
+                break;
+            }
+            continue;
+        }
+        m_batch.clear();
+    }
+    if (m_sock) {
+        m_sock->close();
+        m_sock.reset();
+    }
+}
+
+void NetworkLogAppender::Sender::waitFor(uint64_t ms) {
+    // 分成小段睡，析构时最多等一小段，不用等完整个退避时间
+    static const uint64_t s_slice_ms = 10;
+    while (ms > 0 && !m_stopping) {
+        uint64_t slice = std::min(ms, s_slice_ms);
+        usleep(slice * 1000);
+        ms -= slice;
+    }
+}
+
+std::string NetworkLogAppender::toYAMLString() {
+    MutexType::Lock lock(m_mutex);
+    YAML::Node node;
+    node["type"] = "NetworkLogAppender";
+    node["address"] = m_sender->m_address;
+    node["protocol"] = ProtocolToString(m_sender->m_protocol);
+    node["queue_size"] = m_sender->m_queue.capacity();
+    node["batch_size"] = m_sender->m_batchSize;
+    node["flush_interval"] = m_sender->m_flushInterval;
+    if (m_level != LogLevel::UNKNOWN) {
+        node["level"] = LogLevel::ToString(m_level);
+    }
+    if (m_hasFormatter && m_formatter) {
+        node["formatter"] = m_formatter->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+}
@@ -0,0 +1,70 @@
+#ifndef __YUAN_NET_LOG_APPENDER_H__
+#define __YUAN_NET_LOG_APPENDER_H__
+
+/**
+ * @file net_log_appender.h
+ * 把日志直接发到远端的日志收集服务，不需要旁路程序去tail日志文件。
+ * 依赖IOManager和Socket，所以不放在log.h里
+ */
+
+#include <atomic>
+#include <string>
+#include "address.h"
+#include "iomanager.h"
+#include "lockfree_queue.h"
+#include "log.h"
+#include "socket.h"
+
+namespace yuan {
+
+/**
+ * @brief 网络日志Appender
+ * 写日志的线程/协程只在本地格式化，然后放进有界的无锁队列，队列满了直接丢弃（计数），不会被慢的收集端阻塞。
+ * 发送在自己独占的单线程IOManager里由一个协程完成：把队列里的日志拼成不超过batch_size字节的批次再发送
+ *   TCP：一批一次send，断开后按100ms到5s指数退避重连，发送失败的那一批重连后重发（可能重复一部分，不会丢）。
+ *        断开期间日志留在队列里，满了再丢
+ *   UDP：一批一个数据报，一行日志不会被拆到两个数据报里
+ * 析构时会把队列里剩余的日志尽量发完；如果收集端正连不上（在退避重连），不再等待，剩余的日志丢弃。如果析构发生在发送线程自己身上（发送协程写的日志正好持有最后一个引用），
+ * 不能join自己，就把IOManager交给一个detach的线程去停
+ */
+class NetworkLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<NetworkLogAppender> ptr;
+
+    enum Protocol {
+        TCP = 0,
+        UDP = 1
+    };
+
+    static Protocol ProtocolFromString(const std::string &str);
+    static const char *ProtocolToString(Protocol protocol);
+
+    /**
+     * @param address 收集端的地址，如"127.0.0.1:9000"、"logs.example.com:9000"
+     * @param queue_size 队列里最多缓存多少条日志
+     * @param batch_size 一批最多多少字节，UDP时即数据报的最大长度
+     * @param flush_interval_ms 队列空时，发送协程最长多久看一次队列
+     */
+    NetworkLogAppender(const std::string &address, Protocol protocol = TCP, size_t queue_size = 10000
+        , size_t batch_size = 64 * 1024, uint32_t flush_interval_ms = 100);
+    ~NetworkLogAppender();
+
+    virtual void log(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event) override;
+    std::string toYAMLString() override;
+
+    // 因队列满被丢弃的日志条数
+    uint64_t getDropped() const;
+    // 成功发送的日志条数
+    uint64_t getSent() const;
+    bool isConnected() const;
+private:
+    // 发送协程用到的状态。由发送协程和appender共同持有，
+    // 这样appender在发送线程自己身上析构时，协程还能安全地跑完
+    class Sender;
+    std::shared_ptr<Sender> m_sender;
+    std::shared_ptr<IOManager> m_iom;
+};
+
+}
+
+#endif
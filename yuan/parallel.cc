@@ -0,0 +1,67 @@
+#include "parallel.h"
+#include "macro.h"
+#include "util.h"
+
+namespace yuan {
+
+void WaitGroup::add(size_t n) {
+    MutexType::Lock lock(m_mutex);
+    m_pending += n;
+}
+
+void WaitGroup::done() {
+    Fiber::ptr waiter;
+    Scheduler *scheduler = nullptr;
+    int thread = -1;
+    bool post = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        YUAN_ASSERT(m_pending > 0);
+        if (--m_pending > 0) {
+            return;
+        }
+        waiter.swap(m_waiter);
+        scheduler = m_scheduler;
+        thread = m_waiterThread;
+        post = m_semWaiting;
+        m_semWaiting = false;
+    }
+
+    if (waiter) {
+        // 指定回到等待者原来的线程执行。该线程一定是先完成了切出，才会再从任务队列里取出这个协程，
+        // 避免在其他线程上切入一个还没来得及保存上下文的协程
+        scheduler->schedule(waiter, thread);
+    } else if (post) {
+        m_semaphore.post();
+    }
+}
+
+void WaitGroup::wait() {
+    Scheduler *scheduler = Scheduler::GetThis();
+    Fiber::ptr cur = Fiber::GetThis();
+    // 在调度器的任务协程里才能挂起协程。调度器的主协程、线程的主协程（id为0）挂起了就没人来调度了
+    bool in_fiber = scheduler && cur.get() != Scheduler::GetMainFiber() && cur->getId() != 0;
+
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_pending == 0) {
+            return;
+        }
+        if (in_fiber) {
+            m_waiter = cur;
+            m_scheduler = scheduler;
+            m_waiterThread = GetThreadId();
+        } else {
+            m_semWaiting = true;
+        }
+    }
+
+    if (in_fiber) {
+        cur.reset();
+        Fiber::YieldToHold();
+    } else {
+        m_semaphore.wait();
+    }
+}
+
+}
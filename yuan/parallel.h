@@ -0,0 +1,171 @@
+#ifndef __YUAN_PARALLEL_H__
+#define __YUAN_PARALLEL_H__
+
+/**
+ * @file parallel.h
+ * 基于Scheduler的并行计算原语：parallel_for、parallel_reduce、parallel_sort
+ * 用于CPU密集的批处理任务，和IO任务共用同一个调度器（线程池）
+ * 思路：区间递归二分，每次把右半部分作为新任务放进调度器的任务队列，自己继续处理左半部分，直到区间不大于grain。
+ * 任务队列是所有线程共享的，空闲的线程会从队列里取走（窃取）被拆出来的任务，所以负载会自动均衡
+ * 调用者只阻塞当前协程，不阻塞线程：等待期间调用者所在线程可以继续执行其他任务（包括拆出来的子任务）
+ */
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "fiber.h"
+#include "scheduler.h"
+#include "thread.h"
+
+namespace yuan {
+
+// 等待一组任务完成。类似go的WaitGroup
+// 在调度器的协程里调用wait，只挂起当前协程；在调度器之外的线程里调用，则用信号量阻塞线程
+class WaitGroup : Noncopyable {
+public:
+    typedef std::shared_ptr<WaitGroup> ptr;
+    typedef Spinlock MutexType;
+
+    WaitGroup(size_t count = 0) : m_pending(count) {}
+
+    void add(size_t n = 1);
+    void done();
+    // 等到计数变为0才返回
+    void wait();
+private:
+    MutexType m_mutex;
+    size_t m_pending;
+    // 在协程里等待时，记录要唤醒的协程以及它所在的调度器和线程
+    Fiber::ptr m_waiter;
+    Scheduler *m_scheduler = nullptr;
+    int m_waiterThread = -1;
+    // 在调度器之外的线程等待时使用
+    bool m_semWaiting = false;
+    Semaphore m_semaphore;
+};
+
+namespace detail {
+
+// 递归二分区间。右半部分交给调度器，左半部分继续在当前协程里拆分，拆到不大于grain后执行fn
+template<typename Fn>
+void ParallelRange(Scheduler *scheduler, WaitGroup::ptr wg, std::shared_ptr<Fn> fn
+                , size_t begin, size_t end, size_t grain) {
+    while (end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        wg->add();
+        scheduler->schedule(std::function<void()>(
+            std::bind(&ParallelRange<Fn>, scheduler, wg, fn, mid, end, grain)));
+        end = mid;
+    }
+    (*fn)(begin, end);
+    wg->done();
+}
+
+}
+
+/**
+ * @brief 并行执行fn(b, e)，所有的[b, e)拼起来恰好是[begin, end)，且每段长度不超过grain
+ * 返回时所有子区间都已执行完。fn可能在多个线程上同时执行，要自己保证线程安全
+ * @param grain 子区间的最大长度，太小则任务调度的开销占比大，太大则负载不均衡
+ */
+template<typename Fn>
+void parallel_for(size_t begin, size_t end, size_t grain, Fn fn
+                , Scheduler *scheduler = Scheduler::GetThis()) {
+    if (begin >= end) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    if (!scheduler || end - begin <= grain) {
+        fn(begin, end);
+        return;
+    }
+
+    WaitGroup::ptr wg(new WaitGroup(1));
+    std::shared_ptr<Fn> shared_fn(new Fn(std::move(fn)));
+    // 调用者自己也参与计算
+    detail::ParallelRange(scheduler, wg, shared_fn, begin, end, grain);
+    wg->wait();
+}
+
+/**
+ * @brief 并行归约。先把[begin, end)按grain切成若干段，并行地用map计算每段的结果，
+ * 再按区间顺序用reduce把结果合并起来。因为合并是按顺序的，reduce只需满足结合律，不需要满足交换律
+ * @param map T(size_t b, size_t e)
+ * @param reduce T(const T &lhs, const T &rhs)
+ */
+template<typename T, typename MapFn, typename ReduceFn>
+T parallel_reduce(size_t begin, size_t end, size_t grain, const T &identity
+                , MapFn map, ReduceFn reduce, Scheduler *scheduler = Scheduler::GetThis()) {
+    if (begin >= end) {
+        return identity;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    size_t chunks = (end - begin + grain - 1) / grain;
+    std::vector<T> results(chunks, identity);
+    parallel_for(0, chunks, 1, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            size_t chunk_begin = begin + i * grain;
+            size_t chunk_end = std::min(chunk_begin + grain, end);
+            results[i] = map(chunk_begin, chunk_end);
+        }
+    }, scheduler);
+
+    T result = identity;
+    for (auto &r : results) {
+        result = reduce(result, r);
+    }
+    return result;
+}
+
+/**
+ * @brief 并行排序。先并行地对每段长度为grain的区间排序，再一轮轮并行地两两归并，每轮归并的区间长度翻倍
+ * 不是稳定排序（每段内部用的std::sort）
+ */
+template<typename RandomIt, typename Compare>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp, size_t grain = 4096
+                , Scheduler *scheduler = Scheduler::GetThis()) {
+    size_t n = last - first;
+    if (n <= 1) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+    size_t chunks = (n + grain - 1) / grain;
+    parallel_for(0, chunks, 1, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            std::sort(first + i * grain, first + std::min((i + 1) * grain, n), comp);
+        }
+    }, scheduler);
+
+    for (size_t width = grain; width < n; width *= 2) {
+        size_t pairs = (n + 2 * width - 1) / (2 * width);
+        parallel_for(0, pairs, 1, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                size_t left = i * 2 * width;
+                size_t mid = std::min(left + width, n);
+                size_t right = std::min(left + 2 * width, n);
+                if (mid < right) {
+                    std::inplace_merge(first + left, first + mid, first + right, comp);
+                }
+            }
+        }, scheduler);
+    }
+}
+
+template<typename RandomIt>
+void parallel_sort(RandomIt first, RandomIt last, size_t grain = 4096
+                , Scheduler *scheduler = Scheduler::GetThis()) {
+    parallel_sort(first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>()
+                , grain, scheduler);
+}
+
+}
+
+#endif
@@ -1,7 +1,10 @@
 #include "scheduler.h"
+#include "config.h"
+#include "epoch.h"
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include <sstream>
 
 namespace yuan {
 
@@ -11,10 +14,29 @@ static yuan::Logger::ptr g_logger = YUAN_GET_LOGGER("system");
 static thread_local Scheduler *t_scheduler = nullptr;
 // 每个线程执行Scheduler::run方法的主协程
 static thread_local Fiber *t_fiber = nullptr;
+// 当前线程在调度器中的统计项。对象由Scheduler::m_threadMetrics持有
+static thread_local SchedulerThreadMetrics *t_metrics = nullptr;
+
+std::atomic<bool> Scheduler::s_histograms = {false};
+
+static ConfigVar<bool>::ptr g_scheduler_histograms =
+    Config::Lookup("scheduler.histograms", false, "record scheduler histograms: queue depth, task wait/run time, events per epoll_wait");
+
+struct SchedulerHistogramsIniter {
+    SchedulerHistogramsIniter() {
+        Scheduler::SetHistogramsEnabled(g_scheduler_histograms->getValue());
+        g_scheduler_histograms->add_listener([](const bool &old_value, const bool &new_value){
+            Scheduler::SetHistogramsEnabled(new_value);
+        });
+    }
+};
+
+static SchedulerHistogramsIniter s_histograms_initer;
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name)
     : m_name(name) {
     YUAN_ASSERT(threads > 0);
+    m_mutex.setName("Scheduler::m_mutex");
 
     if (use_caller) {
         // 一个线程上只能有一个调度器。先判断是否已经初始化过。
@@ -142,7 +164,8 @@ void Scheduler::stop() {
 }
 
 void Scheduler::tickle() {
-    YUAN_LOG_INFO(g_logger) << "tickle";
+    ++m_ticklesSent;
+    YUAN_DLOG_DEBUG(g_logger) << "tickle";
 }
 
 void Scheduler::run() {
@@ -157,6 +180,18 @@ void Scheduler::run() {
         t_fiber = Fiber::GetThis().get();
     }
 
+    SchedulerThreadMetrics::ptr metrics(new SchedulerThreadMetrics);
+    metrics->threadId = GetThreadId();
+    metrics->threadName = Thread::GetName();
+    {
+        MutexType::Lock lock(m_mutex);
+        m_threadMetrics.push_back(metrics);
+    }
+    t_metrics = metrics.get();
+    // 调度线程都参与内存回收，run的每次循环是一个静止点
+    EpochManager *epoch = EpochMgr::GetInstance();
+    epoch->registerThread();
+
     // 任务队列里没有任务可执行时，执行idle
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
     // 为下面的任务队列中的function对象准备的协程
@@ -165,10 +200,13 @@ void Scheduler::run() {
     FiberAndThread fat;
     while (true) {
         fat.reset();
+        epoch->quiescent();
         // 有可能当前线程并不是想要唤醒的线程，那么当前线程就要接过再唤醒其他线程的任务
         bool need_tickle = false;
         // 用来标记是否有从任务队列取出任务
         bool is_active = false;
+        // 已被取消的任务。放到锁外面析构，防止任务析构时又调用schedule导致死锁
+        std::vector<FiberAndThread> cancelled;
         {
             MutexType::Lock lock(m_mutex);
             // 遍历任务队列，取出能在当前线程执行的任务
@@ -182,11 +220,19 @@ void Scheduler::run() {
                 }
 
                 YUAN_ASSERT(it->fiber || it->cb);
+                if (it->isCancelled()) {
+                    cancelled.push_back(*it);
+                    it = m_fibers.erase(it);
+                    continue;
+                }
                 if (it->fiber && it->fiber->getState() == Fiber::EXEC) {
                     ++it;
                     continue;
                 }
 
+                if (IsHistogramsEnabled()) {
+                    metrics->queueDepth.record(m_fibers.size());
+                }
                 fat = *it;
                 m_fibers.erase(it);
                 is_active = true;
@@ -196,13 +242,37 @@ void Scheduler::run() {
             }
         }
 
+        if (!cancelled.empty()) {
+            YUAN_DLOG_DEBUG(g_logger) << "drop " << cancelled.size() << " cancelled tasks";
+            cancelled.clear();
+        }
+
         if (need_tickle) {
             tickle();
         }
 
+        uint64_t start_us = 0;
+        if (is_active) {
+            // 顺便刷新本线程缓存的时间，任务里加定时器时用到的时间就不会太旧
+            Clock::Update();
+            // 任务放入队列时没有记时间（直方图是之后才打开的）就不统计这个任务
+            if (IsHistogramsEnabled() && fat.enqueueUs) {
+                start_us = Clock::NowUs();
+                metrics->waitUs.record(start_us > fat.enqueueUs ? start_us - fat.enqueueUs : 0);
+            }
+        }
+
         if (fat.fiber && fat.fiber->getState() != Fiber::TERM && fat.fiber->getState() != Fiber::EXCEPT) {
+            if (fat.token) {
+                fat.fiber->setCancelToken(fat.token);
+            }
+            ++metrics->contextSwitches;
+            ++metrics->tasks;
             fat.fiber->swapIn();
             --m_activeThreadCount;
+            if (start_us) {
+                metrics->runUs.record(Clock::NowUs() - start_us);
+            }
             // fat.fiber因某种原因停止了执行，分情况处理
             // 协程里调用了YieldToReady
             if (fat.fiber->getState() == Fiber::READY) {
@@ -219,10 +289,16 @@ void Scheduler::run() {
             } else {
                 cb_fiber.reset(new Fiber(fat.cb));
             }
+            cb_fiber->setCancelToken(fat.token);
             fat.reset();
 
+            ++metrics->contextSwitches;
+            ++metrics->tasks;
             cb_fiber->swapIn();
             --m_activeThreadCount;
+            if (start_us) {
+                metrics->runUs.record(Clock::NowUs() - start_us);
+            }
 
             if (cb_fiber->getState() == Fiber::READY) {
                 schedule(cb_fiber);
@@ -246,10 +322,18 @@ void Scheduler::run() {
             if (idle_fiber->getState() == Fiber::TERM) {
                 YUAN_LOG_INFO(g_logger) << "idle fiber term";
                 // 先简单粗暴处理：既没有任务，空闲协程也已终止，则整个线程任务完成，跳出while(true)
+                t_metrics = nullptr;
+                epoch->unregisterThread();
                 break;
             }
             ++m_idleThreadCount;
+            ++metrics->contextSwitches;
+            uint64_t idle_start_us = Clock::NowUs();
+            // idle里可能长时间阻塞，离线期间不拖住回收
+            epoch->offline();
             idle_fiber->swapIn();
+            epoch->online();
+            metrics->idleUs += Clock::NowUs() - idle_start_us;
             --m_idleThreadCount;
             if (idle_fiber->getState() != Fiber::TERM && idle_fiber->getState() != Fiber::EXCEPT) {
                 idle_fiber->setState(Fiber::HOLD);
@@ -258,6 +342,10 @@ void Scheduler::run() {
     }
 }
 
+void Scheduler::SetHistogramsEnabled(bool enabled) {
+    s_histograms.store(enabled, std::memory_order_relaxed);
+}
+
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
     return m_autoStop && m_stopping && m_fibers.empty() && m_activeThreadCount == 0;
@@ -282,4 +370,53 @@ Scheduler *Scheduler::GetThis() {
 Fiber *Scheduler::GetMainFiber() {
     return t_fiber;
 }
+
+SchedulerThreadMetrics *Scheduler::GetThreadMetrics() {
+    return t_metrics;
+}
+
+size_t Scheduler::getQueueDepth() {
+    MutexType::Lock lock(m_mutex);
+    return m_fibers.size();
+}
+
+void Scheduler::getThreadMetrics(std::vector<SchedulerThreadMetrics::ptr> &metrics) {
+    MutexType::Lock lock(m_mutex);
+    metrics = m_threadMetrics;
+}
+
+std::string Scheduler::dumpMetrics() {
+    std::vector<SchedulerThreadMetrics::ptr> metrics;
+    getThreadMetrics(metrics);
+
+    std::stringstream ss;
+    ss << "scheduler name=" << m_name
+        << " queue_depth=" << getQueueDepth()
+        << " tickles_sent=" << m_ticklesSent
+        << " active_threads=" << m_activeThreadCount
+        << " idle_threads=" << m_idleThreadCount
+        << " threads=" << metrics.size() << std::endl;
+    // 汇总所有线程，再逐个线程输出
+    Histogram total_wait, total_run;
+    for (auto &m : metrics) {
+        total_wait.merge(m->waitUs);
+        total_run.merge(m->runUs);
+    }
+    ss << "    wait_us: " << total_wait.toString() << std::endl;
+    ss << "    run_us: " << total_run.toString() << std::endl;
+    for (auto &m : metrics) {
+        ss << "thread id=" << m->threadId
+            << " name=" << m->threadName
+            << " tasks=" << m->tasks
+            << " context_switches=" << m->contextSwitches
+            << " idle_us=" << m->idleUs
+            << " tickles_received=" << m->ticklesReceived
+            << " epoll_wakeups=" << m->epollWakeups << std::endl;
+        ss << "    queue_depth: " << m->queueDepth.toString() << std::endl;
+        ss << "    wait_us: " << m->waitUs.toString() << std::endl;
+        ss << "    run_us: " << m->runUs.toString() << std::endl;
+        ss << "    events_per_wait: " << m->eventsPerWait.toString() << std::endl;
+    }
+    return ss.str();
+}
 }
\ No newline at end of file
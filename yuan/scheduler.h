@@ -8,8 +8,11 @@
  * 如果是创建Scheduler的主线程，线程主协程和Scheduler在该线程的主协程是不同的。注意区分
  */
 #include <memory>
+#include "clock.h"
 #include "fiber.h"
+#include "metrics.h"
 #include "thread.h"
+#include "util.h"
 #include <functional>
 #include <list>
 #include <vector>
@@ -18,6 +21,32 @@
 
 namespace yuan {
 
+// 调度器在每个线程上的运行统计。只由所属线程写入，其他线程可以随时读取
+struct SchedulerThreadMetrics {
+    typedef std::shared_ptr<SchedulerThreadMetrics> ptr;
+
+    int threadId = 0;
+    std::string threadName;
+    // 执行过的任务数
+    std::atomic<uint64_t> tasks = {0};
+    // run方法里切换到任务协程或idle协程的次数
+    std::atomic<uint64_t> contextSwitches = {0};
+    // 在idle里花费的时间，单位微秒
+    std::atomic<uint64_t> idleUs = {0};
+    // 以下两项只有IOManager会统计：被tickle唤醒的次数和epoll_wait返回的次数
+    std::atomic<uint64_t> ticklesReceived = {0};
+    std::atomic<uint64_t> epollWakeups = {0};
+    // 以下几个直方图只有打开scheduler.histograms才统计，见Scheduler::SetHistogramsEnabled
+    // 每次取任务时任务队列的长度
+    Histogram queueDepth;
+    // 任务从放入队列到开始执行的时间，单位微秒
+    Histogram waitUs;
+    // 任务每次被切入执行的时间，单位微秒
+    Histogram runUs;
+    // 每次epoll_wait返回的事件数
+    Histogram eventsPerWait;
+};
+
 // 调度基类。以后还要继承扩展，比如和epoll结合的调度器
 class Scheduler {
 public:
@@ -49,6 +78,20 @@ public:
         }
     }
 
+    // 带取消令牌的调度。令牌被取消时，还没开始执行的任务会被直接丢弃；已经开始执行的任务，令牌会绑定在执行它的协程上
+    template<typename FiberOrCb>
+    void schedule(FiberOrCb foc, CancelToken::ptr token, int thread = -1) {
+        bool need_tickle = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            need_tickle = scheduleNoLock(foc, thread, token);
+        }
+
+        if (need_tickle) {
+            tickle();
+        }
+    }
+
     // 批量调度方法。泛型的设计思维。批量增加的好处是能保证任务在消息队列中的顺序
     template<typename FiberOrCbIterator>
     void schedule(FiberOrCbIterator begin, FiberOrCbIterator end) {
@@ -83,6 +126,24 @@ public:
     static Scheduler *GetThis();
     // 获取当前线程的调度器主协程（运行run方法的协程）
     static Fiber *GetMainFiber();
+    // 获取当前线程在调度器中的统计项，不在调度线程里则返回nullptr
+    static SchedulerThreadMetrics *GetThreadMetrics();
+    // 是否统计直方图（队列长度、等待时间、执行时间、每次epoll的事件数）。每个任务要多读两次时钟、记三次直方图，
+    // 一个线程满负载跑空任务时每个任务慢10%以上（见tests/test_metrics.cc的bench），所以默认关闭，通过配置项scheduler.histograms打开。
+    // 计数类的统计项（任务数、切换次数、idle时间等）一直开着
+    static void SetHistogramsEnabled(bool enabled);
+    static bool IsHistogramsEnabled() { return s_histograms.load(std::memory_order_relaxed); }
+
+    /**
+     * 以下为运行时统计相关的方法
+     */
+    // 当前任务队列的长度
+    size_t getQueueDepth();
+    uint64_t getTicklesSent() const { return m_ticklesSent; }
+    // 获取所有执行过run方法的线程的统计项
+    void getThreadMetrics(std::vector<SchedulerThreadMetrics::ptr> &metrics);
+    // 把所有统计项导出为文本，便于打日志或者通过接口暴露出去
+    std::string dumpMetrics();
 
 private:
     // 封装fiber和function作为可执行的对象
@@ -91,6 +152,10 @@ private:
         std::function<void()> cb;
         // 记录要在那个Thread上执行该任务
         int threadId;
+        // 放入任务队列的时间，用来统计任务的等待时间
+        uint64_t enqueueUs = 0;
+        // 任务的取消令牌，可以为空
+        CancelToken::ptr token;
 
         FiberAndThread(Fiber::ptr f, int thr) : fiber(f), threadId(thr) {}
         // 细节：这个构造方法让传入的智能指针变为空，减少了引用计数，控制权转给Scheduler
@@ -110,17 +175,35 @@ private:
             fiber = nullptr;
             cb = nullptr;
             threadId = -1;
+            enqueueUs = 0;
+            token = nullptr;
+        }
+
+        // 还没开始执行且已经被取消的任务，不再执行
+        bool isCancelled() const {
+            if (token && token->isCancelled()) {
+                return !fiber || fiber->getState() == Fiber::INIT;
+            }
+            if (fiber && fiber->getState() == Fiber::INIT) {
+                CancelToken::ptr t = fiber->getCancelToken();
+                return t && t->isCancelled();
+            }
+            return false;
         }
     };
 
 private:
     // 不加锁的调度方法。模板类是因为既能传function也能传fiber。
     template<typename FiberOrCb>
-    bool scheduleNoLock(FiberOrCb foc, int thread) {
+    bool scheduleNoLock(FiberOrCb foc, int thread, CancelToken::ptr token = nullptr) {
         // 如果m_fibers为空，则可能所有线程在阻塞态，需要通知唤醒，从协程队列取出任务
         bool need_tickle = m_fibers.empty();
         FiberAndThread task(foc, thread);
         if (task.cb || task.fiber) {
+            if (IsHistogramsEnabled()) {
+                task.enqueueUs = Clock::NowUs();
+            }
+            task.token = token;
             m_fibers.push_back(std::move(task));
         }
         return need_tickle;
@@ -135,6 +218,9 @@ private:
     // 如果use_caller为true，该主线程里的主协程已被使用。需要scheduler自己准备一个该线程里的主协程
     Fiber::ptr m_rootFiber; 
     std::string m_name;
+    // 每个执行run方法的线程的统计项。线程启动时加入，受m_mutex保护
+    std::vector<SchedulerThreadMetrics::ptr> m_threadMetrics;
+    static std::atomic<bool> s_histograms;
 
 protected:
     // 以下是为了便于扩展的属性变量
@@ -152,6 +238,8 @@ protected:
     bool m_autoStop = false;
     // 调用调度器构造函数的主线程ID
     int m_rootThreadId = 0;
+    // 实际发出的tickle次数。子类的tickle实现里也要记得累加
+    std::atomic<uint64_t> m_ticklesSent = {0};
 };
 
 }
@@ -0,0 +1,396 @@
+/**
+ * @file serialize.h
+ * @brief 基于ByteArray的结构体二进制序列化。结构体里用YUAN_SERIALIZE_FIELDS列出要序列化的成员，
+ * 编码、解码、计算编码后大小的代码都在编译期由模板生成，不用再手写一串writeFint32/writeStringVint和对应的读取
+ *
+ * 编码和ByteArray逐个写入的方式完全相同，可以和手写的读写代码互通：
+ * 8、16位整数为定长，32、64位整数为varint（有符号的用zigzag），浮点型为定长，string为varint长度加内容，
+ * vector、map为varint个数加各个元素，结构体为各成员依次编码，没有额外的字段标记
+ *
+ * 编码时先算出总大小，ByteArray一次扩容并取出可写的内存，之后每个成员直接写进去，不再逐个检查容量
+ *
+ * 用法：
+ *     struct Item {
+ *         uint32_t id;
+ *         std::string name;
+ *         std::vector<int64_t> timestamps;
+ *         YUAN_SERIALIZE_FIELDS(id, name, timestamps)
+ *     };
+ *     yuan::Serialize(ba, item);
+ *     ba.setPosition(0);
+ *     yuan::Deserialize(ba, item);
+ */
+
+#ifndef __YUAN_SERIALIZE_H__
+#define __YUAN_SERIALIZE_H__
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bytearray.h"
+#include "endian.h"
+#include "macro.h"
+
+/**
+ * @brief 在结构体内列出要序列化的成员，按列出的顺序编码。成员可以是整数、浮点型、string、
+ * vector、map、unordered_map，以及同样用了这个宏的结构体。参数名用了不常见的名字，免得和成员重名
+ */
+#define YUAN_SERIALIZE_FIELDS(...) \
+    template<typename YuanVisitor> \
+    void yuanVisitFields(YuanVisitor &yuan_visitor) { yuan_visitor(__VA_ARGS__); } \
+    template<typename YuanVisitor> \
+    void yuanVisitFields(YuanVisitor &yuan_visitor) const { yuan_visitor(__VA_ARGS__); }
+
+namespace yuan {
+
+/**
+ * @brief 往事先取好的一段可写内存（ByteArray::getWriteBuffers的结果）里写，不检查也不扩容，
+ * 总大小由Serializer::Size保证
+ */
+class SerializeWriter {
+public:
+    SerializeWriter(const std::vector<iovec> &buffers, bool little_endian)
+        : m_buffers(buffers)
+        , m_endian(little_endian ? YUAN_LITTLE_ENDIAN : YUAN_BIG_ENDIAN) {
+        if (!m_buffers.empty()) {
+            m_cur = static_cast<char*>(m_buffers[0].iov_base);
+            m_end = m_cur + m_buffers[0].iov_len;
+        }
+    }
+
+    void write(const void *buf, size_t size) {
+        // 大多数情况在当前这段内存里
+        if (YUAN_LIKELY(size <= static_cast<size_t>(m_end - m_cur))) {
+            memcpy(m_cur, buf, size);
+            m_cur += size;
+            return;
+        }
+        const char *src = static_cast<const char*>(buf);
+        while (size > 0) {
+            if (m_cur == m_end) {
+                ++m_index;
+                m_cur = static_cast<char*>(m_buffers[m_index].iov_base);
+                m_end = m_cur + m_buffers[m_index].iov_len;
+            }
+            size_t n = std::min(size, static_cast<size_t>(m_end - m_cur));
+            memcpy(m_cur, src, n);
+            m_cur += n;
+            src += n;
+            size -= n;
+        }
+    }
+
+    template<typename T>
+    void writeFixed(T value) {
+        if (m_endian != YUAN_BYTE_ORDER) {
+            value = byteswap(value);
+        }
+        write(&value, sizeof(value));
+    }
+
+    void writeVarint(uint64_t value) {
+        uint8_t tmp[10];
+        size_t i = 0;
+        while (value >= 0x80) {
+            tmp[i++] = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        tmp[i++] = value;
+        write(tmp, i);
+    }
+private:
+    const std::vector<iovec> &m_buffers;
+    int8_t m_endian;
+    size_t m_index = 0;
+    char *m_cur = nullptr;
+    char *m_end = nullptr;
+};
+
+// varint编码后的字节数
+inline size_t VarintSize(uint64_t value) {
+    return (64 - __builtin_clzll(value | 1) + 6) / 7;
+}
+
+// 和ByteArray里的zigzag编码相同
+inline uint64_t ZigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+/**
+ * @brief 每种类型的编解码，用偏特化支持各种类型，容器的元素、结构体的成员递归使用对应类型的Serializer
+ * Size：编码后的字节数；Write：写入SerializeWriter；Read：从ByteArray的position处读出
+ */
+template<typename T, typename Enable = void>
+class Serializer;
+
+// 8位整数和bool：1个字节
+template<typename T>
+class Serializer<T, typename std::enable_if<std::is_integral<T>::value && sizeof(T) == 1>::type> {
+public:
+    static size_t Size(const T &) { return 1; }
+    static void Write(SerializeWriter &w, const T &v) {
+        uint8_t tmp = static_cast<uint8_t>(v);
+        w.write(&tmp, 1);
+    }
+    static void Read(ByteArray &ba, T &v) { v = static_cast<T>(ba.readFuint8()); }
+};
+
+// 16位整数：定长
+template<typename T>
+class Serializer<T, typename std::enable_if<std::is_integral<T>::value && sizeof(T) == 2>::type> {
+public:
+    static size_t Size(const T &) { return 2; }
+    static void Write(SerializeWriter &w, const T &v) { w.writeFixed(static_cast<uint16_t>(v)); }
+    static void Read(ByteArray &ba, T &v) { v = static_cast<T>(ba.readFuint16()); }
+};
+
+// 32、64位整数：varint，有符号的先zigzag，和writeInt32/writeUint64等相同
+template<typename T>
+class Serializer<T, typename std::enable_if<std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8)>::type> {
+public:
+    static uint64_t Encode(const T &v) {
+        if (std::is_signed<T>::value) {
+            // 32位的zigzag结果也在32位之内
+            return sizeof(T) == 4 ? static_cast<uint32_t>(ZigzagEncode(v)) : ZigzagEncode(v);
+        }
+        return static_cast<uint64_t>(v);
+    }
+    static size_t Size(const T &v) { return VarintSize(Encode(v)); }
+    static void Write(SerializeWriter &w, const T &v) { w.writeVarint(Encode(v)); }
+    static void Read(ByteArray &ba, T &v) {
+        if (sizeof(T) == 4) {
+            v = std::is_signed<T>::value ? static_cast<T>(ba.readInt32()) : static_cast<T>(ba.readUint32());
+        } else {
+            v = std::is_signed<T>::value ? static_cast<T>(ba.readInt64()) : static_cast<T>(ba.readUint64());
+        }
+    }
+    // 整个数组一次读出，走ByteArray的批量解码
+    static void ReadArray(ByteArray &ba, T *values, size_t count) {
+        typedef typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type Signed;
+        typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type Unsigned;
+        if (std::is_signed<T>::value) {
+            ReadBatch(ba, reinterpret_cast<Signed*>(values), count);
+        } else {
+            ReadBatch(ba, reinterpret_cast<Unsigned*>(values), count);
+        }
+    }
+private:
+    static void ReadBatch(ByteArray &ba, int32_t *values, size_t count) { ba.readInt32Array(values, count); }
+    static void ReadBatch(ByteArray &ba, uint32_t *values, size_t count) { ba.readUint32Array(values, count); }
+    static void ReadBatch(ByteArray &ba, int64_t *values, size_t count) { ba.readInt64Array(values, count); }
+    static void ReadBatch(ByteArray &ba, uint64_t *values, size_t count) { ba.readUint64Array(values, count); }
+};
+
+// 浮点型：按同样大小的整数定长写，和writeFloat/writeDouble相同
+template<typename T>
+class Serializer<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+public:
+    typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type Bits;
+    static size_t Size(const T &) { return sizeof(T); }
+    static void Write(SerializeWriter &w, const T &v) {
+        Bits tmp;
+        memcpy(&tmp, &v, sizeof(tmp));
+        w.writeFixed(tmp);
+    }
+    static void Read(ByteArray &ba, T &v) { v = sizeof(T) == 4 ? ba.readFloat() : ba.readDouble(); }
+};
+
+// string：varint长度加内容，和writeStringVint相同
+template<>
+class Serializer<std::string> {
+public:
+    static size_t Size(const std::string &v) { return VarintSize(v.size()) + v.size(); }
+    static void Write(SerializeWriter &w, const std::string &v) {
+        w.writeVarint(v.size());
+        w.write(v.data(), v.size());
+    }
+    static void Read(ByteArray &ba, std::string &v) { v = ba.readStringVint(); }
+};
+
+// 读出元素个数，每个元素至少1个字节，超过剩余数据的说明数据有问题，不要按它分配内存
+inline size_t ReadCount(ByteArray &ba) {
+    uint64_t count = ba.readUint64();
+    if (count > ba.getReadSize()) {
+        throw std::out_of_range("Deserialize count exceeds remaining data");
+    }
+    return count;
+}
+
+// 32、64位整数的vector可以批量解码
+template<typename T>
+struct IsVarintArray {
+    static const bool value = std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8);
+};
+
+// vector：varint个数加各个元素
+template<typename T>
+class Serializer<std::vector<T> > {
+public:
+    static size_t Size(const std::vector<T> &v) {
+        size_t size = VarintSize(v.size());
+        for (auto &i : v) {
+            size += Serializer<T>::Size(i);
+        }
+        return size;
+    }
+    static void Write(SerializeWriter &w, const std::vector<T> &v) {
+        w.writeVarint(v.size());
+        for (auto &i : v) {
+            Serializer<T>::Write(w, i);
+        }
+    }
+    static void Read(ByteArray &ba, std::vector<T> &v) {
+        v.resize(ReadCount(ba));
+        ReadElements(ba, v, std::integral_constant<bool, IsVarintArray<T>::value>());
+    }
+private:
+    static void ReadElements(ByteArray &ba, std::vector<T> &v, std::true_type) {
+        if (!v.empty()) {
+            Serializer<T>::ReadArray(ba, &v[0], v.size());
+        }
+    }
+    static void ReadElements(ByteArray &ba, std::vector<T> &v, std::false_type) {
+        for (auto &i : v) {
+            Serializer<T>::Read(ba, i);
+        }
+    }
+};
+
+// map、unordered_map：varint个数加各个键值对
+template<typename M>
+class MapSerializer {
+public:
+    typedef typename M::key_type K;
+    typedef typename M::mapped_type V;
+    static size_t Size(const M &v) {
+        size_t size = VarintSize(v.size());
+        for (auto &i : v) {
+            size += Serializer<K>::Size(i.first) + Serializer<V>::Size(i.second);
+        }
+        return size;
+    }
+    static void Write(SerializeWriter &w, const M &v) {
+        w.writeVarint(v.size());
+        for (auto &i : v) {
+            Serializer<K>::Write(w, i.first);
+            Serializer<V>::Write(w, i.second);
+        }
+    }
+    static void Read(ByteArray &ba, M &v) {
+        v.clear();
+        size_t count = ReadCount(ba);
+        for (size_t i = 0; i < count; ++i) {
+            K key;
+            Serializer<K>::Read(ba, key);
+            Serializer<V>::Read(ba, v[key]);
+        }
+    }
+};
+
+template<typename K, typename V>
+class Serializer<std::map<K, V> > : public MapSerializer<std::map<K, V> > {};
+
+template<typename K, typename V>
+class Serializer<std::unordered_map<K, V> > : public MapSerializer<std::unordered_map<K, V> > {};
+
+// 判断T是否用了YUAN_SERIALIZE_FIELDS
+template<typename T>
+class HasSerializeFields {
+    struct Probe {
+        template<typename... Args>
+        void operator()(Args&...) {}
+    };
+    template<typename U>
+    static std::true_type check(decltype(std::declval<U&>().yuanVisitFields(std::declval<Probe&>()))*);
+    template<typename U>
+    static std::false_type check(...);
+public:
+    static const bool value = decltype(check<T>(nullptr))::value;
+};
+
+// 结构体：各成员依次编码
+template<typename T>
+class Serializer<T, typename std::enable_if<HasSerializeFields<T>::value>::type> {
+public:
+    static size_t Size(const T &v) {
+        SizeVisitor visitor;
+        v.yuanVisitFields(visitor);
+        return visitor.size;
+    }
+    static void Write(SerializeWriter &w, const T &v) {
+        WriteVisitor visitor{w};
+        v.yuanVisitFields(visitor);
+    }
+    static void Read(ByteArray &ba, T &v) {
+        ReadVisitor visitor{ba};
+        v.yuanVisitFields(visitor);
+    }
+private:
+    // 展开YUAN_SERIALIZE_FIELDS里的成员，每个成员调用一次对应类型的Serializer
+    struct SizeVisitor {
+        size_t size = 0;
+        void operator()() {}
+        template<typename F, typename... Rest>
+        void operator()(const F &field, const Rest&... rest) {
+            size += Serializer<F>::Size(field);
+            (*this)(rest...);
+        }
+    };
+    struct WriteVisitor {
+        SerializeWriter &w;
+        void operator()() {}
+        template<typename F, typename... Rest>
+        void operator()(const F &field, const Rest&... rest) {
+            Serializer<F>::Write(w, field);
+            (*this)(rest...);
+        }
+    };
+    struct ReadVisitor {
+        ByteArray &ba;
+        void operator()() {}
+        template<typename F, typename... Rest>
+        void operator()(F &field, Rest&... rest) {
+            Serializer<F>::Read(ba, field);
+            (*this)(rest...);
+        }
+    };
+};
+
+// 编码后的字节数
+template<typename T>
+size_t SerializedSize(const T &value) {
+    return Serializer<T>::Size(value);
+}
+
+/**
+ * @brief 和其他write方法一样写到ba的position处，并移动position。先算出总大小，一次扩容后直接写入
+ * @return 写入的字节数
+ */
+template<typename T>
+size_t Serialize(ByteArray &ba, const T &value) {
+    size_t size = Serializer<T>::Size(value);
+    std::vector<iovec> buffers;
+    ba.getWriteBuffers(buffers, size);
+    SerializeWriter w(buffers, ba.isLittleEndian());
+    Serializer<T>::Write(w, value);
+    ba.setPosition(ba.getPosition() + size);
+    return size;
+}
+
+/**
+ * @brief 从ba的position处读出，数据不够或者有问题时抛出std::out_of_range
+ */
+template<typename T>
+void Deserialize(ByteArray &ba, T &value) {
+    Serializer<T>::Read(ba, value);
+}
+
+}
+
+#endif
@@ -0,0 +1,346 @@
+#include "slab_allocator.h"
+#include <atomic>
+#include <new>
+#include <set>
+#include <string.h>
+#include <sys/mman.h>
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "thread.h"
+
+namespace yuan {
+
+static Logger::ptr g_logger = YUAN_GET_LOGGER("system");
+
+static ConfigVar<bool>::ptr g_huge_page =
+    Config::Lookup("bytearray.huge_page", false, "allocate bytearray buffers from 2MB huge pages");
+
+// 分级的个数：64B, 128B ... 64KB
+static const size_t s_class_count = 11;
+// 每个线程每一级最多缓存多少字节，超过时把一半还给全局链表
+static const size_t s_thread_cache_bytes = 256 * 1024;
+static const size_t s_slab_size = 256 * 1024;
+static const size_t s_huge_slab_size = 2 * 1024 * 1024;
+
+namespace {
+
+// 空闲块本身的前8个字节用作链表指针
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct FreeList {
+    FreeBlock *head = nullptr;
+    size_t count = 0;
+
+    void push(void *ptr) {
+        FreeBlock *block = static_cast<FreeBlock*>(ptr);
+        block->next = head;
+        head = block;
+        ++count;
+    }
+
+    void *pop() {
+        FreeBlock *block = head;
+        head = block->next;
+        --count;
+        return block;
+    }
+};
+
+// 全局的每一级：空闲链表，以及正在切分的slab
+struct CentralList {
+    Mutex mutex;
+    FreeList list;
+    char *slabCur = nullptr;
+    char *slabEnd = nullptr;
+    char pad[YUAN_CACHELINE_SIZE];
+};
+
+// 计数只由所属线程写，GetStats时其他线程读，所以不需要原子的读改写
+typedef std::atomic<uint64_t> Counter;
+
+inline void Add(Counter &counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct ThreadCache {
+    FreeList lists[s_class_count];
+    Counter allocs = {0};
+    Counter frees = {0};
+    Counter hits = {0};
+    Counter largeAllocs = {0};
+    Counter cachedBlocks = {0};
+};
+
+struct Central {
+    Central() {
+        for (size_t i = 0; i < s_class_count; ++i) {
+            lists[i].mutex.setName("SlabAllocator::CentralList::mutex");
+        }
+        threadsMutex.setName("SlabAllocator::threadsMutex");
+    }
+
+    CentralList lists[s_class_count];
+    std::atomic<uint64_t> slabs = {0};
+    std::atomic<uint64_t> slabBytes = {0};
+    std::atomic<uint64_t> hugePageSlabs = {0};
+
+    // 保护threads和exited
+    Mutex threadsMutex;
+    std::set<ThreadCache*> threads;
+    // 已退出线程的计数
+    SlabAllocator::Stats exited;
+};
+
+// 故意不析构：线程退出（包括主线程）时还要往里面归还
+Central &GetCentral() {
+    static Central *s_central = new Central;
+    return *s_central;
+}
+
+inline size_t ClassIndex(size_t size) {
+    if (size <= SlabAllocator::MIN_SIZE) {
+        return 0;
+    }
+    return (64 - __builtin_clzll(size - 1)) - 6;
+}
+
+inline size_t ClassSize(size_t index) {
+    return SlabAllocator::MIN_SIZE << index;
+}
+
+// 本线程每一级最多缓存的块数
+inline size_t CacheLimit(size_t index) {
+    size_t limit = s_thread_cache_bytes / ClassSize(index);
+    return limit < 8 ? 8 : limit;
+}
+
+char *NewSlab(size_t &bytes) {
+    Central &central = GetCentral();
+    bool huge = g_huge_page && g_huge_page->getValue();
+    bytes = huge ? s_huge_slab_size : s_slab_size;
+    void *ptr = MAP_FAILED;
+    if (huge) {
+        ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            ++central.hugePageSlabs;
+        } else {
+            // 系统没有预留大页(vm.nr_hugepages)，退化为透明大页
+            YUAN_LOG_ERROR_LIMIT(g_logger, 1, 60000) << "SlabAllocator mmap MAP_HUGETLB fail errno=" << errno
+                << " strerr=" << strerror(errno) << ", fall back to transparent huge pages";
+        }
+    }
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            YUAN_LOG_ERROR(g_logger) << "SlabAllocator mmap " << bytes << " bytes fail errno=" << errno
+                << " strerr=" << strerror(errno);
+            throw std::bad_alloc();
+        }
+        if (huge) {
+            madvise(ptr, bytes, MADV_HUGEPAGE);
+        }
+    }
+    ++central.slabs;
+    central.slabBytes += bytes;
+    return static_cast<char*>(ptr);
+}
+
+// 从全局取最多n块放进list，返回取到的块数，至少一块
+size_t CentralFetch(size_t index, FreeList &list, size_t n) {
+    CentralList &cl = GetCentral().lists[index];
+    size_t block_size = ClassSize(index);
+    Mutex::Lock lock(cl.mutex);
+    size_t got = 0;
+    while (got < n && cl.list.head) {
+        list.push(cl.list.pop());
+        ++got;
+    }
+    while (got < n) {
+        if (cl.slabCur == cl.slabEnd) {
+            if (got) {
+                break;
+            }
+            size_t bytes = 0;
+            cl.slabCur = NewSlab(bytes);
+            cl.slabEnd = cl.slabCur + bytes;
+        }
+        list.push(cl.slabCur);
+        cl.slabCur += block_size;
+        ++got;
+    }
+    return got;
+}
+
+// 把list里的n块还给全局
+void CentralRelease(size_t index, FreeList &list, size_t n) {
+    CentralList &cl = GetCentral().lists[index];
+    Mutex::Lock lock(cl.mutex);
+    while (n-- && list.head) {
+        cl.list.push(list.pop());
+    }
+}
+
+void FlushCache(ThreadCache *cache) {
+    uint64_t blocks = 0;
+    for (size_t i = 0; i < s_class_count; ++i) {
+        blocks += cache->lists[i].count;
+        CentralRelease(i, cache->lists[i], cache->lists[i].count);
+    }
+    Add(cache->cachedBlocks, -blocks);
+}
+
+// 线程退出时把缓存还给全局，计数也并到全局
+struct ThreadCacheHolder {
+    ThreadCache *cache = nullptr;
+    ~ThreadCacheHolder();
+};
+
+static thread_local ThreadCache *t_cache = nullptr;
+static thread_local bool t_exited = false;
+static thread_local ThreadCacheHolder t_holder;
+
+ThreadCacheHolder::~ThreadCacheHolder() {
+    if (!cache) {
+        return;
+    }
+    FlushCache(cache);
+    Central &central = GetCentral();
+    {
+        Mutex::Lock lock(central.threadsMutex);
+        central.threads.erase(cache);
+        central.exited.allocs += cache->allocs;
+        central.exited.frees += cache->frees;
+        central.exited.hits += cache->hits;
+        central.exited.largeAllocs += cache->largeAllocs;
+    }
+    // 之后本线程的其他thread_local析构时还可能分配释放，直接走全局链表
+    t_cache = nullptr;
+    t_exited = true;
+    delete cache;
+}
+
+ThreadCache *GetThreadCache() {
+    if (YUAN_LIKELY(t_cache)) {
+        return t_cache;
+    }
+    if (t_exited) {
+        return nullptr;
+    }
+    ThreadCache *cache = new ThreadCache;
+    Central &central = GetCentral();
+    {
+        Mutex::Lock lock(central.threadsMutex);
+        central.threads.insert(cache);
+    }
+    t_holder.cache = cache;
+    t_cache = cache;
+    return cache;
+}
+
+}
+
+void *SlabAllocator::Alloc(size_t size) {
+    ThreadCache *cache = GetThreadCache();
+    if (YUAN_UNLIKELY(size > MAX_SIZE)) {
+        if (cache) {
+            Add(cache->allocs);
+            Add(cache->largeAllocs);
+        }
+        return new char[size];
+    }
+    size_t index = ClassIndex(size);
+    if (YUAN_UNLIKELY(!cache)) {
+        FreeList list;
+        CentralFetch(index, list, 1);
+        return list.pop();
+    }
+    Add(cache->allocs);
+    FreeList &list = cache->lists[index];
+    if (YUAN_LIKELY(list.head)) {
+        Add(cache->hits);
+        Add(cache->cachedBlocks, -1);
+        return list.pop();
+    }
+    // 一次取回半个上限，避免在全局锁上来回
+    size_t got = CentralFetch(index, list, CacheLimit(index) / 2);
+    Add(cache->cachedBlocks, got - 1);
+    return list.pop();
+}
+
+void SlabAllocator::Free(void *ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    ThreadCache *cache = GetThreadCache();
+    if (cache) {
+        Add(cache->frees);
+    }
+    if (YUAN_UNLIKELY(size > MAX_SIZE)) {
+        delete [] static_cast<char*>(ptr);
+        return;
+    }
+    size_t index = ClassIndex(size);
+    if (YUAN_UNLIKELY(!cache)) {
+        FreeList list;
+        list.push(ptr);
+        CentralRelease(index, list, 1);
+        return;
+    }
+    FreeList &list = cache->lists[index];
+    list.push(ptr);
+    Add(cache->cachedBlocks);
+    size_t limit = CacheLimit(index);
+    if (YUAN_UNLIKELY(list.count > limit)) {
+        CentralRelease(index, list, limit / 2);
+        Add(cache->cachedBlocks, -(limit / 2));
+    }
+}
+
+SlabAllocator::Stats SlabAllocator::GetStats() {
+    Central &central = GetCentral();
+    Stats stats;
+    {
+        Mutex::Lock lock(central.threadsMutex);
+        stats = central.exited;
+        for (auto &i : central.threads) {
+            stats.allocs += i->allocs.load(std::memory_order_relaxed);
+            stats.frees += i->frees.load(std::memory_order_relaxed);
+            stats.hits += i->hits.load(std::memory_order_relaxed);
+            stats.largeAllocs += i->largeAllocs.load(std::memory_order_relaxed);
+            stats.threadCachedBlocks += i->cachedBlocks.load(std::memory_order_relaxed);
+        }
+    }
+    stats.slabs = central.slabs;
+    stats.slabBytes = central.slabBytes;
+    stats.hugePageSlabs = central.hugePageSlabs;
+    stats.centralCachedBlocks = 0;
+    for (size_t i = 0; i < s_class_count; ++i) {
+        Mutex::Lock lock(central.lists[i].mutex);
+        stats.centralCachedBlocks += central.lists[i].list.count;
+    }
+    return stats;
+}
+
+void SlabAllocator::FlushThreadCache() {
+    if (t_cache) {
+        FlushCache(t_cache);
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, const SlabAllocator::Stats &stats) {
+    os << "allocs=" << stats.allocs
+       << " frees=" << stats.frees
+       << " hits=" << stats.hits
+       << " large_allocs=" << stats.largeAllocs
+       << " slabs=" << stats.slabs
+       << " slab_bytes=" << stats.slabBytes
+       << " huge_page_slabs=" << stats.hugePageSlabs
+       << " thread_cached_blocks=" << stats.threadCachedBlocks
+       << " central_cached_blocks=" << stats.centralCachedBlocks;
+    return os;
+}
+
+}
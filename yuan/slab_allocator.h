@@ -0,0 +1,58 @@
+#ifndef __YUAN_SLAB_ALLOCATOR_H__
+#define __YUAN_SLAB_ALLOCATOR_H__
+
+/**
+ * @file slab_allocator.h
+ * 给ByteArray::Node等缓冲区用的内存池。网络收发的典型写法是每次循环clear后再getWriteBuffers，
+ * 每次都要new/delete好几块4KB的内存，这里把释放的块缓存起来重复使用
+ *
+ * 大小按2的幂分级（64B到64KB），更大的直接用new。每个线程有自己的空闲链表，分配和释放都不加锁，
+ * 空闲块太多时成批还给全局的链表，本线程空了再成批取回，所以在A线程分配、B线程释放也没问题。
+ * 新的块从slab（一大块mmap出来的内存）里切，slab不会还给系统。
+ * 配置bytearray.huge_page为true时slab用2MB的大页（没有预留大页时退化为透明大页），减少TLB miss
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+
+namespace yuan {
+
+class SlabAllocator {
+public:
+    // 统计信息，各线程的计数相加，不是严格的快照
+    struct Stats {
+        // Alloc/Free调用的次数
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+        // 直接从本线程空闲链表拿到的次数
+        uint64_t hits = 0;
+        // 超过最大分级、直接new的次数
+        uint64_t largeAllocs = 0;
+        // 分配过的slab个数、总字节数，其中用了大页的个数
+        uint64_t slabs = 0;
+        uint64_t slabBytes = 0;
+        uint64_t hugePageSlabs = 0;
+        // 空闲的块：在各线程链表里的、在全局链表里的
+        uint64_t threadCachedBlocks = 0;
+        uint64_t centralCachedBlocks = 0;
+    };
+
+    // 最小、最大的分级
+    static const size_t MIN_SIZE = 64;
+    static const size_t MAX_SIZE = 64 * 1024;
+
+    static void *Alloc(size_t size);
+    // size必须和Alloc时的相同
+    static void Free(void *ptr, size_t size);
+
+    static Stats GetStats();
+    // 把当前线程缓存的空闲块都还给全局链表，一般不需要调用，线程退出时会自动归还
+    static void FlushThreadCache();
+};
+
+std::ostream &operator<<(std::ostream &os, const SlabAllocator::Stats &stats);
+
+}
+
+#endif
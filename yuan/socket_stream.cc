@@ -26,12 +26,12 @@ int SocketStream::read(ByteArray::ptr ba, int length)  {
         return -1;
     }
     std::vector<iovec> iovs;
-    ba->getWriteBuffers(iovs, length);
+    // 直接收到ba末尾的空闲空间，position不动，收完就可以从position开始读
+    ba->prepare(iovs, length);
 
     int ret = m_socket->recv(&(iovs[0]), iovs.size());
     if (ret > 0) {
-        // 必须手动刷新一下ba的position和size
-        ba->setPosition(ba->getPosition() + ret);
+        ba->commit(ret);
     }
     return ret;
 }
@@ -23,7 +23,7 @@ public:
     virtual ~Stream() {}
 
     virtual int read(void *buffer, int length) = 0;
-    // 向pa的position处写入length个字节
+    // 向ba的末尾（size处）追加最多length个字节，ba的position不变，读出的数据从position开始取
     virtual int read(ByteArray::ptr ba, int length) = 0;
     // 重点：读到参数指定的length个字节才返回。比如：已经从http头部知晓了Content-Length，所以指定读这么多字节
     // 提供默认实现，用上面的read来实现，则子类不必需实现此函数
@@ -96,7 +96,8 @@ void TcpServer::startAccept(Socket::ptr sock) {
             // 重点：注意这里shared_from_this的使用，确保tcp_server的生命周期，不会提前被释放掉
             m_worker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client));
         } else {
-            YUAN_LOG_ERROR(g_system_logger) << "accept errno=" << errno << "strerr"
+            // fd耗尽等情况下accept会持续失败，限流防止日志刷屏
+            YUAN_LOG_ERROR_LIMIT(g_system_logger, 10, 1000) << "accept errno=" << errno << "strerr"
                 << strerror(errno);
         }
     }
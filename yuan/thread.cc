@@ -1,6 +1,15 @@
 #include "thread.h"
+#include "clock.h"
 #include "log.h"
+#include "macro.h"
 #include "util.h"
+#include <algorithm>
+#include <errno.h>
+#include <map>
+#include <sched.h>
+#include <sstream>
+#include <stdlib.h>
+#include <time.h>
 
 namespace yuan {
 
@@ -12,6 +21,234 @@ static thread_local std::string t_thread_name = "UNKNOWN";
 // 系统的库打日志的时候统一用叫system的logger。与业务区分
 static Logger::ptr g_system_logger = YUAN_GET_LOGGER("system");
 
+/**
+ * @brief 以下是锁统计相关的定义
+ */
+std::atomic<bool> LockProfiler::s_enabled = {false};
+static std::atomic<uint32_t> s_lock_sample_rate = {1};
+static thread_local uint32_t t_lock_sample_count = 0;
+
+// 统计项的注册表。用函数内的静态变量，保证全局对象的构造函数里给锁起名字时已经初始化
+static Mutex &GetLockSitesMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+static std::map<std::string, LockSite*> &GetLockSites() {
+    static std::map<std::string, LockSite*> s_sites;
+    return s_sites;
+}
+
+static void UpdateMax(std::atomic<uint64_t> &max, uint64_t value) {
+    uint64_t old_max = max.load(std::memory_order_relaxed);
+    while (value > old_max
+            && !max.compare_exchange_weak(old_max, value, std::memory_order_relaxed));
+}
+
+void LockProfiler::SetEnabled(bool enabled) {
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void LockProfiler::SetSampleRate(uint32_t rate) {
+    s_lock_sample_rate.store(rate ? rate : 1, std::memory_order_relaxed);
+}
+
+uint32_t LockProfiler::GetSampleRate() {
+    return s_lock_sample_rate.load(std::memory_order_relaxed);
+}
+
+LockSite *LockProfiler::GetSite(const std::string &name) {
+    Mutex::Lock lock(GetLockSitesMutex());
+    LockSite *&site = GetLockSites()[name];
+    if (!site) {
+        site = new LockSite;
+        site->name = name;
+    }
+    return site;
+}
+
+bool LockProfiler::Sample() {
+    return IsEnabled()
+        && ++t_lock_sample_count % s_lock_sample_rate.load(std::memory_order_relaxed) == 0;
+}
+
+uint64_t LockProfiler::NowNs() {
+    // 等锁、持锁的时间都很短，用最快的TSC。不能用Clock::NowNs，缓存模式下测不出耗时
+    return Clock::TscNs();
+}
+
+void LockProfiler::RecordWait(LockSite *site, uint64_t ns, bool contended) {
+    site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended) {
+        site->contentions.fetch_add(1, std::memory_order_relaxed);
+    }
+    site->waitNs.fetch_add(ns, std::memory_order_relaxed);
+    UpdateMax(site->maxWaitNs, ns);
+}
+
+void LockProfiler::RecordHold(LockSite *site, uint64_t ns) {
+    site->holds.fetch_add(1, std::memory_order_relaxed);
+    site->holdNs.fetch_add(ns, std::memory_order_relaxed);
+    UpdateMax(site->maxHoldNs, ns);
+}
+
+std::string LockProfiler::Dump() {
+    std::vector<LockSite*> sites;
+    {
+        Mutex::Lock lock(GetLockSitesMutex());
+        for (auto &i : GetLockSites()) {
+            sites.push_back(i.second);
+        }
+    }
+    std::sort(sites.begin(), sites.end(), [](const LockSite *a, const LockSite *b) {
+        return a->waitNs.load(std::memory_order_relaxed) > b->waitNs.load(std::memory_order_relaxed);
+    });
+
+    std::stringstream ss;
+    ss << "lock profile: enabled=" << IsEnabled() << " sample_rate=" << GetSampleRate() << std::endl;
+    for (auto &i : sites) {
+        uint64_t acquisitions = i->acquisitions.load(std::memory_order_relaxed);
+        if (acquisitions == 0) {
+            continue;
+        }
+        uint64_t contentions = i->contentions.load(std::memory_order_relaxed);
+        uint64_t wait_ns = i->waitNs.load(std::memory_order_relaxed);
+        uint64_t holds = i->holds.load(std::memory_order_relaxed);
+        uint64_t hold_ns = i->holdNs.load(std::memory_order_relaxed);
+        ss << "  " << i->name
+            << " acquisitions=" << acquisitions
+            << " contentions=" << contentions
+            << " contention_rate=" << (acquisitions ? contentions * 100.0 / acquisitions : 0) << "%"
+            << " wait_total_us=" << wait_ns / 1000
+            << " wait_avg_ns=" << (acquisitions ? wait_ns / acquisitions : 0)
+            << " wait_max_us=" << i->maxWaitNs.load(std::memory_order_relaxed) / 1000
+            << " hold_total_us=" << hold_ns / 1000
+            << " hold_avg_ns=" << (holds ? hold_ns / holds : 0)
+            << " hold_max_us=" << i->maxHoldNs.load(std::memory_order_relaxed) / 1000
+            << std::endl;
+    }
+    return ss.str();
+}
+
+void LockProfiler::Reset() {
+    Mutex::Lock lock(GetLockSitesMutex());
+    for (auto &i : GetLockSites()) {
+        LockSite *site = i.second;
+        site->acquisitions.store(0, std::memory_order_relaxed);
+        site->contentions.store(0, std::memory_order_relaxed);
+        site->waitNs.store(0, std::memory_order_relaxed);
+        site->maxWaitNs.store(0, std::memory_order_relaxed);
+        site->holds.store(0, std::memory_order_relaxed);
+        site->holdNs.store(0, std::memory_order_relaxed);
+        site->maxHoldNs.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief 以下是BRWMutex相关的定义
+ */
+// 线程对应的读计数槽位，第一次用到时按轮转分配，让线程尽量均匀分布在各个槽位上
+static std::atomic<uint32_t> s_brw_slot_seq = {0};
+static thread_local int t_brw_slot = -1;
+
+static inline size_t GetBRWSlot() {
+    if (YUAN_UNLIKELY(t_brw_slot < 0)) {
+        t_brw_slot = s_brw_slot_seq++ % BRWMutex::SLOTS;
+    }
+    return t_brw_slot;
+}
+
+BRWMutex::BRWMutex() {
+    void *mem = nullptr;
+    if (posix_memalign(&mem, YUAN_CACHELINE_SIZE, sizeof(Slot) * SLOTS)) {
+        throw std::bad_alloc();
+    }
+    m_slots = static_cast<Slot*>(mem);
+    for (size_t i = 0; i < SLOTS; ++i) {
+        new (&m_slots[i].readers) std::atomic<int64_t>(0);
+    }
+    pthread_mutex_init(&m_writerMutex, nullptr);
+    m_writer.store(false, std::memory_order_relaxed);
+    m_owner.store(0, std::memory_order_relaxed);
+}
+
+BRWMutex::~BRWMutex() {
+    pthread_mutex_destroy(&m_writerMutex);
+    free(m_slots);
+}
+
+bool BRWMutex::tryrdlock() {
+    std::atomic<int64_t> &readers = m_slots[GetBRWSlot()].readers;
+    readers.fetch_add(1, std::memory_order_seq_cst);
+    if (!m_writer.load(std::memory_order_seq_cst)) {
+        return true;
+    }
+    readers.fetch_sub(1, std::memory_order_release);
+    return false;
+}
+
+bool BRWMutex::trywrlock() {
+    if (pthread_mutex_trylock(&m_writerMutex)) {
+        return false;
+    }
+    m_writer.store(true, std::memory_order_seq_cst);
+    int64_t sum = 0;
+    for (size_t i = 0; i < SLOTS; ++i) {
+        sum += m_slots[i].readers.load(std::memory_order_seq_cst);
+    }
+    if (sum != 0) {
+        m_writer.store(false, std::memory_order_release);
+        pthread_mutex_unlock(&m_writerMutex);
+        return false;
+    }
+    m_owner.store(pthread_self(), std::memory_order_relaxed);
+    return true;
+}
+
+void BRWMutex::doRdlock() {
+    std::atomic<int64_t> &readers = m_slots[GetBRWSlot()].readers;
+    while (true) {
+        // 先登记再检查写标志，和wrlock里先设标志再检查计数配合，二者至少有一方能看到对方
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        if (YUAN_LIKELY(!m_writer.load(std::memory_order_seq_cst))) {
+            return;
+        }
+        // 有写者，撤销登记，等写者完成后重试
+        readers.fetch_sub(1, std::memory_order_release);
+        while (m_writer.load(std::memory_order_relaxed)) {
+            sched_yield();
+        }
+    }
+}
+
+void BRWMutex::doWrlock() {
+    pthread_mutex_lock(&m_writerMutex);
+    m_owner.store(pthread_self(), std::memory_order_relaxed);
+    m_writer.store(true, std::memory_order_seq_cst);
+    // 等所有读者离开。读锁可能在一个槽位加、在另一个槽位减，所以看总和
+    while (true) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < SLOTS; ++i) {
+            sum += m_slots[i].readers.load(std::memory_order_seq_cst);
+        }
+        if (sum == 0) {
+            break;
+        }
+        sched_yield();
+    }
+}
+
+void BRWMutex::unlock() {
+    if (m_owner.load(std::memory_order_relaxed) == pthread_self()) {
+        m_stats.release();
+        m_owner.store(0, std::memory_order_relaxed);
+        m_writer.store(false, std::memory_order_release);
+        pthread_mutex_unlock(&m_writerMutex);
+    } else {
+        m_slots[GetBRWSlot()].readers.fetch_sub(1, std::memory_order_release);
+    }
+}
+
 /**
  * @brief 以下是信号量相关的定义
  */
@@ -31,6 +268,25 @@ void Semaphore::wait() {
     }
 }
 
+bool Semaphore::timedwait(uint64_t timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&m_semaphore, &ts)) {
+        if (errno == ETIMEDOUT) {
+            return false;
+        } else if (errno != EINTR) {
+            throw std::logic_error("sem_timedwait error");
+        }
+    }
+    return true;
+}
+
 void Semaphore::post() {
     if (sem_post(&m_semaphore)) {
         throw std::logic_error("sem_post error");
@@ -45,7 +301,7 @@ Thread *Thread::GetThis() {
     return t_thread;
 }
 
-const std::string Thread::GetName() {
+const std::string &Thread::GetName() {
     return t_thread_name;
 }
 
@@ -11,6 +11,7 @@
 #ifndef __YUAN_THREAD_H__
 #define __YUAN_THREAD_H__
 
+#include <string>
 #include <thread>
 #include <functional>
 #include <memory> 
@@ -21,8 +22,92 @@
 
 #include "noncopyable.h"
 
+// 缓存行大小。多线程频繁写的变量放在不同缓存行，避免伪共享(false sharing)
+#define YUAN_CACHELINE_SIZE 64
+
 namespace yuan {
 
+/**
+ * @brief 锁的争抢统计。默认关闭，打开后对起过名字(setName)的锁按比例采样，记录等锁时间、持锁时间和发生争抢的次数
+ * 同名的锁共用一个统计项，比如所有FdContext的锁。没起名字的锁和关闭时的开销只有一次判断
+ * 用法：LockProfiler::SetEnabled(true)，运行一段时间后LockProfiler::Dump()，按总等待时间从大到小输出
+ */
+struct LockSite {
+    std::string name;
+    // 以下都是采样到的数据
+    std::atomic<uint64_t> acquisitions = {0};
+    // try_lock失败，需要等待的次数
+    std::atomic<uint64_t> contentions = {0};
+    // 单位纳秒
+    std::atomic<uint64_t> waitNs = {0};
+    std::atomic<uint64_t> maxWaitNs = {0};
+    // 只统计独占的加锁（普通锁、写锁）
+    std::atomic<uint64_t> holds = {0};
+    std::atomic<uint64_t> holdNs = {0};
+    std::atomic<uint64_t> maxHoldNs = {0};
+};
+
+class LockProfiler {
+public:
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    // 每个线程每rate次加锁采样一次，rate为1则全部统计
+    static void SetSampleRate(uint32_t rate);
+    static uint32_t GetSampleRate();
+    // 获取（不存在则创建）名为name的统计项，统计项不会释放
+    static LockSite *GetSite(const std::string &name);
+    // 按总等待时间从大到小导出所有统计项
+    static std::string Dump();
+    // 清零所有统计项
+    static void Reset();
+
+    // 以下供锁的实现使用
+    // 本次加锁是否要统计
+    static bool Sample();
+    static uint64_t NowNs();
+    static void RecordWait(LockSite *site, uint64_t ns, bool contended);
+    static void RecordHold(LockSite *site, uint64_t ns);
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// 嵌在各个锁里，负责采样和计时
+class LockStats {
+public:
+    void setName(const std::string &name) { m_site = LockProfiler::GetSite(name); }
+    // 是否要对本次加锁计时。没起名字的锁只有这一次判断
+    bool sampling() const {
+        return __builtin_expect(m_site != nullptr, 0) && LockProfiler::Sample();
+    }
+
+    // 先try_lock，失败说明有争抢，再阻塞加锁。exclusive为true时，记录加锁时刻用来统计持锁时间
+    template<typename TryLock, typename Lock>
+    void acquire(TryLock try_lock, Lock lock, bool exclusive) {
+        uint64_t start = LockProfiler::NowNs();
+        bool contended = !try_lock();
+        if (contended) {
+            lock();
+        }
+        uint64_t now = LockProfiler::NowNs();
+        LockProfiler::RecordWait(m_site, now - start, contended);
+        if (exclusive) {
+            // 持有锁之后才写，只有持有者会访问
+            m_holdStart = now;
+        }
+    }
+
+    // 在真正解锁之前调用
+    void release() {
+        if (__builtin_expect(m_holdStart != 0, 0)) {
+            LockProfiler::RecordHold(m_site, LockProfiler::NowNs() - m_holdStart);
+            m_holdStart = 0;
+        }
+    }
+private:
+    LockSite *m_site = nullptr;
+    uint64_t m_holdStart = 0;
+};
+
 // 在服务器中常用来管理消息队列，有生产消息和消费消息的
 class Semaphore : Noncopyable {
 public:
@@ -30,6 +115,8 @@ public:
     ~Semaphore();
 
     void wait();
+    // 最多等待timeout_ms毫秒，超时返回false
+    bool timedwait(uint64_t timeout_ms);
     void post();
 
 private:
@@ -147,14 +234,24 @@ public:
     }
 
     void lock() {
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() { return pthread_mutex_trylock(&m_mutex) == 0; }
+                , [this]() { pthread_mutex_lock(&m_mutex); }, true);
+            return;
+        }
         pthread_mutex_lock(&m_mutex);
     }
 
     void unlock() {
+        m_stats.release();
         pthread_mutex_unlock(&m_mutex);
     }
+
+    // 起了名字的锁才会被LockProfiler统计
+    void setName(const std::string &name) { m_stats.setName(name); }
 private:
     pthread_mutex_t m_mutex;
+    LockStats m_stats;
 };
 
 // 读写锁
@@ -171,18 +268,89 @@ public:
     }
 
     void rdlock() {
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() { return pthread_rwlock_tryrdlock(&m_lock) == 0; }
+                , [this]() { pthread_rwlock_rdlock(&m_lock); }, false);
+            return;
+        }
         pthread_rwlock_rdlock(&m_lock);
     }
 
     void wrlock() {
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() { return pthread_rwlock_trywrlock(&m_lock) == 0; }
+                , [this]() { pthread_rwlock_wrlock(&m_lock); }, true);
+            return;
+        }
         pthread_rwlock_wrlock(&m_lock);
     }
 
     void unlock() {
+        m_stats.release();
         pthread_rwlock_unlock(&m_lock);
     }
+
+    void setName(const std::string &name) { m_stats.setName(name); }
 private:
     pthread_rwlock_t m_lock;
+    LockStats m_stats;
+};
+
+/**
+ * @brief 偏向读者的读写锁(big-reader lock)，接口和RWMutex相同，可以直接替换
+ * RWMutex的每次rdlock都要对同一个计数做原子的读改写，核数多时这个缓存行会在各个核之间来回传递
+ * 这里每个线程固定映射到一个读计数槽位，槽位各占一个缓存行。读者只修改自己的槽位，互相之间不再争抢
+ * 代价是写者要设置标志位后等所有槽位清零，写锁更贵。适合读远多于写的表，如fd表、路由表
+ * 注意：读锁不能跨协程切换持有（协程可能换线程恢复），这一点和pthread的读写锁一样
+ */
+class BRWMutex : Noncopyable {
+public:
+    typedef ReadScopedMutexImpl<BRWMutex> ReadLock;
+    typedef WriteScopedMutexImpl<BRWMutex> WriteLock;
+    // 读计数槽位的个数。线程数超过它时，多个线程共享一个槽位，依然正确，只是会有一些争抢
+    static const size_t SLOTS = 32;
+
+    BRWMutex();
+    ~BRWMutex();
+
+    void rdlock() {
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() { return tryrdlock(); }, [this]() { doRdlock(); }, false);
+            return;
+        }
+        doRdlock();
+    }
+
+    void wrlock() {
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() { return trywrlock(); }, [this]() { doWrlock(); }, true);
+            return;
+        }
+        doWrlock();
+    }
+
+    bool tryrdlock();
+    bool trywrlock();
+    // 根据当前线程是否是写锁的持有者，决定释放写锁还是读锁
+    void unlock();
+
+    void setName(const std::string &name) { m_stats.setName(name); }
+private:
+    void doRdlock();
+    void doWrlock();
+private:
+    struct Slot {
+        std::atomic<int64_t> readers;
+        char pad[YUAN_CACHELINE_SIZE - sizeof(std::atomic<int64_t>)];
+    };
+
+    // 按缓存行对齐分配
+    Slot *m_slots;
+    // 写者之间互斥
+    pthread_mutex_t m_writerMutex;
+    std::atomic<bool> m_writer;
+    std::atomic<pthread_t> m_owner;
+    LockStats m_stats;
 };
 
 // 在冲突较多且冲突时间较短时，这种锁能提升一定性能.在日志系统中比Mutex表现确实好一点
@@ -198,14 +366,23 @@ public:
     }
 
     void lock() {
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() { return pthread_spin_trylock(&m_mutex) == 0; }
+                , [this]() { pthread_spin_lock(&m_mutex); }, true);
+            return;
+        }
         pthread_spin_lock(&m_mutex);
     }
 
     void unlock() {
+        m_stats.release();
         pthread_spin_unlock(&m_mutex);
     }
+
+    void setName(const std::string &name) { m_stats.setName(name); }
 private:
     pthread_spinlock_t m_mutex;
+    LockStats m_stats;
 };
 
 // CAS锁，更底层，上述锁都用它实现的，但SpinLock在旋转方面还有优化，因此性能更好。之后自己再深入学习一下
@@ -221,14 +398,28 @@ public:
     }
 
     void lock() {
-        while (std::atomic_flag_test_and_set_explicit(&m_mutex, std::memory_order_acquire));
+        if (m_stats.sampling()) {
+            m_stats.acquire([this]() {
+                    return !std::atomic_flag_test_and_set_explicit(&m_mutex, std::memory_order_acquire);
+                }, [this]() { doLock(); }, true);
+            return;
+        }
+        doLock();
     }
 
     void unlock() {
+        m_stats.release();
         std::atomic_flag_clear_explicit(&m_mutex, std::memory_order_release);
     }
+
+    void setName(const std::string &name) { m_stats.setName(name); }
+private:
+    void doLock() {
+        while (std::atomic_flag_test_and_set_explicit(&m_mutex, std::memory_order_acquire));
+    }
 private:
     volatile std::atomic_flag m_mutex;
+    LockStats m_stats;
 };
 
 // 测试用，作为Mutex的对照
@@ -240,6 +431,7 @@ public:
 
     void lock() {}
     void unlock() {}
+    void setName(const std::string &name) {}
 };
 
 class NullRWMutex : Noncopyable {
@@ -252,6 +444,7 @@ public:
     void rdlock() {}
     void wrlock() {}
     void unlock() {}
+    void setName(const std::string &name) {}
 };
 
 class Thread : Noncopyable {
@@ -268,7 +461,7 @@ public:
     // 供其他函数查询现在正在哪个线程上执行执行
     static Thread *GetThis();  
     // 获取当前线程的名称，日志的时候方便一些
-    static const std::string GetName();
+    static const std::string &GetName();
     // 有些线程不是我们创建的，如主线程，但也希望它有名字
     static void SetName(const std::string &name);
 private:
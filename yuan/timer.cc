@@ -1,4 +1,5 @@
 #include "timer.h"
+#include "clock.h"
 #include "util.h"
 
 namespace yuan {
@@ -9,7 +10,7 @@ namespace yuan {
 
 Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager *manager)
     :  m_ms(ms), m_recurring(recurring), m_manager(manager), m_cb(cb) {
-    m_next = GetCurrentTimeMS() + m_ms;
+    m_next = Clock::CachedMs() + m_ms;
 }
 
 Timer::Timer(uint64_t next) : m_next(next) {
@@ -37,7 +38,7 @@ bool Timer::refresh() {
         }
 
         m_manager->m_timers.erase(it);
-        m_next = yuan::GetCurrentTimeMS() + m_ms;
+        m_next = Clock::CachedMs() + m_ms;
         // 肯定比之前的下次执行时间晚，所以不需要考虑插入到set最前面的情况
         m_manager->m_timers.insert(shared_from_this());
         return true;
@@ -59,7 +60,7 @@ bool Timer::reset(uint64_t ms, bool from_now) {
         m_manager->m_timers.erase(it);
 
         if (from_now) {
-            m_next = yuan::GetCurrentTimeMS() + ms;
+            m_next = Clock::CachedMs() + ms;
         } else {
             m_next = m_next - m_ms + ms;
         }
@@ -94,7 +95,7 @@ bool Timer::Comparator::operator()(const Timer::ptr &lhs, const Timer::ptr &rhs)
  */
 
 TimerManager::TimerManager() {
-    m_previousTime = yuan::GetCurrentTimeMS();
+    m_mutex.setName("TimerManager::m_mutex");
 }
 
 TimerManager::~TimerManager() {
@@ -131,7 +132,7 @@ uint64_t TimerManager::getNextTimer() {
     }
 
     const Timer::ptr &next = *(m_timers.begin());
-    uint64_t now_ms = yuan::GetCurrentTimeMS();
+    uint64_t now_ms = Clock::CachedMs();
     if (now_ms > next->m_next) {
         // 不知道什么原因，timer已过时但没有执行，返回0
         return 0;
@@ -141,7 +142,7 @@ uint64_t TimerManager::getNextTimer() {
 }
 
 void TimerManager::listExpiredCbs(std::vector<std::function<void()>> &cbs) {
-    uint64_t now_ms = yuan::GetCurrentTimeMS();
+    uint64_t now_ms = Clock::CachedMs();
     std::vector<Timer::ptr> expired;
     
     // 重点：曾经的代码：这里加读锁，到erase的时候才加写锁。但并不对：相同的cb可能会被多线程都取出，然后被执行多次
@@ -150,15 +151,14 @@ void TimerManager::listExpiredCbs(std::vector<std::function<void()>> &cbs) {
         return;
     }
 
-    bool rollover = detectClockRollover(now_ms);
-    if (!rollover && now_ms < (*m_timers.begin())->m_next) {
+    // 用的是单调时钟，不会往回调，不需要再检测服务器时间被调的情况
+    if (now_ms < (*m_timers.begin())->m_next) {
         return;
     }
 
     // 借以下方式调用set的upper_bound
     Timer::ptr now_timer(new Timer(now_ms));
-    // 服务器时间如果被调了，则先简单粗暴的把所有Timer都移除
-    auto it = rollover ? m_timers.end() : m_timers.upper_bound(now_timer);
+    auto it = m_timers.upper_bound(now_timer);
     expired.insert(expired.begin(), m_timers.begin(), it);
     // readLock.unlock();
 
@@ -196,16 +196,6 @@ void TimerManager::addTimer(Timer::ptr timer, RWMutexType::WriteLock &write_lock
     }
 }
 
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
-    bool rollover = false;
-    // 这里只是个经验值，比之前的校准时间还小一个小时，肯定是有问题的
-    if (now_ms < m_previousTime - 60 * 60 * 1000) {
-        rollover = true;
-    }
-    m_previousTime = now_ms;
-    return rollover;
-}
-
 
 
 
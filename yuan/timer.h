@@ -5,6 +5,7 @@
  * @file timer.h
  * 定时器的基础类。具体如何计时由TimerManager的子类来实现。
  * TimerManager可以添加两种定时器：一定执行的和条件的
+ * 时间取的是Clock缓存的单调时间（毫秒），不受系统时间被修改的影响，IOManager每轮循环都会刷新
  */
 
 #include <memory>
@@ -80,17 +81,12 @@ protected:
     virtual void onTimerInsertedAtFront() = 0;
     // 一个共有的添加timer到集合中的方法。要处理插到最前面的情况
     void addTimer(Timer::ptr timer, RWMutexType::WriteLock &write_lock);
-private:
-    // 如果服务器的时间被调了，也要能检测到并做相应调整
-    bool detectClockRollover(uint64_t now_ms);
 private:
     RWMutexType m_mutex;
     // 重点：利用了set红黑树的有序性，给timer排序
     std::set<Timer::ptr, Timer::Comparator> m_timers;
     // 提高性能：多次连续添加新计时器到最前端，只调用onTimerInsertedAtFront一次。getNextTimer后再置为false
     bool m_tickled = false;
-    // 记录设定计时器时的时间，用来校准是否服务器时间有变化
-    uint64_t m_previousTime = 0;
 };
 
 }
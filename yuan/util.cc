@@ -9,7 +9,12 @@ namespace yuan {
 Logger::ptr g_system_logger = YUAN_GET_LOGGER("system");
 
 pid_t GetThreadId() {
-     return syscall(SYS_gettid);
+    // 线程id在线程的生命周期里不会变，缓存下来，每条日志都要取，不用每次都系统调用
+    static thread_local pid_t t_tid = 0;
+    if (t_tid == 0) {
+        t_tid = syscall(SYS_gettid);
+    }
+    return t_tid;
  }
 
 uint32_t GetFiberId() {
@@ -45,6 +50,20 @@ std::string BacktraceToString(int size, int skip, const std::string &prefix) {
     return ss.str();
 }
 
+void AssertFailed(const char *file, int line, const char *expr, const char *msg) {
+    const Logger::ptr &root = LoggerMgr::GetInstance()->getRootLogger();
+    if (LogLevel::ERROR < root->getLevel()) {
+        return;
+    }
+    LogEventWrap wrap(root, LogLevel::ERROR, file, line);
+    wrap.getSS() << "ASSERTION: " << expr;
+    if (msg) {
+        wrap.getSS() << "\n" << msg;
+    }
+    // 跳过Backtrace、BacktraceToString和自己
+    wrap.getSS() << "\nbacktrace\n" << BacktraceToString(100, 3, "    ");
+}
+
 uint64_t GetCurrentTimeMS() {
     timeval tv;
     gettimeofday(&tv, NULL);
@@ -22,6 +22,9 @@ void Backtrace(std::vector<std::string> &bt, int size = 64, int skip = 1);
 // skip默认为2，因为自己加上自己里面还要调用Backtrace
 std::string BacktraceToString(int size = 64, int skip = 2, const std::string &prefix = "");
 
+// YUAN_ASSERT失败时调用，输出断言失败的日志和调用栈，msg可以为空
+void AssertFailed(const char *file, int line, const char *expr, const char *msg) __attribute__((noinline, cold));
+
 // 当前时间，毫秒
 uint64_t GetCurrentTimeMS();
 // 微妙
@@ -3,6 +3,8 @@
 
 // 所有头文件在这里好处是所有测试程序每次包含这个头文件就可以，坏处是修改一个头文件，所有测试程序都要重新编译
 // 多个文件的最好按首字母排好，养成良好习惯
+#include "cancel_token.h"
+#include "clock.h"
 #include "config.h"
 #include "fiber.h"
 #include "log.h"